@@ -40,6 +40,9 @@
 #include "Fenrir/v1/net/Handshake.ipp"
 #include "Fenrir/v1/rate/Rate.ipp"
 #include "Fenrir/v1/resolve/DNSSEC.ipp"
+#include "Fenrir/v1/resolve/Disk_Cache.ipp"
+#include "Fenrir/v1/resolve/Resolver.ipp"
+#include "Fenrir/v1/resolve/Zone.ipp"
 
 #include "Fenrir/Fenrir_v1.hpp"
 
@@ -21,6 +21,8 @@
 #pragma once
 
 #include "Fenrir/v1/common.hpp"
+#include <utility>
+#include <vector>
 
 namespace Fenrir__v1 {
 namespace Report {
@@ -30,7 +32,8 @@ namespace Report {
 class FENRIR_API Base {
 public:
     enum class ID : uint32_t {
-        RESOLVE
+        RESOLVE,
+        HANDSHAKE
     };
     const ID _type;
     // FIXME: everything is async, we need to somehow identify the user request
@@ -62,5 +65,15 @@ public:
     Fenrir__v1::Error _err;
 };
 
+// a connection we started failed during the handshake
+// "_fqdn": the name we were connecting to
+class FENRIR_API Handshake final : public Base {
+public:
+    Handshake (Fenrir__v1::Error err, std::vector<uint8_t> fqdn)
+        : Base (Base::ID::HANDSHAKE), _err (err), _fqdn (std::move(fqdn)) {}
+    Fenrir__v1::Error _err;
+    std::vector<uint8_t> _fqdn;
+};
+
 } // namespace Report
 } // namespace Fenrir__v1
@@ -24,11 +24,14 @@
 #include "Fenrir/v1/data/packet/Packet.hpp"
 #include "Fenrir/v1/event/Events_all.hpp"
 #include "Fenrir/v1/event/Loop.hpp"
+#include "Fenrir/v1/net/Direction.hpp"
 #include "Fenrir/v1/net/Handshake.hpp"
 #include "Fenrir/v1/plugin/Loader.hpp"
+#include "Fenrir/v1/resolve/Cache.hpp"
 #include "Fenrir/v1/service/Service_ID.hpp"
 #include "Fenrir/v1/service/Service_Info.hpp"
 #include "Fenrir/v1/util/Shared_Lock.hpp"
+#include <atomic>
 #include <map>
 #include <memory>
 #include <vector>
@@ -64,17 +67,48 @@ public:
                                           const gsl::span<const uint8_t> priv,
                                           const gsl::span<const uint8_t> pub);
     bool del_pubkey (const Crypto::Key::Serial serial);
+    // the same secret on all the processes that share our handshakes
+    bool set_cookie_secret (const gsl::span<const uint8_t> secret,
+                                                    const int64_t rotation_sec);
+    // MAC by default: no signature before the client proves its address
+    void set_cookie_mode (const Handshake::Cookie_Mode mode);
+    Handshake::Stats handshake_stats();
+    // decrypt and encrypt the packets of one connection on all the worker
+    // threads at the same time. Off by default: all the encryption, hmac
+    // and ecc plugins in use must be safe for concurrent use.
+    void set_parallel_crypto (const bool parallel);
     bool listen (const Link_ID id);
+    // bytes per second, 0 == unlimited
+    Error set_socket_rate (const Link_ID id, const uint64_t bytes_sec);
+    Error set_connection_rate (const Conn_ID id, const uint64_t bytes_sec);
+    Error set_link_rate (const Conn_ID id, const Link_ID to,
+                                                    const uint64_t bytes_sec);
 
 
     std::shared_ptr<Socket> get_socket (const Link_ID id);
+    Link_ID socket_for (const Link_ID dest);
     void proxy_enqueue (const Link_ID from, const Link_ID to,
                     std::unique_ptr<Packet> pkt, const Conn0_Type handshake);
+    void proxy_report (std::unique_ptr<Report::Base> report);
     Link_Params proxy_def_link_params ();
+    bool proxy_parallel_crypto() const;
+    void proxy_wakeup (const Conn_ID id);
+    void proxy_add_link (const Conn_ID id, const Link_ID link,
+                                                        const Direction dir);
+    void proxy_del_link (const Conn_ID id, const Link_ID link,
+                                                        const Direction dir);
+    void proxy_timestamp_echo (const Conn_ID id, const Link_ID to,
+                                    const std::chrono::microseconds timestamp,
+                                    const std::chrono::microseconds delay,
+                                    const uint32_t received);
     Error add_connection (std::shared_ptr<Connection> conn);
     std::shared_ptr<Connection> get_connection (const Conn_ID id);
     Conn_ID get_next_free (const Conn_ID id);
-    void connect (const std::vector<uint8_t> &dest, const Service_ID &service);
+    // "early_data" is sent with the first packet if we can resume a
+    // previous connection to the same server and the server accepts that
+    // much with its ticket, dropped otherwise.
+    void connect (const std::vector<uint8_t> &dest, const Service_ID &service,
+                    std::vector<uint8_t> early_data = std::vector<uint8_t>());
     std::unique_ptr<Report::Base> get_report();
     std::shared_ptr<Lattice> search_lattice (const Service_ID service,
                                             const std::vector<uint8_t> &vhost);
@@ -121,6 +155,7 @@ private:
     std::shared_ptr<Db> _db;
     std::shared_ptr<Rate::Rate> _rate;
     std::vector<std::shared_ptr<Resolve::Resolver>> _resolvers;
+    Resolve::Cache _res_cache;
     std::map<Conn_ID, std::shared_ptr<Connection>> _connections;
     std::vector<std::pair<Vhost_Service, Service_Info>> _service_info;
     std::vector<std::pair<Vhost_Service, std::shared_ptr<Connection>>>_services;
@@ -128,6 +163,7 @@ private:
     std::deque<std::unique_ptr<Report::Base>> _user_reports;
     Handshake _handshakes;
     uint8_t _keepalive_fail_before_drop;
+    std::atomic<bool> _parallel_crypto;
 
     void do_work (std::shared_ptr<Event::Base> ev);
 
@@ -135,8 +171,12 @@ private:
     void send_pkt (std::shared_ptr<Event::Send> ev);
     void ev_keepalive (std::shared_ptr<Event::Keepalive> ev);
     void connect (std::shared_ptr<Event::Connect> ev);
+    void resolve (std::shared_ptr<Event::Resolve> ev);
+    void resolve_next (std::shared_ptr<Event::Resolve> ev);
     void connect_resolve (std::shared_ptr<Event::Resolve> ev);
+    void connect_as (std::shared_ptr<Event::Resolve> ev);
     void plg_ev (std::shared_ptr<Event::Plugin_Timer> ev);
+    void plg_io (std::shared_ptr<Event::Plugin_IO> ev);
 };
 
 } // namespace Impl
@@ -29,15 +29,23 @@
 #include "Fenrir/v1/rate/RR-RR.hpp"
 #include "Fenrir/v1/util/Shared_Lock.ipp"
 #include <type_safe/optional.hpp>
+#include <algorithm>
 
 namespace Fenrir__v1 {
 namespace Impl {
 
+namespace {
+// all resolvers are queried, but not all at once: most of the times
+// the first one is enough.
+constexpr std::chrono::milliseconds resolve_stagger {100};
+} // empty namespace
+
 FENRIR_INLINE Handler::Handler()
     : _load (&_loop, &_rnd),
       _db (_load.get_shared<Db> (Db::ID{1})),
       _handshakes (&_loop, &_rnd, &_load, this, _db.get()),
-      _keepalive_fail_before_drop (4)
+      _keepalive_fail_before_drop (4),
+      _parallel_crypto (false)
 {
     if (!_loop)
         return;
@@ -51,6 +59,11 @@ FENRIR_INLINE Handler::Handler()
             _resolvers.pop_back();
     }
 #pragma clang pop
+    // resolvers are raced in order: no need to wait for the network
+    // if we have the answer locally
+    std::stable_partition (_resolvers.begin(), _resolvers.end(),
+                                                    [] (const auto &res)
+                                                { return res->is_local(); });
     _rate = std::make_shared<Rate::RR_RR> (nullptr, &_loop, &_load, &_rnd,this);
     _handshakes.add_auth (Crypto::Auth::ID{1}); // token
 }
@@ -68,6 +81,21 @@ FENRIR_INLINE bool Handler::load_pubkey (const Crypto::Key::Serial serial,
 FENRIR_INLINE bool Handler::del_pubkey (const Crypto::Key::Serial serial)
     { return _handshakes.del_pubkey (serial); }
 
+FENRIR_INLINE bool Handler::set_cookie_secret (
+                                        const gsl::span<const uint8_t> secret,
+                                                    const int64_t rotation_sec)
+    { return _handshakes.set_cookie_secret (secret, rotation_sec); }
+
+FENRIR_INLINE void Handler::set_cookie_mode (
+                                        const Handshake::Cookie_Mode mode)
+    { _handshakes.set_cookie_mode (mode); }
+
+FENRIR_INLINE Handshake::Stats Handler::handshake_stats()
+    { return _handshakes.stats(); }
+
+FENRIR_INLINE void Handler::set_parallel_crypto (const bool parallel)
+    { _parallel_crypto.store (parallel, std::memory_order_relaxed); }
+
 
 FENRIR_INLINE bool Handler::listen (const Link_ID id)
 {
@@ -77,9 +105,16 @@ FENRIR_INLINE bool Handler::listen (const Link_ID id)
     std::shared_ptr<Event::Read> sk_ev = Event::Read::mk_shared (&_loop, sk);
     sk->sock_ev = sk_ev;
     Shared_Lock_Guard<Shared_Lock_Write> lock (Shared_Lock_NN{&_sock_lock});
-    _sockets.emplace_back (id, std::move(sk));
+    // keep them ordered, see get_socket
+    auto it = std::lower_bound (_sockets.begin(), _sockets.end(), id,
+                                [] (const auto &el, const Link_ID link)
+                                    { return std::get<Link_ID> (el) < link; });
+    if (it != _sockets.end() && std::get<Link_ID> (*it) == id)
+        return false;
+    _sockets.emplace (it, id, std::move(sk));
     lock.early_unlock();
 
+    _rate->add_socket (id);
     _loop.start(sk_ev);
 
     // TODO: add to existing connections. (but what if local net only?)
@@ -87,19 +122,81 @@ FENRIR_INLINE bool Handler::listen (const Link_ID id)
 }
 
 FENRIR_INLINE void Handler::connect (const std::vector<uint8_t> &dest,
-                                                    const Service_ID &service)
+                                                    const Service_ID &service,
+                                                std::vector<uint8_t> early_data)
 {
     std::vector<uint8_t> fqdn = dest;
     //fqdn.reserve (dest.size() + 1);
     //std::copy (dest.begin(), dest.end(), fqdn.begin());
     //fqdn.push_back ('\0');
     auto res_ev = Event::Resolve::mk_shared (&_loop, std::move(fqdn));
+    res_ev->_early_data = std::move(early_data);
+
+    const auto cached = _res_cache.get (res_ev->_fqdn, res_ev->_as);
+    if (cached == Resolve::Cache::State::HIT)
+        return connect_as (std::move(res_ev));
+
+    if (cached == Resolve::Cache::State::REFRESH) {
+        // about to expire: resolve again in the background,
+        // but do not wait for it.
+        auto refresh_ev = Event::Resolve::mk_shared (&_loop,
+                                        std::vector<uint8_t> (res_ev->_fqdn));
+        refresh_ev->_refresh = true;
+        resolve (std::move(refresh_ev));
+        return connect_as (std::move(res_ev));
+    }
+    resolve (std::move(res_ev));
+}
 
+// "ev" goes to the first resolver now, copies of it to the others later.
+FENRIR_INLINE void Handler::resolve (std::shared_ptr<Event::Resolve> ev)
+{
     Shared_Lock_Guard<Shared_Lock_Read> rlock (Shared_Lock_NN {&_res_lock});
     FENRIR_UNUSED (rlock);
     if (_resolvers.size() == 0)
         return;
-    _resolvers[0]->resolv_async (std::move (res_ev));
+    auto race = std::make_shared<Resolve::Race> (
+                                    static_cast<uint16_t> (_resolvers.size()));
+    for (size_t idx = 1; idx < _resolvers.size(); ++idx) {
+        auto next = Event::Resolve::mk_shared (&_loop,
+                                            std::vector<uint8_t> (ev->_fqdn));
+        next->_early_data = ev->_early_data;
+        next->_refresh = ev->_refresh;
+        next->_race = race;
+        next->_resolver_idx = static_cast<uint16_t> (idx);
+        next->status = Event::Connect_Status::RESOLV_NEXT;
+        _loop.start (next, resolve_stagger * idx, Event::Repeat::NO);
+    }
+    ev->_race = std::move(race);
+    ev->_resolver_idx = 0;
+    if (_resolvers[0]->resolv_async (ev) != Error::NONE) {
+        rlock.early_unlock();
+        // our failure, not an answer: never cached
+        ev->_as._err = Error::CAN_NOT_CONNECT;
+        connect_resolve (std::move(ev));
+    }
+}
+
+// the stagger timer of a resolver expired
+FENRIR_INLINE void Handler::resolve_next (std::shared_ptr<Event::Resolve> ev)
+{
+    _loop.deactivate (ev);
+    {
+        std::unique_lock<std::mutex> lock (ev->_race->_mtx);
+        FENRIR_UNUSED (lock);
+        if (ev->_race->_done)
+            return; // somebody already answered
+    }
+    ev->status = Event::Connect_Status::RESOLV;
+    Shared_Lock_Guard<Shared_Lock_Read> rlock (Shared_Lock_NN {&_res_lock});
+    FENRIR_UNUSED (rlock);
+    if (ev->_resolver_idx >= _resolvers.size() ||
+                    _resolvers[ev->_resolver_idx]->resolv_async (ev) !=
+                                                                Error::NONE) {
+        rlock.early_unlock();
+        ev->_as._err = Error::CAN_NOT_CONNECT;
+        connect_resolve (std::move(ev));
+    }
 }
 
 FENRIR_INLINE std::unique_ptr<Report::Base> Handler::get_report()
@@ -135,11 +232,71 @@ FENRIR_INLINE std::shared_ptr<Socket> Handler::get_socket (const Link_ID id)
     return std::get<std::shared_ptr<Socket>> (*it);
 }
 
+// one of our sockets that can send to "dest": same address family if we
+// have one. no socket: IP()
+FENRIR_INLINE Link_ID Handler::socket_for (const Link_ID dest)
+{
+    Shared_Lock_Guard<Shared_Lock_Read> rlock (Shared_Lock_NN{&_sock_lock});
+    FENRIR_UNUSED (rlock);
+    if (_sockets.size() == 0)
+        return Link_ID {{IP(), UDP_Port{0}}};
+    const bool ipv6 = dest.ip().ipv6;
+    const auto same_family = static_cast<uint32_t> (std::count_if (
+                                            _sockets.begin(), _sockets.end(),
+                                            [ipv6] (const auto &sk)
+                        { return std::get<Link_ID> (sk).ip().ipv6 == ipv6; }));
+    if (same_family == 0) {
+        return std::get<Link_ID> (_sockets[_rnd.uniform<uint32_t> (0,
+                                    static_cast<uint32_t> (_sockets.size()))]);
+    }
+    auto chosen = _rnd.uniform<uint32_t> (0, same_family);
+    for (const auto &sk : _sockets) {
+        if (std::get<Link_ID> (sk).ip().ipv6 != ipv6)
+            continue;
+        if (chosen == 0)
+            return std::get<Link_ID> (sk);
+        --chosen;
+    }
+    return Link_ID {{IP(), UDP_Port{0}}};
+}
+
 FENRIR_INLINE void Handler::proxy_enqueue (const Link_ID from, const Link_ID to,
                         std::unique_ptr<Packet> pkt, const Conn0_Type handshake)
     { return _rate->enqueue (from, to, std::move(pkt), handshake); }
+FENRIR_INLINE void Handler::proxy_report (std::unique_ptr<Report::Base> report)
+{
+    std::unique_lock<std::mutex> rep_lock (_rep_lock);
+    FENRIR_UNUSED (rep_lock);
+    _user_reports.push_back (std::move(report));
+}
 FENRIR_INLINE Link_Params Handler::proxy_def_link_params()
     { return _rate->def_link_params(); }
+FENRIR_INLINE bool Handler::proxy_parallel_crypto() const
+    { return _parallel_crypto.load (std::memory_order_relaxed); }
+FENRIR_INLINE void Handler::proxy_wakeup (const Conn_ID id)
+    { return _rate->wakeup (id); }
+FENRIR_INLINE void Handler::proxy_add_link (const Conn_ID id,
+                                    const Link_ID link, const Direction dir)
+    { _rate->add_link (id, link, dir); }
+FENRIR_INLINE void Handler::proxy_del_link (const Conn_ID id,
+                                    const Link_ID link, const Direction dir)
+    { _rate->del_link (id, link, dir); }
+FENRIR_INLINE void Handler::proxy_timestamp_echo (const Conn_ID id,
+                                    const Link_ID to,
+                                    const std::chrono::microseconds timestamp,
+                                    const std::chrono::microseconds delay,
+                                    const uint32_t received)
+    { _rate->timestamp_echo (id, to, timestamp, delay, received); }
+
+FENRIR_INLINE Error Handler::set_socket_rate (const Link_ID id,
+                                                    const uint64_t bytes_sec)
+    { return _rate->set_socket_rate (id, bytes_sec); }
+FENRIR_INLINE Error Handler::set_connection_rate (const Conn_ID id,
+                                                    const uint64_t bytes_sec)
+    { return _rate->set_connection_rate (id, bytes_sec); }
+FENRIR_INLINE Error Handler::set_link_rate (const Conn_ID id,
+                                const Link_ID to, const uint64_t bytes_sec)
+    { return _rate->set_link_rate (id, to, bytes_sec); }
 
 FENRIR_INLINE void Handler::do_work (std::shared_ptr<Event::Base> ev)
 {
@@ -151,12 +308,14 @@ FENRIR_INLINE void Handler::do_work (std::shared_ptr<Event::Base> ev)
     case Event::Type::KEEPALIVE:
         return ev_keepalive (std::static_pointer_cast<Event::Keepalive>(ev));
     case Event::Type::HANDSHAKE:
-        return _handshakes.drop_handshake (
+        return _handshakes.timer (
                             std::static_pointer_cast<Event::Handshake> (ev));
     case Event::Type::CONNECT:
         return connect (std::static_pointer_cast<Event::Connect> (ev));
     case Event::Type::PLUGIN_TIMER:
         return plg_ev (std::static_pointer_cast<Event::Plugin_Timer> (ev));
+    case Event::Type::PLUGIN_IO:
+        return plg_io (std::static_pointer_cast<Event::Plugin_IO> (ev));
     case Event::Type::USER:
         // TODO: report ev to user
         return;
@@ -169,20 +328,46 @@ FENRIR_INLINE Error Handler::add_connection (std::shared_ptr<Connection> conn)
 {
     const Conn_ID id = conn->_read_connection_id;
 
+    // register to the rate plugin first, so that it will track all the
+    // links added from now on. The links added before are registered here.
+    // the rate plugin looks up connections while locked:
+    // do not call it with _conn_lock held.
+    const auto err = _rate->add_connection (id);
+    if (err != Error::NONE)
+        return err;
+    for (const auto &lnk : conn->_incoming)
+        _rate->add_link (id, lnk._link, Direction::INCOMING);
+    for (const auto &lnk : conn->_outgoing)
+        _rate->add_link (id, lnk._link, Direction::OUTGOING);
+
+    // add_Link_out calls the rate plugin and looks up the socket:
+    // do not hold _sock_lock.
+    std::vector<Link_ID> socks;
     {
-        Shared_Lock_Guard<Shared_Lock_Write> rlock(Shared_Lock_NN{&_sock_lock});
+        Shared_Lock_Guard<Shared_Lock_Read> rlock(Shared_Lock_NN{&_sock_lock});
+        FENRIR_UNUSED (rlock);
+        socks.reserve (_sockets.size());
         for (const auto &sock : _sockets)
-            conn->add_Link_out (std::get<Link_ID> (sock));
+            socks.push_back (std::get<Link_ID> (sock));
     }
+    for (const auto sock : socks)
+        conn->add_Link_out (sock);
 
-    Shared_Lock_Guard<Shared_Lock_Write> wlock (Shared_Lock_NN{&_conn_lock});
-    FENRIR_UNUSED (wlock);
-    auto res_pair = _connections.insert ({id, std::move(conn)});
-    if (std::get<bool> (res_pair))
-        return Error::NONE;
-    if (res_pair.first == _connections.end())
-        return Error::FULL; // probably memory problems?
-    return Error::ALREADY_PRESENT;
+    {
+        Shared_Lock_Guard<Shared_Lock_Write> wlock (
+                                                Shared_Lock_NN{&_conn_lock});
+        auto res_pair = _connections.insert ({id, std::move(conn)});
+        if (!std::get<bool> (res_pair)) {
+            wlock.early_unlock();
+            _rate->del_connection (id);
+            if (res_pair.first == _connections.end())
+                return Error::FULL; // probably memory problems?
+            return Error::ALREADY_PRESENT;
+        }
+    }
+    // the rate plugin might have parked it while it was not visible.
+    _rate->wakeup (id);
+    return Error::NONE;
 }
 
 FENRIR_INLINE std::shared_ptr<Connection> Handler::get_connection (
@@ -258,19 +443,19 @@ FENRIR_INLINE void Handler::read_pkt (std::shared_ptr<Event::Read> ev)
     if (shared_conn == nullptr)
         return;
 
-    auto activation_pkt = shared_conn->update_source (std::get<Link_ID> (read));
-    if (activation_pkt!= nullptr) {
-        // we need to send the activation link
-        auto dest = std::get<Link_ID> (read);
-        sock->write (activation_pkt->raw, dest);
-        if (activation_pkt != nullptr &&
-                                activation_pkt->raw.size() <= pkt.raw.size()) {
-            return _rate->enqueue (sock->id(), std::get<Link_ID> (read),
+    // the packet might be kept for reordering: "pkt" can be moved
+    const size_t pkt_size = pkt.raw.size();
+    if (!shared_conn->recv (pkt, sock->id()))
+        return; // forged or replayed: it does not touch the links.
+
+    // new source: the activation is queued, not sent from here.
+    // never answer with more than we received: no amplification.
+    auto activation_pkt = shared_conn->update_source (std::get<Link_ID> (read),
+                                                                    pkt_size);
+    if (activation_pkt != nullptr) {
+        _rate->enqueue (sock->id(), std::get<Link_ID> (read),
                                 std::move(activation_pkt), type_safe::nullopt);
-        }
     }
-
-    shared_conn->recv (pkt);
 }
 
 FENRIR_INLINE void Handler::send_pkt (std::shared_ptr<Event::Send> ev)
@@ -313,6 +498,10 @@ FENRIR_INLINE void Handler::connect (std::shared_ptr<Event::Connect> ev)
     switch (ev->status) {
     case Event::Connect_Status::RESOLV:
         return connect_resolve (std::static_pointer_cast<Event::Resolve> (ev));
+    case Event::Connect_Status::RESOLV_NEXT:
+        return resolve_next (std::static_pointer_cast<Event::Resolve> (ev));
+    default:
+        break;
     }
 
     return;
@@ -320,48 +509,78 @@ FENRIR_INLINE void Handler::connect (std::shared_ptr<Event::Connect> ev)
 
 FENRIR_INLINE void Handler::connect_resolve (std::shared_ptr<Event::Resolve> ev)
 {
-    if (ev->_err == Error::RESOLVE_NOT_FOUND) {
-        Shared_Lock_Guard<Shared_Lock_Read> lock (Shared_Lock_NN {&_res_lock});
+    if (ev->_race != nullptr) {
+        std::unique_lock<std::mutex> lock (ev->_race->_mtx);
         FENRIR_UNUSED (lock);
-        uint32_t idx;
-        for (idx = 0; idx < _resolvers.size(); ++idx) {
-            if (_resolvers[idx]->id() == ev->_last_resolver) {
-                ++idx;
-                break;
+        if (ev->_race->_done)
+            return; // another resolver was faster
+        if (ev->_as._err != Error::NONE) {
+            // "not fenrir" is an answer, "not found" might be our network,
+            // anything else is our network or our resolver.
+            if (ev->_as._err == Error::RESOLVE_NOT_FENRIR ||
+                        (ev->_as._err == Error::RESOLVE_NOT_FOUND &&
+                            ev->_race->_err == Error::CAN_NOT_CONNECT)) {
+                ev->_race->_err = ev->_as._err;
             }
+            --ev->_race->_pending;
+            if (ev->_race->_pending > 0)
+                return; // wait for the others
+            ev->_as._err = ev->_race->_err;
         }
-        if (idx < _resolvers.size()) {
-            _resolvers[idx]->resolv_async (std::move(ev));
-        } else {
-            std::unique_lock<std::mutex> rep_lock (_rep_lock);
-            FENRIR_UNUSED (rep_lock);
-            // no more resolvers to try.
-            _user_reports.emplace_back (
+        ev->_race->_done = true;
+    }
+    if (ev->_refresh && ev->_as._err != Error::NONE) {
+        // keep the old result until it expires
+        _res_cache.refresh_failed (ev->_fqdn);
+        return;
+    }
+    _res_cache.put (ev->_fqdn, ev->_as);
+    if (ev->_refresh)
+        return;
+    connect_as (std::move(ev));
+}
+
+// resolution done, from the resolvers or the cache
+FENRIR_INLINE void Handler::connect_as (std::shared_ptr<Event::Resolve> ev)
+{
+    if (ev->_as._err == Error::RESOLVE_NOT_FOUND) {
+        std::unique_lock<std::mutex> rep_lock (_rep_lock);
+        FENRIR_UNUSED (rep_lock);
+        _user_reports.emplace_back (
                     new Report::Resolve (Fenrir__v1::Error::NO_SUCH_DOMAIN));
-        }
         return;
     }
-    if (ev->_err == Error::RESOLVE_NOT_FENRIR) {
+    if (ev->_as._err == Error::RESOLVE_NOT_FENRIR) {
         std::unique_lock<std::mutex> rep_lock (_rep_lock);
         FENRIR_UNUSED (rep_lock);
         _user_reports.emplace_back (
                     new Report::Resolve (Fenrir__v1::Error::DOMAIN_NOT_FENRIR));
         return;
     }
+    if (ev->_as._err != Error::NONE) {
+        // no resolver could ask: try again later
+        std::unique_lock<std::mutex> rep_lock (_rep_lock);
+        FENRIR_UNUSED (rep_lock);
+        _user_reports.emplace_back (
+                    new Report::Resolve (Fenrir__v1::Error::NO_CONNECTION));
+        return;
+    }
 
-    // done resolving, try to connect
+    // done resolving, try to connect.
+    // not all the resolvers fill the name: the handshake reports need it
+    ev->_as._fqdn = ev->_fqdn;
     std::unique_ptr<Packet> pkt;
     Link_ID dest;
-    std::tie (pkt, dest) = _handshakes.connect (ev->_as);
+    Conn0_Type type;
+    std::tie (pkt, dest, type) = _handshakes.connect (ev->_as,
+                                                            ev->_early_data);
     if (dest.ip() == IP())
         return;
 
-    Shared_Lock_Guard<Shared_Lock_Read> rlock (Shared_Lock_NN{&_sock_lock});
-    const auto from = std::get<Link_ID> (_sockets[_rnd.uniform<uint32_t> (0,
-                                    static_cast<uint32_t> (_sockets.size()))]);
-    rlock.early_unlock();
-
-    _rate->enqueue (from, dest, std::move(pkt), Conn0_Type::C_INIT);
+    const auto from = socket_for (dest);
+    if (from.ip() == IP())
+        return;
+    _rate->enqueue (from, dest, std::move(pkt), type);
 }
 
 FENRIR_INLINE void Handler::plg_ev (std::shared_ptr<Event::Plugin_Timer> ev)
@@ -374,6 +593,16 @@ FENRIR_INLINE void Handler::plg_ev (std::shared_ptr<Event::Plugin_Timer> ev)
     return plugin->parse_event (std::move(ev));
 }
 
+FENRIR_INLINE void Handler::plg_io (std::shared_ptr<Event::Plugin_IO> ev)
+{
+    auto plugin = ev->_plg.lock();
+    if (plugin == nullptr) {
+        _loop.del (std::move(ev));
+        return;
+    }
+    return plugin->parse_io (std::move(ev));
+}
+
 FENRIR_INLINE std::shared_ptr<Lattice> Handler::search_lattice (
                                             const Service_ID service,
                                             const std::vector<uint8_t> &vhost)
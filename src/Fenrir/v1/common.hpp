@@ -97,6 +97,7 @@ namespace Impl {
                 EXITING         = 4,
                 TIMEOUT         = 5,
                 CAN_NOT_CONNECT = 6,
+                AUTH_FAILED     = 7,
                 UNSUPPORTED     = 100,
                 RESOLVE_NOT_FOUND  = 101,
                 RESOLVE_NOT_FENRIR = 102,
@@ -118,6 +119,8 @@ enum class FENRIR_API Error : uint8_t {
                                             (Impl::Error::RESOLVE_NOT_FENRIR),
             NO_CONNECTION   = static_cast<uint8_t>
                                                 (Impl::Error::CAN_NOT_CONNECT),
+            TIMEOUT         = static_cast<uint8_t>(Impl::Error::TIMEOUT),
+            AUTH_FAILED     = static_cast<uint8_t>(Impl::Error::AUTH_FAILED),
             };
 } // namespace Fenrir__v1
 #endif
@@ -24,6 +24,7 @@
 #include "Fenrir/v1/plugin/Dynamic.hpp"
 #include "Fenrir/v1/net/Role.hpp"
 #include <array>
+#include <cassert>
 #include <gsl/span>
 #include <memory>
 #include <tuple>
@@ -43,6 +44,9 @@ class Loop;
 
 namespace Crypto {
 
+// With Handler::set_parallel_crypto (true) the worker threads call
+// encrypt() and decrypt() on the same instance at the same time:
+// the plugins must then be safe for concurrent use after set_key().
 class FENRIR_LOCAL Encryption : public Dynamic
 {
 public:
@@ -71,8 +75,42 @@ public:
     virtual Impl::Error decrypt (const gsl::span<uint8_t> in,
                                                 gsl::span<uint8_t> &out) = 0;
     virtual bool is_authenticated() const = 0;
+    // the packet sequence, read from the header of an encrypted packet
+    // without any crypto work, for the anti-replay window.
+    //   [ 4 bits sender lane | 60 bits counter, increasing in each lane ]
+    // nullopt: no sequence, no replay protection.
+    virtual type_safe::optional<uint64_t> sequence (
+                                    const gsl::span<const uint8_t> in) const
+    {
+        FENRIR_UNUSED (in);
+        return type_safe::nullopt;
+    }
+
+    // batches: one virtual call for a whole burst of packets.
+    // "err" gets the result of each packet, and must be as long as "in".
+    // The default just loops, plugins can override it to amortize
+    // the per-packet work.
+    virtual void encrypt_batch (gsl::span<gsl::span<uint8_t>> in,
+                                                    gsl::span<Impl::Error> err)
+    {
+        assert (in.size() == err.size() && "Fenrir: encrypt_batch: sizes");
+        for (ssize_t idx = 0; idx < in.size(); ++idx)
+            err[idx] = encrypt (in[idx]);
+    }
+    // "out" works as in decrypt(), and must be as long as "in".
+    virtual void decrypt_batch (const gsl::span<gsl::span<uint8_t>> in,
+                                            gsl::span<gsl::span<uint8_t>> out,
+                                                    gsl::span<Impl::Error> err)
+    {
+        assert (in.size() == out.size() && in.size() == err.size() &&
+                                        "Fenrir: decrypt_batch: sizes");
+        for (ssize_t idx = 0; idx < in.size(); ++idx)
+            err[idx] = decrypt (in[idx], out[idx]);
+    }
 };
 
+// like Encryption: add_hmac() and is_valid() run concurrently
+// with Handler::set_parallel_crypto (true).
 class FENRIR_LOCAL Hmac : public Dynamic
 {
 public:
@@ -99,6 +137,25 @@ public:
     virtual bool is_valid (const gsl::span<uint8_t> in,
                                                 gsl::span<uint8_t> &out) = 0;
     virtual Impl::Error add_hmac (gsl::span<uint8_t> in) = 0;
+
+    // batches, see Encryption::encrypt_batch
+    virtual void add_hmac_batch (gsl::span<gsl::span<uint8_t>> in,
+                                                    gsl::span<Impl::Error> err)
+    {
+        assert (in.size() == err.size() && "Fenrir: add_hmac_batch: sizes");
+        for (ssize_t idx = 0; idx < in.size(); ++idx)
+            err[idx] = add_hmac (in[idx]);
+    }
+    // "valid": one result per packet, as is_valid()
+    virtual void is_valid_batch (const gsl::span<gsl::span<uint8_t>> in,
+                                            gsl::span<gsl::span<uint8_t>> out,
+                                                        gsl::span<bool> valid)
+    {
+        assert (in.size() == out.size() && in.size() == valid.size() &&
+                                        "Fenrir: is_valid_batch: sizes");
+        for (ssize_t idx = 0; idx < in.size(); ++idx)
+            valid[idx] = is_valid (in[idx], out[idx]);
+    }
 };
 
 
@@ -24,9 +24,10 @@
 #include "Fenrir/v1/crypto/Crypto.hpp"
 #include "Fenrir/v1/util/Random.hpp"
 #include <array>
+#include <atomic>
+#include <cassert>
 #include <gsl/span>
 #include <memory>
-#include <mutex>
 #include <sodium.h>
 #include <string.h>
 #include <vector>
@@ -36,17 +37,99 @@ namespace Impl {
 
 namespace Crypto {
 
-class FENRIR_LOCAL ChaCha20_Poly1305_IETF : public Encryption
+// Lock-free nonce generation: the nonce space is split in "nonce_lanes"
+// lanes, so that threads encrypting with the same key never contend:
+//   [ random salt | 4 bits lane | 60 bits lane counter ]
+// each thread always uses the same lane, and the lane counter is atomic,
+// so even two threads sharing a lane never get the same nonce.
+template<size_t bytes>
+class FENRIR_LOCAL Nonce_Lanes
+{
+public:
+    static_assert (bytes > sizeof(uint64_t), "Fenrir: nonce too small");
+
+    Nonce_Lanes()
+    {
+        randombytes_buf (_salt.data(), _salt.size());
+        for (auto &lane : _lanes)
+            lane._next.store (0, std::memory_order_relaxed);
+    }
+    Nonce_Lanes (const Nonce_Lanes&) = delete;
+    Nonce_Lanes& operator= (const Nonce_Lanes&) = delete;
+    Nonce_Lanes (Nonce_Lanes &&) = delete;
+    Nonce_Lanes& operator= (Nonce_Lanes &&) = delete;
+    ~Nonce_Lanes() = default;
+
+    // reserve "count" consecutive nonces with a single atomic operation.
+    // use write() with "first", "first + 1"... "first + count - 1".
+    // Error::FULL when the lane is out of nonces: rekey.
+    Impl::Error reserve (const uint32_t count, uint64_t &first)
+    {
+        const uint32_t lane = thread_lane();
+        const uint64_t counter = _lanes[lane]._next.fetch_add (count,
+                                                    std::memory_order_relaxed);
+        if (count == 0 || counter + (count - 1) > lane_counter_mask)
+            return Impl::Error::FULL;
+        first = (static_cast<uint64_t> (lane) << lane_counter_bits) | counter;
+        return Impl::Error::NONE;
+    }
+    // the lane nonce (lane + counter) written by write()
+    static uint64_t read (const gsl::span<const uint8_t> in)
+    {
+        uint64_t lane_nonce = 0;
+        for (size_t idx = 0; idx < sizeof(lane_nonce); ++idx) {
+            lane_nonce = (lane_nonce << 8) | in[static_cast<ssize_t> (
+                                            bytes - sizeof(uint64_t) + idx)];
+        }
+        return lane_nonce;
+    }
+    void write (gsl::span<uint8_t, bytes> out, const uint64_t lane_nonce) const
+    {
+        memcpy (out.data(), _salt.data(), _salt.size());
+        for (size_t idx = 0; idx < sizeof(lane_nonce); ++idx) {
+            out[static_cast<ssize_t> (_salt.size() + idx)] =
+                    static_cast<uint8_t> (lane_nonce >>
+                                        (8 * (sizeof(lane_nonce) - 1 - idx)));
+        }
+    }
+private:
+    static constexpr uint32_t nonce_lanes = 16;
+    static constexpr uint32_t lane_counter_bits = 60;
+    static constexpr uint64_t lane_counter_mask =
+                                    (uint64_t {1} << lane_counter_bits) - 1;
+    // one cache line per lane, so that the lanes do not false-share.
+    struct alignas(64) lane_counter {
+        std::atomic<uint64_t> _next;
+    };
+    static_assert (sizeof(lane_counter) == 64,
+                                    "Fenrir: nonce lanes must not share lines");
+
+    std::array<uint8_t, bytes - sizeof(uint64_t)> _salt;
+    std::array<lane_counter, nonce_lanes> _lanes;
+
+    // lanes are assigned to threads in order of first use.
+    static uint32_t thread_lane()
+    {
+        static std::atomic<uint32_t> next_lane (0);
+        thread_local const uint32_t lane = next_lane.fetch_add (1,
+                                    std::memory_order_relaxed) % nonce_lanes;
+        return lane;
+    }
+};
+
+class FENRIR_LOCAL ChaCha20_Poly1305_IETF final : public Encryption
 {
 public:
     ChaCha20_Poly1305_IETF()
         : Encryption(std::shared_ptr<Lib> (nullptr), nullptr, nullptr, nullptr),
-            _nonces_sent (0), _initialized (sodium_init() >= 0)
-        { randombytes_buf (_last_nonce.data(), _last_nonce.size()); }
-    ChaCha20_Poly1305_IETF (const ChaCha20_Poly1305_IETF&) = default;
-    ChaCha20_Poly1305_IETF& operator= (const ChaCha20_Poly1305_IETF&)=default;
-    ChaCha20_Poly1305_IETF (ChaCha20_Poly1305_IETF &&) = default;
-    ChaCha20_Poly1305_IETF& operator= (ChaCha20_Poly1305_IETF &&) = default;
+            _initialized (sodium_init() >= 0)
+        {}
+    // the nonce lanes can not be shared, nor copied: no two instances
+    // may ever hold the same key and counters.
+    ChaCha20_Poly1305_IETF (const ChaCha20_Poly1305_IETF&) = delete;
+    ChaCha20_Poly1305_IETF& operator= (const ChaCha20_Poly1305_IETF&)=delete;
+    ChaCha20_Poly1305_IETF (ChaCha20_Poly1305_IETF &&) = delete;
+    ChaCha20_Poly1305_IETF& operator= (ChaCha20_Poly1305_IETF &&) = delete;
     ~ChaCha20_Poly1305_IETF() override {}
     void parse_event (std::shared_ptr<Event::Plugin_Timer> ev) override
         { FENRIR_UNUSED (ev); }
@@ -68,16 +151,58 @@ public:
     {
         if (in.size() < bytes_overhead())
             return Impl::Error::WRONG_INPUT;
+        uint64_t lane_nonce;
+        const auto err = _nonces.reserve (1, lane_nonce);
+        if (err != Impl::Error::NONE)
+            return err;
+        seal (in, lane_nonce);
+        return Impl::Error::NONE;
+    }
+    Impl::Error decrypt (const gsl::span<uint8_t> in,
+                                            gsl::span<uint8_t> &out) override
+        { return open (in, out); }
+    // one nonce reservation for the whole burst, and no virtual calls.
+    // decrypt_batch has nothing to share between the packets: the default
+    // loop is enough.
+    void encrypt_batch (gsl::span<gsl::span<uint8_t>> in,
+                                            gsl::span<Impl::Error> err) override
+    {
+        assert (in.size() == err.size() && "Fenrir: encrypt_batch: sizes");
+        uint64_t lane_nonce = 0;
+        const auto res = _nonces.reserve (static_cast<uint32_t> (in.size()),
+                                                                    lane_nonce);
+        for (ssize_t idx = 0; idx < in.size(); ++idx, ++lane_nonce) {
+            err[idx] = res;
+            if (res != Impl::Error::NONE)
+                continue;
+            if (in[idx].size() < bytes_overhead()) {
+                err[idx] = Impl::Error::WRONG_INPUT;
+                continue;   // that nonce is skipped, never reused
+            }
+            seal (in[idx], lane_nonce);
+        }
+    }
+    bool is_authenticated() const override
+        { return true; }
+    type_safe::optional<uint64_t> sequence (
+                            const gsl::span<const uint8_t> in) const override
+    {
+        if (in.size() < bytes_overhead())
+            return type_safe::nullopt;
+        return type_safe::make_optional (Nonce_Lanes<
+                    crypto_aead_chacha20poly1305_IETF_NPUBBYTES>::read (in));
+    }
+private:
+    bool _initialized;  // keep first: sodium_init before the nonces
+    std::array<uint8_t, 32> _key;
+    Nonce_Lanes<crypto_aead_chacha20poly1305_IETF_NPUBBYTES> _nonces;
+
+    // "in" must be at least bytes_overhead() long
+    void seal (gsl::span<uint8_t> in, const uint64_t lane_nonce)
+    {
         gsl::span<uint8_t, crypto_aead_chacha20poly1305_IETF_NPUBBYTES> nonce
                     (in.data(), crypto_aead_chacha20poly1305_IETF_NPUBBYTES);
-        {
-            std::unique_lock<std::mutex> lock (_mtx);
-            FENRIR_UNUSED (lock);
-            sodium_increment (reinterpret_cast<uint8_t*> (_last_nonce.data()),
-                                                            _last_nonce.size());
-            memcpy (nonce.data(), _last_nonce.data(), nonce.size());
-            ++_nonces_sent;
-        }
+        _nonces.write (nonce, lane_nonce);
         uint8_t *cipher_start = in.data() +
                                     crypto_aead_chacha20poly1305_IETF_NPUBBYTES;
         unsigned long long ciphertext_len;
@@ -92,10 +217,8 @@ public:
                                                                 nullptr,
                                                                 nonce.data(),
                                                                 _key.data());
-        return Impl::Error::NONE;
     }
-    Impl::Error decrypt (const gsl::span<uint8_t> in,
-                                            gsl::span<uint8_t> &out) override
+    Impl::Error open (const gsl::span<uint8_t> in, gsl::span<uint8_t> &out)
     {
         if (in.size() < bytes_overhead())
             return Impl::Error::WRONG_INPUT;
@@ -122,14 +245,137 @@ public:
                                                 in.size() - bytes_overhead());
         return Impl::Error::NONE;
     }
+};
+
+// AES-256-GCM is much faster than ChaCha20 where the cpu has AES-NI and
+// PCLMUL, but libsodium implements it only there: check is_available()
+// before advertising it.
+class FENRIR_LOCAL AES256_GCM final : public Encryption
+{
+public:
+    AES256_GCM()
+        : Encryption(std::shared_ptr<Lib> (nullptr), nullptr, nullptr, nullptr),
+            _initialized (sodium_init() >= 0)
+        {}
+    // like ChaCha20_Poly1305_IETF: the nonce lanes can not be copied.
+    AES256_GCM (const AES256_GCM&) = delete;
+    AES256_GCM& operator= (const AES256_GCM&) = delete;
+    AES256_GCM (AES256_GCM &&) = delete;
+    AES256_GCM& operator= (AES256_GCM &&) = delete;
+    ~AES256_GCM() override
+        { sodium_memzero (&_state, sizeof(_state)); }
+    void parse_event (std::shared_ptr<Event::Plugin_Timer> ev) override
+        { FENRIR_UNUSED (ev); }
+
+    static bool is_available()
+        { return sodium_init() >= 0 && crypto_aead_aes256gcm_is_available(); }
+
+    Encryption::ID id() const override
+        { return Encryption::ID {3}; }
+    uint16_t bytes_header() const override
+        { return crypto_aead_aes256gcm_NPUBBYTES; }
+    uint16_t bytes_footer() const override
+        { return crypto_aead_aes256gcm_ABYTES; }
+    uint16_t bytes_overhead() const override
+        { return bytes_header() + bytes_footer(); }
+    bool set_key (const std::array<uint8_t, 64> &key) override
+    {
+        // expand the key only once, not on every packet
+        return crypto_aead_aes256gcm_beforenm (&_state, key.data()) == 0;
+    }
+    Impl::Error encrypt (gsl::span<uint8_t> in) override
+    {
+        if (in.size() < bytes_overhead())
+            return Impl::Error::WRONG_INPUT;
+        uint64_t lane_nonce;
+        const auto err = _nonces.reserve (1, lane_nonce);
+        if (err != Impl::Error::NONE)
+            return err;
+        seal (in, lane_nonce);
+        return Impl::Error::NONE;
+    }
+    Impl::Error decrypt (const gsl::span<uint8_t> in,
+                                            gsl::span<uint8_t> &out) override
+        { return open (in, out); }
+    // see ChaCha20_Poly1305_IETF::encrypt_batch
+    void encrypt_batch (gsl::span<gsl::span<uint8_t>> in,
+                                            gsl::span<Impl::Error> err) override
+    {
+        assert (in.size() == err.size() && "Fenrir: encrypt_batch: sizes");
+        uint64_t lane_nonce = 0;
+        const auto res = _nonces.reserve (static_cast<uint32_t> (in.size()),
+                                                                    lane_nonce);
+        for (ssize_t idx = 0; idx < in.size(); ++idx, ++lane_nonce) {
+            err[idx] = res;
+            if (res != Impl::Error::NONE)
+                continue;
+            if (in[idx].size() < bytes_overhead()) {
+                err[idx] = Impl::Error::WRONG_INPUT;
+                continue;   // that nonce is skipped, never reused
+            }
+            seal (in[idx], lane_nonce);
+        }
+    }
     bool is_authenticated() const override
         { return true; }
+    type_safe::optional<uint64_t> sequence (
+                            const gsl::span<const uint8_t> in) const override
+    {
+        if (in.size() < bytes_overhead())
+            return type_safe::nullopt;
+        return type_safe::make_optional (Nonce_Lanes<
+                            crypto_aead_aes256gcm_NPUBBYTES>::read (in));
+    }
 private:
-    uint64_t _nonces_sent;
-    std::array<uint8_t, 32> _key;
-    std::array<uint8_t, crypto_aead_chacha20poly1305_IETF_NPUBBYTES>_last_nonce;
-    std::mutex _mtx;
-    bool _initialized;
+    bool _initialized;  // keep first: sodium_init before the nonces
+    crypto_aead_aes256gcm_state _state;    // expanded key
+    Nonce_Lanes<crypto_aead_aes256gcm_NPUBBYTES> _nonces;
+
+    // "in" must be at least bytes_overhead() long
+    void seal (gsl::span<uint8_t> in, const uint64_t lane_nonce)
+    {
+        gsl::span<uint8_t, crypto_aead_aes256gcm_NPUBBYTES> nonce
+                                (in.data(), crypto_aead_aes256gcm_NPUBBYTES);
+        _nonces.write (nonce, lane_nonce);
+        uint8_t *cipher_start = in.data() + crypto_aead_aes256gcm_NPUBBYTES;
+        unsigned long long ciphertext_len;
+        unsigned long long data_size = static_cast<unsigned long long> (
+                                                in.size() - bytes_overhead());
+        crypto_aead_aes256gcm_encrypt_afternm (cipher_start, &ciphertext_len,
+                                                                cipher_start,
+                                                                data_size,
+                                                                nullptr,
+                                                                0,
+                                                                nullptr,
+                                                                nonce.data(),
+                                                                &_state);
+    }
+    Impl::Error open (const gsl::span<uint8_t> in, gsl::span<uint8_t> &out)
+    {
+        if (in.size() < bytes_overhead())
+            return Impl::Error::WRONG_INPUT;
+        gsl::span<uint8_t, crypto_aead_aes256gcm_NPUBBYTES> nonce
+                                (in.data(), crypto_aead_aes256gcm_NPUBBYTES);
+
+        uint8_t *cipher_start = in.data() + crypto_aead_aes256gcm_NPUBBYTES;
+        unsigned long long cleartext_len;
+        const unsigned long long data_size = static_cast<unsigned long long> (
+                                                in.size() - bytes_header());
+        int res = crypto_aead_aes256gcm_decrypt_afternm (cipher_start,
+                                                                &cleartext_len,
+                                                                nullptr,
+                                                                cipher_start,
+                                                                data_size,
+                                                                nullptr,
+                                                                0,
+                                                                nonce.data(),
+                                                                &_state);
+        if (res)
+            return Impl::Error::WRONG_INPUT;
+        out = in.subspan (crypto_aead_aes256gcm_NPUBBYTES,
+                                                in.size() - bytes_overhead());
+        return Impl::Error::NONE;
+    }
 };
 
 class FENRIR_LOCAL Ed25519 : public Key
@@ -149,7 +395,8 @@ public:
                     type_safe::strong_typedef_op::relational_comparison<ID>
         { using strong_typedef::strong_typedef; };
     Ed25519()
-        : Key(std::shared_ptr<Lib> (nullptr), nullptr, nullptr, nullptr)
+        : Key(std::shared_ptr<Lib> (nullptr), nullptr, nullptr, nullptr),
+          _has_curve_priv (false)
         {}
     Ed25519 (const Ed25519&) = default;
     Ed25519& operator= (const Ed25519&) = default;
@@ -177,7 +424,7 @@ public:
         if (static_cast<uint32_t> (pub.size()) != _pub.size())
             return false;
         memcpy (_pub.data(), pub.data(), _pub.size());
-        return true;
+        return to_curve (false);
     }
     bool init (const gsl::span<const uint8_t> priv,
                                     const gsl::span<const uint8_t> pub) override
@@ -192,12 +439,12 @@ public:
             return false;
         if (sodium_memcmp (pub.data(), _pub.data(), _pub.size()) != 0)
             return false;
-        return true;
+        return to_curve (true);
     }
     bool init() override
     {
         crypto_sign_ed25519_keypair (_pub.data(), _priv.data());
-        return true;
+        return to_curve (true);
     }
     bool verify (const gsl::span<const uint8_t> data,
                             const gsl::span<const uint8_t> signature) override
@@ -261,35 +508,23 @@ public:
             return false;
         const Ed25519 *other_ed_key = reinterpret_cast<const Ed25519*> (
                                                                 other_pubkey);
-
-        std::array<uint8_t, crypto_scalarmult_curve25519_BYTES> curve_other_pub;
-        std::array<uint8_t, crypto_scalarmult_curve25519_BYTES> curve_pub;
-        std::array<uint8_t, crypto_scalarmult_curve25519_BYTES> curve_priv;
-        if (crypto_sign_ed25519_pk_to_curve25519 (curve_other_pub.data(),
-                                            other_ed_key->_pub.data()) != 0) {
-            return false;
-        }
-        if (crypto_sign_ed25519_pk_to_curve25519 (curve_pub.data(),
-                                                            _pub.data()) != 0) {
-            return false;
-        }
-        if (crypto_sign_ed25519_sk_to_curve25519 (curve_priv.data(),
-                                                            _priv.data()) != 0){
+        // converted once, in init()
+        if (!_has_curve_priv)
             return false;
-        }
+        const auto &curve_other_pub = other_ed_key->_curve_pub;
 
         // this the key exchange generates 2 keys of
         // crypto_kx_SESSIONKEYBYTES == 32 bytes each.
         // but we don't use those directly, we will pass it as input to a KDF.
         if (role == Role::Client) {
             if (crypto_kx_client_session_keys (output.data() + 32,output.data(),
-                                            curve_pub.data(), curve_priv.data(),
+                                        _curve_pub.data(), _curve_priv.data(),
                                             curve_other_pub.data()) != 0) {
                 return false;
             }
         } else {
             if (crypto_kx_server_session_keys (output.data(),output.data() + 32,
-                                            curve_pub.data(), curve_priv.data(),
+                                        _curve_pub.data(), _curve_priv.data(),
                                             curve_other_pub.data()) != 0) {
                 return false;
             }
@@ -299,6 +534,29 @@ public:
 private:
     std::array<uint8_t, crypto_sign_ed25519_PUBLICKEYBYTES> _pub;
     std::array<uint8_t, crypto_sign_ed25519_SECRETKEYBYTES> _priv;
+    // the key exchange is on Curve25519. The conversion is a field
+    // exponentiation per key: do it once per key, not once per exchange.
+    std::array<uint8_t, crypto_scalarmult_curve25519_BYTES> _curve_pub;
+    std::array<uint8_t, crypto_scalarmult_curve25519_BYTES> _curve_priv;
+    bool _has_curve_priv;
+
+    // false: not a valid point, the key can not be used
+    bool to_curve (const bool priv)
+    {
+        _has_curve_priv = false;
+        if (crypto_sign_ed25519_pk_to_curve25519 (_curve_pub.data(),
+                                                            _pub.data()) != 0) {
+            return false;
+        }
+        if (!priv)
+            return true;
+        if (crypto_sign_ed25519_sk_to_curve25519 (_curve_priv.data(),
+                                                            _priv.data()) != 0){
+            return false;
+        }
+        _has_curve_priv = true;
+        return true;
+    }
 };
 
 class FENRIR_LOCAL blake2b final : public KDF
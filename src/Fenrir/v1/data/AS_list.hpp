@@ -42,7 +42,8 @@ namespace Resolve {
 class FENRIR_LOCAL AS_list
 {
 public:
-    AS_list() {}
+    AS_list()
+        : _ttl (0), _err (Impl::Error::RESOLVE_NOT_FOUND) {}
     AS_list (const AS_list&) = delete;
     AS_list& operator= (const AS_list&) = delete;
     AS_list (AS_list &&) = default;
@@ -67,8 +68,22 @@ public:
 
     std::vector<Srv_info> _servers;
     std::vector<Crypto::Auth::ID> _auth_protocols;
+    int64_t _ttl;   // seconds the result can be cached
     Impl::Error _err;
 
+    // AS_list is not copyable on purpose: copy everything but share the keys
+    AS_list clone() const
+    {
+        AS_list ret;
+        ret._fqdn = _fqdn;
+        ret._key = _key;
+        ret._servers = _servers;
+        ret._auth_protocols = _auth_protocols;
+        ret._ttl = _ttl;
+        ret._err = _err;
+        return ret;
+    }
+
     void sort () {
             std::sort (_servers.begin (), _servers.end (),
                 [] (const Srv_info &a, const Srv_info &b) {
@@ -128,6 +143,40 @@ public:
         }
         return static_cast<uint16_t> (idx_from);
     }
+
+    // the servers to contact in parallel, best first: the one chosen by
+    // get_idx, then the best of the other address family, and so on.
+    // a broken ipv4 or ipv6 path must not stall the connection.
+    std::vector<uint16_t> get_parallel (const size_t max, Random *const rnd)
+    {
+        std::vector<uint16_t> ret;
+        const auto first = get_idx (0, rnd);
+        if (!first.has_value())
+            return ret;
+        ret.reserve (max);
+        ret.push_back (first.value());
+        while (ret.size() < max) {
+            const bool want_ipv6 = !_servers[ret.back()].ip.ipv6;
+            type_safe::optional<uint16_t> best {type_safe::nullopt};
+            uint32_t best_score = 0;
+            for (size_t idx = 0; idx < _servers.size(); ++idx) {
+                const auto srv_idx = static_cast<uint16_t> (idx);
+                if (std::find (ret.begin(), ret.end(), srv_idx) != ret.end())
+                    continue;
+                // family first, then priority
+                const uint32_t score = _servers[idx].priority +
+                                (_servers[idx].ip.ipv6 == want_ipv6 ? 0 : 8);
+                if (!best.has_value() || score < best_score) {
+                    best = srv_idx;
+                    best_score = score;
+                }
+            }
+            if (!best.has_value())
+                break;
+            ret.push_back (best.value());
+        }
+        return ret;
+    }
 };
 
 } // namespace Resolve
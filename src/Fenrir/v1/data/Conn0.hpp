@@ -166,6 +166,9 @@ public:
     struct data const *const r;
     struct data *const w;
     Span_Overlay<Crypto::Auth::ID> _supported_auth;
+    // the cookie is the _s_data_signature, the client sends it back as-is.
+    // with MAC cookies the _cs_data_signature is empty and the cookie is
+    // opaque: the server signs everything later, in the S_KEYS.
     Span_Overlay<uint8_t> _cs_data_signature;
     Span_Overlay<uint8_t> _s_data_signature;
 
@@ -185,7 +188,8 @@ public:
                             const Crypto::KDF::ID selected_kdf,
                             const int64_t timestamp,
                             const std::vector<Crypto::Auth::ID>&supported_auth,
-                            const uint16_t signature_length);
+                            const uint16_t signature_length,
+                            const uint16_t cookie_length);
     static constexpr uint16_t min_size();
     const std::vector<uint8_t> client_server_data_tosign (
                                                 const Conn0_C_INIT &req) const;
@@ -290,6 +294,9 @@ public:
 
     static constexpr uint16_t min_size();
     gsl::span<const uint8_t> data_tosign() const;
+    // with MAC cookies, also sign the hash of the C_INIT/S_COOKIE exchange
+    std::vector<uint8_t> data_tosign (const gsl::span<const uint8_t> cs_hash)
+                                                                        const;
 private:
     static constexpr uint16_t pubkey_offset = sizeof(struct data);
     static constexpr uint16_t min_data_len = pubkey_offset +
@@ -394,6 +401,7 @@ public:
         Stream_ID _control_stream;
         Packet::Alignment_Flag _alignment;
         uint8_t _max_padding;
+        uint16_t _max_early_data;   // accepted when resuming with _ticket
         // IP
         // UDP_Port
     };
@@ -406,6 +414,7 @@ public:
     struct data const *const r;
     struct data *const w;
     Span_Overlay<stream_info> _streams;
+    Span_Overlay<uint8_t> _ticket;  // resumption ticket. can be empty.
 
     Conn0_Auth_Result (const gsl::span<uint8_t> span);
     Conn0_Auth_Result (      gsl::span<uint8_t> span,
@@ -414,7 +423,9 @@ public:
                                             const Stream_ID control_stream,
                                             const Packet::Alignment_Flag _align,
                                             const uint8_t max_padding,
-                                            const uint16_t streams);
+                                            const uint16_t max_early_data,
+                                            const uint16_t streams,
+                                            const uint16_t ticket_length);
 
     static constexpr uint16_t min_size();
     static uint16_t stream_info_size (const uint16_t streams);
@@ -424,9 +435,10 @@ private:
     bool _error;
     static constexpr uint16_t stream_offset = sizeof(struct data);
     static constexpr uint16_t min_data_len = stream_offset +
-                                                        1 * sizeof(uint16_t);
+                                                        2 * sizeof(uint16_t);
 };
 
+// also used for the S_RESUME, with the same layout
 class FENRIR_LOCAL Conn0_S_RESULT final : public Conn0
 {
 public:
@@ -439,8 +451,10 @@ public:
     struct data *const w;
     Span_Overlay<uint8_t> _enc;
 
-    Conn0_S_RESULT (const gsl::span<uint8_t> raw);
-    Conn0_S_RESULT (      gsl::span<uint8_t> raw, const uint16_t enc_length);
+    Conn0_S_RESULT (const gsl::span<uint8_t> raw,
+                                const Conn0_Type type = Conn0_Type::S_RESULT);
+    Conn0_S_RESULT (      gsl::span<uint8_t> raw, const uint16_t enc_length,
+                                const Conn0_Type type = Conn0_Type::S_RESULT);
 
     static constexpr uint16_t min_size();
     gsl::span<uint8_t> as_cleartext (const uint16_t crypto_overhead,
@@ -450,6 +464,80 @@ private:
     static constexpr uint16_t min_data_len = enc_offset + 1 * sizeof(uint16_t);
 };
 
+/////////////////
+// Conn0_C_RESUME
+/////////////////
+
+class FENRIR_LOCAL Conn0_Resume_Data
+{
+private:
+    gsl::span<uint8_t> _raw;
+public:
+    struct data {
+        Conn_ID _client_conn_id;
+        uint8_t _max_padding;
+        Packet::Alignment_Flag _alignment;
+        Stream_ID _control_stream;
+        Stream_ID _early_stream;
+        uint32_t _ticket_age;   // milliseconds since we got the ticket
+    };
+    struct data const *const r;
+    struct data *const w;
+    Span_Overlay<uint8_t> _early_data;  // 0-RTT data. can be empty.
+
+    Conn0_Resume_Data (const gsl::span<uint8_t> raw);
+    Conn0_Resume_Data (      gsl::span<uint8_t> raw,
+                                        const Conn_ID client_conn_id,
+                                        const uint8_t padding,
+                                        const Packet::Alignment_Flag alignment,
+                                        const Stream_ID control_stream,
+                                        const Stream_ID early_stream,
+                                        const uint32_t ticket_age,
+                                    const gsl::span<const uint8_t> early_data);
+
+    static constexpr uint16_t min_size();
+    explicit operator bool() const
+        { return _error == false; }
+private:
+    bool _error;
+    static constexpr uint16_t early_offset = sizeof(struct data);
+    static constexpr uint16_t min_data_len = early_offset + sizeof(uint16_t);
+};
+
+class FENRIR_LOCAL Conn0_C_RESUME final : public Conn0
+{
+public:
+    struct data {
+        Fenrir_Version _version; // == 0 on error
+        Conn0_Type _type;
+        Nonce _nonce;
+    };
+    struct data const *const r;
+    struct data *const w;
+    Span_Overlay<uint8_t> _ticket;
+    Span_Overlay<uint8_t> _enc_data;
+
+    Conn0_C_RESUME() = delete;
+    Conn0_C_RESUME (const Conn0_C_RESUME&) = default;
+    Conn0_C_RESUME& operator= (const Conn0_C_RESUME&) = default;
+    Conn0_C_RESUME (Conn0_C_RESUME &&) = default;
+    Conn0_C_RESUME& operator= (Conn0_C_RESUME &&) = default;
+    ~Conn0_C_RESUME() = default;
+    Conn0_C_RESUME (const gsl::span<uint8_t> raw);  // received pkt
+    Conn0_C_RESUME (      gsl::span<uint8_t> raw,   // sent pkt
+                                    const Nonce &nonce, // keys depend on it
+                                    const gsl::span<const uint8_t> ticket,
+                                    const uint16_t enc_data_length);
+
+    static constexpr uint16_t min_size();
+    gsl::span<uint8_t> as_cleartext (const uint16_t crypto_header,
+                                                const uint16_t crypto_footer);
+private:
+    static constexpr uint16_t ticket_offset = sizeof(struct data);
+    static constexpr uint16_t min_data_len = ticket_offset +
+                                                        2 * sizeof(uint16_t);
+};
+
 
 } // namespace Impl
 } // namespace Fenrir__v1
@@ -195,7 +195,8 @@ Conn0_S_COOKIE::Conn0_S_COOKIE (gsl::span<uint8_t> raw,
                             const Crypto::KDF::ID selected_kdf,
                             const int64_t timestamp,
                             const std::vector<Crypto::Auth::ID> &supported_auth,
-                            const uint16_t signature_length)
+                            const uint16_t signature_length,
+                            const uint16_t cookie_length)
     : Conn0 (raw, Conn0_Type::S_COOKIE, Fenrir_Version (1)),
         r (reinterpret_cast<struct data*>(_raw.data())),
         w (reinterpret_cast<struct data*>(_raw.data())),
@@ -208,7 +209,7 @@ Conn0_S_COOKIE::Conn0_S_COOKIE (gsl::span<uint8_t> raw,
                         _raw.subspan (static_cast<ssize_t> (supported_offset
                                                 + _supported_auth.raw_size() +
                                                 _cs_data_signature.raw_size())),
-                                                            signature_length))
+                                                                cookie_length))
 {
     if (_raw.size() < min_data_len || !_supported_auth ||
                                     !_cs_data_signature || !_s_data_signature) {
@@ -400,6 +401,17 @@ gsl::span<const uint8_t> Conn0_S_KEYS::data_tosign() const
                                     _pubkey.raw_size() + _key_data.raw_size()));
 }
 
+std::vector<uint8_t> Conn0_S_KEYS::data_tosign (
+                                const gsl::span<const uint8_t> cs_hash) const
+{
+    const auto tosign = data_tosign();
+    std::vector<uint8_t> ret (static_cast<size_t> (tosign.size() +
+                                                            cs_hash.size()), 0);
+    std::copy (tosign.begin(), tosign.end(), ret.begin());
+    std::copy (cs_hash.begin(), cs_hash.end(), ret.begin() + tosign.size());
+    return ret;
+}
+
 ///////////////
 // Conn0_C_AUTH
 ///////////////
@@ -577,9 +589,13 @@ Conn0_Auth_Result::Conn0_Auth_Result (const gsl::span<uint8_t> raw)
         r (reinterpret_cast<struct data*>(_raw.data())),
         w (reinterpret_cast<struct data*>(_raw.data())),
         _streams (Span_Overlay<stream_info>::mk_overlay (
-                                                _raw.subspan (stream_offset)))
+                                                _raw.subspan (stream_offset))),
+        _ticket (Span_Overlay<uint8_t>::mk_overlay (
+                                        _raw.subspan (static_cast<ssize_t> (
+                                        stream_offset + _streams.raw_size()))))
 {
-    if (_raw.size() < min_data_len || !_streams || r->_conn_id < Conn_Reserved||
+    if (_raw.size() < min_data_len || !_streams || !_ticket ||
+                                                r->_conn_id < Conn_Reserved ||
             static_cast<const uint8_t>(r->_alignment) >
                 static_cast<const uint8_t> (Packet::Alignment_Flag::UINT64)){
         _error = true;
@@ -601,14 +617,20 @@ Conn0_Auth_Result::Conn0_Auth_Result (gsl::span<uint8_t> raw,
                                             const Stream_ID control_stream,
                                             const Packet::Alignment_Flag align,
                                             const uint8_t max_padding,
-                                            const uint16_t streams)
+                                            const uint16_t max_early_data,
+                                            const uint16_t streams,
+                                            const uint16_t ticket_length)
     : _raw (std::move(raw)),
         r (reinterpret_cast<struct data*>(_raw.data())),
         w (reinterpret_cast<struct data*>(_raw.data())),
         _streams (Span_Overlay<stream_info>::mk_overlay (
-                                        _raw.subspan (stream_offset), streams))
+                                        _raw.subspan (stream_offset), streams)),
+        _ticket (Span_Overlay<uint8_t>::mk_overlay (
+                                        _raw.subspan (static_cast<ssize_t> (
+                                        stream_offset + _streams.raw_size())),
+                                                                ticket_length))
 {
-    if (_raw.size() < min_data_len || !_streams) {
+    if (_raw.size() < min_data_len || !_streams || !_ticket) {
         _error = true;
         return;
     }
@@ -617,6 +639,7 @@ Conn0_Auth_Result::Conn0_Auth_Result (gsl::span<uint8_t> raw,
     w->_control_stream = control_stream;
     w->_alignment = align;
     w->_max_padding = max_padding;
+    w->_max_early_data = max_early_data;
     _error = false;
 }
 
@@ -632,8 +655,9 @@ uint16_t Conn0_Auth_Result::stream_info_size (const uint16_t streams)
 /////////////////
 
 
-Conn0_S_RESULT::Conn0_S_RESULT (const gsl::span<uint8_t> raw)
-    : Conn0 (raw, Conn0_Type::S_RESULT, Fenrir_Version (1)),
+Conn0_S_RESULT::Conn0_S_RESULT (const gsl::span<uint8_t> raw,
+                                                        const Conn0_Type type)
+    : Conn0 (raw, type, Fenrir_Version (1)),
         r (reinterpret_cast<struct data*>(_raw.data())),
         w (reinterpret_cast<struct data*>(_raw.data())),
         _enc (Span_Overlay<uint8_t>::mk_overlay (_raw.subspan (enc_offset)))
@@ -645,8 +669,9 @@ Conn0_S_RESULT::Conn0_S_RESULT (const gsl::span<uint8_t> raw)
 }
 
 Conn0_S_RESULT::Conn0_S_RESULT (gsl::span<uint8_t> raw,
-                                                    const uint16_t enc_length)
-    : Conn0 (raw, Conn0_Type::S_RESULT, Fenrir_Version (1)),
+                                                    const uint16_t enc_length,
+                                                    const Conn0_Type type)
+    : Conn0 (raw, type, Fenrir_Version (1)),
         r (reinterpret_cast<struct data*>(_raw.data())),
         w (reinterpret_cast<struct data*>(_raw.data())),
         _enc (Span_Overlay<uint8_t>::mk_overlay (_raw.subspan (enc_offset),
@@ -670,5 +695,112 @@ gsl::span<uint8_t> Conn0_S_RESULT::as_cleartext (const uint16_t crypto_header,
                                             - (crypto_header + crypto_footer));
 }
 
+////////////////////
+// Conn0_Resume_Data
+////////////////////
+
+Conn0_Resume_Data::Conn0_Resume_Data (const gsl::span<uint8_t> raw)
+    : _raw (std::move(raw)),
+        r (reinterpret_cast<struct data*>(_raw.data())),
+        w (reinterpret_cast<struct data*>(_raw.data())),
+        _early_data (Span_Overlay<uint8_t>::mk_overlay (
+                                                _raw.subspan (early_offset)))
+{
+    if (_raw.size() < min_data_len || !_early_data ||
+                                    r->_client_conn_id < Conn_Reserved ||
+            static_cast<const uint8_t>(r->_alignment) >
+                static_cast<const uint8_t> (Packet::Alignment_Flag::UINT64)) {
+        _error = true;
+        return;
+    }
+    _error = false;
+}
+
+Conn0_Resume_Data::Conn0_Resume_Data (gsl::span<uint8_t> raw,
+                                        const Conn_ID client_conn_id,
+                                        const uint8_t padding,
+                                        const Packet::Alignment_Flag alignment,
+                                        const Stream_ID control_stream,
+                                        const Stream_ID early_stream,
+                                        const uint32_t ticket_age,
+                                    const gsl::span<const uint8_t> early_data)
+    : _raw (std::move(raw)),
+        r (reinterpret_cast<struct data*>(_raw.data())),
+        w (reinterpret_cast<struct data*>(_raw.data())),
+        _early_data (Span_Overlay<uint8_t>::mk_overlay (
+                                _raw.subspan (early_offset),
+                                static_cast<uint16_t> (early_data.size())))
+{
+    if (_raw.size() < min_data_len || !_early_data) {
+        _error = true;
+        return;
+    }
+    w->_client_conn_id = client_conn_id;
+    w->_max_padding = padding;
+    w->_alignment = alignment;
+    w->_control_stream = control_stream;
+    w->_early_stream = early_stream;
+    w->_ticket_age = ticket_age;
+    std::copy (early_data.begin(), early_data.end(), _early_data.begin());
+    _error = false;
+}
+
+constexpr uint16_t Conn0_Resume_Data::min_size()
+    { return min_data_len; }
+
+/////////////////
+// Conn0_C_RESUME
+/////////////////
+
+Conn0_C_RESUME::Conn0_C_RESUME (const gsl::span<uint8_t> raw)
+    : Conn0 (raw, Conn0_Type::C_RESUME, Fenrir_Version (1)),
+        r (reinterpret_cast<struct data*>(_raw.data())),
+        w (reinterpret_cast<struct data*>(_raw.data())),
+        _ticket (Span_Overlay<uint8_t>::mk_overlay (
+                                                _raw.subspan (ticket_offset))),
+        _enc_data (Span_Overlay<uint8_t>::mk_overlay (
+                                        _raw.subspan (static_cast<ssize_t> (
+                                        ticket_offset + _ticket.raw_size()))))
+{
+    if (_raw.size() < min_data_len || !_ticket || !_enc_data) {
+        w->_version = Fenrir_Version (0);
+        return;
+    }
+}
+
+Conn0_C_RESUME::Conn0_C_RESUME (gsl::span<uint8_t> raw,
+                                        const Nonce &nonce,
+                                        const gsl::span<const uint8_t> ticket,
+                                        const uint16_t enc_data_length)
+    : Conn0 (raw, Conn0_Type::C_RESUME, Fenrir_Version (1)),
+        r (reinterpret_cast<struct data*>(_raw.data())),
+        w (reinterpret_cast<struct data*>(_raw.data())),
+        _ticket (Span_Overlay<uint8_t>::mk_overlay (
+                                _raw.subspan (ticket_offset),
+                                static_cast<uint16_t> (ticket.size()))),
+        _enc_data (Span_Overlay<uint8_t>::mk_overlay (
+                                        _raw.subspan (static_cast<ssize_t> (
+                                        ticket_offset + _ticket.raw_size())),
+                                                            enc_data_length))
+{
+    if (_raw.size() < min_data_len || !_ticket || !_enc_data) {
+        w->_version = Fenrir_Version (0);
+        return;
+    }
+    w->_nonce = nonce;
+    std::copy (ticket.begin(), ticket.end(), _ticket.begin());
+}
+
+constexpr uint16_t Conn0_C_RESUME::min_size()
+    { return min_data_len; }
+
+gsl::span<uint8_t> Conn0_C_RESUME::as_cleartext (const uint16_t header,
+                                                        const uint16_t footer)
+{
+    if ((header + footer) >= _enc_data.raw_size())
+        return gsl::span<uint8_t>();
+    return _enc_data.subspan (header, _enc_data.size() - (header + footer));
+}
+
 } // namespace Impl
 } // namespace Fenrir__v1
@@ -33,6 +33,8 @@ enum class Conn0_Type : uint8_t {
     S_KEYS = 0x03,      // 3-RTT server keys and selected algorithm
     C_AUTH = 0x04,      // 3-RTT client keys and authentication
     S_RESULT = 0x05,    // 3-RTT authentication result
+    C_RESUME = 0x06,    // 1-RTT resumption ticket, keys and 0-RTT data
+    S_RESUME = 0x07,    // 1-RTT resumption result
 };
 
 } // namespace Impl
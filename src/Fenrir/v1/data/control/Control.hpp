@@ -46,7 +46,9 @@ class FENRIR_LOCAL Base
 public:
     enum class Type : uint8_t {
         LINK_ACTIVATION_SRV = 0x00,  // link activation message: server
-        LINK_ACTIVATION_CLI = 0x01  // link activation message: client
+        LINK_ACTIVATION_CLI = 0x01, // link activation message: client
+        TIMESTAMP           = 0x02, // rtt probe, please echo
+        TIMESTAMP_ECHO      = 0x03  // answer to the rtt probe
     };
 
     // const or not depending on template
@@ -107,6 +109,10 @@ public:
             return Type::LINK_ACTIVATION_SRV;
         case static_cast<uint8_t> (Type::LINK_ACTIVATION_CLI):
             return Type::LINK_ACTIVATION_CLI;
+        case static_cast<uint8_t> (Type::TIMESTAMP):
+            return Type::TIMESTAMP;
+        case static_cast<uint8_t> (Type::TIMESTAMP_ECHO):
+            return Type::TIMESTAMP_ECHO;
         default:
             return type_safe::nullopt;;
         }
@@ -210,6 +216,103 @@ private:
 };
 
 
+///////////////////////
+// Timestamp
+///////////////////////
+
+// sent on the unreliable control stream, together with data.
+// The timestamp is opaque for the receiver, that only has to echo it
+// back as soon as possible, together with the link the probe was sent to.
+template <Access A = Access::READ_ONLY>
+class FENRIR_LOCAL Timestamp final : public Base<A>
+{
+public:
+    struct data {
+        typename Base<A>::Type _type;
+        Link_ID _link_id;       // link the probe was sent to
+        uint64_t _timestamp;    // sender clock, microseconds
+    };
+    struct data const *const r;
+    typename std::conditional_t<A == Access::READ_ONLY,
+                                                struct data const *const,
+                                                struct data *const> w;
+
+    Timestamp() = delete;
+    Timestamp (const Timestamp&) = default;
+    Timestamp& operator= (const Timestamp&) = default;
+    Timestamp (Timestamp &&) = default;
+    Timestamp& operator= (Timestamp &&) = default;
+    ~Timestamp() = default;
+
+    // only enable for READ-ONLY ACCESS
+    template <Access A1 = A,
+        typename std::enable_if_t<A1 == Access::READ_ONLY, uint32_t> = 0>
+    Timestamp (const gsl::span<const uint8_t> raw);  // received pkt
+
+    // only enable for READ-WRITE ACCESS
+    template <Access A1 = A,
+        typename std::enable_if_t<A1 == Access::READ_WRITE, uint32_t> = 0>
+    Timestamp (gsl::span<uint8_t> raw, const Link_ID &link,
+                                                    const uint64_t timestamp);
+
+    explicit operator bool() const;
+
+    static constexpr uint16_t min_size();
+private:
+    static constexpr uint16_t min_data_len = sizeof(struct data);
+};
+
+
+///////////////////////
+// Timestamp_Echo
+///////////////////////
+
+// "_received" is a (wrapping) counter of all the packets of the connection
+// received on the socket the probe arrived on, the probe included:
+// the sender compares it with what it sent to detect losses.
+template <Access A = Access::READ_ONLY>
+class FENRIR_LOCAL Timestamp_Echo final : public Base<A>
+{
+public:
+    struct data {
+        typename Base<A>::Type _type;
+        Link_ID _link_id;       // copied from the probe
+        uint64_t _timestamp;    // copied from the probe
+        uint32_t _delay;        // microseconds we held the probe before echo
+        uint32_t _received;     // packets received on the probe socket
+    };
+    struct data const *const r;
+    typename std::conditional_t<A == Access::READ_ONLY,
+                                                struct data const *const,
+                                                struct data *const> w;
+
+    Timestamp_Echo() = delete;
+    Timestamp_Echo (const Timestamp_Echo&) = default;
+    Timestamp_Echo& operator= (const Timestamp_Echo&) = default;
+    Timestamp_Echo (Timestamp_Echo &&) = default;
+    Timestamp_Echo& operator= (Timestamp_Echo &&) = default;
+    ~Timestamp_Echo() = default;
+
+    // only enable for READ-ONLY ACCESS
+    template <Access A1 = A,
+        typename std::enable_if_t<A1 == Access::READ_ONLY, uint32_t> = 0>
+    Timestamp_Echo (const gsl::span<const uint8_t> raw);  // received pkt
+
+    // only enable for READ-WRITE ACCESS
+    template <Access A1 = A,
+        typename std::enable_if_t<A1 == Access::READ_WRITE, uint32_t> = 0>
+    Timestamp_Echo (gsl::span<uint8_t> raw, const Link_ID &link,
+                                const uint64_t timestamp, const uint32_t delay,
+                                                    const uint32_t received);
+
+    explicit operator bool() const;
+
+    static constexpr uint16_t min_size();
+private:
+    static constexpr uint16_t min_data_len = sizeof(struct data);
+};
+
+
 } // namespace Control
 } // namespace Impl
 } // namespace Fenrir__v1
@@ -120,6 +120,86 @@ FENRIR_INLINE constexpr uint16_t Link_Activation_CLi<A>::min_size()
     { return min_data_len; }
 
 
+///////////////////////
+// Timestamp
+///////////////////////
+
+template <Access A>
+template <Access A1,
+                typename std::enable_if_t<A1 == Access::READ_ONLY, uint32_t>>
+FENRIR_INLINE Timestamp<A>::Timestamp (const gsl::span<const uint8_t> raw)
+    : Base<A> (raw, Base<A>::Type::TIMESTAMP),
+                r (reinterpret_cast<struct data const*>(Base<A>::_raw.data())),
+                w (reinterpret_cast<struct data const*>(Base<A>::_raw.data()))
+{}
+
+template <Access A>
+template <Access A1,
+                typename std::enable_if_t<A1 == Access::READ_WRITE, uint32_t>>
+FENRIR_INLINE Timestamp<A>::Timestamp (gsl::span<uint8_t> raw,
+                                                    const Link_ID &link,
+                                                    const uint64_t timestamp)
+    : Base<A> (raw, Base<A>::Type::TIMESTAMP),
+                    r (reinterpret_cast<struct data*>(Base<A>::_raw.data())),
+                    w (reinterpret_cast<struct data*>(Base<A>::_raw.data()))
+{
+    if (Base<A>::_raw.size() >= min_data_len) {
+        w->_link_id = link;
+        w->_timestamp = timestamp;
+    }
+}
+
+template <Access A>
+FENRIR_INLINE Timestamp<A>::operator bool() const
+    { return Base<A>::_raw.size() >= min_data_len && r->_link_id; }
+
+template <Access A>
+FENRIR_INLINE constexpr uint16_t Timestamp<A>::min_size()
+    { return min_data_len; }
+
+
+///////////////////////
+// Timestamp_Echo
+///////////////////////
+
+template <Access A>
+template <Access A1,
+                typename std::enable_if_t<A1 == Access::READ_ONLY, uint32_t>>
+FENRIR_INLINE Timestamp_Echo<A>::Timestamp_Echo (
+                                            const gsl::span<const uint8_t> raw)
+    : Base<A> (raw, Base<A>::Type::TIMESTAMP_ECHO),
+                r (reinterpret_cast<struct data const*>(Base<A>::_raw.data())),
+                w (reinterpret_cast<struct data const*>(Base<A>::_raw.data()))
+{}
+
+template <Access A>
+template <Access A1,
+                typename std::enable_if_t<A1 == Access::READ_WRITE, uint32_t>>
+FENRIR_INLINE Timestamp_Echo<A>::Timestamp_Echo (gsl::span<uint8_t> raw,
+                                                    const Link_ID &link,
+                                                    const uint64_t timestamp,
+                                                    const uint32_t delay,
+                                                    const uint32_t received)
+    : Base<A> (raw, Base<A>::Type::TIMESTAMP_ECHO),
+                    r (reinterpret_cast<struct data*>(Base<A>::_raw.data())),
+                    w (reinterpret_cast<struct data*>(Base<A>::_raw.data()))
+{
+    if (Base<A>::_raw.size() >= min_data_len) {
+        w->_link_id = link;
+        w->_timestamp = timestamp;
+        w->_delay = delay;
+        w->_received = received;
+    }
+}
+
+template <Access A>
+FENRIR_INLINE Timestamp_Echo<A>::operator bool() const
+    { return Base<A>::_raw.size() >= min_data_len && r->_link_id; }
+
+template <Access A>
+FENRIR_INLINE constexpr uint16_t Timestamp_Echo<A>::min_size()
+    { return min_data_len; }
+
 
 } // namespace Control
 } // namespace Impl
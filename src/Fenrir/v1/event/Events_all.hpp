@@ -136,7 +136,9 @@ enum class Connect_Status : uint8_t {
                                     RESOLV = 0x00,
                                     INIT = 0x01,
                                     DROP = 0x02,
-                                    SUCCESS = 0x03
+                                    SUCCESS = 0x03,
+                                    // timer: ask the next resolver
+                                    RESOLV_NEXT = 0x04
                                     };
 
 class FENRIR_LOCAL Connect : public Timer
@@ -161,8 +163,13 @@ class FENRIR_LOCAL Resolve final : public Connect
 public:
     Impl::Resolve::AS_list _as;
     std::vector<uint8_t> _fqdn;
+    std::vector<uint8_t> _early_data;   // 0-RTT, if we can resume
     Impl::Resolve::Resolver::ID _last_resolver;
     Error _err;
+    bool _refresh;  // only update the resolver cache, do not connect
+    // shared with the queries to the other resolvers
+    std::shared_ptr<Impl::Resolve::Race> _race;
+    uint16_t _resolver_idx;
 
     Resolve() = delete;
     Resolve (const Resolve&) = delete;
@@ -172,7 +179,8 @@ public:
     Resolve (Loop *const loop, std::vector<uint8_t> &&fqdn)
         : Connect (loop, Connect_Status::RESOLV),
             _fqdn (std::forward<std::vector<uint8_t>>(fqdn)),
-            _err (Error::WORKING)
+            _err (Error::WORKING), _refresh (false), _race (nullptr),
+            _resolver_idx (0)
         {}
     ~Resolve()
         {}
@@ -192,7 +200,8 @@ class FENRIR_LOCAL Handshake final : public Timer
 public:
     enum class TYPE : uint8_t {
         SEND = 0x01,
-        TIMEOUT = 0x02
+        TIMEOUT = 0x02,
+        EXPIRE = 0x03   // all the client handshakes, "_id" is not used
     };
 
     Handshake_ID _id;
@@ -258,6 +267,14 @@ public:
         {}
     ~Plugin_IO()
         {}
+    static std::shared_ptr<Plugin_IO> mk_shared (Loop *const loop,
+                                                    std::weak_ptr<Dynamic> plg,
+                                                    int fd, Impl::IO type)
+    {
+        auto ret = std::make_shared<Plugin_IO> (loop, plg, fd, type);
+        ret->_ourselves = ret;
+        return ret;
+    }
 };
 
 class FENRIR_LOCAL User final : public Base
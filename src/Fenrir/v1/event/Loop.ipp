@@ -158,6 +158,7 @@ FENRIR_INLINE void Loop::start (std::shared_ptr<IO> ev)
     FENRIR_UNUSED (loop_lock);
     switch (ev->_type) {
     case Type::READ:
+    case Type::PLUGIN_IO:
         ev->_status = Base::status::STARTED;
         ev_io_start (ev_base, &ev->_io_ev);
         break;
@@ -222,6 +223,7 @@ FENRIR_INLINE void Loop::start (std::shared_ptr<Timer> ev,
                         &std::static_pointer_cast<Plugin_Timer> (ev)->_time_ev);
         break;
     case Type::READ:
+    case Type::PLUGIN_IO:
         assert (false && "Fenrir loop: activated io as timer");
         break;
     }
@@ -257,6 +259,7 @@ FENRIR_INLINE void Loop::update (std::shared_ptr<Base> ev)
                         &std::static_pointer_cast<Plugin_Timer> (ev)->_time_ev);
         break;
     case Type::READ:
+    case Type::PLUGIN_IO:
         assert (false && "Fenrir loop: activated io as timer");
         break;
     }
@@ -279,6 +282,11 @@ FENRIR_INLINE void Loop::deactivate (std::shared_ptr<Base> ev)
         ev_io_stop (ev_base, &std::static_pointer_cast<Read> (ev)->_io_ev);
         ev->_status = Base::status::INITIALIZED;
         break;
+    case Type::PLUGIN_IO:
+        ev_io_stop (ev_base,
+                        &std::static_pointer_cast<Plugin_IO> (ev)->_io_ev);
+        ev->_status = Base::status::INITIALIZED;
+        break;
     case Type::SEND:
         ev_timer_stop (ev_base,&std::static_pointer_cast<Send> (ev)->_time_ev);
         ev->_status = Base::status::INITIALIZED;
@@ -303,8 +311,7 @@ FENRIR_INLINE void Loop::deactivate (std::shared_ptr<Base> ev)
 
 void Loop::del (std::shared_ptr<Base> ev)
 {
-    std::unique_lock<std::mutex> loop_lock (loop_mtx);
-    FENRIR_UNUSED (loop_lock);
+    // "deactivate" takes the loop lock, which is not recursive
     if (ev->_status == Base::status::STARTED)
         deactivate (ev);
 }
@@ -31,10 +31,16 @@ namespace Event {
 // libev event callback for io events
 FENRIR_INLINE void cb_io (struct ev_loop *loop, ev_io *ev,int ev_type)
 {
-    FENRIR_UNUSED (loop);
     FENRIR_UNUSED (ev_type);
     auto shared_ev = static_cast<Base *> (ev->data)->_ourselves;
 
+    // the plugin fds stay readable until the plugin reads them,
+    // and libev would queue them again at each loop.
+    // one shot: the plugin will start them again.
+    if (shared_ev->_type == Type::PLUGIN_IO) {
+        ev_io_stop (loop, ev);
+        shared_ev->_status = Base::status::INITIALIZED;
+    }
     shared_ev->_loop->add_work (std::move(shared_ev));
 }
 
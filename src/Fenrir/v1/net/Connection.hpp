@@ -28,8 +28,15 @@
 #include "Fenrir/v1/data/Storage.hpp"
 #include "Fenrir/v1/data/Username.hpp"
 #include "Fenrir/v1/net/Link.hpp"
+#include "Fenrir/v1/net/Link_Activation.hpp"
+#include "Fenrir/v1/net/Replay_Window.hpp"
 #include "Fenrir/v1/net/Role.hpp"
+#include "Fenrir/v1/net/Security_Pipeline.hpp"
+#include "Fenrir/v1/rate/Token_Bucket.hpp"
 #include "Fenrir/v1/util/Random.hpp"
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <map>
 #include <memory>
 #include <type_safe/strong_typedef.hpp>
@@ -109,11 +116,21 @@ public:
                             const type_safe::optional<Stream_ID> linked_with);
     Error del_stream_out (const Stream_ID id);
     Error del_stream_in  (const Stream_ID id);
-    void recv (Packet &pkt);
+    // "sock": our link that received the packet
+    // can be called by multiple threads: the crypto runs in parallel,
+    // but the packets are delivered to the streams in order of arrival.
+    // false: not authenticated, or replayed. dropped.
+    bool recv (Packet &pkt, const Link_ID sock);
     std::vector<user_data> get_data();
-    // add source and queue activation pkt
-    // returns the activation vector (if the link need sto be activated)
-    std::unique_ptr<Packet> update_source (const Link_ID from);
+    // 0-RTT data of a resumed connection, returned first by get_data()
+    void add_early_data (const Stream_ID id, std::vector<uint8_t> &&data);
+    // refresh the keepalive of a known source.
+    // unknown sources get an activation packet (nullptr: none, or none now),
+    // but no state: the link is added when the peer echoes it.
+    // only after "recv" authenticated the packet.
+    // no activation larger than "max_size": no amplification.
+    std::unique_ptr<Packet> update_source (const Link_ID from,
+                                                        const size_t max_size);
     Error add_Link_in  (const Link_ID id);
     Error add_Link_out (const Link_ID id);
     void missed_keepalive_in (const Link_ID id, const uint8_t max_fail);
@@ -122,8 +139,17 @@ public:
 
     void update_destination (const Link_ID to);
     uint32_t total_overhead() const;
+    // biggest packet we can send from our link "from" to the peer link "to"
+    // 0 if the links are not ours.
     uint32_t mtu (const Link_ID from, const Link_ID to) const;
-    Error add_data (Packet_NN pkt, const uint32_t mtu);
+    // path mtu to the peer link "to", see Rate::PMTU_Discovery
+    void set_mtu (const Link_ID to, const uint16_t mtu);
+    // add the control messages and the stream data.
+    // "timestamp": add a timestamp probe for the link "to"
+    // "mtu_probe": add only the timestamp probe, padded to fill the packet.
+    Error add_data (Packet_NN pkt, const uint32_t mtu, const Link_ID to,
+                const type_safe::optional<std::chrono::microseconds> timestamp,
+                                                        const bool mtu_probe);
     Error add_security (Packet_NN pkt);
 private:
     class FENRIR_LOCAL Stream_Track_In
@@ -167,10 +193,33 @@ private:
     Handler *const _handler;
 
     // TODO: split mutex in multiple shared_locks.
-    std::mutex _mtx;
+    mutable std::mutex _mtx;
     std::vector<std::pair<Stream_ID, Stream_Track_In>>  _streams_in;
     std::vector<std::pair<Stream_ID, Stream_Track_Out>> _streams_out;
     Stream_ID _last_out;
+    std::vector<user_data> _early;
+
+    // timestamp probes received, to be echoed back
+    struct FENRIR_LOCAL Echo
+    {
+        Link_ID _link;
+        uint64_t _timestamp;
+        std::chrono::microseconds _arrival;
+        uint32_t _received;
+    };
+    static constexpr size_t max_echo = 32;
+    std::deque<Echo> _echo;
+    // packets received on each of our links, for the echoes.
+    std::vector<std::pair<Link_ID, uint32_t>> _recv_count;
+    // in-order delivery of the packets decrypted in parallel:
+    // each packet gets a tag when received, and waits in "_recv_reorder"
+    // until all the previous tags have been delivered.
+    // failed packets are kept as nullptr, so that we do not wait for them.
+    static constexpr size_t max_reorder = 64;
+    std::atomic<uint64_t> _recv_tag;
+    uint64_t _recv_next;
+    std::map<uint64_t, std::pair<Link_ID, std::unique_ptr<Packet>>>
+                                                                _recv_reorder;
 
     std::shared_ptr<Crypto::Encryption> _enc_send;
     std::shared_ptr<Crypto::Hmac> _hmac_send;
@@ -179,6 +228,15 @@ private:
     std::shared_ptr<Crypto::Hmac> _hmac_recv;
     std::shared_ptr<Recover::ECC> _ecc_recv;
     std::shared_ptr<Crypto::KDF> _user_kdf;
+    // native plugins only: the packets skip the virtual calls
+    Security_Pipeline::Kind _send_pipeline, _recv_pipeline;
+    Replay_Window _replay;
+    // stateless activation of new source links: the bucket only limits
+    // how many activation packets the whole connection sends.
+    static constexpr uint64_t activation_rate = 8;     // packets per second
+    static constexpr uint64_t activation_burst = 16;
+    Link_Activation _activation;
+    Rate::Token_Bucket _activation_rate;
 
     Connection (const Role role, const User_ID user,
                                 Event::Loop *const loop,
@@ -198,13 +256,30 @@ private:
                                 std::shared_ptr<Crypto::Hmac> hmac_recv,
                                 std::shared_ptr<Recover::ECC> ecc_recv,
                                 std::shared_ptr<Crypto::KDF> user_kdf);
+    // ecc, hmac, decrypt, parse. no locks.
+    bool decode (Packet &pkt);
+    // give the packet data to the streams. "unrel_received": the packet
+    // counter of "sock", if the packet has unreliable control data.
+    // NOTE: call with _mtx locked.
+    void deliver (const Packet &pkt, const Link_ID sock,
+                                bool &rel_control, uint32_t &unrel_received);
     void parse_rel_control();
-    void parse_unrel_control();
-    void parse_control (const std::vector<uint8_t> &data);
+    // "received": packet counter of the link the control data arrived on
+    void parse_unrel_control (const uint32_t received);
+    void parse_control (const std::vector<uint8_t> &data,
+                                                    const uint32_t received);
     void parse_control (const
             Control::Link_Activation_CLi<Control::Access::READ_ONLY> &&data);
     void parse_control (const
             Control::Link_Activation_Srv<Control::Access::READ_ONLY> &&data);
+    void parse_control (const
+            Control::Timestamp<Control::Access::READ_ONLY> &&data,
+                                                    const uint32_t received);
+    void parse_control (const
+            Control::Timestamp_Echo<Control::Access::READ_ONLY> &&data);
+    bool add_control (Packet_NN pkt, const Link_ID to,
+                const type_safe::optional<std::chrono::microseconds> timestamp,
+                                    const bool pad, uint32_t &bytes_left);
 };
 
 } // namespace Impl
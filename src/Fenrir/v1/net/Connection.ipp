@@ -28,6 +28,7 @@
 #include "Fenrir/v1/Handler.hpp"
 #include "Fenrir/v1/net/Connection.hpp"
 #include "Fenrir/v1/net/Link.hpp"
+#include "Fenrir/v1/rate/Token_Bucket.hpp"
 #include "Fenrir/v1/util/math.hpp"
 #include <algorithm>
 #include <limits>
@@ -100,13 +101,20 @@ FENRIR_INLINE Connection::Connection (const Role role, const User_ID user,
                             _max_read_padding (max_read_padding),
                             _max_write_padding (max_write_padding),
                             _role (role), _loop (loop), _handler (handler),
+                            _recv_tag (0), _recv_next (0),
                             _enc_send (std::move(enc_send)),
                             _hmac_send (std::move(hmac_send)),
                             _ecc_send (std::move(ecc_send)),
                             _enc_recv (std::move(enc_recv)),
                             _hmac_recv (std::move(hmac_recv)),
                             _ecc_recv (std::move(ecc_recv)),
-                            _user_kdf (std::move(user_kdf))
+                            _user_kdf (std::move(user_kdf)),
+                            _send_pipeline (Security_Pipeline::select (
+                                    *_enc_send, *_hmac_send, *_ecc_send)),
+                            _recv_pipeline (Security_Pipeline::select (
+                                    *_enc_recv, *_hmac_recv, *_ecc_recv)),
+                            _activation_rate (activation_rate,
+                                                            activation_burst)
 {
     _max_write_padding = 8;
     auto rel_st_in = std::make_shared<Storage_Raw> ();
@@ -183,7 +191,6 @@ FENRIR_INLINE std::pair<Impl::Error, Stream_ID> Connection::add_stream_out (
             const Storage_t s, const type_safe::optional<Stream_ID> linked_with)
 {
     std::unique_lock<std::mutex> lock (_mtx);
-    FENRIR_UNUSED (lock);
 
     if (_streams_out.size() == (pow (2, 16) - 1))
         return {Impl::Error::FULL, Stream_ID{0}};
@@ -216,6 +223,9 @@ FENRIR_INLINE std::pair<Impl::Error, Stream_ID> Connection::add_stream_out (
                                                             std::move (str)));
         break;
     }
+    lock.unlock();
+    // the rate plugin might have parked us for lack of data
+    _handler->proxy_wakeup (_read_connection_id);
     return {Impl::Error::NONE, id};
 }
 
@@ -286,28 +296,129 @@ FENRIR_INLINE Impl::Error Connection::del_stream_in (const Stream_ID id)
     return Error::NONE;
 }
 
-FENRIR_INLINE void Connection::recv (Packet &pkt)
+FENRIR_INLINE bool Connection::recv (Packet &pkt, const Link_ID sock)
+{
+    // tag the packet in the order we read it, then decrypt it.
+    // With parallel crypto we decrypt without locking: if the previous
+    // packets are still being decrypted by other threads, leave this one
+    // to them.
+    const bool parallel = _handler->proxy_parallel_crypto();
+    std::unique_lock<std::mutex> lock (_mtx, std::defer_lock);
+    if (!parallel)
+        lock.lock();
+    const uint64_t tag = _recv_tag.fetch_add (1, std::memory_order_relaxed);
+    const bool decoded = decode (pkt);
+
+    bool rel_control = false;
+    // the counter of the packet with the Timestamp, not of the last one
+    // delivered: they differ when the reorder buffer is flushed. 0: none
+    uint32_t unrel_received = 0;
+    if (parallel)
+        lock.lock();
+    if (tag > _recv_next) {
+        if (_recv_reorder.size() < max_reorder) {
+            std::unique_ptr<Packet> wait (nullptr);
+            if (decoded)
+                wait = std::make_unique<Packet> (std::move(pkt));
+            _recv_reorder.emplace (tag, std::make_pair (sock,std::move(wait)));
+            return decoded;
+        }
+        // too many waiting: stop waiting for the missing packets.
+        // they will be delivered as soon as they arrive.
+        for (const auto &waiting : _recv_reorder) {
+            const auto &wait_pkt = std::get<std::unique_ptr<Packet>> (
+                                                        std::get<1> (waiting));
+            if (wait_pkt != nullptr) {
+                deliver (*wait_pkt, std::get<Link_ID> (std::get<1> (waiting)),
+                                                rel_control, unrel_received);
+            }
+        }
+        _recv_reorder.clear();
+        _recv_next = tag;
+    }
+    if (decoded)
+        deliver (pkt, sock, rel_control, unrel_received);
+    if (tag == _recv_next) {
+        ++_recv_next;
+        auto next = _recv_reorder.begin();
+        while (next != _recv_reorder.end() && next->first == _recv_next) {
+            const auto &wait_pkt = std::get<std::unique_ptr<Packet>> (
+                                                                next->second);
+            if (wait_pkt != nullptr) {
+                deliver (*wait_pkt, std::get<Link_ID> (next->second),
+                                                rel_control, unrel_received);
+            }
+            next = _recv_reorder.erase (next);
+            ++_recv_next;
+        }
+    }
+    lock.unlock();
+    // the control message handlers lock by themselves
+    if (rel_control)
+        parse_rel_control();
+    if (unrel_received != 0)
+        parse_unrel_control (unrel_received);
+    return decoded;
+}
+
+FENRIR_INLINE bool Connection::decode (Packet &pkt)
 {
     gsl::span<uint8_t> raw_pkt;
-    if (_ecc_recv->correct (pkt.data_no_id(), raw_pkt)
-                                                == Recover::ECC::Result::ERR) {
-        return;
+    bool ok = false;
+    switch (_recv_pipeline) {
+    case Security_Pipeline::Kind::NULL_ALL:
+        ok = Security_Pipeline::open<Crypto::Crypto_NULL, Crypto::Hmac_NULL,
+                                    Recover::ECC_NULL> (_enc_recv.get(),
+                                        _hmac_recv.get(), _ecc_recv.get(),
+                                        _replay, pkt.data_no_id(), raw_pkt);
+        break;
+    case Security_Pipeline::Kind::CHACHA20:
+        ok = Security_Pipeline::open<Crypto::ChaCha20_Poly1305_IETF,
+                                    Crypto::Hmac_NULL,
+                                    Recover::ECC_NULL> (_enc_recv.get(),
+                                        _hmac_recv.get(), _ecc_recv.get(),
+                                        _replay, pkt.data_no_id(), raw_pkt);
+        break;
+    case Security_Pipeline::Kind::AES256_GCM:
+        ok = Security_Pipeline::open<Crypto::AES256_GCM, Crypto::Hmac_NULL,
+                                    Recover::ECC_NULL> (_enc_recv.get(),
+                                        _hmac_recv.get(), _ecc_recv.get(),
+                                        _replay, pkt.data_no_id(), raw_pkt);
+        break;
+    case Security_Pipeline::Kind::DYNAMIC:
+        ok = Security_Pipeline::open<Crypto::Encryption, Crypto::Hmac,
+                                    Recover::ECC> (_enc_recv.get(),
+                                        _hmac_recv.get(), _ecc_recv.get(),
+                                        _replay, pkt.data_no_id(), raw_pkt);
+        break;
     }
-    if (!_hmac_recv->is_valid (raw_pkt, raw_pkt))
-        return;
-    if (_enc_recv->decrypt (raw_pkt, raw_pkt) != Error::NONE)
-        return;
+    if (!ok)
+        return false;
     if (pkt.parse (raw_pkt, _read_al) != Error::NONE) {
         // Error::WRONG_INPUT;
-        return;
+        return false;
     }
-    std::unique_lock<std::mutex> lock (_mtx);
-    FENRIR_UNUSED (lock);
+    return true;
+}
+
+FENRIR_INLINE void Connection::deliver (const Packet &pkt,
+                                                    const Link_ID sock,
+                                                    bool &rel_control,
+                                                    uint32_t &unrel_received)
+{
+    auto count = std::find_if (_recv_count.begin(), _recv_count.end(),
+                                [sock] (const auto &it)
+                                    { return std::get<Link_ID> (it) == sock; });
+    if (count == _recv_count.end()) {
+        _recv_count.emplace_back (sock, 0);
+        count = _recv_count.end() - 1;
+    }
+    const uint32_t received = ++std::get<uint32_t> (*count);
 
     for (const auto &stream : pkt.stream) {
         auto in = std::lower_bound (_streams_in.begin(), _streams_in.end(),
                         stream.id(), [] (const auto &it, const Stream_ID tmp_id)
-                                { return std::get<Stream_ID> (it) == tmp_id; });
+                                { return std::get<Stream_ID> (it) < tmp_id; });
         if (in == _streams_in.end() ||
                                     std::get<Stream_ID> (*in) != stream.id()) {
             continue; // ignore unknown streams
@@ -317,12 +428,11 @@ FENRIR_INLINE void Connection::recv (Packet &pkt)
                                                             stream.data(),
                                                             stream.type());
         if (stream.id() == _rel_read_control_stream) {
-            parse_rel_control();
-        } else if (stream.id() == _rel_read_control_stream) {
-            parse_unrel_control();
+            rel_control = true;
+        } else if (stream.id() == _unrel_read_control_stream) {
+            unrel_received = received;
         }
     }
-
 }
 
 FENRIR_INLINE std::vector<user_data> Connection::get_data()
@@ -331,7 +441,8 @@ FENRIR_INLINE std::vector<user_data> Connection::get_data()
     FENRIR_UNUSED (lock);
 
     // get all possible data from all possible streams.
-    std::vector<user_data> ret;
+    std::vector<user_data> ret = std::move (_early);
+    _early.clear();
     for (auto &stream_it : _streams_in) {
         user_data::data data;
         std::vector<user_data::data> ret_stream;
@@ -349,8 +460,19 @@ FENRIR_INLINE std::vector<user_data> Connection::get_data()
     return ret;
 }
 
+FENRIR_INLINE void Connection::add_early_data (const Stream_ID id,
+                                                std::vector<uint8_t> &&data)
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    std::vector<user_data::data> msg;
+    msg.emplace_back (Counter {0}, Stream::Fragment::FULL, std::move(data));
+    _early.emplace_back (id, std::move(msg));
+}
+
 FENRIR_INLINE std::unique_ptr<Packet> Connection::update_source (
-                                                            const Link_ID from)
+                                                        const Link_ID from,
+                                                        const size_t max_size)
 {
     std::lock_guard<std::mutex> lock (_mtx);
     FENRIR_UNUSED (lock);
@@ -362,22 +484,26 @@ FENRIR_INLINE std::unique_ptr<Packet> Connection::update_source (
     if (link != _incoming.rend()) {
         link->keepalive (_loop);
         link->_keepalive_failed = 0;
-        // FIXME: check if this link still has to be activated. then re-send
-        // activation pkt. But not at every packet. ... WHEN?
-        // right now if the activation pkt is missing
         return nullptr;
     }
-    auto keepal = Event::Keepalive::mk_shared (_loop, _ourselves, from,
-                                                        Direction::INCOMING);
-    _loop->start (keepal, Link::keepalive_timeout, Event::Repeat::YES);
-
-    _incoming.emplace_back (from, &_rnd, keepal);
-
-    // build the activation packet.
+    // unknown source: no link, no timer, only a token (see Link_Activation)
+    // the packet is authentic, but anyone on the path can send a copy
+    // from another address before the original arrives: limit the answers
+    // of the whole connection.
+    // a lost activation is not a problem: the next packets get a new one.
     const uint16_t msg_size = static_cast<uint16_t> (
                                     Control::Link_Activation_Srv<>::min_size() +
-                                        _incoming.rbegin()->_activation.size());
+                                                Link_Activation::token_bytes);
     const size_t total_size = PKT_MINLEN + msg_size + total_overhead();
+    // too small to answer: keep the token, the counter and the nonce
+    // for a packet we can answer.
+    if (total_size > max_size)
+        return nullptr;
+    const auto now = Rate::usec_now();
+    if (!_activation_rate.consume (1, now))
+        return nullptr;
+
+    // build the activation packet.
     auto activation_pkt = std::make_unique<Packet> (
                                         std::vector<uint8_t> (total_size, 0));
     // HACK: using the random header to offset stream (later overwritten)
@@ -389,11 +515,7 @@ FENRIR_INLINE std::unique_ptr<Packet> Connection::update_source (
                                                     _hmac_send->bytes_header() +
                                                     _ecc_send->bytes_header()),
                                                                         &_rnd);
-    // use reserve_data (size) on the unrel_control_stream
-    // TODO: we should be able to do this stateless. easy enough:
-    // LINK_ID + timestamp encrypted/authenticated. (over the existing
-    // connection)
-    // TODO: also: choose between "manual" and automatic confirmation
+    // TODO: choose between "manual" and automatic confirmation
     //   meaning: automatic sends an activation for each non-active link,
     //   and manual requires you to request the activaton pkt.
     const Stream_ID unrel_str = _unrel_write_control_stream;
@@ -405,11 +527,19 @@ FENRIR_INLINE std::unique_ptr<Packet> Connection::update_source (
                                             reserve_data (unrel_str, msg_size);
     auto msg = activation_pkt->add_stream (unrel_str, Stream::Fragment::FULL,
                                                                 ctr, msg_size);
+    // the token length goes in front of the token, the overlay reads it.
+    const uint16_t token_len = h_to_l<uint16_t> (
+                        static_cast<uint16_t> (Link_Activation::token_bytes));
+    const size_t len_offset = Control::Link_Activation_Srv<>::min_size() -
+                                                            sizeof(uint16_t);
+    memcpy (msg->data().data() + len_offset, &token_len, sizeof(token_len));
     Control::Link_Activation_Srv<Control::Access::READ_WRITE> activate_msg (
                                                             msg->data(), from);
-    std::copy (activate_msg._activation.begin(),
-                                    activate_msg._activation.end(),
-                                    _incoming.rbegin()->_activation.begin());
+    if (!activate_msg)
+        return nullptr;
+    _activation.token (from, std::chrono::duration_cast<
+                                    std::chrono::milliseconds> (now).count(),
+                                                    activate_msg._activation);
 
     activation_pkt->set_header (_write_connection_id, 0, &_rnd);
     // FIXME: wrong start/end of encrypt section
@@ -450,41 +580,48 @@ FENRIR_INLINE void Connection::update_destination (const Link_ID to)
 
 FENRIR_INLINE Error Connection::add_Link_in (const Link_ID id)
 {
-    auto keepal = Event::Keepalive::mk_shared (_loop, _ourselves, id,
-                                                        Direction::INCOMING);
     auto def_param = _handler->proxy_def_link_params();
-    std::lock_guard<std::mutex> lock (_mtx);
-    FENRIR_UNUSED (lock);
+    std::unique_lock<std::mutex> lock (_mtx);
 
+    // already active. do not even create the event: it would never be freed
+    auto link = std::find_if (_incoming.begin(), _incoming.end(),
+                                            [id] (const Link &l)
+                                                { return id == l._link; });
+    if (link != _incoming.end())
+        return Error::NONE;
+    auto keepal = Event::Keepalive::mk_shared (_loop, _ourselves, id,
+                                                        Direction::INCOMING);
     _loop->start (keepal, Link::keepalive_timeout, Event::Repeat::YES);
 
     _incoming.emplace_back (id, keepal, def_param.mtu(),
                                                     def_param.init_window());
-
+    lock.unlock();
+    _handler->proxy_add_link (_read_connection_id, id, Direction::INCOMING);
     return Error::NONE;
 }
 
 FENRIR_INLINE Error Connection::add_Link_out (const Link_ID id)
 {
     auto keepal = Event::Keepalive::mk_shared (_loop, _ourselves, id,
-                                                        Direction::INCOMING);
+                                                        Direction::OUTGOING);
     auto def_param = _handler->proxy_def_link_params();
-    std::lock_guard<std::mutex> lock (_mtx);
-    FENRIR_UNUSED (lock);
+    // our links are limited by the interface mtu
+    auto sock = _handler->get_socket (id);
+    const uint16_t mtu = sock == nullptr ? def_param.mtu() : sock->mtu();
+    std::unique_lock<std::mutex> lock (_mtx);
 
     _loop->start (keepal, Link::keepalive_timeout, Event::Repeat::YES);
 
-    _outgoing.emplace_back (id, keepal, def_param.mtu(),
-                                                    def_param.init_window());
+    _outgoing.emplace_back (id, keepal, mtu, def_param.init_window());
+    lock.unlock();
+    _handler->proxy_add_link (_read_connection_id, id, Direction::OUTGOING);
     return Error::NONE;
-
 }
 
 FENRIR_INLINE void Connection::missed_keepalive_in (const Link_ID id,
                                                         const uint8_t max_fail)
 {
-    std::lock_guard<std::mutex> lock (_mtx);
-    FENRIR_UNUSED (lock);
+    std::unique_lock<std::mutex> lock (_mtx);
 
     auto link = std::find_if (_incoming.begin(), _incoming.end(),
                                             [id] (const Link &l)
@@ -502,6 +639,8 @@ FENRIR_INLINE void Connection::missed_keepalive_in (const Link_ID id,
     // we got over the max keepalive failed. drop this Link, it is not active
     // anymore.
     _incoming.erase (link);
+    lock.unlock();
+    _handler->proxy_del_link (_read_connection_id, id, Direction::INCOMING);
 
     // FIXME : when do we delete the connection?
     // should we put a timeout on activating the links?
@@ -557,22 +696,39 @@ FENRIR_INLINE uint32_t Connection::total_overhead() const
 FENRIR_INLINE uint32_t Connection::mtu (const Link_ID from, const Link_ID to)
                                                                         const
 {
-    auto from_it = std::lower_bound (_incoming.begin(), _incoming.end(), from,
-                                        [] (const auto &link, const Link_ID id)
-                                            { return link._link < id; });
-    if (from_it->_link != from)
+    std::lock_guard<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    // the links are not ordered
+    auto from_it = std::find_if (_outgoing.begin(), _outgoing.end(),
+                                            [from] (const Link &l)
+                                                { return from == l._link; });
+    if (from_it == _outgoing.end())
         return 0;
-    auto to_it = std::lower_bound (_outgoing.begin(), _outgoing.end(), to,
-                                        [] (const auto &link, const Link_ID id)
-                                            { return link._link < id; });
-    if (to_it->_link != from)
+    auto to_it = std::find_if (_incoming.begin(), _incoming.end(),
+                                            [to] (const Link &l)
+                                                { return to == l._link; });
+    if (to_it == _incoming.end())
         return 0;
     return std::min (from_it->_mtu, to_it->_mtu);
 }
 
-FENRIR_INLINE Error Connection::add_data (Packet_NN pkt, const uint32_t mtu)
+FENRIR_INLINE void Connection::set_mtu (const Link_ID to, const uint16_t mtu)
+{
+    std::lock_guard<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    auto to_it = std::find_if (_incoming.begin(), _incoming.end(),
+                                            [to] (const Link &l)
+                                                { return to == l._link; });
+    if (to_it != _incoming.end())
+        to_it->_mtu = mtu;
+}
+
+FENRIR_INLINE Error Connection::add_data (Packet_NN pkt, const uint32_t mtu,
+                const Link_ID to,
+                const type_safe::optional<std::chrono::microseconds> timestamp,
+                                                        const bool mtu_probe)
 {
-    // Add data to packet. Select streams in Round Robin.
+    // Add control messages, then data to packet. Select streams in Round Robin.
     // TODO: make this a plugin for easier experimentation.
 
     // set the packet data to start after padding + encryption overhead
@@ -586,9 +742,20 @@ FENRIR_INLINE Error Connection::add_data (Packet_NN pkt, const uint32_t mtu)
                                                                         &_rnd);
 
     std::unique_lock<std::mutex> lock (_mtx);
-    auto bytes_left = mtu - (_enc_send->bytes_overhead() +
+    uint32_t bytes_left = mtu - (_enc_send->bytes_overhead() +
                                                 _hmac_send->bytes_overhead() +
                                                 _ecc_send->bytes_overhead());
+    // control messages first: they are small and time sensitive
+    bool added = add_control (pkt, to, timestamp, mtu_probe, bytes_left);
+    if (mtu_probe) {
+        // the probe might be lost because it is too big: no data here.
+        lock.unlock();
+        if (!added)
+            return Impl::Error::EMPTY;
+        pkt.modify().get()->set_header (_write_connection_id, pad, &_rnd);
+        return Impl::Error::NONE;
+    }
+
     // get first stream after "_last_out"
     auto it = std::lower_bound (_streams_out.begin(), _streams_out.end(),
                             _last_out,
@@ -597,7 +764,7 @@ FENRIR_INLINE Error Connection::add_data (Packet_NN pkt, const uint32_t mtu)
     if (it == _streams_out.end()) {
         it = _streams_out.begin();
         if (it == _streams_out.end())
-            return Impl::Error::EMPTY;
+            return added ? Impl::Error::NONE : Impl::Error::EMPTY;
     } else if (std::get<Stream_ID> (*it) == _last_out) {
         ++it;
         if (it == _streams_out.end())
@@ -625,6 +792,7 @@ FENRIR_INLINE Error Connection::add_data (Packet_NN pkt, const uint32_t mtu)
                             std::get<std::vector<uint8_t>> (to_add).begin());
             bytes_left -= size;
             _last_out = std::get<Stream_ID> (*it);
+            added = true;
         } else {
             bytes_left += STREAM_MINLEN;
         }
@@ -633,29 +801,112 @@ FENRIR_INLINE Error Connection::add_data (Packet_NN pkt, const uint32_t mtu)
             it = _streams_out.begin();
     }
     lock.unlock();
+    if (!added)
+        return Impl::Error::EMPTY;
     // set the correct padding
     pkt.modify().get()->set_header (_write_connection_id, pad, &_rnd);
     return Impl::Error::NONE;
 }
 
+// NOTE: call with _mtx locked
+// "pad": the timestamp probe fills the packet (path mtu discovery).
+FENRIR_INLINE bool Connection::add_control (Packet_NN pkt, const Link_ID to,
+                const type_safe::optional<std::chrono::microseconds> timestamp,
+                                    const bool pad, uint32_t &bytes_left)
+{
+    using Probe = Control::Timestamp<Control::Access::READ_WRITE>;
+    using Echo_Msg = Control::Timestamp_Echo<Control::Access::READ_WRITE>;
+
+    if (!timestamp.has_value() && _echo.size() == 0)
+        return false;
+    const Stream_ID unrel_str = _unrel_write_control_stream;
+    auto unrel_stream = std::find_if (_streams_out.begin(), _streams_out.end(),
+                        [unrel_str] (const auto &st)
+                            { return unrel_str == std::get<Stream_ID> (st); });
+    if (unrel_stream == _streams_out.end())
+        return false;
+    auto &storage = std::get<Stream_Track_Out> (*unrel_stream)._sent;
+
+    bool added = false;
+    if (timestamp.has_value() &&
+                            bytes_left >= STREAM_MINLEN + Probe::min_size()) {
+        // the receiver ignores the bytes after the probe
+        uint16_t size = Probe::min_size();
+        if (pad) {
+            size = static_cast<uint16_t> (std::min<uint32_t> (
+                                    bytes_left - STREAM_MINLEN,
+                                    std::numeric_limits<uint16_t>::max()));
+        }
+        const Counter ctr = storage->reserve_data (unrel_str, size);
+        auto msg = pkt.modify().get()->add_stream (unrel_str,
+                                                    Stream::Fragment::FULL,
+                                                    ctr, size);
+        if (msg != nullptr) {
+            Probe probe (msg->data(), to,
+                        static_cast<uint64_t> (timestamp.value().count()));
+            FENRIR_UNUSED (probe);
+            bytes_left -= STREAM_MINLEN + size;
+            added = true;
+        }
+    }
+    if (pad)
+        return added;
+    // echo all the probes we can, the peer uses the missing ones
+    // to detect losses.
+    const auto now = Rate::usec_now();
+    while (_echo.size() > 0 &&
+                        bytes_left >= STREAM_MINLEN + Echo_Msg::min_size()) {
+        const auto &to_echo = _echo.front();
+        const Counter ctr = storage->reserve_data (unrel_str,
+                                                        Echo_Msg::min_size());
+        auto msg = pkt.modify().get()->add_stream (unrel_str,
+                                                    Stream::Fragment::FULL,
+                                                    ctr, Echo_Msg::min_size());
+        if (msg == nullptr)
+            break;
+        const uint32_t delay = static_cast<uint32_t> (std::min<int64_t> (
+                                        (now - to_echo._arrival).count(),
+                                        std::numeric_limits<uint32_t>::max()));
+        Echo_Msg echo (msg->data(), to_echo._link, to_echo._timestamp, delay,
+                                                        to_echo._received);
+        FENRIR_UNUSED (echo);
+        _echo.pop_front();
+        bytes_left -= STREAM_MINLEN + Echo_Msg::min_size();
+        added = true;
+    }
+    return added;
+}
+
 FENRIR_INLINE Error Connection::add_security (Packet_NN pkt)
 {
-    uint8_t *start = pkt.modify().get()->raw.data() + sizeof(Conn_ID);
-    uint8_t *end = start + pkt.modify().get()->raw.size();
-    auto enc_span = gsl::span<uint8_t> (start, end);
+    std::vector<uint8_t> &raw = pkt.modify().get()->raw;
     // FIXME: wrong start/end of encrypt/hmac section
-    auto err = _enc_send->encrypt (enc_span);
-    if (err != Impl::Error::NONE)
-        return err;
-    gsl::span<uint8_t> span (pkt.modify().get()->raw.data(),
-                        static_cast<ssize_t> (pkt.modify().get()->raw.size()));
-    err = _hmac_send->add_hmac (span);
-    if (err != Impl::Error::NONE)
-        return err;
-    err = _ecc_send->add_ecc (pkt.modify().get()->raw);
-    if (err != Impl::Error::NONE)
-        return err;
-    return Error::WRONG_INPUT;
+    auto enc_span = gsl::span<uint8_t> (raw.data() + sizeof(Conn_ID),
+                                                    raw.data() + raw.size());
+    switch (_send_pipeline) {
+    case Security_Pipeline::Kind::NULL_ALL:
+        return Security_Pipeline::seal<Crypto::Crypto_NULL, Crypto::Hmac_NULL,
+                                    Recover::ECC_NULL> (_enc_send.get(),
+                                        _hmac_send.get(), _ecc_send.get(),
+                                                            enc_span, raw);
+    case Security_Pipeline::Kind::CHACHA20:
+        return Security_Pipeline::seal<Crypto::ChaCha20_Poly1305_IETF,
+                                    Crypto::Hmac_NULL,
+                                    Recover::ECC_NULL> (_enc_send.get(),
+                                        _hmac_send.get(), _ecc_send.get(),
+                                                            enc_span, raw);
+    case Security_Pipeline::Kind::AES256_GCM:
+        return Security_Pipeline::seal<Crypto::AES256_GCM, Crypto::Hmac_NULL,
+                                    Recover::ECC_NULL> (_enc_send.get(),
+                                        _hmac_send.get(), _ecc_send.get(),
+                                                            enc_span, raw);
+    case Security_Pipeline::Kind::DYNAMIC:
+        break;
+    }
+    return Security_Pipeline::seal<Crypto::Encryption, Crypto::Hmac,
+                                    Recover::ECC> (_enc_send.get(),
+                                        _hmac_send.get(), _ecc_send.get(),
+                                                            enc_span, raw);
 }
 
 } // namespace Impl
@@ -23,6 +23,9 @@
 #include "Fenrir/v1/common.hpp"
 #include "Fenrir/v1/data/control/Control.ipp"
 #include "Fenrir/v1/net/Connection.hpp"
+#include "Fenrir/v1/rate/Token_Bucket.hpp"
+#include <algorithm>
+#include <limits>
 
 namespace Fenrir__v1 {
 namespace Impl {
@@ -41,12 +44,14 @@ FENRIR_INLINE void Connection::parse_rel_control()
     do {
         data = std::get<Stream_Track_In> (*rel_it)._received->get_user_data (
                                                     _rel_read_control_stream);
+        // timestamps only come on the unreliable stream
         if (std::get<std::vector<uint8_t>> (data).size() > 0)
-            parse_control (std::move (std::get<std::vector<uint8_t>> (data)));
+            parse_control (std::move (std::get<std::vector<uint8_t>> (data)),
+                                                                            0);
     } while (std::get<std::vector<uint8_t>> (data).size() > 0);
 }
 
-FENRIR_INLINE void Connection::parse_unrel_control()
+FENRIR_INLINE void Connection::parse_unrel_control (const uint32_t received)
 {
     auto unrel_it = std::lower_bound (_streams_in.begin(), _streams_in.end(),
                                     _unrel_read_control_stream,
@@ -60,11 +65,13 @@ FENRIR_INLINE void Connection::parse_unrel_control()
         data = std::get<Stream_Track_In> (*unrel_it)._received->get_user_data (
                                                     _unrel_read_control_stream);
         if (std::get<std::vector<uint8_t>> (data).size() > 0)
-            parse_control (std::move (std::get<std::vector<uint8_t>> (data)));
+            parse_control (std::move (std::get<std::vector<uint8_t>> (data)),
+                                                                    received);
     } while (std::get<std::vector<uint8_t>> (data).size() > 0);
 
 }
-FENRIR_INLINE void Connection::parse_control (const std::vector<uint8_t> &data)
+FENRIR_INLINE void Connection::parse_control (const std::vector<uint8_t> &data,
+                                                    const uint32_t received)
 {
     assert (data.size() > 0 && "Fenrir:Wrog call parameter - parse_control");
 
@@ -84,6 +91,14 @@ FENRIR_INLINE void Connection::parse_control (const std::vector<uint8_t> &data)
         parse_control (Control::Link_Activation_Srv<Control::Access::READ_ONLY>
                                                                 {data_span});
         return; // NOTE the Control:: classes use references to out "data"
+    case Control::Base<>::Type::TIMESTAMP:
+        parse_control (Control::Timestamp<Control::Access::READ_ONLY>
+                                                    {data_span}, received);
+        return; // NOTE the Control:: classes use references to out "data"
+    case Control::Base<>::Type::TIMESTAMP_ECHO:
+        parse_control (Control::Timestamp_Echo<Control::Access::READ_ONLY>
+                                                                {data_span});
+        return; // NOTE the Control:: classes use references to out "data"
     }
 
     assert (false && "Fenrir: nonexaustive switch: parse_control");
@@ -92,30 +107,21 @@ FENRIR_INLINE void Connection::parse_control (const std::vector<uint8_t> &data)
 void Connection::parse_control (const Control::Link_Activation_CLi<
                                             Control::Access::READ_ONLY> &&data)
 {
-    std::unique_lock<std::mutex> lock (_mtx);
-    FENRIR_UNUSED (lock);
-    auto lnk_it = std::lower_bound (_incoming.begin(), _incoming.end(),
-                                                data.r->_link_id,
-                                                [] (const auto &it, Link_ID lnk)
-                                                    { return it._link < lnk; });
-    if (lnk_it == _incoming.end() || lnk_it->_link != data.r->_link_id)
-        return;
-    if (lnk_it->_activation.size() == 0)
+    if (!data)
         return;
-    if (memcmp (lnk_it->_activation.data(), data._activation.data(),
-                                            lnk_it->_activation.size()) != 0) {
+    const auto now = std::chrono::duration_cast<std::chrono::milliseconds> (
+                                                    Rate::usec_now()).count();
+    // the token is all we need: we kept nothing for this link.
+    if (!_activation.check (data.r->_link_id, data._activation, now))
         return;
-    }
-    lnk_it->_activation = std::vector<uint8_t>();
-    lnk_it->keepalive (_loop);
-    add_Link_in (lnk_it->_link);
+    // echoed twice, or replayed: add_Link_in ignores the active links.
+    add_Link_in (data.r->_link_id);
 }
 
 void Connection::parse_control (const Control::Link_Activation_Srv<
                                             Control::Access::READ_ONLY> &&data)
 {
     std::unique_lock<std::mutex> lock (_mtx);
-    FENRIR_UNUSED (lock);
     auto rel_it = std::lower_bound (_streams_in.begin(), _streams_in.end(),
                                     _rel_read_control_stream,
                                     [] (const auto &it, Stream_ID _rel)
@@ -131,9 +137,58 @@ void Connection::parse_control (const Control::Link_Activation_Srv<
 
     std::get<Stream_Track_In> (*rel_it)._received->add_data (
                                         _rel_read_control_stream, answer._raw);
+    lock.unlock();
+    // the answer waits in the control stream: we might be parked.
+    _handler->proxy_wakeup (_read_connection_id);
+}
+
+
+void Connection::parse_control (const Control::Timestamp<
+                                            Control::Access::READ_ONLY> &&data,
+                                                    const uint32_t received)
+{
+    if (!data)
+        return;
+    std::unique_lock<std::mutex> lock (_mtx);
+    // too many probes, and we can not send: the oldest are lost anyway.
+    if (_echo.size() >= max_echo)
+        _echo.pop_front();
+    _echo.push_back ({data.r->_link_id, data.r->_timestamp,
+                                                Rate::usec_now(), received});
+    lock.unlock();
+    // echo as soon as possible, even if we have no data.
+    _handler->proxy_wakeup (_read_connection_id);
 }
 
+void Connection::parse_control (const Control::Timestamp_Echo<
+                                            Control::Access::READ_ONLY> &&data)
+{
+    if (!data)
+        return;
+    const auto now = Rate::usec_now();
+    const std::chrono::microseconds timestamp (
+                                static_cast<int64_t> (data.r->_timestamp));
+    const std::chrono::microseconds delay (data.r->_delay);
+    const Link_ID to = data.r->_link_id;
+    if (now <= timestamp + delay)
+        return; // not our timestamp
 
+    {
+        std::unique_lock<std::mutex> lock (_mtx);
+        FENRIR_UNUSED (lock);
+        auto link = std::find_if (_incoming.begin(), _incoming.end(),
+                                            [to] (const Link &l)
+                                                { return to == l._link; });
+        if (link != _incoming.end()) {
+            const auto rtt = now - timestamp - delay;
+            link->_rtt = Link::smallmicro (static_cast<uint32_t> (
+                                std::min<int64_t> (rtt.count(),
+                                    std::numeric_limits<uint32_t>::max())));
+        }
+    }
+    _handler->proxy_timestamp_echo (_read_connection_id, to, timestamp, delay,
+                                                        data.r->_received);
+}
 
 
 } // namespace Impl
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/util/endian.hpp"
+#include <gsl/span>
+#include <type_safe/optional.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <sodium.h>
+#include <string.h>
+
+namespace Fenrir__v1 {
+namespace Impl {
+
+// The key ring that seals our cookies, the server data of the S_KEYS and
+// the resumption tickets.
+//
+// Keys are derived from a master secret and the epoch
+// (wall clock / rotation period). The epoch is the key id, and is
+// prepended in clear to the sealed data.
+// Processes and hosts that share the master secret derive the same keys
+// without talking to each other, so the C_COOKIE and C_AUTH can be handled
+// by any of them: the handshakes can be spread behind a UDP load balancer.
+// We open the previous epoch for the overlap during the rotation,
+// and the next one for the clock skew between hosts.
+// Without a shared secret we use a random one: only this process can
+// open its cookies.
+//
+// All those processes seal with the same key, and have no counter in
+// common: the nonces are random, and 192 bits long (XChaCha20-Poly1305)
+// so that they never collide.
+//   [ key id | nonce | sealed data | tag ]
+class FENRIR_LOCAL Cookie_Keys
+{
+public:
+    static constexpr size_t secret_bytes = crypto_kdf_KEYBYTES;
+    static constexpr int64_t default_rotation_sec = 3600;
+    // a key must last as long as the tickets it seals.
+    static constexpr int64_t min_rotation_sec = 30 * 60;
+
+    Cookie_Keys()
+        : _rotation_sec (default_rotation_sec)
+    {
+        randombytes_buf (_secret.data(), _secret.size());
+        for (auto &slot : _ring)
+            slot._valid = false;
+    }
+    Cookie_Keys (const Cookie_Keys&) = delete;
+    Cookie_Keys& operator= (const Cookie_Keys&) = delete;
+    Cookie_Keys (Cookie_Keys &&) = delete;
+    Cookie_Keys& operator= (Cookie_Keys &&) = delete;
+    ~Cookie_Keys()
+    {
+        sodium_memzero (_secret.data(), _secret.size());
+        for (auto &slot : _ring)
+            sodium_memzero (slot._key.data(), slot._key.size());
+    }
+
+    // all the processes that share the handshakes must use the same
+    // secret and rotation. The rotation is raised to "min_rotation_sec".
+    bool set_secret (const gsl::span<const uint8_t> secret,
+                                                    const int64_t rotation_sec)
+    {
+        if (static_cast<size_t> (secret.size()) != secret_bytes)
+            return false;
+        std::unique_lock<std::mutex> lock (_mtx);
+        FENRIR_UNUSED (lock);
+        std::copy (secret.begin(), secret.end(), _secret.begin());
+        _rotation_sec = std::max (rotation_sec, min_rotation_sec);
+        for (auto &slot : _ring)
+            slot._valid = false;
+        return true;
+    }
+
+    // same layout as Crypto::Encryption, with the key id in front.
+    static constexpr uint16_t bytes_header()
+    {
+        return static_cast<uint16_t> (sizeof(uint32_t) +
+                                crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
+    }
+    static constexpr uint16_t bytes_overhead()
+    {
+        return static_cast<uint16_t> (bytes_header() +
+                                    crypto_aead_xchacha20poly1305_ietf_ABYTES);
+    }
+
+    Impl::Error encrypt (gsl::span<uint8_t> in)
+    {
+        if (static_cast<size_t> (in.size()) < bytes_overhead())
+            return Impl::Error::WRONG_INPUT;
+        uint32_t key_id;
+        std::array<uint8_t, crypto_aead_xchacha20poly1305_ietf_KEYBYTES> key;
+        if (!get (type_safe::nullopt, key_id, key))
+            return Impl::Error::INITIALIZATION;
+        const uint32_t raw_id = h_to_l<uint32_t> (key_id);
+        memcpy (in.data(), &raw_id, sizeof(raw_id));
+        uint8_t *const nonce = in.data() + sizeof(raw_id);
+        randombytes_buf (nonce, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
+        uint8_t *const data = in.data() + bytes_header();
+        const unsigned long long data_size = static_cast<unsigned long long> (
+                                                in.size() - bytes_overhead());
+        unsigned long long sealed_size;
+        // the key id is authenticated, too
+        const int res = crypto_aead_xchacha20poly1305_ietf_encrypt (data,
+                                                &sealed_size, data, data_size,
+                                                in.data(), sizeof(raw_id),
+                                                nullptr, nonce, key.data());
+        sodium_memzero (key.data(), key.size());
+        return res == 0 ? Impl::Error::NONE : Impl::Error::WRONG_INPUT;
+    }
+    Impl::Error decrypt (const gsl::span<uint8_t> in, gsl::span<uint8_t> &out)
+    {
+        if (static_cast<size_t> (in.size()) < bytes_overhead())
+            return Impl::Error::WRONG_INPUT;
+        uint32_t raw_id;
+        memcpy (&raw_id, in.data(), sizeof(raw_id));
+        uint32_t key_id = l_to_h<uint32_t> (raw_id);
+        std::array<uint8_t, crypto_aead_xchacha20poly1305_ietf_KEYBYTES> key;
+        if (!get (type_safe::make_optional (key_id), key_id, key))
+            return Impl::Error::WRONG_INPUT;    // expired or garbage
+        const uint8_t *const nonce = in.data() + sizeof(raw_id);
+        uint8_t *const data = in.data() + bytes_header();
+        const unsigned long long sealed_size = static_cast<
+                unsigned long long> (in.size() - bytes_header());
+        unsigned long long data_size;
+        const int res = crypto_aead_xchacha20poly1305_ietf_decrypt (data,
+                                                &data_size, nullptr,
+                                                data, sealed_size,
+                                                in.data(), sizeof(raw_id),
+                                                nonce, key.data());
+        sodium_memzero (key.data(), key.size());
+        if (res != 0)
+            return Impl::Error::WRONG_INPUT;
+        out = in.subspan (bytes_header(), static_cast<ssize_t> (data_size));
+        return Impl::Error::NONE;
+    }
+private:
+    struct slot {
+        uint32_t _epoch;
+        bool _valid;
+        std::array<uint8_t, crypto_aead_xchacha20poly1305_ietf_KEYBYTES> _key;
+    };
+
+    std::mutex _mtx;
+    std::array<uint8_t, secret_bytes> _secret;
+    int64_t _rotation_sec;
+    // previous, current and next epoch, plus one being replaced
+    std::array<slot, 4> _ring;
+
+    // "want": the key id to open, nullopt to seal with the current one.
+    // "key_id" gets the id of the key copied in "key".
+    bool get (const type_safe::optional<uint32_t> want, uint32_t &key_id,
+        std::array<uint8_t, crypto_aead_xchacha20poly1305_ietf_KEYBYTES> &key)
+    {
+        const int64_t now_sec =
+                std::chrono::duration_cast<std::chrono::seconds> (
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        std::unique_lock<std::mutex> lock (_mtx);
+        FENRIR_UNUSED (lock);
+        const uint32_t current = static_cast<uint32_t> (now_sec /
+                                                                _rotation_sec);
+        if (!want.has_value()) {
+            key_id = current;
+        } else {
+            // only the overlap window: never derive keys for garbage ids
+            if (want.value() + 1 != current && want.value() != current &&
+                                                want.value() != current + 1) {
+                return false;
+            }
+            key_id = want.value();
+        }
+        slot &key_slot = _ring[key_id % _ring.size()];
+        if (!key_slot._valid || key_slot._epoch != key_id) {
+            crypto_kdf_derive_from_key (key_slot._key.data(),
+                                        key_slot._key.size(), key_id,
+                                                "FenrirCK", _secret.data());
+            key_slot._epoch = key_id;
+            key_slot._valid = true;
+        }
+        key = key_slot._key;
+        return true;
+    }
+};
+
+} // namespace Impl
+} // namespace Fenrir__v1
@@ -26,11 +26,25 @@
 #include "Fenrir/v1/data/Conn0.hpp"
 #include "Fenrir/v1/event/Loop.hpp"
 #include "Fenrir/v1/event/Events_all.hpp"
+#include "Fenrir/v1/net/Cookie_Keys.hpp"
 #include "Fenrir/v1/net/Handshake_ID.hpp"
+#include "Fenrir/v1/net/Handshake_Pool.hpp"
+#include "Fenrir/v1/net/Handshake_Table.hpp"
 #include "Fenrir/v1/net/Link_defs.hpp"
+#include "Fenrir/v1/net/Result_Cache.hpp"
+#include "Fenrir/v1/net/Role.hpp"
+#include "Fenrir/v1/net/Ticket_Replay.hpp"
 #include "Fenrir/v1/plugin/Loader.ipp"
 #include "Fenrir/v1/util/Shared_Lock.hpp"
+#include <type_safe/optional.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <deque>
+#include <mutex>
+#include <sodium.h>
+#include <thread>
+#include <vector>
 
 namespace Fenrir__v1 {
 namespace Impl {
@@ -46,26 +60,53 @@ class Handler;
 class FENRIR_LOCAL Handshake
 {
 public:
+    // client handshakes, since the start
+    struct Stats {
+        uint64_t _pending;      // now
+        uint64_t _started;
+        uint64_t _completed;    // we have the connection
+        uint64_t _failed;       // the server refused us
+        uint64_t _retransmits;  // packets sent again
+        uint64_t _timeouts;     // nobody answered
+        uint64_t _evicted;      // too many pending handshakes
+    };
+    // SIGNED: the S_COOKIE is signed: two signatures for every C_INIT,
+    //      before the client has proven its address.
+    // MAC: the cookie is sealed with _srv_secret, we sign only in the S_KEYS,
+    //      after a valid C_COOKIE.
+    enum class Cookie_Mode : uint8_t {
+        SIGNED = 0x00,
+        MAC    = 0x01
+    };
+
     Handshake (Event::Loop *const loop, Random *const rnd, Loader *const load,
                                         Handler *const handler, Db *const db)
-        :_loop (loop), _rnd (rnd), _load (load), _handler (handler), _db (db)
+        :_loop (loop), _rnd (rnd), _load (load), _handler (handler), _db (db),
+         _cookie_mode (Cookie_Mode::MAC),
+         _shared_secret (false),
+         _expire_ev (Event::Handshake::mk_shared (loop, Handshake_ID {},
+                                            Event::Handshake::TYPE::EXPIRE)),
+         _expire_running (false), _stats {0, 0, 0, 0, 0, 0, 0}
     {
-        std::array<uint8_t, 64> key;
-        _rnd->uniform<uint8_t> (key);
-
-        _srv_secret = _load->get_shared<Crypto::Encryption> (
-                                                    Crypto::Encryption::ID {2});
-        _srv_secret->set_key (key);
-        assert (_srv_secret->is_authenticated() &&
-                                    "Handshake: srv_secret not authenticated");
-        // FIXME: cleanup. keys should be properly deleted
+        // a fraction of the cores: the rest is for the connections.
+        const uint32_t workers = std::max (1u,
+                                    std::thread::hardware_concurrency() / 4);
+        _workers.reserve (workers);
+        for (uint32_t idx = 0; idx < workers; ++idx)
+            _workers.emplace_back (&Handshake::worker, this);
     }
     Handshake() = delete;
     Handshake (const Handshake&) = delete;
     Handshake& operator= (const Handshake&) = delete;
-    Handshake (Handshake &&) = default;
-    Handshake& operator= (Handshake &&) = default;
-    ~Handshake() = default;
+    Handshake (Handshake &&) = delete;
+    Handshake& operator= (Handshake &&) = delete;
+    ~Handshake()
+    {
+        _loop->del (_expire_ev);
+        _pool.stop();
+        for (auto &thread : _workers)
+            thread.join();
+    }
 
     bool add_auth (const Crypto::Auth::ID id);
     bool del_auth (const Crypto::Auth::ID id);
@@ -76,13 +117,27 @@ public:
                                           const gsl::span<const uint8_t> priv,
                                           const gsl::span<const uint8_t> pub);
     bool del_pubkey (const Crypto::Key::Serial serial);
+    // share the cookie keys with the other processes behind the same address
+    // the tickets are shared too, but not the replay checks: no more
+    // early data for the new tickets.
+    bool set_cookie_secret (const gsl::span<const uint8_t> secret,
+                                                    const int64_t rotation_sec);
+    // the handshakes already past the S_COOKIE are dropped
+    void set_cookie_mode (const Cookie_Mode mode);
+    Stats stats();
 
+    // admission control only: the handshake is handled by our workers.
     void recv (const Link_ID from, const Link_ID to, Packet &pkt);
     void drop_handshake (std::shared_ptr<Event::Handshake> ev);
+    void timer (std::shared_ptr<Event::Handshake> ev);
 
-    std::tuple<std::unique_ptr<Packet>, Link_ID>
-                                        connect (Resolve::AS_list &auth_servers)
-            { return send_c_init (auth_servers); }
+    // resume with the ticket of a previous connection if we have one,
+    // else full handshake.
+    // "early_data" is sent only with the resumption (0-RTT), and only
+    // if the server accepts that much with this ticket.
+    std::tuple<std::unique_ptr<Packet>, Link_ID, Conn0_Type> connect (
+                                        Resolve::AS_list &auth_servers,
+                                        const std::vector<uint8_t> &early_data);
 
 private:
     Shared_Lock _mtx_auths;
@@ -93,6 +148,7 @@ private:
     Loader *const _load;
     Handler *const _handler;
     Db *const _db;
+    std::atomic<Cookie_Mode> _cookie_mode;
     std::vector<std::shared_ptr<Crypto::Auth>> auths;
     std::vector<std::pair<Crypto::Key::Serial, std::shared_ptr<Crypto::Key>>>
                                                                     _pubkeys;
@@ -100,6 +156,46 @@ private:
     // track the handshakes we initialize
     using ID = Handshake_ID;
 
+    // what we need to resume a connection.
+    // the server seals it in the ticket, the client keeps it with the ticket.
+    struct resume_params {
+        std::array<uint8_t, 64> _secret;
+        User_ID _user;
+        Crypto::Encryption::ID _enc;
+        Crypto::Hmac::ID _hmac;
+        Recover::ECC::ID _ecc;
+        Crypto::KDF::ID _kdf;
+    };
+    // cleartext of the ticket, sealed with _srv_secret
+    // "_stream": the data stream of the connection, the S_RESUME
+    // gives it back with the same id, type and priority.
+    struct ticket_format {
+        static constexpr size_t bytes = 64 + sizeof(uint64_t) +
+                        4 * sizeof(uint16_t) +              // _params
+                        sizeof(uint16_t) + sizeof(uint32_t) + 2 + // _stream
+                        sizeof(int64_t);
+        resume_params _params;
+        Conn0_Auth_Result::stream_info _stream;
+        int64_t _issued;    // system_clock, milliseconds
+
+        // little endian, "bytes" long
+        void write (uint8_t *out) const;
+        void read (const uint8_t *in);
+    };
+    struct resume_ticket {
+        resume_params _params;
+        std::vector<uint8_t> _ticket;   // opaque, sealed by the server
+        std::chrono::steady_clock::time_point _received;
+        uint16_t _max_early_data;       // as told by the server
+    };
+    struct conn_keys {
+        std::shared_ptr<Crypto::Encryption> _enc_read, _enc_write;
+        std::shared_ptr<Crypto::Hmac> _hmac_read, _hmac_write;
+        std::shared_ptr<Recover::ECC> _ecc_read, _ecc_write;
+        std::shared_ptr<Crypto::KDF> _user_kdf;
+        std::array<uint8_t, 64> _next_secret;   // for the next ticket
+    };
+
     struct state_client {
         Conn0_Type _type;   // last sent
         uint16_t _auth_server_idx;
@@ -107,13 +203,27 @@ private:
         Resolve::AS_list _auth_servers;
         std::unique_ptr<Packet> _pkt;   // last packet, used for signatures
         std::shared_ptr<Crypto::Key> _client_key;
-        std::shared_ptr<Crypto::Encryption> _enc_read;
-        std::shared_ptr<Crypto::Hmac> _hmac_read;
-        std::shared_ptr<Recover::ECC> _ecc_read;
-        std::shared_ptr<Crypto::Encryption> _enc_write;
-        std::shared_ptr<Crypto::Hmac> _hmac_write;
-        std::shared_ptr<Recover::ECC> _ecc_write;
-        std::shared_ptr<Crypto::KDF> _user_kdf;
+        // the plugins of the connection: only after the S_KEYS
+        // (or with the C_RESUME), most handshakes never get here.
+        std::unique_ptr<conn_keys> _keys;
+        // MAC cookies: hash of our C_INIT and the S_COOKIE, that
+        // the server signs in the S_KEYS
+        type_safe::optional<std::array<uint8_t, crypto_generichash_BYTES>>
+                                                                    _cs_hash;
+        // the ticket the server will send in the S_RESULT/S_RESUME is for
+        // these parameters
+        type_safe::optional<resume_params> _resume;
+        // happy eyeballs: the servers that get the C_INIT if nobody
+        // answers soon. the first that answers wins.
+        std::vector<Link_ID> _next_dest;
+        // the last packet, as sent, for the retransmissions.
+        // IP() in "_sent_from": any socket.
+        std::vector<uint8_t> _sent;
+        Link_ID _sent_from;
+        std::vector<Link_ID> _sent_to;
+        uint8_t _retries;
+        // the cookie expired once already: time out next time
+        bool _restarted;
         // TODO: provide KDF *and* deterministic rng for user
         //std::shared_ptr<Crypto::KDF> _kdf;
 
@@ -124,18 +234,68 @@ private:
               _auth_server_idx (auth_srv_idx), _key_idx (key_idx),
               _auth_servers (std::move(list)),
               _pkt (std::move(pkt)),
-              _client_key (nullptr), _enc_read (nullptr), _hmac_read (nullptr),
-              _ecc_read (nullptr), _enc_write (nullptr), _hmac_write (nullptr),
-              _ecc_write (nullptr)
+              _client_key (nullptr), _keys (nullptr),
+              _cs_hash (type_safe::nullopt),
+              _resume (type_safe::nullopt), _sent_from {{IP(), UDP_Port{0}}},
+              _retries (0), _restarted (false)
         {}
     };
-    std::vector<std::pair<Handshake::ID, state_client>> _client_active;
+    Handshake_Table<state_client> _client_active;
     std::atomic<uint32_t> _srv_next_tracked;
     std::atomic<uint32_t> _client_next_tracked;
-    std::shared_ptr<Crypto::Encryption> _srv_secret; // Authenticated enc.
+    Cookie_Keys _srv_secret;
+    Ticket_Replay _replay;
+    // _replay is per process: with a shared secret a ticket could be
+    // used once per process, and the early data replayed with it.
+    std::atomic<bool> _shared_secret;
+    // our S_RESULT/S_RESUME, for the clients that did not get them
+    Result_Cache _results;
+    // tickets for the servers we connected to. one per server.
+    std::mutex _tickets_mtx;
+    std::vector<std::pair<Link_ID, resume_ticket>> _tickets;
+    Handshake_Pool _pool;
+    std::vector<std::thread> _workers;
+    // retransmits the client packets nobody answered, and drops
+    // the handshakes after the last retransmission.
+    // runs only while there are client handshakes.
+    std::shared_ptr<Event::Handshake> _expire_ev;
+    bool _expire_running;
+    Stats _stats;   // under _mtx
+
+    void worker();
+    void process (Handshake_Pool::job &work);
 
+    Conn_ID reserve_conn_id (std::atomic<uint32_t> &next);
+    Handshake::ID track_client (Packet &pkt, state_client &&state);
+    void expire_clients (std::shared_ptr<Event::Handshake> ev);
+    // 0-RTT bytes we accept with the tickets we issue now
+    uint16_t early_data_limit() const;
+    type_safe::optional<conn_keys> resume_keys (const resume_params &params,
+                                    const Nonce &nonce, const Role role);
+    std::unique_ptr<Packet> mk_result (const Packet &pkt, const Conn0_Type type,
+                                    const Conn_ID conn,
+                                    const Counter control_start,
+                                    const Stream_ID control_stream,
+                                    const Packet::Alignment_Flag alignment,
+                                    const uint8_t max_padding,
+                                    Crypto::Encryption *const enc_write,
+                                    Crypto::Hmac *const hmac_write,
+                                    Recover::ECC *const ecc_write,
+                            const type_safe::optional<resume_params> &ticket,
+            const type_safe::optional<Conn0_Auth_Result::stream_info> &stream);
+    bool resend_result (const Result_Cache::key &request, const Link_ID from,
+                                    const Link_ID to, const Conn0_Type type);
+    void save_ticket (const Link_ID srv, const resume_params &params,
+                                        const gsl::span<const uint8_t> ticket,
+                                        const uint16_t max_early);
+
+    std::tuple<std::unique_ptr<Packet>, Link_ID>
+                                send_c_init (Resolve::AS_list &auth_servers,
+                                                    const bool restarted);
+    void send_c_init_next (std::shared_ptr<Event::Handshake> ev);
     std::tuple<std::unique_ptr<Packet>, Link_ID>
-                                send_c_init (Resolve::AS_list &auth_servers);
+                                send_c_resume (Resolve::AS_list &auth_servers,
+                                        const std::vector<uint8_t> &early_data);
     void answer_c_init (const Link_ID from, const Link_ID to, const Packet &pkt,
                                                     const Conn0_C_INIT data);
     void answer_s_cookie (const Link_ID from, const Link_ID to,
@@ -146,8 +306,11 @@ private:
                                 const Packet &pkt, const Conn0_S_KEYS data);
     void answer_c_auth (const Link_ID from, const Link_ID to,
                                 const Packet &pkt, const Conn0_C_AUTH data);
+    // also S_RESUME
     void parse_s_result (const Link_ID from, const Link_ID to,
                                 const Packet &pkt, const Conn0_S_RESULT data);
+    void answer_c_resume (const Link_ID from, const Link_ID to,
+                                const Packet &pkt, const Conn0_C_RESUME data);
 };
 
 } // namespace Impl
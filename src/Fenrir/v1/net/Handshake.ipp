@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include "Fenrir/v1/API/Report.hpp"
 #include "Fenrir/v1/auth/Lattice.hpp"
 #include "Fenrir/v1/common.hpp"
 #include "Fenrir/v1/util/Shared_Lock.ipp"
@@ -33,6 +34,8 @@
 #include <array>
 #include <chrono>
 #include <limits>
+#include <sodium.h>
+#include <string.h>
 
 namespace Fenrir__v1 {
 namespace Impl {
@@ -44,6 +47,34 @@ constexpr auto pkt_timeout = std::chrono::duration_cast<
 // client can not send less than this to avoid amplification.
 constexpr uint16_t pkt_init_minlen = 1280 - 8;
 constexpr uint16_t conn_init_minlen = pkt_init_minlen - PKT_MINLEN;
+// tickets must expire before the cookie key that seals them
+constexpr int64_t ticket_lifetime_ms = 30 * 60 * 1000;
+static_assert (Cookie_Keys::min_rotation_sec * 1000 >= ticket_lifetime_ms,
+                    "Fenrir: the tickets would outlive the cookie key ring");
+// 0-RTT data can be replayed by the network before we see it. keep it small.
+constexpr uint16_t max_early_data = 512;
+// we remember the tickets of this many servers
+constexpr size_t max_tickets = 64;
+// happy eyeballs: C_INIT to this many servers, one after the other
+// if the previous did not answer (RFC 8305 uses 250ms)
+constexpr size_t max_parallel_connect = 3;
+constexpr std::chrono::milliseconds connect_stagger {250};
+// client packets with no answer are sent again after 1s, 3s, 7s,
+// then the handshake is dropped
+constexpr std::chrono::milliseconds retransmit_start {1000};
+constexpr uint8_t max_retransmit = 3;
+// but the server refuses a cookie older than pkt_timeout:
+// C_COOKIE and C_AUTH are sent again every second while the cookie is
+// good, then the handshake starts again from the C_INIT, once.
+constexpr uint8_t max_cookie_retransmit = static_cast<uint8_t> (
+                        pkt_timeout.count() / retransmit_start.count() - 1);
+static_assert (max_cookie_retransmit > 0,
+                    "Fenrir: the cookie expires before the first retransmit");
+// bound the memory of the pending client handshakes: drop the oldest
+constexpr size_t max_client_handshakes = 4096;
+static_assert (Result_Cache::keep_ms >= retransmit_start.count() *
+                                                    ((1 << max_retransmit) - 1),
+                        "Fenrir: the answers must outlive the retransmissions");
 
 } // empty namespace
 
@@ -166,17 +197,132 @@ FENRIR_INLINE void Handshake::drop_handshake (
 {
     Shared_Lock_Guard<Shared_Lock_Write> w_lock {Shared_Lock_NN(&_mtx)};
     FENRIR_UNUSED (w_lock);
-    // search previous packet in _cative handshakes
-    auto it = std::lower_bound (_client_active.begin(), _client_active.end(),
-                        ev->_id,
-                            [] (const auto &el, const Handshake::ID id)
-                                { return std::get<Handshake::ID> (el) < id; });
+    // we might get triggered just after the handshake finished:
+    // then there is nothing to erase.
+    _client_active.erase (ev->_id);
+}
+
+FENRIR_INLINE bool Handshake::set_cookie_secret (
+                                        const gsl::span<const uint8_t> secret,
+                                        const int64_t rotation_sec)
+{
+    if (!_srv_secret.set_secret (secret, rotation_sec))
+        return false;
+    _shared_secret.store (true, std::memory_order_relaxed);
+    return true;
+}
+
+FENRIR_INLINE void Handshake::set_cookie_mode (const Cookie_Mode mode)
+    { _cookie_mode.store (mode, std::memory_order_relaxed); }
+
+FENRIR_INLINE uint16_t Handshake::early_data_limit() const
+{
+    if (_shared_secret.load (std::memory_order_relaxed))
+        return 0;
+    return max_early_data;
+}
+
+FENRIR_INLINE Handshake::Stats Handshake::stats()
+{
+    Shared_Lock_Guard<Shared_Lock_Read> r_lock {Shared_Lock_NN(&_mtx)};
+    FENRIR_UNUSED (r_lock);
+    Stats ret = _stats;
+    ret._pending = _client_active.size();
+    return ret;
+}
+
+FENRIR_INLINE void Handshake::expire_clients (
+                                        std::shared_ptr<Event::Handshake> ev)
+{
+    struct resend {
+        Link_ID _from, _to;
+        std::unique_ptr<Packet> _pkt;
+        Conn0_Type _type;
+    };
+    std::vector<Handshake::ID> due;
+    std::vector<resend> to_send;
+    std::vector<Resolve::AS_list> restart;
+    std::vector<std::vector<uint8_t>> timed_out;
+    Shared_Lock_Guard<Shared_Lock_Write> w_lock {Shared_Lock_NN(&_mtx)};
+    _client_active.due (due);
+    for (const auto id : due) {
+        state_client *const state = _client_active.find (id);
+        if (state == nullptr)
+            continue;
+        const bool cookie = state->_type == Conn0_Type::C_COOKIE ||
+                                        state->_type == Conn0_Type::C_AUTH;
+        if (cookie && state->_retries >= max_cookie_retransmit &&
+                                                        !state->_restarted) {
+            // the server would refuse our cookie now: get a new one
+            restart.push_back (std::move(state->_auth_servers));
+            _client_active.erase (id);
+            continue;
+        }
+        if (state->_retries >= (cookie ? max_cookie_retransmit :
+                                                            max_retransmit)) {
+            timed_out.push_back (std::move(state->_auth_servers._fqdn));
+            _client_active.erase (id);
+            ++_stats._timeouts;
+            continue;
+        }
+        ++state->_retries;
+        ++_stats._retransmits;
+        _client_active.rearm (id, cookie ? retransmit_start :
+                                retransmit_start * (1 << state->_retries));
+        for (const auto dest : state->_sent_to) {
+            to_send.push_back (resend {state->_sent_from, dest,
+                                std::make_unique<Packet> (
+                                        std::vector<uint8_t> (state->_sent)),
+                                                                state->_type});
+        }
+    }
+    if (_client_active.size() == 0 && _expire_running) {
+        // no wakeups while idle. track_client starts us again.
+        _loop->deactivate (std::move(ev));
+        _expire_running = false;
+    }
+    w_lock.early_unlock();
+
+    for (auto &pkt : to_send) {
+        const Link_ID from = pkt._from.ip() == IP() ?
+                                    _handler->socket_for (pkt._to) : pkt._from;
+        if (from.ip() == IP())
+            continue;
+        _handler->proxy_enqueue (from, pkt._to, std::move(pkt._pkt),
+                                                                    pkt._type);
+    }
+    for (auto &auth_servers : restart) {
+        std::unique_ptr<Packet> pkt;
+        Link_ID dest;
+        std::tie (pkt, dest) = send_c_init (auth_servers, true);
+        if (pkt == nullptr) {
+            // not tracked: "auth_servers" is still ours
+            timed_out.push_back (std::move(auth_servers._fqdn));
+            continue;
+        }
+        // no socket now: the retransmissions will try again
+        const Link_ID from = _handler->socket_for (dest);
+        if (from.ip() == IP())
+            continue;
+        _handler->proxy_enqueue (from, dest, std::move(pkt),
+                                                        Conn0_Type::C_INIT);
+    }
+    for (auto &fqdn : timed_out) {
+        _handler->proxy_report (std::make_unique<Report::Handshake> (
+                                Fenrir__v1::Error::TIMEOUT, std::move(fqdn)));
+    }
+}
 
-    if (it == _client_active.end() || std::get<Handshake::ID> (*it) != ev->_id){
-        return;     // we got triggered, but luckily the hanshake finished
-                    // just a little before we deleted it.
+FENRIR_INLINE void Handshake::timer (std::shared_ptr<Event::Handshake> ev)
+{
+    switch (ev->_type) {
+    case Event::Handshake::TYPE::SEND:
+        return send_c_init_next (std::move(ev));
+    case Event::Handshake::TYPE::TIMEOUT:
+        return drop_handshake (std::move(ev));
+    case Event::Handshake::TYPE::EXPIRE:
+        return expire_clients (std::move(ev));
     }
-    _client_active.erase (it);
 }
 
 
@@ -184,6 +330,7 @@ FENRIR_INLINE void Handshake::drop_handshake (
 FENRIR_INLINE void Handshake::recv (const Link_ID from, const Link_ID to,
                                                                     Packet &pkt)
 {
+    // only cheap checks here: we are on a connection thread.
     if (pkt.stream.size() != 1 ||
                     static_cast<size_t> (pkt.stream.begin()->data().size()) <=
                                                             Conn0::min_size()) {
@@ -192,6 +339,38 @@ FENRIR_INLINE void Handshake::recv (const Link_ID from, const Link_ID to,
     const auto conn_t = Conn0::get_type (pkt.stream.begin()->data());
     if (!conn_t.has_value())
         return;
+    const uint32_t cost = Handshake_Pool::cost (conn_t.value());
+    if (cost == 0)
+        return; // unknown type
+    const bool unsolicited = Handshake_Pool::unsolicited (conn_t.value());
+    if (!unsolicited) {
+        // an answer: only for the handshakes we started.
+        const Handshake::ID hshake_id ({pkt.stream[0].counter(),
+                                                        pkt.stream[0].id()});
+        Shared_Lock_Guard<Shared_Lock_Read> lock {Shared_Lock_NN{&_mtx}};
+        if (!_client_active.has (hshake_id))
+            return;
+    }
+    // the stream data points into the packet buffer, which is moved, too.
+    _pool.push (Handshake_Pool::job {from, to, std::move(pkt), cost},
+                                                unsolicited, Rate::usec_now());
+}
+
+FENRIR_INLINE void Handshake::worker()
+{
+    while (true) {
+        auto work = _pool.pop();
+        if (!work.has_value())
+            return;
+        process (work.value());
+    }
+}
+
+FENRIR_INLINE void Handshake::process (Handshake_Pool::job &work)
+{
+    const Link_ID from = work._from, to = work._to;
+    const Packet &pkt = work._pkt;
+    const auto conn_t = Conn0::get_type (pkt.stream.begin()->data());
 
     switch (conn_t.value()) {
     case Conn0_Type::C_INIT:
@@ -212,23 +391,130 @@ FENRIR_INLINE void Handshake::recv (const Link_ID from, const Link_ID to,
     case Conn0_Type::S_RESULT:
         return parse_s_result (from, to, pkt,
                                     Conn0_S_RESULT (pkt.stream.begin()->data()));
+    case Conn0_Type::C_RESUME:
+        return answer_c_resume (from, to, pkt,
+                                    Conn0_C_RESUME(pkt.stream.begin()->data()));
+    case Conn0_Type::S_RESUME:
+        return parse_s_result (from, to, pkt,
+                                    Conn0_S_RESULT (pkt.stream.begin()->data(),
+                                                        Conn0_Type::S_RESUME));
+    }
+}
+
+FENRIR_INLINE Conn_ID Handshake::reserve_conn_id (std::atomic<uint32_t> &next)
+{
+    uint32_t orig_id = next.load();
+    auto next_free = _handler->get_next_free (Conn_ID {orig_id});
+    uint32_t old_val = orig_id;
+    uint32_t new_val = static_cast<uint32_t> (next_free) + 1;
+    // now try to reserve "new_val - 1"
+    while (!next.compare_exchange_weak (old_val, new_val)) {
+        // could not exchange.
+        if (old_val >= new_val) {
+            if (orig_id <= new_val) {
+                // other threads already reserved new_val. Try next.
+                new_val = 1 + static_cast<uint32_t> (_handler->get_next_free (
+                                                            Conn_ID {old_val}));
+            } // else get_next(old_val) had overlowed. all ok.
+        } else {
+            // new_val < old_val
+            if (old_val < orig_id) {
+                // overflow. we can't reserve new_val. Try next.
+                new_val = 1 + static_cast<uint32_t> (_handler->get_next_free (
+                                                            Conn_ID {old_val}));
+                orig_id = old_val;
+            } // else all ok. we can still reserve new_val - 1
+        }
     }
+    // we have reserved "new_val - 1"
+    return Conn_ID {new_val - 1};
 }
 
-// FIXME: craete events (pkt_timeout) for handshake timeouts
+// give the handshake a new, unused ID, and track it.
+// "pkt" and "state._pkt" get the ID in their stream header.
+// "state._sent_to" must have the destination of "pkt".
+FENRIR_INLINE Handshake::ID Handshake::track_client (Packet &pkt,
+                                                        state_client &&state)
+{
+    std::vector<std::vector<uint8_t>> evicted;
+    Shared_Lock_Guard<Shared_Lock_Write> lock {Shared_Lock_NN{&_mtx}};
+    // full: the oldest handshakes are the least likely to finish
+    while (_client_active.size() >= max_client_handshakes) {
+        Handshake::ID old;
+        if (!_client_active.oldest (old))
+            break;
+        evicted.push_back (std::move(
+                            _client_active.find (old)->_auth_servers._fqdn));
+        _client_active.erase (old);
+        ++_stats._evicted;
+    }
+    // search for a new, usable Handshake::ID
+    Handshake::ID h_id;
+    do {
+        h_id = Handshake::ID {{Counter {_rnd->uniform<uint32_t> (0,
+                                        static_cast<uint32_t> (max_counter))},
+                                    Stream_ID{_rnd->uniform<uint16_t>()}}};
+    } while (_client_active.has (h_id));
+
+    auto raw_id = static_cast<std::pair<Counter, Stream_ID>> (h_id);
+    pkt.stream[0].set_header (std::get<Stream_ID> (raw_id),
+                                                   Stream::Fragment::FULL,
+                                                   std::get<Counter> (raw_id));
+    state._pkt->stream[0].set_header (std::get<Stream_ID> (raw_id),
+                                                   Stream::Fragment::FULL,
+                                                   std::get<Counter> (raw_id));
+    state._sent = pkt.raw;
+    _client_active.insert (h_id, std::move(state), retransmit_start);
+    ++_stats._started;
+    if (!_expire_running) {
+        _expire_running = true;
+        _loop->start (_expire_ev, std::chrono::milliseconds (
+                                    Handshake_Table<state_client>::tick_ms),
+                                                        Event::Repeat::YES);
+    }
+    lock.early_unlock();
+
+    for (auto &fqdn : evicted) {
+        _handler->proxy_report (std::make_unique<Report::Handshake> (
+                        Fenrir__v1::Error::NO_CONNECTION, std::move(fqdn)));
+    }
+    return h_id;
+}
+
+FENRIR_INLINE std::tuple<std::unique_ptr<Packet>, Link_ID, Conn0_Type>
+                            Handshake::connect (Resolve::AS_list &auth_servers,
+                                        const std::vector<uint8_t> &early_data)
+{
+    std::unique_ptr<Packet> pkt;
+    Link_ID dest;
+    std::tie (pkt, dest) = send_c_resume (auth_servers, early_data);
+    if (pkt != nullptr)
+        return std::make_tuple (std::move(pkt), dest, Conn0_Type::C_RESUME);
+    // no ticket. full handshake.
+    std::tie (pkt, dest) = send_c_init (auth_servers, false);
+    return std::make_tuple (std::move(pkt), dest, Conn0_Type::C_INIT);
+}
 
 FENRIR_INLINE std::tuple<std::unique_ptr<Packet>, Link_ID>
-                        Handshake::send_c_init (Resolve::AS_list &auth_servers)
+                        Handshake::send_c_init (Resolve::AS_list &auth_servers,
+                                                        const bool restarted)
 {
     if (auth_servers._err != Error::NONE || auth_servers._key.size() == 0)
         return {nullptr, Link_ID {{IP(), UDP_Port{0}}}};
 
-    // select the auth server we eill contact
-    const auto srv_idx = auth_servers.get_idx (0, _rnd);
-    if (!srv_idx.has_value())
+    // select the auth servers we will contact. the first one now,
+    // the others only if the first is slow to answer.
+    const auto srv_idx = auth_servers.get_parallel (max_parallel_connect,
+                                                                        _rnd);
+    if (srv_idx.size() == 0)
         return {nullptr, Link_ID {{IP(), UDP_Port{0}}}};
-    const Link_ID srv_dest {{auth_servers._servers[srv_idx.value()].ip,
-                                auth_servers._servers[srv_idx.value()].port}};
+    std::vector<Link_ID> all_dest;
+    all_dest.reserve (srv_idx.size());
+    for (const auto idx : srv_idx) {
+        all_dest.push_back (Link_ID {{auth_servers._servers[idx].ip,
+                                            auth_servers._servers[idx].port}});
+    }
+    const Link_ID srv_dest = all_dest[0];
 
 
     const auto all_enc  = _load->list<Crypto::Encryption>();
@@ -280,43 +566,351 @@ FENRIR_INLINE std::tuple<std::unique_ptr<Packet>, Link_ID>
     // add stream faster than copy_pkt->parse() again
     copy_pkt->add_stream (Stream_ID {0}, Stream::Fragment::FULL,
                                                         Counter {0}, msg_size);
+    state_client state (auth_servers, srv_idx[0],
+                                                static_cast<uint16_t> (key_idx),
+                                                std::move(copy_pkt));
+    state._next_dest.assign (all_dest.begin() + 1, all_dest.end());
+    state._sent_to.push_back (srv_dest);
+    state._restarted = restarted;
+    const auto h_id = track_client (*pkt, std::move(state));
+    if (all_dest.size() > 1) {
+        auto ev = Event::Handshake::mk_shared (_loop, h_id,
+                                                Event::Handshake::TYPE::SEND);
+        _loop->start (ev, connect_stagger, Event::Repeat::NO);
+    }
+    return {std::move(pkt), srv_dest};
+}
+
+// happy eyeballs: nobody answered our C_INIT yet, try the next server.
+FENRIR_INLINE void Handshake::send_c_init_next (
+                                        std::shared_ptr<Event::Handshake> ev)
+{
+    _loop->deactivate (ev);
     Shared_Lock_Guard<Shared_Lock_Write> lock {Shared_Lock_NN{&_mtx}};
+    state_client *const found = _client_active.find (ev->_id);
+    if (found == nullptr)
+        return;
+    auto &state = *found;
+    if (state._type != Conn0_Type::C_INIT || state._next_dest.size() == 0)
+        return; // somebody answered
+    const Link_ID dest = state._next_dest.front();
+    state._next_dest.erase (state._next_dest.begin());
+    // the retransmissions go to every server we tried
+    state._sent_to.push_back (dest);
+    // same C_INIT, same handshake id.
+    const auto &sent = state._pkt->stream[0];
+    auto pkt = std::make_unique<Packet> (std::vector<uint8_t> (
+                                                        state._pkt->raw));
+    pkt->add_stream (sent.id(), Stream::Fragment::FULL, sent.counter(),
+                                static_cast<uint16_t> (sent.data().size()));
+    const bool more = state._next_dest.size() > 0;
+    lock.early_unlock();
+
+    if (more)
+        _loop->start (ev, connect_stagger, Event::Repeat::NO);
+    const auto from = _handler->socket_for (dest);
+    if (from.ip() == IP())
+        return;
+    _handler->proxy_enqueue (from, dest, std::move(pkt), Conn0_Type::C_INIT);
+}
+
+FENRIR_INLINE void Handshake::save_ticket (const Link_ID srv,
+                                        const resume_params &params,
+                                        const gsl::span<const uint8_t> ticket,
+                                        const uint16_t max_early)
+{
+    resume_ticket saved {params, std::vector<uint8_t> (ticket.begin(),
+                                                                ticket.end()),
+                                            std::chrono::steady_clock::now(),
+                                            max_early};
+    std::unique_lock<std::mutex> lock (_tickets_mtx);
     FENRIR_UNUSED (lock);
-    // search for a new, usable Handshake::ID
-    Handshake::ID h_id;
+    for (auto &tkt : _tickets) {
+        if (std::get<Link_ID> (tkt) == srv) {
+            std::get<resume_ticket> (tkt) = std::move(saved);
+            return;
+        }
+    }
+    if (_tickets.size() >= max_tickets)
+        _tickets.erase (_tickets.begin());  // oldest
+    _tickets.emplace_back (srv, std::move(saved));
+}
+
+FENRIR_INLINE type_safe::optional<Handshake::conn_keys>
+                            Handshake::resume_keys (const resume_params &params,
+                                                        const Nonce &nonce,
+                                                        const Role role)
+{
+    // the secret is used only once per nonce: fresh keys every time.
+    std::array<uint8_t, 64> key;
+    const auto &raw_nonce = static_cast<const std::array<uint8_t, 16>&> (
+                                                                        nonce);
+    crypto_generichash (key.data(), key.size(), raw_nonce.data(),
+                                                            raw_nonce.size(),
+                                                        params._secret.data(),
+                                                        params._secret.size());
+    auto kdf = _load->get_shared<Crypto::KDF> (params._kdf);
+    const bool kdf_ok = kdf != nullptr && kdf->init (key);
+    sodium_memzero (key.data(), key.size());
+    if (!kdf_ok)
+        return type_safe::nullopt;
+
+    conn_keys ret;
+    ret._enc_read = _load->get_shared<Crypto::Encryption> (params._enc);
+    ret._enc_write = _load->get_shared<Crypto::Encryption> (params._enc);
+    ret._hmac_read = _load->get_shared<Crypto::Hmac> (params._hmac);
+    ret._hmac_write = _load->get_shared<Crypto::Hmac> (params._hmac);
+    ret._ecc_read = _load->get_shared<Recover::ECC> (params._ecc);
+    ret._ecc_write = _load->get_shared<Recover::ECC> (params._ecc);
+    ret._user_kdf = _load->get_shared<Crypto::KDF> (params._kdf);
+    if (ret._enc_read == nullptr || ret._enc_write == nullptr ||
+                    ret._hmac_read == nullptr || ret._hmac_write == nullptr ||
+                    ret._ecc_read == nullptr || ret._ecc_write == nullptr ||
+                                                    ret._user_kdf == nullptr) {
+        return type_safe::nullopt;
+    }
+    if (ret._hmac_read->id() == Crypto::Hmac::ID{1} &&
+                                        !ret._enc_read->is_authenticated()) {
+        return type_safe::nullopt;
+    }
+
+    // same indexes as the full handshake
+    constexpr std::array<char, 8> context {{ "FENRIR_" }};
+    const bool client = role == Role::Client;
+    auto &enc_cs  = client ? ret._enc_write  : ret._enc_read;
+    auto &hmac_cs = client ? ret._hmac_write : ret._hmac_read;
+    auto &ecc_cs  = client ? ret._ecc_write  : ret._ecc_read;
+    auto &enc_sc  = client ? ret._enc_read   : ret._enc_write;
+    auto &hmac_sc = client ? ret._hmac_read  : ret._hmac_write;
+    auto &ecc_sc  = client ? ret._ecc_read   : ret._ecc_write;
+    bool ok = kdf->get (1, context, key) && enc_cs->set_key (key) &&
+                kdf->get (2, context, key) && hmac_cs->set_key (key) &&
+                kdf->get (3, context, key) && ecc_cs->init (key) &&
+                kdf->get (4, context, key) && enc_sc->set_key (key) &&
+                kdf->get (5, context, key) && hmac_sc->set_key (key) &&
+                kdf->get (6, context, key) && ecc_sc->init (key) &&
+                kdf->get (7, context, key) && ret._user_kdf->init (key) &&
+                kdf->get (8, context, ret._next_secret);
+    sodium_memzero (key.data(), key.size());
+    if (!ok)
+        return type_safe::nullopt;
+    return type_safe::make_optional (std::move(ret));
+}
+
+FENRIR_INLINE std::tuple<std::unique_ptr<Packet>, Link_ID>
+                    Handshake::send_c_resume (Resolve::AS_list &auth_servers,
+                                        const std::vector<uint8_t> &early_data)
+{
+    if (auth_servers._err != Error::NONE)
+        return {nullptr, Link_ID {{IP(), UDP_Port{0}}}};
+
+    // tickets are single use: take it out.
+    type_safe::optional<resume_ticket> tkt {type_safe::nullopt};
+    uint16_t srv_idx;
     {
-        auto it = _client_active.end();
-        do {
-            h_id = Handshake::ID {{Counter {_rnd->uniform<uint32_t> (0,
-                                        static_cast<uint32_t> (max_counter))},
-                                    Stream_ID{_rnd->uniform<uint16_t>()}}};
-            it = std::lower_bound(_client_active.begin(), _client_active.end(),
-                        h_id, [] (const auto &data, Handshake::ID id)
-                            { return std::get<Handshake::ID> (data) < id; });
-        } while (it != _client_active.end() &&
-                                        std::get<Handshake::ID> (*it) == h_id);
+        std::unique_lock<std::mutex> lock (_tickets_mtx);
+        FENRIR_UNUSED (lock);
+        auto it = _tickets.end();
+        for (srv_idx = 0; srv_idx < auth_servers._servers.size(); ++srv_idx) {
+            const Link_ID srv {{auth_servers._servers[srv_idx].ip,
+                                        auth_servers._servers[srv_idx].port}};
+            it = std::find_if (_tickets.begin(), _tickets.end(),
+                                        [srv] (const auto &test)
+                                { return std::get<Link_ID> (test) == srv; });
+            if (it != _tickets.end())
+                break;
+        }
+        if (it != _tickets.end()) {
+            tkt = type_safe::make_optional (std::move(
+                                            std::get<resume_ticket> (*it)));
+            _tickets.erase (it);
+        }
     }
+    if (!tkt.has_value())
+        return {nullptr, Link_ID {{IP(), UDP_Port{0}}}};
+    const auto age = std::chrono::duration_cast<std::chrono::milliseconds> (
+                    std::chrono::steady_clock::now() - tkt.value()._received);
+    if (age.count() >= ticket_lifetime_ms)
+        return {nullptr, Link_ID {{IP(), UDP_Port{0}}}};
+    const Link_ID srv_dest {{auth_servers._servers[srv_idx].ip,
+                                        auth_servers._servers[srv_idx].port}};
+    // the server would drop the whole C_RESUME: resume without early data.
+    gsl::span<const uint8_t> early {early_data};
+    if (early_data.size() > tkt.value()._max_early_data)
+        early = gsl::span<const uint8_t> ();
+
+    const Nonce nonce = _rnd->uniform<Nonce>();
+    auto keys = resume_keys (tkt.value()._params, nonce, Role::Client);
+    if (!keys.has_value())
+        return {nullptr, Link_ID {{IP(), UDP_Port{0}}}};
+    auto &enc_write = keys.value()._enc_write;
+    auto &hmac_write = keys.value()._hmac_write;
+    auto &ecc_write = keys.value()._ecc_write;
+
+    const uint16_t enc_length = static_cast<uint16_t> (
+                                            Conn0_Resume_Data::min_size() +
+                                            static_cast<size_t> (early.size()) +
+                                            enc_write->bytes_overhead() +
+                                            hmac_write->bytes_overhead() +
+                                            ecc_write->bytes_overhead());
+    // like the C_INIT: the S_RESUME must not be bigger than this.
+    uint16_t msg_size = static_cast<uint16_t> (Conn0_C_RESUME::min_size() +
+                                            tkt.value()._ticket.size() +
+                                            enc_length);
+    if (msg_size < conn_init_minlen)
+        msg_size = conn_init_minlen;
+    auto pkt = std::make_unique<Packet> (PKT_MINLEN + msg_size);
+    pkt->set_header (Conn_ID{0}, 0, _rnd);
+    auto stream = pkt->add_stream (Stream_ID {0}, Stream::Fragment::FULL,
+                                                        Counter {0}, msg_size);
+    auto c_resume = Conn0_C_RESUME (stream->data(), nonce,
+                                        tkt.value()._ticket, enc_length);
+    if (!c_resume)
+        return {nullptr, Link_ID {{IP(), UDP_Port{0}}}};
+    const Conn_ID client_id = reserve_conn_id (_client_next_tracked);
+    auto resume_data = Conn0_Resume_Data (c_resume.as_cleartext (
+                                                    enc_write->bytes_header() +
+                                                    hmac_write->bytes_header() +
+                                                    ecc_write->bytes_header(),
+                                                    enc_write->bytes_footer() +
+                                                    hmac_write->bytes_footer() +
+                                                    ecc_write->bytes_footer()),
+                                        client_id,
+                                        _rnd->uniform<uint8_t> (0, 7),
+                                        Packet::Alignment_Flag::UINT8,
+                                        Stream_ID {_rnd->uniform<uint16_t>()},
+                                        Stream_ID {_rnd->uniform<uint16_t>()},
+                                        static_cast<uint32_t> (age.count()),
+                                        early);
+    if (!resume_data)
+        return {nullptr, Link_ID {{IP(), UDP_Port{0}}}};
 
-    auto raw_id = static_cast<std::pair<Counter, Stream_ID>> (h_id);
-    pkt->stream[0].set_header (std::get<Stream_ID> (raw_id),
-                                                   Stream::Fragment::FULL,
-                                                   std::get<Counter> (raw_id));
-    copy_pkt->stream[0].set_header (std::get<Stream_ID> (raw_id),
-                                                   Stream::Fragment::FULL,
-                                                   std::get<Counter> (raw_id));
-    _client_active.emplace_back (h_id, state_client (auth_servers,
-                                                srv_idx.value(),
-                                                static_cast<uint16_t> (key_idx),
-                                                std::move(copy_pkt)));
-    std::sort (_client_active.begin(), _client_active.end(), []
-                (const auto &state_a, const auto &state_b)
-                    {
-                        return std::get<Handshake::ID> (state_a) <
-                                            std::get<Handshake::ID> (state_b);
-                    });
+    // track the CLEARTEXT packet (copy)
+    auto copy_raw = pkt->raw;
+    auto copy_pkt = std::make_unique<Packet> (std::move(copy_raw));
+    copy_pkt->add_stream (Stream_ID {0}, Stream::Fragment::FULL,
+                                                        Counter {0}, msg_size);
+
+    if (enc_write->encrypt (c_resume.as_cleartext (hmac_write->bytes_header() +
+                                                    ecc_write->bytes_header(),
+                                                    hmac_write->bytes_footer() +
+                                                    ecc_write->bytes_footer()))
+                                                            != Error::NONE ||
+            hmac_write->add_hmac (c_resume.as_cleartext (
+                                                    ecc_write->bytes_header(),
+                                                    ecc_write->bytes_footer()))
+                                                            != Error::NONE ||
+            ecc_write->add_ecc (c_resume._enc_data) != Error::NONE) {
+        return {nullptr, Link_ID {{IP(), UDP_Port{0}}}};
+    }
+
+    state_client state (auth_servers, srv_idx, 0, std::move(copy_pkt));
+    state._type = Conn0_Type::C_RESUME;
+    resume_params next = tkt.value()._params;
+    next._secret = keys.value()._next_secret;
+    sodium_memzero (keys.value()._next_secret.data(),
+                                        keys.value()._next_secret.size());
+    state._keys = std::make_unique<conn_keys> (std::move(keys.value()));
+    state._resume = type_safe::make_optional (next);
+    sodium_memzero (next._secret.data(), next._secret.size());
+    state._sent_to.push_back (srv_dest);
+    track_client (*pkt, std::move(state));
     return {std::move(pkt), srv_dest};
 }
 
+namespace {
+// The MAC cookie, the server key and the ticket are opened by any process
+// with the same cookie secret, maybe on another host:
+// fixed little endian fields, not the memory layout of the structs.
+template<typename T, typename In>
+uint8_t *put_le (uint8_t *const out, const In value)
+{
+    const T raw = h_to_l<T> (static_cast<T> (value));
+    memcpy (out, &raw, sizeof(raw));
+    return out + sizeof(raw);
+}
+template<typename T, typename Out>
+const uint8_t *get_le (const uint8_t *const in, Out &value)
+{
+    T raw;
+    memcpy (&raw, in, sizeof(raw));
+    value = static_cast<Out> (l_to_h<T> (raw));
+    return in + sizeof(raw);
+}
+
+// ip version, address, port
+constexpr size_t link_bytes = 1 + 16 + sizeof(uint16_t);
+uint8_t *put_link (uint8_t *const out, const Link_ID link)
+{
+    const IP ip = link.ip();
+    std::fill (out, out + link_bytes, 0);
+    out[0] = ip.ipv6 ? 6 : 4;
+    if (ip.ipv6) {
+        memcpy (out + 1, &ip.ip.v6, 16);
+    } else {
+        memcpy (out + 1, &ip.ip.v4, 4);
+    }
+    return put_le<uint16_t> (out + 1 + 16, link.udp_port());
+}
+// nullptr: not a link
+const uint8_t *get_link (const uint8_t *const in, Link_ID &link)
+{
+    if (in[0] != 4 && in[0] != 6)
+        return nullptr;
+    const IP ip (in + 1, in[0] == 6);
+    UDP_Port port {0};
+    const uint8_t *const end = get_le<uint16_t> (in + 1 + 16, port);
+    link = Link_ID {{ip, port}};
+    return end;
+}
+
+// cleartext of the MAC cookie, sealed with _srv_secret.
+// The hash covers the C_INIT (with its nonce) and the S_COOKIE header,
+// so that the S_KEYS signature covers the whole negotiation.
+struct FENRIR_LOCAL mac_cookie_format {
+    static constexpr size_t bytes = crypto_generichash_BYTES + link_bytes +
+                                    sizeof(int64_t) + 6 * sizeof(uint16_t);
+    std::array<uint8_t, crypto_generichash_BYTES> _cs_hash;
+    Link_ID _client;
+    int64_t _time;
+    Crypto::Key::Serial _key_id;
+    Crypto::Encryption::ID _enc;
+    Crypto::Hmac::ID _hmac;
+    Recover::ECC::ID _ecc;
+    Crypto::Key::ID _key;
+    Crypto::KDF::ID _kdf;
+
+    // "out": "bytes" long
+    void write (uint8_t *out) const
+    {
+        out = std::copy (_cs_hash.begin(), _cs_hash.end(), out);
+        out = put_link (out, _client);
+        out = put_le<int64_t> (out, _time);
+        out = put_le<uint16_t> (out, _key_id);
+        out = put_le<uint16_t> (out, _enc);
+        out = put_le<uint16_t> (out, _hmac);
+        out = put_le<uint16_t> (out, _ecc);
+        out = put_le<uint16_t> (out, _key);
+        put_le<uint16_t> (out, _kdf);
+    }
+    bool read (const uint8_t *in)
+    {
+        std::copy (in, in + _cs_hash.size(), _cs_hash.begin());
+        in = get_link (in + _cs_hash.size(), _client);
+        if (in == nullptr)
+            return false;
+        in = get_le<int64_t> (in, _time);
+        in = get_le<uint16_t> (in, _key_id);
+        in = get_le<uint16_t> (in, _enc);
+        in = get_le<uint16_t> (in, _hmac);
+        in = get_le<uint16_t> (in, _ecc);
+        in = get_le<uint16_t> (in, _key);
+        get_le<uint16_t> (in, _kdf);
+        return true;
+    }
+};
+} // empty namespace
+
 FENRIR_INLINE void Handshake::answer_c_init (const Link_ID recv_from,
                                                         const Link_ID recv_to,
                                                         const Packet &pkt,
@@ -365,33 +959,64 @@ FENRIR_INLINE void Handshake::answer_c_init (const Link_ID recv_from,
 
     int64_t timestamp =
             std::chrono::duration_cast<std::chrono::milliseconds> (
-                std::chrono::steady_clock::now().time_since_epoch()).count();
+                std::chrono::system_clock::now().time_since_epoch()).count();
 
     const auto supported_auth = _load->list<Crypto::Auth>();
 
-    const uint16_t sign_length = priv->signature_length();
+    const bool mac_cookie = _cookie_mode.load (std::memory_order_relaxed) ==
+                                                            Cookie_Mode::MAC;
+    const uint16_t sign_length = mac_cookie ? 0 : priv->signature_length();
+    const uint16_t cookie_length = mac_cookie ?
+                        static_cast<uint16_t> (_srv_secret.bytes_overhead() +
+                                                    mac_cookie_format::bytes) :
+                                                                sign_length;
     const uint16_t total_length = static_cast<uint16_t> (
                             Conn0_S_COOKIE::min_size() +
                             static_cast<uint32_t> (sizeof(Crypto::Auth::ID) *
                                                         supported_auth.size() +
-                                                            2 * sign_length));
+                                                sign_length + cookie_length));
     auto answer = std::make_unique<Packet> (total_length + PKT_MINLEN);
     answer->set_header (Conn_ID{0}, 0, _rnd);
     Stream *str = answer->add_stream (pkt.stream[0].id(),Stream::Fragment::FULL,
                                         pkt.stream[0].counter(), total_length);
     auto cookie = Conn0_S_COOKIE (str->data(), sel_enc, sel_hmac, sel_ecc,
                                         sel_key, sel_kdf, timestamp,
-                                        std::move(supported_auth), sign_length);
+                                        std::move(supported_auth),
+                                        sign_length, cookie_length);
     if (!cookie)
         return;
     std::vector<uint8_t> cs_tosign = cookie.client_server_data_tosign (data);
 
-
-    if (!priv->sign (cs_tosign, cookie._cs_data_signature))
-        return; // can't sign for some reason
-    auto s_tosign = cookie.server_data_tosign();
-    if (!priv->sign (s_tosign, cookie._s_data_signature))
-        return; // can't sign for some reason
+    if (mac_cookie) {
+        // no public key work until the client proves its address
+        std::fill (cookie._s_data_signature.begin(),
+                                        cookie._s_data_signature.end(), 0);
+        mac_cookie_format mac;
+        crypto_generichash (mac._cs_hash.data(), mac._cs_hash.size(),
+                                                    cs_tosign.data(),
+                                                    cs_tosign.size(),
+                                                    nullptr, 0);
+        mac._client = recv_from;
+        mac._time   = timestamp;
+        mac._key_id = data.r->_key_id;
+        mac._enc    = sel_enc;
+        mac._hmac   = sel_hmac;
+        mac._ecc    = sel_ecc;
+        mac._key    = sel_key;
+        mac._kdf    = sel_kdf;
+        mac.write (cookie._s_data_signature.data() +
+                                                _srv_secret.bytes_header());
+        if (_srv_secret.encrypt (cookie._s_data_signature) !=
+                                                            Impl::Error::NONE) {
+            return;
+        }
+    } else {
+        if (!priv->sign (cs_tosign, cookie._cs_data_signature))
+            return; // can't sign for some reason
+        auto s_tosign = cookie.server_data_tosign();
+        if (!priv->sign (s_tosign, cookie._s_data_signature))
+            return; // can't sign for some reason
+    }
     return _handler->proxy_enqueue (recv_to, recv_from,
                                     std::move(answer), Conn0_Type::S_COOKIE);
 }
@@ -401,8 +1026,8 @@ FENRIR_INLINE void Handshake::answer_s_cookie (const Link_ID recv_from,
                                                     const Packet &pkt,
                                                     const Conn0_S_COOKIE data)
 {
+    // MAC cookies have no _cs_data_signature
     if (!data || data._supported_auth.size() == 0 ||
-                                        data._cs_data_signature.size() == 0 ||
                                         data._s_data_signature.size() == 0) {
         return;
     }
@@ -411,19 +1036,12 @@ FENRIR_INLINE void Handshake::answer_s_cookie (const Link_ID recv_from,
                                                         pkt.stream[0].id()});
     Shared_Lock_Guard<Shared_Lock_Read> lock {Shared_Lock_NN{&_mtx}};
     // search previous packet in _cative handshakes
-    auto it = std::lower_bound (_client_active.begin(), _client_active.end(),
-                        hshake_id,
-                            [] (const auto &el, const Handshake::ID id)
-                                { return std::get<Handshake::ID> (el) < id; });
-
-    if (it == _client_active.end() ||
-                    std::get<Handshake::ID> (*it) != hshake_id ||
-                    std::get<state_client> (*it)._type != Conn0_Type::C_INIT){
+    state_client *state = _client_active.find (hshake_id);
+    if (state == nullptr || state->_type != Conn0_Type::C_INIT)
         return; // random packet. Don't answer.
-    }
 
     // test the received data correctness based on our sent data:
-    Conn0_C_INIT prev_data (std::get<state_client>(*it)._pkt->stream[0].data());
+    Conn0_C_INIT prev_data (state->_pkt->stream[0].data());
     if (!prev_data)
         return;
 
@@ -450,13 +1068,22 @@ FENRIR_INLINE void Handshake::answer_s_cookie (const Link_ID recv_from,
                                     static_cast<ssize_t>(v_cs_to_test.size()));
     const auto  s_to_test = data.server_data_tosign();
 
-    const auto key_idx = std::get<state_client> (*it)._key_idx;
-    Crypto::Key *const srv_key_ptr =
-                    std::get<std::shared_ptr<Crypto::Key>>
-                    (std::get<state_client> (*it)._auth_servers._key[key_idx])
-                                                                        .get();
-
-    if (!srv_key_ptr->verify (span_cs_to_test, data._cs_data_signature) ||
+    const auto key_idx = state->_key_idx;
+    Crypto::Key *const srv_key_ptr = std::get<std::shared_ptr<Crypto::Key>> (
+                                    state->_auth_servers._key[key_idx]).get();
+
+    type_safe::optional<std::array<uint8_t, crypto_generichash_BYTES>>
+                                                cs_hash {type_safe::nullopt};
+    if (data._cs_data_signature.size() == 0) {
+        // MAC cookie: the server will sign the hash in the S_KEYS.
+        // we send nothing secret before that.
+        std::array<uint8_t, crypto_generichash_BYTES> hash;
+        crypto_generichash (hash.data(), hash.size(), v_cs_to_test.data(),
+                                                        v_cs_to_test.size(),
+                                                        nullptr, 0);
+        cs_hash = type_safe::make_optional (hash);
+    } else if (!srv_key_ptr->verify (span_cs_to_test,
+                                                data._cs_data_signature) ||
             !srv_key_ptr->verify (      s_to_test, data._s_data_signature)) {
          return; // malicious/malformed packet. Don't answer.
     }
@@ -511,22 +1138,21 @@ FENRIR_INLINE void Handshake::answer_s_cookie (const Link_ID recv_from,
     if (std::get<Shared_Lock_STAT> (write_lock) ==
                                     Shared_Lock_STAT::UNLOCKED_AND_RELOCKED) {
         // could not upgrade the lock
-        // it was unlocked and relocked. This means that the iterator might
-        // have been invalidated. get it again.
-        it = std::lower_bound (_client_active.begin(), _client_active.end(),
-                        hshake_id,
-                            [] (const auto &el, const Handshake::ID id)
-                                { return std::get<Handshake::ID> (el) < id; });
-
-        if (it == _client_active.end() ||
-                                std::get<Handshake::ID> (*it) != hshake_id ||
-                    std::get<state_client> (*it)._type != Conn0_Type::C_INIT) {
+        // it was unlocked and relocked. This means that the handshake might
+        // have been dropped. get it again.
+        state = _client_active.find (hshake_id);
+        if (state == nullptr || state->_type != Conn0_Type::C_INIT)
             return;
-        }
     }
-    std::get<state_client> (*it)._type = Conn0_Type::C_COOKIE;
-    std::get<state_client> (*it)._client_key = std::move (our_key);
-    std::get<state_client> (*it)._pkt = std::move(copy_pkt);
+    state->_type = Conn0_Type::C_COOKIE;
+    state->_client_key = std::move (our_key);
+    state->_pkt = std::move(copy_pkt);
+    state->_cs_hash = std::move(cs_hash);
+    state->_sent = answer->raw;
+    state->_sent_from = recv_to;
+    state->_sent_to.assign (1, recv_from);
+    state->_retries = 0;
+    _client_active.rearm (hshake_id, retransmit_start);
     std::get<Shared_Lock_Guard<Shared_Lock_Write>> (write_lock).early_unlock();
 
     return _handler->proxy_enqueue (recv_to, recv_from,
@@ -534,7 +1160,10 @@ FENRIR_INLINE void Handshake::answer_s_cookie (const Link_ID recv_from,
 }
 
 namespace {
+// cleartext of the server data of the S_KEYS, sealed with _srv_secret
 struct FENRIR_LOCAL srv_key_format {
+    static constexpr size_t bytes = 64 + sizeof(int64_t) + sizeof(uint32_t) +
+                                                        4 * sizeof(uint16_t);
     std::array<uint8_t, 64> _key;
     int64_t _time;
     Conn_ID _reserved_conn;
@@ -542,6 +1171,28 @@ struct FENRIR_LOCAL srv_key_format {
     Crypto::Hmac::ID _hmac;
     Recover::ECC::ID _ecc;
     Crypto::KDF::ID _kdf;
+
+    // "out": "bytes" long
+    void write (uint8_t *out) const
+    {
+        out = std::copy (_key.begin(), _key.end(), out);
+        out = put_le<int64_t> (out, _time);
+        out = put_le<uint32_t> (out, _reserved_conn);
+        out = put_le<uint16_t> (out, _enc);
+        out = put_le<uint16_t> (out, _hmac);
+        out = put_le<uint16_t> (out, _ecc);
+        put_le<uint16_t> (out, _kdf);
+    }
+    void read (const uint8_t *in)
+    {
+        std::copy (in, in + _key.size(), _key.begin());
+        in = get_le<int64_t> (in + _key.size(), _time);
+        in = get_le<uint32_t> (in, _reserved_conn);
+        in = get_le<uint16_t> (in, _enc);
+        in = get_le<uint16_t> (in, _hmac);
+        in = get_le<uint16_t> (in, _ecc);
+        get_le<uint16_t> (in, _kdf);
+    }
 };
 } // empty namespace
 
@@ -559,7 +1210,7 @@ FENRIR_INLINE void Handshake::answer_c_cookie (const Link_ID recv_from,
     // check that the handshake happened in the last 5secs
     const int64_t time_now =
             std::chrono::duration_cast<std::chrono::milliseconds> (
-                std::chrono::steady_clock::now().time_since_epoch()).count();
+                std::chrono::system_clock::now().time_since_epoch()).count();
     if (data.r->_timestamp > time_now ||
                         (data.r->_timestamp + pkt_timeout.count()) < time_now) {
         // we don't do just one "if" clause to avoid overflows.
@@ -584,19 +1235,52 @@ FENRIR_INLINE void Handshake::answer_c_cookie (const Link_ID recv_from,
 
     lock.early_unlock();
 
-    std::vector<uint8_t> test_data (Conn0_S_COOKIE::min_size(), 0);
-    const Conn0_S_COOKIE test_cookie (test_data, data.r->_selected_crypt,
+    // the same mode for the cookie and the S_KEYS signature
+    const bool mac_cookie = _cookie_mode.load (std::memory_order_relaxed) ==
+                                                            Cookie_Mode::MAC;
+    std::array<uint8_t, crypto_generichash_BYTES> cs_hash;
+    if (mac_cookie) {
+        // authenticate/decrypt the cookie, and check it was for this client
+        if (static_cast<size_t> (data._cookie.size()) !=
+                                        (_srv_secret.bytes_overhead() +
+                                                mac_cookie_format::bytes)) {
+            return;
+        }
+        std::vector<uint8_t> dec_cookie_v (static_cast<size_t> (
+                                                    data._cookie.size()), 0);
+        gsl::span<uint8_t> dec_cookie (dec_cookie_v);
+        if (_srv_secret.decrypt (data._cookie, dec_cookie) !=
+                                                            Impl::Error::NONE) {
+            return;
+        }
+        mac_cookie_format mac;
+        if (!mac.read (dec_cookie.data()) || mac._client != recv_from ||
+                                    mac._time != data.r->_timestamp ||
+                                    mac._key_id != data.r->_key_id ||
+                                    mac._enc != data.r->_selected_crypt ||
+                                    mac._hmac != data.r->_selected_hmac ||
+                                    mac._ecc != data.r->_selected_ecc ||
+                                    mac._key != data.r->_selected_key ||
+                                    mac._kdf != data.r->_selected_kdf) {
+            return;
+        }
+        cs_hash = mac._cs_hash;
+    } else {
+        std::vector<uint8_t> test_data (Conn0_S_COOKIE::min_size(), 0);
+        const Conn0_S_COOKIE test_cookie (test_data, data.r->_selected_crypt,
                                             data.r->_selected_hmac,
                                             data.r->_selected_ecc,
                                             data.r->_selected_key,
                                             data.r->_selected_kdf,
                                             data.r->_timestamp,
-                                            std::vector<Crypto::Auth::ID>(), 0);
+                                            std::vector<Crypto::Auth::ID>(),
+                                                                        0, 0);
 
-    if (!priv->verify (test_cookie.server_data_tosign(), data._cookie))
-        return;
+        if (!priv->verify (test_cookie.server_data_tosign(), data._cookie))
+            return;
+    }
 
-    // signature OK, build answer
+    // cookie OK, build answer
     const uint16_t sign_length = priv->signature_length();
 
     const auto client_ephemeral =_load->get_shared<Crypto::Key> (
@@ -612,8 +1296,8 @@ FENRIR_INLINE void Handshake::answer_c_cookie (const Link_ID recv_from,
 
     const uint16_t pub_len = server_ephemeral->get_publen();
     const uint16_t key_exchange_len = server_ephemeral->get_key_data_length();
-    const uint16_t srv_enc_length = _srv_secret->bytes_overhead() +
-                                                sizeof(struct srv_key_format);
+    const uint16_t srv_enc_length = _srv_secret.bytes_overhead() +
+                                                        srv_key_format::bytes;
     const uint16_t total_length = Conn0_S_KEYS::min_size() +
                                                 pub_len + key_exchange_len +
                                                 srv_enc_length + sign_length;
@@ -628,58 +1312,47 @@ FENRIR_INLINE void Handshake::answer_c_cookie (const Link_ID recv_from,
                                                             key_exchange_len,
                                                             srv_enc_length,
                                                             sign_length);
-    struct srv_key_format *srv = reinterpret_cast<srv_key_format*> (
-                        s_keys._srv_enc.data() + _srv_secret->bytes_header());
+    srv_key_format srv;
 
     server_ephemeral->get_pubkey (s_keys._pubkey);
     server_ephemeral->get_key_data (s_keys._key_data);
     if (!server_ephemeral->exchange_key (client_ephemeral.get(),
                                                         data._client_key_data,
                                                         s_keys._key_data,
-                                                        srv->_key,
+                                                        srv._key,
                                                         Role::Server)) {
+        sodium_memzero (srv._key.data(), srv._key.size());
         return;
     }
 
     // reserve a connection id
-    uint32_t orig_id = _srv_next_tracked.load();
-    auto next_free = _handler->get_next_free (Conn_ID {orig_id});
-    uint32_t old_val = orig_id;
-    uint32_t new_val = static_cast<uint32_t> (next_free) + 1;
-    // now try to reserve "new_val - 1"
-    while (!_srv_next_tracked.compare_exchange_weak (old_val, new_val)) {
-        // could not exchange.
-        if (old_val >= new_val) {
-            if (orig_id <= new_val) {
-                // other threads already reserved new_val. Try next.
-                new_val = 1 + static_cast<uint32_t> (_handler->get_next_free (
-                                                            Conn_ID {old_val}));
-            } // else get_next(old_val) had overlowed. all ok.
-        } else {
-            // new_val < old_val
-            if (old_val < orig_id) {
-                // overflow. we can't reserve new_val. Try next.
-                new_val = 1 + static_cast<uint32_t> (_handler->get_next_free (
-                                                            Conn_ID {old_val}));
-                orig_id = old_val;
-            } // else all ok. we can still reserve new_val - 1
-        }
+    const Conn_ID next_free = reserve_conn_id (_srv_next_tracked);
+
+
+    srv._time = time_now;
+    srv._reserved_conn = next_free;
+    srv._enc  = data.r->_selected_crypt;
+    srv._hmac = data.r->_selected_hmac;
+    srv._ecc  = data.r->_selected_ecc;
+    srv._kdf  = data.r->_selected_kdf;
+    srv.write (s_keys._srv_enc.data() + _srv_secret.bytes_header());
+    sodium_memzero (srv._key.data(), srv._key.size());
+
+    if (_srv_secret.encrypt (s_keys._srv_enc) != Impl::Error::NONE) {
+        // never send the session key in clear
+        sodium_memzero (s_keys._srv_enc.data(),
+                                static_cast<size_t> (s_keys._srv_enc.size()));
+        return;
     }
-    // we have reserved "new_val - 1"
-    next_free = Conn_ID {new_val - 1};
-
-
-    srv->_time = time_now;
-    srv->_reserved_conn = next_free;
-    srv->_enc  = data.r->_selected_crypt;
-    srv->_hmac = data.r->_selected_hmac;
-    srv->_ecc  = data.r->_selected_ecc;
-    srv->_kdf  = data.r->_selected_kdf;
 
-    _srv_secret->encrypt (s_keys._srv_enc);
-
-    if (!priv->sign (s_keys.data_tosign(), s_keys._sign))
+    if (mac_cookie) {
+        // the first signature of the handshake: cover the negotiation, too.
+        const auto tosign = s_keys.data_tosign (cs_hash);
+        if (!priv->sign (tosign, s_keys._sign))
+            return;
+    } else if (!priv->sign (s_keys.data_tosign(), s_keys._sign)) {
         return;
+    }
 
     return _handler->proxy_enqueue (recv_to, recv_from,
                                         std::move(answer), Conn0_Type::S_KEYS);
@@ -699,38 +1372,37 @@ FENRIR_INLINE void Handshake::answer_s_keys (const Link_ID recv_from,
                                                         pkt.stream[0].id()});
     Shared_Lock_Guard<Shared_Lock_Read> lock {Shared_Lock_NN{&_mtx}};
     // search previous packet in _client_ative handshakes
-    auto it = std::lower_bound (_client_active.begin(), _client_active.end(),
-                        hshake_id,
-                            [] (const auto &el, const Handshake::ID id)
-                                { return std::get<Handshake::ID> (el) < id; });
-
-    if (it == _client_active.end() ||
-                    std::get<Handshake::ID> (*it) != hshake_id ||
-                    std::get<state_client> (*it)._type != Conn0_Type::C_COOKIE){
+    state_client *const state = _client_active.find (hshake_id);
+    if (state == nullptr || state->_type != Conn0_Type::C_COOKIE)
         return; // random packet. Don't answer.
-    }
 
-    Conn0_C_COOKIE prev_data (std::get<state_client> (*it)._pkt->stream[0].
-                                                                        data());
+    Conn0_C_COOKIE prev_data (state->_pkt->stream[0].data());
     if (prev_data.r->_nonce != data.r->_client_nonce)
         return;
 
     // check signature
-    auto key_idx = std::get<state_client> (*it)._key_idx;
-    if (!std::get<std::shared_ptr<Crypto::Key>> (
-            std::get<state_client> (*it)._auth_servers._key[key_idx])->verify (
-                                                            data.data_tosign(),
-                                                                data._sign)) {
+    auto key_idx = state->_key_idx;
+    Crypto::Key *const srv_key_ptr = std::get<std::shared_ptr<Crypto::Key>> (
+                                    state->_auth_servers._key[key_idx]).get();
+    const auto &cs_hash = state->_cs_hash;
+    if (cs_hash.has_value()) {
+        // MAC cookie: this is the first server signature we get.
+        const auto v_tosign = data.data_tosign (cs_hash.value());
+        const gsl::span<const uint8_t> tosign (v_tosign.data(),
+                                        static_cast<ssize_t>(v_tosign.size()));
+        if (!srv_key_ptr->verify (tosign, data._sign))
+            return;
+    } else if (!srv_key_ptr->verify (data.data_tosign(), data._sign)) {
         return;
     }
 
 
-    Crypto::Key *const our_key = std::get<state_client> (*it)._client_key.get();
+    Crypto::Key *const our_key = state->_client_key.get();
     std::array<uint8_t, 64> key;
     auto srv_ephemeral = _load->get_shared<Crypto::Key> (our_key->id());
     if (!srv_ephemeral->init (data._pubkey))
         return;
-    if (!std::get<state_client> (*it)._client_key->exchange_key (
+    if (!state->_client_key->exchange_key (
                                             srv_ephemeral.get(), data._key_data,
                                             prev_data._client_key_data, key,
                                                                 Role::Client)) {
@@ -786,6 +1458,15 @@ FENRIR_INLINE void Handshake::answer_s_keys (const Link_ID recv_from,
     kdf->get (7, context, tmp_key);
     if (!user_kdf->init (tmp_key))
         return;
+    // the server might give us a ticket for this
+    resume_params resume;
+    kdf->get (8, context, resume._secret);
+    resume._user = User_ID {0};
+    resume._enc  = prev_data.r->_selected_crypt;
+    resume._hmac = prev_data.r->_selected_hmac;
+    resume._ecc  = prev_data.r->_selected_ecc;
+    resume._kdf  = prev_data.r->_selected_kdf;
+    sodium_memzero (tmp_key.data(), tmp_key.size());
 
     // TODO: GET STREAMS DATA
     const uint16_t streams_num = 1;
@@ -819,31 +1500,7 @@ FENRIR_INLINE void Handshake::answer_s_keys (const Link_ID recv_from,
     auto c_auth = Conn0_C_AUTH (str->data(), data._srv_enc, auth_data_len);
 
     // reserve a connection id
-    uint32_t orig_id = _client_next_tracked.load();
-    auto client_id = _handler->get_next_free (Conn_ID {orig_id});
-    uint32_t old_val = orig_id;
-    uint32_t new_val = static_cast<uint32_t> (client_id) + 1;
-    // now try to reserve "new_val - 1"
-    while (!_client_next_tracked.compare_exchange_weak (old_val, new_val)) {
-        // could not exchange.
-        if (old_val >= new_val) {
-            if (orig_id <= new_val) {
-                // other threads already reserved new_val. Try next.
-                new_val = 1 + static_cast<uint32_t> (_handler->get_next_free (
-                                                            Conn_ID {old_val}));
-            } // else get_next(old_val) had overlowed. all ok.
-        } else {
-            // new_val < old_val
-            if (old_val < orig_id) {
-                // overflow. we can't reserve new_val. Try next.
-                new_val = 1 + static_cast<uint32_t> (_handler->get_next_free (
-                                                            Conn_ID {old_val}));
-                orig_id = old_val;
-            } // else all ok. we can still reserve new_val - 1
-        }
-    }
-    // we have reserved "new_val - 1"
-    client_id = Conn_ID {new_val - 1};
+    const Conn_ID client_id = reserve_conn_id (_client_next_tracked);
 
     // FIXME: get the device id /service id/usernames raw_auth_data somewhere
     Device_ID test_dev_id   {{{ 4,4,4,4,4,4,4,4,
@@ -902,14 +1559,8 @@ FENRIR_INLINE void Handshake::answer_s_keys (const Link_ID recv_from,
     ecc_write->add_ecc   (c_auth._enc_data);
     Shared_Lock_Guard<Shared_Lock_Write> w_lock {Shared_Lock_NN{&_mtx}};
     // search previous packet in _active handshakes
-    auto pkt_it = std::lower_bound (_client_active.begin(),_client_active.end(),
-                        hshake_id,
-                            [] (const auto &el, const Handshake::ID id)
-                                { return std::get<Handshake::ID> (el) < id; });
-
-    if (pkt_it == _client_active.end() ||
-                std::get<Handshake::ID> (*pkt_it) != hshake_id ||
-                std::get<state_client> (*pkt_it)._type != Conn0_Type::C_COOKIE){
+    state_client *const advance = _client_active.find (hshake_id);
+    if (advance == nullptr || advance->_type != Conn0_Type::C_COOKIE) {
         // did we lose the hadshake?
         // can happen if the server sends the S_KEYS packet twice to avoid
         // trasnmission errors, and we reeive both. This means we already
@@ -917,16 +1568,23 @@ FENRIR_INLINE void Handshake::answer_s_keys (const Link_ID recv_from,
         return;
     }
 
-    std::get<state_client> (*pkt_it)._type = Conn0_Type::C_AUTH;
-    std::get<state_client> (*pkt_it)._pkt = std::move(copy_pkt);
-    std::get<state_client> (*pkt_it)._enc_read = std::move(enc_read);
-    std::get<state_client> (*pkt_it)._hmac_read = std::move(hmac_read);
-    std::get<state_client> (*pkt_it)._ecc_read = std::move(ecc_read);
-    std::get<state_client> (*pkt_it)._enc_write = std::move(enc_write);
-    std::get<state_client> (*pkt_it)._hmac_write = std::move(hmac_write);
-    std::get<state_client> (*pkt_it)._ecc_write = std::move(ecc_write);
-    std::get<state_client> (*pkt_it)._user_kdf = std::move(user_kdf);
-    std::get<state_client> (*pkt_it)._client_key = nullptr;
+    advance->_type = Conn0_Type::C_AUTH;
+    advance->_pkt = std::move(copy_pkt);
+    advance->_keys = std::make_unique<conn_keys>();
+    advance->_keys->_enc_read = std::move(enc_read);
+    advance->_keys->_hmac_read = std::move(hmac_read);
+    advance->_keys->_ecc_read = std::move(ecc_read);
+    advance->_keys->_enc_write = std::move(enc_write);
+    advance->_keys->_hmac_write = std::move(hmac_write);
+    advance->_keys->_ecc_write = std::move(ecc_write);
+    advance->_keys->_user_kdf = std::move(user_kdf);
+    advance->_client_key = nullptr;
+    advance->_resume = type_safe::make_optional (resume);
+    advance->_sent = answer->raw;
+    advance->_sent_from = recv_to;
+    advance->_sent_to.assign (1, recv_from);
+    advance->_retries = 0;
+    _client_active.rearm (hshake_id, retransmit_start);
     w_lock.early_unlock();
 
 
@@ -943,46 +1601,54 @@ FENRIR_INLINE void Handshake::answer_c_auth (const Link_ID recv_from,
     if (pkt.raw.size() < pkt_init_minlen || !data ||
                         data._enc_data.size() <  Conn0_Auth_Data::min_size() ||
                         static_cast<size_t> (data._srv_key.size()) !=
-                                        (_srv_secret->bytes_overhead() +
-                                            sizeof(struct srv_key_format))) {
+                                        (_srv_secret.bytes_overhead() +
+                                                    srv_key_format::bytes)) {
         return;
     }
+    // the connection might already be there: answer again, if we did.
+    const auto request = Result_Cache::hash (pkt.stream[0].data());
+    if (resend_result (request, recv_from, recv_to, Conn0_Type::S_RESULT))
+        return;
 
     // authenticate/decrypt the _srv_key
-    std::vector<uint8_t> dec_srv_key_v (sizeof(srv_key_format) +
-                                            _srv_secret->bytes_overhead(), 0);
-    gsl::span<uint8_t> dec_srv_key (dec_srv_key_v);
-    if (_srv_secret->decrypt (data._srv_key, dec_srv_key) != Impl::Error::NONE){
+    gsl::span<uint8_t> dec_srv_key;
+    if (_srv_secret.decrypt (data._srv_key, dec_srv_key) != Impl::Error::NONE){
         return;
     }
-    auto srv = reinterpret_cast<struct srv_key_format*> (dec_srv_key.data());
+    srv_key_format srv;
+    srv.read (dec_srv_key.data());
+    sodium_memzero (dec_srv_key.data(),
+                                static_cast<size_t> (dec_srv_key.size()));
     const int64_t time_now =
             std::chrono::duration_cast<std::chrono::milliseconds> (
-                std::chrono::steady_clock::now().time_since_epoch()).count();
-    if (srv->_time > time_now || (srv->_time + pkt_timeout.count()) < time_now)
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    if (srv._time > time_now || (srv._time + pkt_timeout.count()) < time_now)
         return;
 
-    if (!_load->has<Crypto::Encryption> (srv->_enc) ||
-                                    !_load->has<Crypto::Hmac> (srv->_hmac)) {
+    if (!_load->has<Crypto::Encryption> (srv._enc) ||
+                                    !_load->has<Crypto::Hmac> (srv._hmac)) {
         return;
     }
 
     //The next check is not definitive, try again when allocating the connection
-    if (_handler->get_connection (srv->_reserved_conn) != nullptr)
+    if (_handler->get_connection (srv._reserved_conn) != nullptr)
         return;
 
-    auto kdf = _load->get_shared<Crypto::KDF> (srv->_kdf);
-    auto user_kdf = _load->get_shared<Crypto::KDF> (srv->_kdf);
-    if (kdf == nullptr || user_kdf == nullptr || !kdf->init (srv->_key))
+    auto kdf = _load->get_shared<Crypto::KDF> (srv._kdf);
+    auto user_kdf = _load->get_shared<Crypto::KDF> (srv._kdf);
+    const bool kdf_ok = kdf != nullptr && user_kdf != nullptr &&
+                                                        kdf->init (srv._key);
+    sodium_memzero (srv._key.data(), srv._key.size());
+    if (!kdf_ok)
         return;
 
     constexpr std::array<char, 8> context {{ "FENRIR_" }};
     std::array<uint8_t, 64> tmp_key;
 
     // load encryption keys
-    auto enc_read = _load->get_shared<Crypto::Encryption> (srv->_enc);
-    auto hmac_read = _load->get_shared<Crypto::Hmac> (srv->_hmac);
-    auto ecc_read = _load->get_shared<Recover::ECC> (srv->_ecc);
+    auto enc_read = _load->get_shared<Crypto::Encryption> (srv._enc);
+    auto hmac_read = _load->get_shared<Crypto::Hmac> (srv._hmac);
+    auto ecc_read = _load->get_shared<Recover::ECC> (srv._ecc);
     if (enc_read == nullptr || hmac_read == nullptr || ecc_read == nullptr)
         return;
     if (hmac_read->id() == Crypto::Hmac::ID{1} && !enc_read->is_authenticated())
@@ -1046,31 +1712,38 @@ FENRIR_INLINE void Handshake::answer_c_auth (const Link_ID recv_from,
                                         static_cast<uint32_t> (max_counter))};
     const uint8_t srv_max_padding = _rnd->uniform<uint8_t> (0, 16);
     const auto srv_alignment = Packet::Alignment_Flag::UINT8;
-    std::shared_ptr<Crypto::Encryption> enc_write;
-    std::shared_ptr<Crypto::Hmac> hmac_write;
-    std::shared_ptr<Recover::ECC> ecc_write;
+    // the answer is encrypted even on failure
+    auto enc_write = _load->get_shared<Crypto::Encryption> (srv._enc);
+    auto hmac_write = _load->get_shared<Crypto::Hmac> (srv._hmac);
+    auto ecc_write = _load->get_shared<Recover::ECC> (srv._ecc);
+    if (enc_write == nullptr || hmac_write == nullptr || ecc_write == nullptr)
+        return;
+    kdf->get (4, context, tmp_key);
+    enc_write->set_key (tmp_key);
+    kdf->get (5, context, tmp_key);
+    hmac_write->set_key (tmp_key);
+    kdf->get (6, context, tmp_key);
+    if (!ecc_write->init (tmp_key))
+        return;
+
+    type_safe::optional<resume_params> ticket {type_safe::nullopt};
     if (!auth_res._failed) {
         // TODO: Contact service, ask for the connection ID, XORed keys
         // and whatnot
 
         // allocate connection
-        enc_write = _load->get_shared<Crypto::Encryption> (srv->_enc);
-        hmac_write = _load->get_shared<Crypto::Hmac> (srv->_hmac);
-        ecc_write = _load->get_shared<Recover::ECC> (srv->_ecc);
-        if (enc_write == nullptr || hmac_write == nullptr ||
-                                                        ecc_write == nullptr) {
-            return;
-        }
-        kdf->get (4, context, tmp_key);
-        enc_write->set_key (tmp_key);
-        kdf->get (5, context, tmp_key);
-        hmac_write->set_key (tmp_key);
-        kdf->get (6, context, tmp_key);
-        if (!ecc_write->init (tmp_key))
-            return;
         kdf->get (7, context, tmp_key);
         if (!user_kdf->init (tmp_key))
             return;
+        resume_params resume;
+        kdf->get (8, context, resume._secret);
+        resume._user = auth_res._user_id;
+        resume._enc  = srv._enc;
+        resume._hmac = srv._hmac;
+        resume._ecc  = srv._ecc;
+        resume._kdf  = srv._kdf;
+        ticket = type_safe::make_optional (resume);
+        sodium_memzero (resume._secret.data(), resume._secret.size());
 
 
         auto conn = Connection::mk_shared (Role::Server,
@@ -1080,7 +1753,7 @@ FENRIR_INLINE void Handshake::answer_c_auth (const Link_ID recv_from,
                                             client_auth_data.r->_control_stream,
                                             srv_control_stream,
                                             client_auth_data.r->_client_conn_id,
-                                            srv->_reserved_conn,
+                                            srv._reserved_conn,
                                             control_stream_start,
                                             Packet::Flag_To_Byte (
                                                 client_auth_data.r->_alignment),
@@ -1095,11 +1768,98 @@ FENRIR_INLINE void Handshake::answer_c_auth (const Link_ID recv_from,
         if (_handler->add_connection (std::move(conn)) != Error::NONE)
             return; // there already is such a connection.
     }
+    sodium_memzero (tmp_key.data(), tmp_key.size());
+
+    // Connection 0 is reserved, we can use this to give back any
+    // kind of failure. We don't want to give back any
+    // "no such user", "wrong pass" or internal error anyway.
+    auto answer = mk_result (pkt, Conn0_Type::S_RESULT,
+                                auth_res._failed ? Conn_ID {0} :
+                                                        srv._reserved_conn,
+                                control_stream_start, srv_control_stream,
+                                srv_alignment, srv_max_padding,
+                                enc_write.get(), hmac_write.get(),
+                                ecc_write.get(), ticket, type_safe::nullopt);
+    if (ticket.has_value()) {
+        sodium_memzero (ticket.value()._secret.data(),
+                                            ticket.value()._secret.size());
+    }
+    if (answer == nullptr)
+        return; // TODO: what to do now? drop earlier connection?
+
+    _results.add (request, recv_from, answer->raw);
+    return _handler->proxy_enqueue (recv_to, recv_from,
+                                    std::move(answer), Conn0_Type::S_RESULT);
+}
+
+// the client did not get our answer, and sent the same request again
+FENRIR_INLINE bool Handshake::resend_result (const Result_Cache::key &request,
+                                                const Link_ID from,
+                                                const Link_ID to,
+                                                const Conn0_Type type)
+{
+    std::vector<uint8_t> answer;
+    if (!_results.find (request, from, answer))
+        return false;
+    _handler->proxy_enqueue (to, from,
+                        std::make_unique<Packet> (std::move(answer)), type);
+    return true;
+}
+
+// S_RESULT and S_RESUME. "ticket": issue a resumption ticket for these
+// "stream": the data stream of the resumed connection, else a new one.
+FENRIR_INLINE void Handshake::ticket_format::write (uint8_t *out) const
+{
+    out = std::copy (_params._secret.begin(), _params._secret.end(), out);
+    out = put_le<uint64_t> (out, _params._user);
+    out = put_le<uint16_t> (out, _params._enc);
+    out = put_le<uint16_t> (out, _params._hmac);
+    out = put_le<uint16_t> (out, _params._ecc);
+    out = put_le<uint16_t> (out, _params._kdf);
+    out = put_le<uint16_t> (out, _stream._id);
+    out = put_le<uint32_t> (out, _stream._counter_start);
+    out = put_le<uint8_t> (out, _stream._type);
+    out = put_le<uint8_t> (out, _stream._priority);
+    put_le<int64_t> (out, _issued);
+}
+
+FENRIR_INLINE void Handshake::ticket_format::read (const uint8_t *in)
+{
+    std::copy (in, in + _params._secret.size(), _params._secret.begin());
+    in = get_le<uint64_t> (in + _params._secret.size(), _params._user);
+    in = get_le<uint16_t> (in, _params._enc);
+    in = get_le<uint16_t> (in, _params._hmac);
+    in = get_le<uint16_t> (in, _params._ecc);
+    in = get_le<uint16_t> (in, _params._kdf);
+    in = get_le<uint16_t> (in, _stream._id);
+    in = get_le<uint32_t> (in, _stream._counter_start);
+    in = get_le<uint8_t> (in, _stream._type);
+    in = get_le<uint8_t> (in, _stream._priority);
+    get_le<int64_t> (in, _issued);
+}
 
-    // build answer
+FENRIR_INLINE std::unique_ptr<Packet> Handshake::mk_result (const Packet &pkt,
+                                    const Conn0_Type type,
+                                    const Conn_ID conn,
+                                    const Counter control_start,
+                                    const Stream_ID control_stream,
+                                    const Packet::Alignment_Flag alignment,
+                                    const uint8_t max_padding,
+                                    Crypto::Encryption *const enc_write,
+                                    Crypto::Hmac *const hmac_write,
+                                    Recover::ECC *const ecc_write,
+                            const type_safe::optional<resume_params> &ticket,
+            const type_safe::optional<Conn0_Auth_Result::stream_info> &stream)
+{
+    const uint16_t ticket_length = !ticket.has_value() ? 0 :
+                        static_cast<uint16_t> (_srv_secret.bytes_overhead() +
+                                                        ticket_format::bytes);
     const uint16_t answer_length = Conn0_Auth_Result::min_size() +
                                 Conn0_Auth_Result::stream_info_size (1) +
-                                enc_read->bytes_overhead() + hmac_read->bytes_overhead();
+                                ticket_length +
+                                enc_write->bytes_overhead() +
+                                hmac_write->bytes_overhead() +
+                                ecc_write->bytes_overhead();
 
     auto answer = std::make_unique<Packet> (Conn0_S_RESULT::min_size() +
                                                     answer_length + PKT_MINLEN);
@@ -1108,7 +1868,7 @@ FENRIR_INLINE void Handshake::answer_c_auth (const Link_ID recv_from,
                                                     pkt.stream[0].counter(),
                                                     Conn0_S_RESULT::min_size()
                                                             + answer_length);
-    Conn0_S_RESULT srv_res (str->data(), answer_length);
+    Conn0_S_RESULT srv_res (str->data(), answer_length, type);
     Conn0_Auth_Result srv_data (srv_res.as_cleartext (
                                                     enc_write->bytes_header() +
                                                     hmac_write->bytes_header() +
@@ -1116,45 +1876,175 @@ FENRIR_INLINE void Handshake::answer_c_auth (const Link_ID recv_from,
                                                     enc_write->bytes_footer() +
                                                     hmac_write->bytes_footer() +
                                                     ecc_write->bytes_footer()),
-                                srv->_reserved_conn,
-                                control_stream_start,
-                                srv_control_stream,
-                                srv_alignment,
-                                srv_max_padding,
-                                1); // TODO: moar streamz
-    srv_data._streams[0]._id = Stream_ID {_rnd->uniform<uint16_t>()};
-    srv_data._streams[0]._counter_start = Counter {_rnd->uniform<uint32_t> (0,
-                                        static_cast<uint32_t> (max_counter))};
-    srv_data._streams[0]._type = Storage_t::COMPLETE | Storage_t::ORDERED  |
+                                conn,
+                                control_start,
+                                control_stream,
+                                alignment,
+                                max_padding,
+                                early_data_limit(),
+                                1, // TODO: moar streamz
+                                ticket_length);
+    if (!srv_data)
+        return nullptr;
+    if (stream.has_value()) {
+        srv_data._streams[0] = stream.value();
+    } else {
+        srv_data._streams[0]._id = Stream_ID {_rnd->uniform<uint16_t>()};
+        srv_data._streams[0]._type = Storage_t::COMPLETE | Storage_t::ORDERED |
                                                         Storage_t::RELIABLE |
                                                         Storage_t::UNICAST;
-    srv_data._streams[0]._priority = Stream_PRIO {0}; // TODO: priority
-
-    if (auth_res._failed) {
-        // Connection 0 is reserved, we can use this to give back any
-        // kind of failure. We don't want to give back any
-        // "no such user", "wrong pass" or internal error anyway.
-        srv_data.w->_conn_id = Conn_ID{0};
+        srv_data._streams[0]._priority = Stream_PRIO {0}; // TODO: priority
     }
+    // new keys, new counters.
+    srv_data._streams[0]._counter_start = Counter {_rnd->uniform<uint32_t> (0,
+                                        static_cast<uint32_t> (max_counter))};
 
+    if (ticket.has_value()) {
+        std::fill (srv_data._ticket.begin(), srv_data._ticket.end(), 0);
+        ticket_format tkt;
+        tkt._params = ticket.value();
+        tkt._stream = srv_data._streams[0];
+        tkt._issued = std::chrono::duration_cast<std::chrono::milliseconds> (
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        tkt.write (srv_data._ticket.data() + _srv_secret.bytes_header());
+        sodium_memzero (tkt._params._secret.data(),
+                                                tkt._params._secret.size());
+        if (_srv_secret.encrypt (srv_data._ticket) != Error::NONE)
+            return nullptr;
+    }
 
     if (enc_write->encrypt (srv_res.as_cleartext (hmac_write->bytes_header() +
                                                     ecc_write->bytes_header(),
                                                   hmac_write->bytes_footer() +
                                                     ecc_write->bytes_footer()))
                                                                 != Error::NONE){
-        return; // TODO: what to do now? drop earlier connection?
+        return nullptr;
     }
     if (hmac_write->add_hmac (srv_res.as_cleartext (ecc_write->bytes_header(),
                                                     ecc_write->bytes_footer()))
                                                                 != Error::NONE){
-        return;
+        return nullptr;
     }
     if (ecc_write->add_ecc (srv_res._enc) != Error::NONE)
+        return nullptr;
+    return answer;
+}
+
+FENRIR_INLINE void Handshake::answer_c_resume (const Link_ID recv_from,
+                                                    const Link_ID recv_to,
+                                                    const Packet &pkt,
+                                                    const Conn0_C_RESUME data)
+{
+    if (pkt.raw.size() < pkt_init_minlen || !data ||
+                    data._enc_data.size() < Conn0_Resume_Data::min_size() ||
+                    static_cast<size_t> (data._ticket.size()) !=
+                                        (_srv_secret.bytes_overhead() +
+                                                    ticket_format::bytes)) {
+        return;
+    }
+    // the nonce has been used: answer again, if we did.
+    const auto request = Result_Cache::hash (pkt.stream[0].data());
+    if (resend_result (request, recv_from, recv_to, Conn0_Type::S_RESUME))
         return;
 
+    // authenticate/decrypt the ticket
+    gsl::span<uint8_t> dec_ticket;
+    if (_srv_secret.decrypt (data._ticket, dec_ticket) != Error::NONE)
+        return; // garbage, or the key expired
+    ticket_format tkt;
+    tkt.read (dec_ticket.data());
+    sodium_memzero (dec_ticket.data(), static_cast<size_t> (dec_ticket.size()));
+    const int64_t time_now =
+            std::chrono::duration_cast<std::chrono::milliseconds> (
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    const int64_t issued = tkt._issued;
+    resume_params params = tkt._params;
+    const Conn0_Auth_Result::stream_info stream = tkt._stream;
+    sodium_memzero (tkt._params._secret.data(), tkt._params._secret.size());
+    if (issued > time_now || (issued + ticket_lifetime_ms) < time_now)
+        return;
+
+    auto keys = resume_keys (params, data.r->_nonce, Role::Server);
+    sodium_memzero (params._secret.data(), params._secret.size());
+    if (!keys.has_value())
+        return;
+    auto &enc_read = keys.value()._enc_read;
+    auto &hmac_read = keys.value()._hmac_read;
+    auto &ecc_read = keys.value()._ecc_read;
+
+    // test autenticity & decrypt
+    gsl::span<uint8_t> decrypted_data {data._enc_data};
+    if (ecc_read->correct (decrypted_data, decrypted_data) ==
+                                                    Recover::ECC::Result::ERR) {
+        return;
+    }
+    if (!hmac_read->is_valid (decrypted_data, decrypted_data))
+        return;
+    if (enc_read->decrypt (decrypted_data, decrypted_data) != Error::NONE)
+        return;
+    Conn0_Resume_Data resume (decrypted_data);
+    if (!resume || resume._early_data.size() > early_data_limit())
+        return;
+
+    // authenticated: now the replay checks can not be flooded with garbage.
+    if (!Ticket_Replay::in_window (issued, resume.r->_ticket_age, time_now) ||
+                        !_replay.fresh (static_cast<const std::array<uint8_t,
+                                        16>&> (data.r->_nonce), time_now)) {
+        return;
+    }
+
+    const Conn_ID srv_conn = reserve_conn_id (_srv_next_tracked);
+    const Stream_ID srv_control_stream {_rnd->uniform<uint16_t>()};
+    const Counter control_stream_start {_rnd->uniform<uint32_t> (0,
+                                        static_cast<uint32_t> (max_counter))};
+    const uint8_t srv_max_padding = _rnd->uniform<uint8_t> (0, 16);
+    const auto srv_alignment = Packet::Alignment_Flag::UINT8;
+
+    auto conn = Connection::mk_shared (Role::Server,
+                                        params._user,
+                                        _loop,
+                                        _handler,
+                                        resume.r->_control_stream,
+                                        srv_control_stream,
+                                        resume.r->_client_conn_id,
+                                        srv_conn,
+                                        control_stream_start,
+                                        Packet::Flag_To_Byte (
+                                                    resume.r->_alignment),
+                                        Packet::Flag_To_Byte(srv_alignment),
+                                        resume.r->_max_padding,
+                                        srv_max_padding,
+                                        keys.value()._enc_write,
+                                        keys.value()._hmac_write,
+                                        keys.value()._ecc_write,
+                                        enc_read, hmac_read, ecc_read,
+                                        keys.value()._user_kdf);
+    conn->add_Link_out (recv_from);
+    if (resume._early_data.size() > 0) {
+        conn->add_early_data (resume.r->_early_stream,
+                            std::vector<uint8_t> (resume._early_data.begin(),
+                                                    resume._early_data.end()));
+    }
+    if (_handler->add_connection (std::move(conn)) != Error::NONE)
+        return;
+
+    // a new ticket: the client used this one.
+    params._secret = keys.value()._next_secret;
+    auto answer = mk_result (pkt, Conn0_Type::S_RESUME, srv_conn,
+                                control_stream_start, srv_control_stream,
+                                srv_alignment, srv_max_padding,
+                                keys.value()._enc_write.get(),
+                                keys.value()._hmac_write.get(),
+                                keys.value()._ecc_write.get(),
+                                type_safe::make_optional (params),
+                                type_safe::make_optional (stream));
+    sodium_memzero (params._secret.data(), params._secret.size());
+    if (answer == nullptr)
+        return;
+
+    _results.add (request, recv_from, answer->raw);
     return _handler->proxy_enqueue (recv_to, recv_from,
-                                    std::move(answer), Conn0_Type::S_RESULT);
+                                    std::move(answer), Conn0_Type::S_RESUME);
 }
 
 FENRIR_INLINE void Handshake::parse_s_result (const Link_ID recv_from,
@@ -1162,52 +2052,62 @@ FENRIR_INLINE void Handshake::parse_s_result (const Link_ID recv_from,
                                                         const Packet &pkt,
                                                         Conn0_S_RESULT data)
 {
-    FENRIR_UNUSED (recv_from);
     FENRIR_UNUSED (recv_to);
     if (!data || data._enc.size() < Conn0_Auth_Result::min_size()) {
         return;
     }
+    // what we sent
+    const Conn0_Type sent = data.r->_type == Conn0_Type::S_RESUME ?
+                                    Conn0_Type::C_RESUME : Conn0_Type::C_AUTH;
 
     const Handshake::ID hshake_id ({pkt.stream[0].counter(),
                                                         pkt.stream[0].id()});
 
     Shared_Lock_Guard<Shared_Lock_Read> r_lock {Shared_Lock_NN{&_mtx}};
     // search previous packet in _client_ative handshakes
-    auto it = std::lower_bound (_client_active.begin(), _client_active.end(),
-                        hshake_id,
-                            [] (const auto &el, const Handshake::ID id)
-                                { return std::get<Handshake::ID> (el) < id; });
-
-    if (it == _client_active.end() ||
-                    std::get<Handshake::ID> (*it) != hshake_id ||
-                    std::get<state_client> (*it)._type != Conn0_Type::C_AUTH) {
+    const state_client *state = _client_active.find (hshake_id);
+    if (state == nullptr || state->_type != sent || state->_keys == nullptr)
         return; // random packet. Don't answer.
-    }
 
-    auto enc_read   = std::get<state_client> (*it)._enc_read;
-    auto hmac_read  = std::get<state_client> (*it)._hmac_read;
-    auto ecc_read   = std::get<state_client> (*it)._ecc_read;
-    auto enc_write  = std::get<state_client> (*it)._enc_write;
-    auto hmac_write = std::get<state_client> (*it)._hmac_write;
-    auto ecc_write  = std::get<state_client> (*it)._ecc_write;
-    auto user_kdf   = std::get<state_client> (*it)._user_kdf;
+    auto enc_read   = state->_keys->_enc_read;
+    auto hmac_read  = state->_keys->_hmac_read;
+    auto ecc_read   = state->_keys->_ecc_read;
+    auto enc_write  = state->_keys->_enc_write;
+    auto hmac_write = state->_keys->_hmac_write;
+    auto ecc_write  = state->_keys->_ecc_write;
+    auto user_kdf   = state->_keys->_user_kdf;
 
-    // save data for later, so we don't lock things too much
-    Conn0_C_AUTH prev_data (std::get<state_client>(*it)._pkt->stream[0].data());
-    r_lock.early_unlock();
+    auto resume     = state->_resume;
 
-    auto cleartext_client_auth = Conn0_Auth_Data (prev_data.as_cleartext (
-                                                enc_read->bytes_header() +
+    // save data for later, so we don't lock things too much
+    const uint16_t header = enc_read->bytes_header() +
                                                     hmac_read->bytes_header() +
-                                                    ecc_read->bytes_header(),
-                                                enc_read->bytes_footer() +
+                                                    ecc_read->bytes_header();
+    const uint16_t footer = enc_read->bytes_footer() +
                                                     hmac_read->bytes_footer() +
-                                                    ecc_read->bytes_footer()));
-
-    auto client_alignment = cleartext_client_auth.r->_alignment;
-    auto client_Conn_ID = cleartext_client_auth.r->_client_conn_id;
-    auto client_control_stream = cleartext_client_auth.r->_control_stream;
-    auto client_max_pading = cleartext_client_auth.r->_max_padding;
+                                                    ecc_read->bytes_footer();
+    Packet::Alignment_Flag client_alignment;
+    Conn_ID client_Conn_ID;
+    Stream_ID client_control_stream;
+    uint8_t client_max_pading;
+    if (sent == Conn0_Type::C_RESUME) {
+        Conn0_C_RESUME prev_data (state->_pkt->stream[0].data());
+        auto cleartext_client_resume = Conn0_Resume_Data (
+                                    prev_data.as_cleartext (header, footer));
+        client_alignment = cleartext_client_resume.r->_alignment;
+        client_Conn_ID = cleartext_client_resume.r->_client_conn_id;
+        client_control_stream = cleartext_client_resume.r->_control_stream;
+        client_max_pading = cleartext_client_resume.r->_max_padding;
+    } else {
+        Conn0_C_AUTH prev_data (state->_pkt->stream[0].data());
+        auto cleartext_client_auth = Conn0_Auth_Data (
+                                    prev_data.as_cleartext (header, footer));
+        client_alignment = cleartext_client_auth.r->_alignment;
+        client_Conn_ID = cleartext_client_auth.r->_client_conn_id;
+        client_control_stream = cleartext_client_auth.r->_control_stream;
+        client_max_pading = cleartext_client_auth.r->_max_padding;
+    }
+    r_lock.early_unlock();
 
     // test hmac
     gsl::span<uint8_t> decrypted_data = data._enc;
@@ -1222,25 +2122,36 @@ FENRIR_INLINE void Handshake::parse_s_result (const Link_ID recv_from,
         return; // trasnmission corruption or malicious packet
 
     Shared_Lock_Guard<Shared_Lock_Write> w_lock {Shared_Lock_NN{&_mtx}};
-    // Get the iterator again, it might have changed
-    it = std::lower_bound (_client_active.begin(), _client_active.end(),
-                    hshake_id,
-                        [] (const auto &el, const Handshake::ID id)
-                            { return std::get<Handshake::ID> (el) < id; });
-
-    if (it == _client_active.end() ||
-                std::get<Handshake::ID> (*it) != hshake_id ||
-                std::get<state_client> (*it)._type != Conn0_Type::C_AUTH) {
-        // if .end() then we got two very close packets and two threads
+    // search again, it might have been dropped
+    state = _client_active.find (hshake_id);
+    if (state == nullptr || state->_type != sent) {
+        // if not found then we got two very close packets and two threads
         // were racing to add the connection
         return; // random packet. Don't answer.
     }
-    _client_active.erase (it);
+    std::vector<uint8_t> fqdn = std::move(_client_active.find (
+                                            hshake_id)->_auth_servers._fqdn);
+    _client_active.erase (hshake_id);
     w_lock.early_unlock();
 
+    const auto report = [this, &fqdn] (const Fenrir__v1::Error err) {
+            _handler->proxy_report (std::make_unique<Report::Handshake> (err,
+                                                            std::move(fqdn)));
+        };
     auto srv_clear_data = Conn0_Auth_Result (decrypted_data);
-    if (srv_clear_data.r->_conn_id < Conn_Reserved)
-        return; // FIXME: report auth failed
+    if (!srv_clear_data || srv_clear_data.r->_conn_id < Conn_Reserved) {
+        // the server gives no reason on purpose
+        {
+            Shared_Lock_Guard<Shared_Lock_Write> stats_lock {
+                                                    Shared_Lock_NN{&_mtx}};
+            FENRIR_UNUSED (stats_lock);
+            ++_stats._failed;
+        }
+        return report (Fenrir__v1::Error::AUTH_FAILED);
+    }
+    if (resume.has_value() && srv_clear_data._ticket.size() > 0)
+        save_ticket (recv_from, resume.value(), srv_clear_data._ticket,
+                                        srv_clear_data.r->_max_early_data);
 
     // Auth OK, allocate connection
     auto conn = Connection::mk_shared (Role::Client,
@@ -1269,8 +2180,7 @@ FENRIR_INLINE void Handshake::parse_s_result (const Link_ID recv_from,
     if (conn == nullptr) {
         // could not allocate?
         // Horror and panic, forget it all.
-        // FIXME: report auth failed
-        return;
+        return report (Fenrir__v1::Error::NO_CONNECTION);
     }
     conn->add_Link_in (recv_from);
 
@@ -1278,9 +2188,11 @@ FENRIR_INLINE void Handshake::parse_s_result (const Link_ID recv_from,
         // There already is such a connection. Duplicated packet?
         // but why caould we get the enc/hmac ??
         // Horror and panic, forget it all.
-        // FIXME: report auth failed
-        return;
+        return report (Fenrir__v1::Error::NO_CONNECTION);
     }
+    Shared_Lock_Guard<Shared_Lock_Write> stats_lock {Shared_Lock_NN{&_mtx}};
+    FENRIR_UNUSED (stats_lock);
+    ++_stats._completed;
 
     // TODO: report succesful connection
 }
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/data/Conn0_Type.hpp"
+#include "Fenrir/v1/data/packet/Packet.hpp"
+#include "Fenrir/v1/net/Link_defs.hpp"
+#include "Fenrir/v1/rate/Token_Bucket.hpp"
+#include <type_safe/optional.hpp>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sodium.h>
+#include <string.h>
+
+namespace Fenrir__v1 {
+namespace Impl {
+
+// Handshakes need public key signatures and key exchanges: a flood of
+// them must not stall the established connections.
+// So they are not handled by the threads that handle the connections,
+// but by a few dedicated threads, fed by this bounded queue.
+//
+// Packets are shed before any public key work:
+//  * each packet costs roughly what it will cost in cpu
+//  * the queue has a total cost budget
+//  * unsolicited packets (the ones a client sends to a server) are limited
+//    by a token bucket per source prefix (/24 for ipv4, /48 for ipv6).
+//    The buckets are a fixed table indexed by a keyed hash of the prefix:
+//    bounded memory, and an attacker can not choose which prefixes share
+//    its bucket.
+//  * the answers a server sends are queued only for the client handshakes
+//    we are tracking, and unknown types never get here (see Handshake::recv)
+class FENRIR_LOCAL Handshake_Pool
+{
+public:
+    struct job {
+        Link_ID _from;
+        Link_ID _to;
+        Packet _pkt;
+        uint32_t _cost;
+    };
+
+    Handshake_Pool()
+        : _queued_cost (0), _stopped (false)
+    {
+        randombytes_buf (_prefix_key.data(), _prefix_key.size());
+        for (auto &bucket : _buckets)
+            bucket = Rate::Token_Bucket (prefix_rate, prefix_burst);
+    }
+    Handshake_Pool (const Handshake_Pool&) = delete;
+    Handshake_Pool& operator= (const Handshake_Pool&) = delete;
+    Handshake_Pool (Handshake_Pool &&) = delete;
+    Handshake_Pool& operator= (Handshake_Pool &&) = delete;
+    ~Handshake_Pool() = default;
+
+    // cost units of a handshake message, ~ one signature or key exchange
+    // 0: not a handshake message, drop it.
+    static uint32_t cost (const Conn0_Type type)
+    {
+        switch (type) {
+        case Conn0_Type::C_INIT:
+            return 1;   // MAC cookie, two signatures if signed
+        case Conn0_Type::S_COOKIE:
+            return 1;   // verify signature
+        case Conn0_Type::C_COOKIE:
+            return 2;   // cookie, key exchange, signature
+        case Conn0_Type::S_KEYS:
+            return 2;   // verify, key exchange
+        case Conn0_Type::C_AUTH:
+            return 3;   // key exchange, auth, new connection
+        case Conn0_Type::S_RESULT:
+            return 1;
+        case Conn0_Type::C_RESUME:
+            return 2;   // ticket, new connection
+        case Conn0_Type::S_RESUME:
+            return 1;
+        }
+        return 0;
+    }
+    // only the packets a client sends are unsolicited.
+    // the others answer our own handshakes: the caller accepts them only
+    // for the handshakes it is tracking, so they need no source limits.
+    static bool unsolicited (const Conn0_Type type)
+    {
+        return type == Conn0_Type::C_INIT || type == Conn0_Type::C_COOKIE ||
+                type == Conn0_Type::C_AUTH || type == Conn0_Type::C_RESUME;
+    }
+
+    // false: over budget, the job has been dropped.
+    bool push (job &&work, const bool limit_source,
+                                        const std::chrono::microseconds now)
+    {
+        std::unique_lock<std::mutex> lock (_mtx);
+        if (_stopped || _queued_cost + work._cost > max_cost)
+            return false;
+        if (limit_source && !_buckets[prefix_idx (work._from)].consume (
+                                                            work._cost, now)) {
+            return false;
+        }
+        _queued_cost += work._cost;
+        _queue.push_back (std::move(work));
+        lock.unlock();
+        _cond.notify_one();
+        return true;
+    }
+
+    // blocks until there is work. nullopt: stopped.
+    type_safe::optional<job> pop()
+    {
+        std::unique_lock<std::mutex> lock (_mtx);
+        _cond.wait (lock, [this] { return _stopped || _queue.size() > 0; });
+        if (_stopped)
+            return type_safe::nullopt;
+        job ret = std::move (_queue.front());
+        _queue.pop_front();
+        _queued_cost -= ret._cost;
+        return type_safe::make_optional (std::move(ret));
+    }
+
+    void stop()
+    {
+        std::unique_lock<std::mutex> lock (_mtx);
+        _stopped = true;
+        _queue.clear();
+        _queued_cost = 0;
+        lock.unlock();
+        _cond.notify_all();
+    }
+private:
+    static constexpr uint32_t max_cost = 1024;
+    static constexpr size_t prefix_buckets = 4096;
+    static constexpr uint64_t prefix_rate = 64;     // cost units per second
+    static constexpr uint64_t prefix_burst = 128;
+
+    std::mutex _mtx;
+    std::condition_variable _cond;
+    std::deque<job> _queue;
+    uint32_t _queued_cost;
+    bool _stopped;
+    std::array<uint8_t, crypto_shorthash_KEYBYTES> _prefix_key;
+    std::array<Rate::Token_Bucket, prefix_buckets> _buckets;
+
+    size_t prefix_idx (const Link_ID from) const
+    {
+        const IP ip = std::get<IP> (static_cast<std::pair<IP, UDP_Port>> (
+                                                                        from));
+        std::array<uint8_t, 7> prefix;
+        prefix.fill (0);
+        if (ip.ipv6) {
+            prefix[0] = 6;
+            memcpy (prefix.data() + 1, &ip.ip.v6, 6);   // /48
+        } else {
+            prefix[0] = 4;
+            memcpy (prefix.data() + 1, &ip.ip.v4, 3);   // /24
+        }
+        std::array<uint8_t, crypto_shorthash_BYTES> hash;
+        crypto_shorthash (hash.data(), prefix.data(), prefix.size(),
+                                                        _prefix_key.data());
+        uint64_t idx;
+        memcpy (&idx, hash.data(), sizeof(idx));
+        return static_cast<size_t> (idx % prefix_buckets);
+    }
+};
+
+} // namespace Impl
+} // namespace Fenrir__v1
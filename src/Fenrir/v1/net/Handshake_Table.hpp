@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/net/Handshake_ID.hpp"
+#include <type_safe/optional.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Fenrir__v1 {
+namespace Impl {
+
+// The handshakes in progress, by Handshake_ID.
+//  * the states live in a slab: freed slots are reused, and a state never
+//    moves, so the table can hold thousands of handshakes without
+//    reallocating or sorting them.
+//  * a hash index gives the slot of an ID: constant time lookups on
+//    every packet of the handshake.
+//  * every handshake has a deadline. The deadlines are kept in a
+//    timer wheel: "due" only looks at the slots of the ticks that
+//    passed, not at the whole table.
+//  * the insertion order is kept, so that the owner can drop the oldest
+//    handshakes when the table is full.
+// No locking: the owner locks.
+template<typename T>
+class FENRIR_LOCAL Handshake_Table
+{
+public:
+    static constexpr uint32_t wheel_slots = 64;
+    static constexpr int64_t tick_ms = 250;
+
+    Handshake_Table()
+        : _last_tick (now_tick()) {}
+    Handshake_Table (const Handshake_Table&) = delete;
+    Handshake_Table& operator= (const Handshake_Table&) = delete;
+    Handshake_Table (Handshake_Table &&) = delete;
+    Handshake_Table& operator= (Handshake_Table &&) = delete;
+    ~Handshake_Table() = default;
+
+    size_t size() const
+        { return _index.size(); }
+    bool has (const Handshake_ID id) const
+        { return _index.find (id) != _index.end(); }
+
+    // nullptr if not found. valid until the entry is erased.
+    T *find (const Handshake_ID id)
+    {
+        auto it = _index.find (id);
+        if (it == _index.end())
+            return nullptr;
+        return &_slab[it->second]._state.value();
+    }
+
+    // false: the ID is already used
+    bool insert (const Handshake_ID id, T &&state,
+                                        const std::chrono::milliseconds timeout)
+    {
+        if (has (id))
+            return false;
+        uint32_t idx;
+        if (_free.size() > 0) {
+            idx = _free.back();
+            _free.pop_back();
+        } else {
+            idx = static_cast<uint32_t> (_slab.size());
+            _slab.emplace_back();
+        }
+        slot &entry = _slab[idx];
+        entry._id = id;
+        entry._state = type_safe::make_optional (std::move(state));
+        _index.emplace (id, idx);
+        _order.emplace_back (idx, entry._gen);
+        arm (idx, timeout);
+        return true;
+    }
+
+    // the handshake advanced: move its deadline
+    void rearm (const Handshake_ID id, const std::chrono::milliseconds timeout)
+    {
+        auto it = _index.find (id);
+        if (it != _index.end())
+            arm (it->second, timeout);
+    }
+
+    void erase (const Handshake_ID id)
+    {
+        auto it = _index.find (id);
+        if (it == _index.end())
+            return;
+        release (it->second);
+        _index.erase (it);
+    }
+
+    // the oldest handshake still in the table. false: empty
+    bool oldest (Handshake_ID &id)
+    {
+        drop_stale_order();
+        if (_order.size() == 0)
+            return false;
+        id = _slab[_order.front().first]._id;
+        return true;
+    }
+
+    // the handshakes past their deadline.
+    // they are not armed anymore: the owner must "rearm" or "erase" them.
+    void due (std::vector<Handshake_ID> &expired)
+    {
+        drop_stale_order();
+        const uint64_t now = now_tick();
+        if (now <= _last_tick)
+            return;
+        // after a long pause every bucket is due
+        const uint64_t from = now - _last_tick > wheel_slots ?
+                                        now - wheel_slots + 1 : _last_tick + 1;
+        _last_tick = now;
+        std::vector<std::pair<uint32_t, uint32_t>> keep;
+        for (uint64_t tick = from; tick <= now; ++tick) {
+            auto &bucket = _wheel[tick % wheel_slots];
+            keep.clear();
+            for (const auto &ref : bucket) {
+                slot &entry = _slab[ref.first];
+                if (entry._expire > now) {
+                    keep.push_back (ref);   // a later round
+                    continue;
+                }
+                expired.push_back (entry._id);
+                entry._expire = disarmed;
+                entry._bucket = no_bucket;
+            }
+            bucket.swap (keep);
+        }
+    }
+private:
+    static constexpr uint64_t disarmed = ~uint64_t {0};
+    static constexpr uint32_t no_bucket = wheel_slots;
+
+    struct slot {
+        Handshake_ID _id;
+        uint32_t _gen;      // changes when the slot is freed
+        uint32_t _bucket;   // the one with our reference, or no_bucket
+        uint64_t _expire;   // tick
+        type_safe::optional<T> _state;
+
+        slot()
+            : _gen (0), _bucket (no_bucket), _expire (0),
+                                                _state (type_safe::nullopt) {}
+    };
+    struct id_hash {
+        size_t operator() (const Handshake_ID id) const
+        {
+            // we choose the IDs, at random
+            const auto raw = static_cast<std::pair<Counter, Stream_ID>> (id);
+            const uint64_t val = (static_cast<uint64_t> (
+                                static_cast<uint32_t> (raw.first)) << 16) |
+                                    static_cast<uint16_t> (raw.second);
+            return std::hash<uint64_t>() (val);
+        }
+    };
+
+    std::deque<slot> _slab;     // deque: the slots never move
+    std::vector<uint32_t> _free;
+    std::unordered_map<Handshake_ID, uint32_t, id_hash> _index;
+    // slab index and generation, oldest first.
+    std::deque<std::pair<uint32_t, uint32_t>> _order;
+    // the same, by deadline. one reference per armed slot.
+    std::array<std::vector<std::pair<uint32_t, uint32_t>>, wheel_slots>
+                                                                        _wheel;
+    uint64_t _last_tick;
+
+    static uint64_t now_tick()
+    {
+        return static_cast<uint64_t> (
+                    std::chrono::duration_cast<std::chrono::milliseconds> (
+                    std::chrono::steady_clock::now().time_since_epoch())
+                                                        .count() / tick_ms);
+    }
+    void arm (const uint32_t idx, const std::chrono::milliseconds timeout)
+    {
+        slot &entry = _slab[idx];
+        // round up: never expire early
+        entry._expire = now_tick() + 1 + static_cast<uint64_t> (
+                                                timeout.count() / tick_ms);
+        const uint32_t bucket = static_cast<uint32_t> (
+                                                entry._expire % wheel_slots);
+        if (entry._bucket == bucket)
+            return; // already there, "due" reads the new deadline
+        unlink (idx);
+        _wheel[bucket].emplace_back (idx, entry._gen);
+        entry._bucket = bucket;
+    }
+    // drop the wheel reference of the slot, if armed
+    void unlink (const uint32_t idx)
+    {
+        slot &entry = _slab[idx];
+        if (entry._bucket == no_bucket)
+            return;
+        auto &bucket = _wheel[entry._bucket];
+        const std::pair<uint32_t, uint32_t> ref {idx, entry._gen};
+        auto it = std::find (bucket.begin(), bucket.end(), ref);
+        if (it != bucket.end()) {
+            *it = bucket.back();
+            bucket.pop_back();
+        }
+        entry._bucket = no_bucket;
+    }
+    void drop_stale_order()
+    {
+        while (_order.size() > 0 && _slab[_order.front().first]._gen !=
+                                                    _order.front().second) {
+            _order.pop_front();
+        }
+    }
+    void release (const uint32_t idx)
+    {
+        unlink (idx);
+        slot &entry = _slab[idx];
+        entry._state = type_safe::nullopt;
+        ++entry._gen;
+        _free.push_back (idx);
+    }
+};
+
+} // namespace Impl
+} // namespace Fenrir__v1
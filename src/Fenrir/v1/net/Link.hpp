@@ -25,11 +25,9 @@
 #include "Fenrir/v1/event/Loop.hpp"
 #include "Fenrir/v1/event/Events_all.hpp"
 #include "Fenrir/v1/net/Link_defs.hpp"
-#include "Fenrir/v1/util/Random.hpp"
 #include <chrono>
 #include <limits>
 #include <memory>
-#include <vector>
 
 namespace Fenrir__v1 {
 namespace Impl {
@@ -43,14 +41,9 @@ public:
     using ID = Link_ID;
     using smallmicro = std::chrono::duration<uint32_t, std::micro>;
 
-    std::vector<uint8_t> _activation;   // random 256 bit: used for confirmation
-                                    // of 1-RTT. if (size() == 0) then confirmed
+    // only activated links are here, see Link_Activation.
     uint64_t _max_rate;  // bps
-    // _keepalive:
-    //   if _activation.size() > 0, then a timeout will drop
-    //     this link from the queue.
-    //   else
-    //     only drop after 4 keepalive failed.
+    // _keepalive: only drop after 4 keepalive failed.
     std::shared_ptr<Event::Keepalive> _keepalive;
     smallmicro _rtt;    // Microseconds. 32 bits should be enough to maintain a
                         // connection towards Mars: Shoot for the stars,
@@ -71,26 +64,12 @@ public:
                                 const uint16_t mtu, const uint64_t max_rate)
         : _max_rate (max_rate), _keepalive (std::move(keepalive)),
                                 _rtt (std::numeric_limits<smallmicro>::max()),
-                                _link (link), _mtu (mtu)
+                                _link (link), _mtu (mtu), _keepalive_failed (0)
     {}
 
-    Link (const Link_ID link, Random *const rnd,
-                                    std::shared_ptr<Event::Keepalive> keepalive)
-        : _max_rate (0), _keepalive (std::move(keepalive)),
-                                _rtt (std::numeric_limits<smallmicro>::max()),
-                                _link (link), _mtu (0), _keepalive_failed (0)
-    {
-        constexpr size_t size = 32;
-        _activation.reserve (size);
-        rnd->uniform<uint8_t> (_activation);
-    }
-
     bool operator== (const Link &s) const
         { return static_cast<bool> (_link == s._link); }
 
-    explicit operator bool() const
-        { return _activation.size() == 0; }
-
     void keepalive (Event::Loop *loop)
         { loop->start (_keepalive, keepalive_timeout, Event::Repeat::YES); }
 
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/net/Link_defs.hpp"
+#include "Fenrir/v1/util/endian.hpp"
+#include <gsl/span>
+#include <array>
+#include <sodium.h>
+#include <string.h>
+
+namespace Fenrir__v1 {
+namespace Impl {
+
+// Activation of a new source address of a connection, without keeping
+// any state for it.
+// When a packet of the connection arrives from an unknown link we answer
+// with a token: the time it was issued and a MAC of the link and the time,
+// keyed with a random secret of the connection. The token travels inside
+// the encrypted connection, so only our peer can echo it back.
+// We add the link only when the echo arrives, and only if the token
+// is ours, is for that link and is recent.
+// Until then a spoofed source costs us nothing but the answer.
+class FENRIR_LOCAL Link_Activation
+{
+public:
+    static constexpr size_t token_bytes = sizeof(uint64_t) + crypto_auth_BYTES;
+    static constexpr int64_t window_ms = 30000;
+
+    Link_Activation()
+        { randombytes_buf (_key.data(), _key.size()); }
+    Link_Activation (const Link_Activation&) = delete;
+    Link_Activation& operator= (const Link_Activation&) = delete;
+    Link_Activation (Link_Activation &&) = default;
+    Link_Activation& operator= (Link_Activation &&) = default;
+    ~Link_Activation()
+        { sodium_memzero (_key.data(), _key.size()); }
+
+    // "out" must be "token_bytes" long
+    void token (const Link_ID link, const int64_t now_ms,
+                                            gsl::span<uint8_t> out) const
+    {
+        const uint64_t issued = h_to_l<uint64_t> (
+                                            static_cast<uint64_t> (now_ms));
+        memcpy (out.data(), &issued, sizeof(issued));
+        mac (link, out.data(), out.data() + sizeof(issued));
+    }
+
+    bool check (const Link_ID link, const gsl::span<const uint8_t> in,
+                                                    const int64_t now_ms) const
+    {
+        if (static_cast<size_t> (in.size()) != token_bytes)
+            return false;
+        uint64_t raw_issued;
+        memcpy (&raw_issued, in.data(), sizeof(raw_issued));
+        const int64_t issued = static_cast<int64_t> (
+                                                l_to_h<uint64_t> (raw_issued));
+        // our own clock: tokens from the future are forged
+        if (issued > now_ms || now_ms - issued > window_ms)
+            return false;
+        std::array<uint8_t, crypto_auth_BYTES> expected;
+        mac (link, in.data(), expected.data());
+        return sodium_memcmp (expected.data(), in.data() + sizeof(uint64_t),
+                                                    expected.size()) == 0;
+    }
+private:
+    std::array<uint8_t, crypto_auth_KEYBYTES> _key;
+
+    // MAC of the issue time and the link: ip version, address, port
+    void mac (const Link_ID link, const uint8_t *const issued,
+                                                    uint8_t *const out) const
+    {
+        std::array<uint8_t, sizeof(uint64_t) + 1 + 16 + sizeof(uint16_t)> in;
+        in.fill (0);
+        uint8_t *p = in.data();
+        memcpy (p, issued, sizeof(uint64_t));
+        p += sizeof(uint64_t);
+        const IP ip = link.ip();
+        *p = ip.ipv6 ? 6 : 4;
+        ++p;
+        if (ip.ipv6) {
+            memcpy (p, &ip.ip.v6, 16);
+        } else {
+            memcpy (p, &ip.ip.v4, 4);
+        }
+        p += 16;
+        const uint16_t port = h_to_l<uint16_t> (
+                                    static_cast<uint16_t> (link.udp_port()));
+        memcpy (p, &port, sizeof(port));
+        crypto_auth (out, in.data(), in.size(), _key.data());
+    }
+};
+
+} // namespace Impl
+} // namespace Fenrir__v1
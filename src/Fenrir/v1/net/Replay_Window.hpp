@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include <array>
+#include <mutex>
+
+namespace Fenrir__v1 {
+namespace Impl {
+
+// Anti-replay window on the packet sequence (see Encryption::sequence),
+// like the IPsec one: the highest sequence received, and a bitmap of the
+// ones just before it.
+// The sender has a counter per thread ("lane"), each lane gets its window.
+// The packets of a lane are reordered by the multipath and by the parallel
+// crypto of both ends, so the window is large: the bitmap is a ring of
+// 64 bit blocks (RFC 6479), moving forward only clears the blocks we
+// jump over, never shifts the whole bitmap.
+//
+// "check" is done before any crypto: replayed and too old packets are
+// dropped without spending time on them.
+// "commit" only after the packet has been authenticated, else anyone could
+// move the window forward. "commit" checks again: two threads might
+// be decrypting the same packet.
+class FENRIR_LOCAL Replay_Window
+{
+public:
+    static constexpr uint32_t lane_bits = 4;
+    static constexpr uint32_t counter_bits = 64 - lane_bits;
+    static constexpr uint64_t blocks = 32;  // power of two
+    // the block of "_top - 1" is partially filled: one less block.
+    static constexpr uint64_t window = (blocks - 1) * 64;
+
+    Replay_Window() = default;
+    Replay_Window (const Replay_Window&) = delete;
+    Replay_Window& operator= (const Replay_Window&) = delete;
+    Replay_Window (Replay_Window &&) = delete;
+    Replay_Window& operator= (Replay_Window &&) = delete;
+    ~Replay_Window() = default;
+
+    bool check (const uint64_t sequence)
+    {
+        lane &seq_lane = _lanes[sequence >> counter_bits];
+        std::unique_lock<std::mutex> lock (seq_lane._mtx);
+        FENRIR_UNUSED (lock);
+        return seq_lane.is_new (sequence & counter_mask);
+    }
+    bool commit (const uint64_t sequence)
+    {
+        lane &seq_lane = _lanes[sequence >> counter_bits];
+        const uint64_t counter = sequence & counter_mask;
+        std::unique_lock<std::mutex> lock (seq_lane._mtx);
+        FENRIR_UNUSED (lock);
+        if (!seq_lane.is_new (counter))
+            return false;
+        if (counter >= seq_lane._top) {
+            // clear the blocks between the old top and the new one
+            if (seq_lane._top != 0) {
+                const uint64_t top_block = (seq_lane._top - 1) / 64;
+                const uint64_t jump = counter / 64 - top_block;
+                for (uint64_t idx = 1; idx <= jump && idx <= blocks; ++idx)
+                    seq_lane._seen[(top_block + idx) % blocks] = 0;
+            }
+            seq_lane._top = counter + 1;
+        }
+        seq_lane._seen[(counter / 64) % blocks] |= uint64_t {1} <<
+                                                                (counter % 64);
+        return true;
+    }
+private:
+    static constexpr uint64_t counter_mask = (uint64_t {1} << counter_bits) -1;
+
+    // a lock per lane: the threads that decrypt different lanes
+    // do not wait for each other.
+    struct lane {
+        std::mutex _mtx;
+        uint64_t _top;      // highest counter + 1. 0: nothing yet
+        // counter N: bit "N % 64" of block "(N / 64) % blocks"
+        std::array<uint64_t, blocks> _seen;
+
+        lane()
+            : _top (0)
+            { _seen.fill (0); }
+
+        bool is_new (const uint64_t counter) const
+        {
+            if (counter >= _top)
+                return true;
+            if (_top - 1 - counter >= window)
+                return false;   // too old
+            return (_seen[(counter / 64) % blocks] &
+                                        (uint64_t {1} << (counter % 64))) == 0;
+        }
+    };
+    std::array<lane, 1 << lane_bits> _lanes;
+};
+
+} // namespace Impl
+} // namespace Fenrir__v1
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/net/Link_defs.hpp"
+#include <gsl/span>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sodium.h>
+#include <utility>
+#include <vector>
+
+namespace Fenrir__v1 {
+namespace Impl {
+
+// The S_RESULT and S_RESUME we sent, by hash of the C_AUTH or C_RESUME
+// they answer.
+// When the answer is lost the client sends the same request again, but
+// the connection now exists (C_AUTH) and the ticket nonce has been used
+// (C_RESUME): without the cache the retransmission gets no answer and
+// the client times out.
+// The answer is sent again only to the address of the first request:
+// a captured request can not point it to someone else.
+// Bounded memory: when full the oldest answers are forgotten, their
+// clients will do a new handshake.
+class FENRIR_LOCAL Result_Cache
+{
+public:
+    using key = std::array<uint8_t, 16>;
+    // the client retransmits after 1, 2 and 4 seconds, then waits 8
+    static constexpr int64_t keep_ms = 15000;
+    static constexpr size_t max_results = 4096;
+
+    Result_Cache() = default;
+    Result_Cache (const Result_Cache&) = delete;
+    Result_Cache& operator= (const Result_Cache&) = delete;
+    Result_Cache (Result_Cache &&) = delete;
+    Result_Cache& operator= (Result_Cache &&) = delete;
+    ~Result_Cache() = default;
+
+    static key hash (const gsl::span<const uint8_t> request)
+    {
+        key ret;
+        crypto_generichash (ret.data(), ret.size(), request.data(),
+                            static_cast<size_t> (request.size()), nullptr, 0);
+        return ret;
+    }
+
+    void add (const key &request, const Link_ID from,
+                                            const std::vector<uint8_t> &answer)
+    {
+        const int64_t now = now_ms();
+        std::unique_lock<std::mutex> lock (_mtx);
+        FENRIR_UNUSED (lock);
+        expire (now);
+        if (_results.size() >= max_results) {
+            _results.erase (_expiry.front().second);
+            _expiry.pop_front();
+        }
+        if (!_results.emplace (request, result {from, answer}).second)
+            return;
+        _expiry.emplace_back (now + keep_ms, request);
+    }
+
+    // false: not a retransmission, or not from the same address
+    bool find (const key &request, const Link_ID from,
+                                                std::vector<uint8_t> &answer)
+    {
+        std::unique_lock<std::mutex> lock (_mtx);
+        FENRIR_UNUSED (lock);
+        expire (now_ms());
+        auto it = _results.find (request);
+        if (it == _results.end() || it->second._from != from)
+            return false;
+        answer = it->second._answer;
+        return true;
+    }
+private:
+    struct result {
+        Link_ID _from;
+        std::vector<uint8_t> _answer;
+    };
+    std::mutex _mtx;
+    std::map<key, result> _results;
+    std::deque<std::pair<int64_t, key>> _expiry;
+
+    static int64_t now_ms()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds> (
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    void expire (const int64_t now)
+    {
+        while (_expiry.size() > 0 && _expiry.front().first <= now) {
+            _results.erase (_expiry.front().second);
+            _expiry.pop_front();
+        }
+    }
+};
+
+} // namespace Impl
+} // namespace Fenrir__v1
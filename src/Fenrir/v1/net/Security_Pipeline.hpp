@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/crypto/Crypto.hpp"
+#include "Fenrir/v1/crypto/Crypto_NULL.hpp"
+#include "Fenrir/v1/crypto/Sodium.hpp"
+#include "Fenrir/v1/net/Replay_Window.hpp"
+#include "Fenrir/v1/recover/ECC_NULL.hpp"
+#include "Fenrir/v1/recover/Error_Correction.hpp"
+#include <gsl/span>
+#include <type_traits>
+#include <vector>
+
+namespace Fenrir__v1 {
+namespace Impl {
+
+// Per packet security: encryption, hmac and ecc.
+// The plugins are virtual: every packet pays a few indirect calls, and
+// nothing can be inlined, not even the NULL plugins.
+// The libraries can not override the native ids (see Loader), so a native
+// plugin id tells us its class. When the encryption, hmac and ecc are all
+// native we call them through their (final) classes: no virtual calls,
+// and the compiler can inline and fuse the whole pipeline.
+// Anything else keeps the virtual calls, with the very same code.
+class FENRIR_LOCAL Security_Pipeline
+{
+public:
+    enum class Kind : uint8_t {
+        DYNAMIC = 0x00,     // at least one plugin from a library
+        NULL_ALL = 0x01,    // no encryption, no hmac, no ecc
+        CHACHA20 = 0x02,    // chacha20-poly1305, no hmac, no ecc
+        AES256_GCM = 0x03   // aes256-gcm, no hmac, no ecc
+    };
+
+    Security_Pipeline() = delete;
+
+    static Kind select (const Crypto::Encryption &enc,
+                        const Crypto::Hmac &hmac, const Recover::ECC &ecc)
+    {
+        if (enc._lib != nullptr || hmac._lib != nullptr || ecc._lib != nullptr)
+            return Kind::DYNAMIC;
+        if (hmac.id() != Crypto::Hmac::ID {1} ||
+                                    ecc.get_id() != Recover::ECC::ID {1}) {
+            return Kind::DYNAMIC;
+        }
+        switch (static_cast<uint16_t> (enc.id())) {
+        case 1:
+            return Kind::NULL_ALL;
+        case 2:
+            return Kind::CHACHA20;
+        case 3:
+            return Kind::AES256_GCM;
+        }
+        return Kind::DYNAMIC;
+    }
+
+    // encrypt "enc_data", then hmac and ecc on the whole packet.
+    template<typename Enc, typename Mac, typename Ecc>
+    static Impl::Error seal (Crypto::Encryption *const enc,
+                                Crypto::Hmac *const hmac,
+                                Recover::ECC *const ecc,
+                                gsl::span<uint8_t> enc_data,
+                                std::vector<uint8_t> &raw)
+    {
+        static_assert (std::is_base_of<Crypto::Encryption, Enc>::value &&
+                                std::is_base_of<Crypto::Hmac, Mac>::value &&
+                                std::is_base_of<Recover::ECC, Ecc>::value,
+                                    "Fenrir: Security_Pipeline: wrong types");
+        auto err = static_cast<Enc*> (enc)->encrypt (enc_data);
+        if (err != Impl::Error::NONE)
+            return err;
+        err = static_cast<Mac*> (hmac)->add_hmac (gsl::span<uint8_t> (
+                            raw.data(), static_cast<ssize_t> (raw.size())));
+        if (err != Impl::Error::NONE)
+            return err;
+        return static_cast<Ecc*> (ecc)->add_ecc (raw);
+    }
+
+    // ecc, replay check, hmac, decrypt. "out" gets the cleartext.
+    template<typename Enc, typename Mac, typename Ecc>
+    static bool open (Crypto::Encryption *const enc,
+                                Crypto::Hmac *const hmac,
+                                Recover::ECC *const ecc,
+                                Replay_Window &replay,
+                                const gsl::span<uint8_t> in,
+                                gsl::span<uint8_t> &out)
+    {
+        static_assert (std::is_base_of<Crypto::Encryption, Enc>::value &&
+                                std::is_base_of<Crypto::Hmac, Mac>::value &&
+                                std::is_base_of<Recover::ECC, Ecc>::value,
+                                    "Fenrir: Security_Pipeline: wrong types");
+        Enc *const e = static_cast<Enc*> (enc);
+        Mac *const m = static_cast<Mac*> (hmac);
+        if (static_cast<Ecc*> (ecc)->correct (in, out) ==
+                                                Recover::ECC::Result::ERR) {
+            return false;
+        }
+        // drop replayed packets before the crypto work
+        const auto seq = e->sequence (out.subspan (m->bytes_header()));
+        if (seq.has_value() && !replay.check (seq.value()))
+            return false;
+        if (!m->is_valid (out, out))
+            return false;
+        if (e->decrypt (out, out) != Impl::Error::NONE)
+            return false;
+        // authenticated: now it can move the window
+        return !seq.has_value() || replay.commit (seq.value());
+    }
+};
+
+} // namespace Impl
+} // namespace Fenrir__v1
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include <array>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <utility>
+
+namespace Fenrir__v1 {
+namespace Impl {
+
+// Anyone that captured a C_RESUME can send it again: the 0-RTT data
+// would be delivered twice, and we would open a second connection.
+// The client tells us how old its ticket is, so we know when the
+// C_RESUME was sent: we accept it only in a short window, and we remember
+// its nonce for as long as the window lasts.
+// Bounded memory: when full we refuse the resumptions (the client will do
+// a full handshake) instead of forgetting nonces.
+// NOTE: per process. Servers that share the cookie secret do not share
+// the nonces, so a C_RESUME can be replayed once on each of them.
+class FENRIR_LOCAL Ticket_Replay
+{
+public:
+    using nonce = std::array<uint8_t, 16>;
+    static constexpr int64_t window_ms = 10000;
+    static constexpr size_t max_nonces = 65536;
+
+    Ticket_Replay() = default;
+    Ticket_Replay (const Ticket_Replay&) = delete;
+    Ticket_Replay& operator= (const Ticket_Replay&) = delete;
+    Ticket_Replay (Ticket_Replay &&) = delete;
+    Ticket_Replay& operator= (Ticket_Replay &&) = delete;
+    ~Ticket_Replay() = default;
+
+    // was the C_RESUME sent ("issued" + "age") recently?
+    static bool in_window (const int64_t issued_ms, const uint32_t age_ms,
+                                                        const int64_t now_ms)
+    {
+        const int64_t sent = issued_ms + static_cast<int64_t> (age_ms);
+        // two "if"s to avoid overflows
+        if (sent > now_ms)
+            return sent - now_ms <= window_ms;
+        return now_ms - sent <= window_ms;
+    }
+
+    // true: first time we see the nonce in the window
+    bool fresh (const nonce &id, const int64_t now_ms)
+    {
+        std::unique_lock<std::mutex> lock (_mtx);
+        FENRIR_UNUSED (lock);
+        while (_expiry.size() > 0 && _expiry.front().first <= now_ms) {
+            _seen.erase (_expiry.front().second);
+            _expiry.pop_front();
+        }
+        if (_seen.size() >= max_nonces)
+            return false;
+        if (!_seen.insert (id).second)
+            return false;
+        // accepted from "sent - window" to "sent + window"
+        _expiry.emplace_back (now_ms + 2 * window_ms, id);
+        return true;
+    }
+private:
+    std::mutex _mtx;
+    std::set<nonce> _seen;
+    std::deque<std::pair<int64_t, nonce>> _expiry;
+};
+
+} // namespace Impl
+} // namespace Fenrir__v1
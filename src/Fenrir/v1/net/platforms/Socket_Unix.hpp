@@ -24,12 +24,16 @@
 #include "Fenrir/v1/data/IP.hpp"
 #include "Fenrir/v1/net/Link_defs.hpp"
 #include "Fenrir/v1/util/endian.hpp"
+#include <algorithm>
 #include <cassert>
-#include <dirent.h>
+#include <ifaddrs.h>
 #include <memory>
 #include <mutex>
+#include <net/if.h>
+#include <netinet/in.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <tuple>
@@ -69,6 +73,9 @@ public:
         { return fd; }
     Link_ID id() const
         { return Link_ID ({ip, port}); }
+    // biggest UDP payload our interface can send without fragmenting
+    uint16_t mtu() const
+        { return payload_mtu; }
 private:
     const IP ip;
     const UDP_Port port;
@@ -76,8 +83,10 @@ private:
     std::vector<uint8_t> buffer;
 
     int32_t fd = -1; // file descriptor for event monitoring
+    uint16_t payload_mtu = 0;
 
     uint32_t find_mtu();
+    void set_dont_fragment();
 };
 
 FENRIR_INLINE Socket::~Socket()
@@ -93,9 +102,13 @@ FENRIR_INLINE Socket::Socket (const Link_ID id)
     struct sockaddr_in s_in4;
     struct sockaddr_in6 s_in6;
 
-    uint32_t bufsize = find_mtu();
-    if (bufsize == 0)
+    const uint32_t if_mtu = find_mtu();
+    // ip + udp headers
+    const uint32_t headers = (ip.ipv6 ? 40 : 20) + 8;
+    if (if_mtu <= headers)
         return;
+    const uint32_t bufsize = std::min<uint32_t> (if_mtu, 0xFFFF) - headers;
+    payload_mtu = static_cast<uint16_t> (bufsize);
     buffer.reserve (bufsize);
     if (buffer.capacity() != bufsize) {
         buffer = std::vector<uint8_t>(); // force memory release
@@ -132,6 +145,34 @@ FENRIR_INLINE Socket::Socket (const Link_ID id)
             return;
         }
     }
+    set_dont_fragment();
+}
+
+FENRIR_INLINE void Socket::set_dont_fragment()
+{
+    // we do our own path mtu discovery (see Rate::PMTU_Discovery):
+    // never fragment, and ignore what the kernel thinks the path mtu is,
+    // it can be stale and it is often wrong on tunnels.
+    // if we can not set it, we just risk fragmentation.
+    int32_t val;
+    if (!ip.ipv6) {
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE)
+        val = IP_PMTUDISC_PROBE;
+        setsockopt (fd, IPPROTO_IP, IP_MTU_DISCOVER, &val, sizeof(val));
+#elif defined(IP_DONTFRAG)
+        val = 1;
+        setsockopt (fd, IPPROTO_IP, IP_DONTFRAG, &val, sizeof(val));
+#endif
+    } else {
+#if defined(IPV6_MTU_DISCOVER) && defined(IPV6_PMTUDISC_PROBE)
+        val = IPV6_PMTUDISC_PROBE;
+        setsockopt (fd, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &val, sizeof(val));
+#elif defined(IPV6_DONTFRAG)
+        val = 1;
+        setsockopt (fd, IPPROTO_IPV6, IPV6_DONTFRAG, &val, sizeof(val));
+#endif
+    }
+    FENRIR_UNUSED (val);
 }
 
 FENRIR_INLINE int64_t Socket::write (const std::vector<uint8_t> &input,
@@ -224,73 +265,56 @@ FENRIR_INLINE std::tuple<Link_ID, std::vector<uint8_t>> Socket::read()
     return {from, std::move(data)};
 }
 
-// TODO: This is Linux only!
-// we'd also like to support *BSD and MacOSX...
-// should we #define everything? :(
-// TODO: pass address so we can check the correct interface.
-
+// SIOCGIFMTU works on Linux and the BSDs.
 FENRIR_INLINE uint32_t Socket::find_mtu ()
 {
-    // find the *BIGGEST* mtu possible for all interfaces.
-    // since we can in theory receive from everyone, and we have no control
-    // on what they send
-    // /sys/class/net/$interface/mtu is the bytes.
+    // mtu of the interface we are bound to.
+    // if we are bound to all of them, take the *BIGGEST* mtu possible:
+    // we can in theory receive from everyone, and we have no control
+    // on what they send.
     // TODO: check for MTU changes.
-
-    DIR *sys_dir;
-    struct dirent *sysdir_d;
-    FILE *mtu_file;
-    char *path = nullptr, *reall_p;
-    uint32_t pathlen, mtu = 0, tmp_mtu;
-    uint64_t ret;
-
-    if ((sys_dir = opendir("/sys/class/net/")) == nullptr)
+    struct ifaddrs *ifs;
+    if (getifaddrs (&ifs) != 0)
         return 0;
-    while ((sysdir_d = readdir(sys_dir)) != nullptr) {
-        if (!strncmp (sysdir_d->d_name, ".", 2) ||
-                                        !strncmp (sysdir_d->d_name, "..", 3)) {
-            continue;
-        }
-        pathlen = 16 + static_cast<uint32_t> (strlen (sysdir_d->d_name) + 4);
-        reall_p = reinterpret_cast<char *> (realloc(path, pathlen));
-        if (reall_p == nullptr) {
-            free (path);
-            closedir (sys_dir);
-            return 0;
-        }
-        path = reall_p;
-        snprintf (path, pathlen, "/sys/class/net/%s/mtu", sysdir_d->d_name);
-        mtu_file = fopen (path, "r");
-        if (mtu_file == nullptr) {
-            free (path);
-            closedir (sys_dir);
-            continue;
-        }
-        // path has a double usage: we also use it to read the file.
-        (memset_ptr) (path, 0, pathlen);
-        ret = fread (path, 1, pathlen, mtu_file);
-        fclose (mtu_file);
-        if (ret == 0) {
-            free (path);
-            closedir (sys_dir);
+    const int32_t sk = socket (ip.ipv6 ? PF_INET6 : PF_INET, SOCK_DGRAM, 0);
+    if (sk < 0) {
+        freeifaddrs (ifs);
+        return 0;
+    }
+    const bool any = ip.ipv6 ? IN6_IS_ADDR_UNSPECIFIED (&ip.ip.v6) :
+                                        ip.ip.v4.s_addr == htonl (INADDR_ANY);
+    uint32_t mtu = 0;
+    for (auto it = ifs; it != nullptr; it = it->ifa_next) {
+        if (it->ifa_addr == nullptr)
             continue;
+        if (!any) {
+            if (ip.ipv6) {
+                if (it->ifa_addr->sa_family != AF_INET6)
+                    continue;
+                const auto addr = reinterpret_cast<struct sockaddr_in6 *> (
+                                                                it->ifa_addr);
+                if (memcmp (&addr->sin6_addr, &ip.ip.v6,
+                                                    sizeof(ip.ip.v6)) != 0) {
+                    continue;
+                }
+            } else {
+                if (it->ifa_addr->sa_family != AF_INET)
+                    continue;
+                const auto addr = reinterpret_cast<struct sockaddr_in *> (
+                                                                it->ifa_addr);
+                if (addr->sin_addr.s_addr != ip.ip.v4.s_addr)
+                    continue;
+            }
         }
-        path[ret] = '\0'; // just to be sure...
-        tmp_mtu = static_cast<uint32_t> (strtoul (path, &reall_p, 10));
-        // check to see that the mtu is he only thing here.
-        if (tmp_mtu == 0) {
-            free (path);
-            closedir (sys_dir);
+        struct ifreq req;
+        (memset_ptr) (&req, 0, sizeof(req));
+        strncpy (req.ifr_name, it->ifa_name, IFNAMSIZ - 1);
+        if (ioctl (sk, SIOCGIFMTU, &req) != 0 || req.ifr_mtu <= 0)
             continue;
-        }
-        if (*reall_p != '\0' && *reall_p != '\n') {
-            free (path);
-            closedir (sys_dir);
-            return 0;
-        }
-        if (mtu < tmp_mtu)
-            mtu = tmp_mtu;
+        mtu = std::max (mtu, static_cast<uint32_t> (req.ifr_mtu));
     }
+    close (sk);
+    freeifaddrs (ifs);
     return mtu;
 }
 
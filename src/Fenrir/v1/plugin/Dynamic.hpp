@@ -33,6 +33,7 @@ class Loader;
 
 namespace Event {
 class Loop;
+class Plugin_IO;
 class Plugin_Timer;
 } // namespace Event
 
@@ -116,6 +117,9 @@ public:
     {}
 
     virtual void parse_event (std::shared_ptr<Event::Plugin_Timer> ev) = 0;
+    // only for the plugins that wait on a file descriptor
+    virtual void parse_io (std::shared_ptr<Event::Plugin_IO> ev)
+        { FENRIR_UNUSED (ev); }
 protected:
     Event::Loop *const _loop;
     Loader *const _loader;
@@ -80,33 +80,12 @@ Plugin<T>::Plugin()
     for (const auto id : list)
         plugin.emplace_back (id, native);
     #pragma clang diagnostic pop
-    // do NOT load previous loaded plugins, and do NOT override native ones
-
-    uint16_t max_native = std::numeric_limits<uint16_t>::max();
-    if (std::is_same<T, Crypto::Encryption>::value) {
-        max_native = NATIVE_CIPHER;
-    } else if (std::is_same<T, Crypto::Hmac>::value) {
-        max_native = NATIVE_HMAC;
-    } else if (std::is_same<T, Crypto::Key>::value) {
-        max_native = NATIVE_KEY;
-    } else if (std::is_same<T, Crypto::KDF>::value) {
-        max_native = NATIVE_KDF;
-    } else if (std::is_same<T, Db>::value) {
-        max_native = NATIVE_DB;
-    } else if (std::is_same<T, Rate::Rate>::value) {
-        max_native = NATIVE_AUTH;
-    } else if (std::is_same<T, Resolve::Resolver>::value) {
-        max_native = NATIVE_RATE;
-    } else if (std::is_same<T, Recover::ECC>::value) {
-        max_native = NATIVE_ECC;
-    } else if (std::is_same<T, Crypto::Auth>::value) {
-        max_native = NATIVE_RESOLV;
-    }
 
     // put preferences in backwards order.
     // rationale: high id: developed/tested afterwards, therefore "better"
-    for (uint16_t idx = max_native; idx > 0; --idx)
-        preferences.push_back (typename T::ID {idx});
+    // only the native plugins that were listed: some depend on the cpu.
+    for (auto it = list.rbegin(); it != list.rend(); ++it)
+        preferences.push_back (*it);
 }
 
 template <typename T>
@@ -28,6 +28,7 @@
 #include "Fenrir/v1/plugin/Lib.hpp"
 #include "Fenrir/v1/recover/ECC_NULL.hpp"
 #include "Fenrir/v1/resolve/DNSSEC.hpp"
+#include "Fenrir/v1/resolve/Zone.hpp"
 #include <memory>
 #include <vector>
 
@@ -53,8 +54,12 @@ FENRIR_INLINE std::vector<std::pair<Dynamic_Type, uint16_t>> Lib::list_native()
                                                                 NATIVE_RESOLV +
                                                                 NATIVE_ECC
                                                                 );
-    for (uint16_t i = 1; i <= NATIVE_CIPHER; i++)
+    for (uint16_t i = 1; i <= NATIVE_CIPHER; i++) {
+        // do not advertise what this cpu can not run
+        if (i == 3 && !Crypto::AES256_GCM::is_available())
+            continue;
         ret.push_back ({Dynamic_Type::CRYPT, i});
+    }
     for (uint16_t i = 1; i <= NATIVE_HMAC; i++)
         ret.push_back ({Dynamic_Type::HMAC, i});
     for (uint16_t i = 1; i <= NATIVE_KEY; i++)
@@ -98,6 +103,12 @@ FENRIR_INLINE std::shared_ptr<Dynamic> Lib::get_shared_native (
         case 2:
             ret = std::make_shared<Crypto::ChaCha20_Poly1305_IETF>();
             ret->_self = ret;
+            break;
+        case 3:
+            if (!Crypto::AES256_GCM::is_available())
+                break;
+            ret = std::make_shared<Crypto::AES256_GCM>();
+            ret->_self = ret;
         }
         break;
     case Dynamic_Type::HMAC:
@@ -142,6 +153,10 @@ FENRIR_INLINE std::shared_ptr<Dynamic> Lib::get_shared_native (
         case 1:
             ret = std::make_shared<Resolve::DNSSEC> (loop, loader, rnd);
             ret->_self = ret;
+            break;
+        case 2:
+            ret = std::make_shared<Resolve::Zone> (loop, loader, rnd);
+            ret->_self = ret;
         }
         break;
     case Dynamic_Type::ECC:
@@ -36,14 +36,14 @@ namespace Impl {
 
 class Random;
 
-constexpr uint32_t NATIVE_CIPHER = 2;
+constexpr uint32_t NATIVE_CIPHER = 3;
 constexpr uint32_t NATIVE_KEY = 1;
 constexpr uint32_t NATIVE_KDF = 1;
 constexpr uint32_t NATIVE_DB = 1;
 constexpr uint32_t NATIVE_HMAC = 1;
 constexpr uint32_t NATIVE_AUTH = 1;
 constexpr uint32_t NATIVE_RATE = 0;
-constexpr uint32_t NATIVE_RESOLV = 1;
+constexpr uint32_t NATIVE_RESOLV = 2;
 constexpr uint32_t NATIVE_ECC = 1;
 constexpr uint32_t NATIVE_FEC = 0;
 
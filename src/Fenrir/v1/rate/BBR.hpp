@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2016-2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/rate/Congestion.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Rate {
+
+// BBR-style model based congestion control.
+// (see "BBR: Congestion-Based Congestion Control", Cardwell et al.)
+// we estimate the bottleneck bandwidth (windowed max of the delivery rate)
+// and the propagation delay (windowed min of the rtt), then pace at
+// gain * bandwidth, with cwnd = cwnd_gain * BDP.
+// Loss is mostly ignored, as in BBRv1.
+class FENRIR_LOCAL BBR final : public Congestion
+{
+public:
+    BBR (const uint32_t mtu, const uint32_t init_window)
+        : Congestion (mtu, init_window), _state (State::STARTUP),
+          _round (0), _next_round_delivered (0), _full_bw (0),
+          _full_bw_rounds (0), _cycle_idx (0), _cycle_stamp (0),
+          _probe_rtt_done (0), _pacing_gain (high_gain),
+          _cwnd_gain (high_gain)
+    {
+        _bw.fill ({0, 0});
+    }
+    BBR() = delete;
+    BBR (const BBR&) = default;
+    BBR& operator= (const BBR&) = default;
+    BBR (BBR &&) = default;
+    BBR& operator= (BBR &&) = default;
+    ~BBR() {}
+
+    Algorithm algorithm() const override
+        { return Algorithm::BBR; }
+
+    uint64_t cwnd() const override
+    {
+        if (_state == State::PROBE_RTT)
+            return min_cwnd();
+        const uint64_t bdp = this->bdp();
+        if (bdp == 0)
+            return _init_window;
+        return std::max (min_cwnd(),
+                    static_cast<uint64_t> (_cwnd_gain *
+                                                static_cast<double> (bdp)));
+    }
+
+    uint64_t pacing_rate() const override
+    {
+        const uint64_t bw = btl_bw();
+        if (bw == 0) {
+            // no estimate yet: init window over the first rtt
+            if (!_rtt.has_sample())
+                return 0;
+            return static_cast<uint64_t> (_pacing_gain *
+                        static_cast<double> (_init_window) * 1000000 /
+                            static_cast<double> (_rtt.srtt().count()));
+        }
+        return static_cast<uint64_t> (_pacing_gain * static_cast<double> (bw));
+    }
+
+protected:
+    void on_ack (const Rate_Sample &sample,
+                                const std::chrono::microseconds now) override
+    {
+        // round trip counting
+        bool new_round = false;
+        if (sample._prior_delivered >= _next_round_delivered) {
+            _next_round_delivered = sample._total_delivered;
+            ++_round;
+            new_round = true;
+        }
+        // bandwidth filter. app limited samples only count if they
+        // are higher than the current estimate
+        const uint64_t rate = sample.delivery_rate();
+        if (rate > 0 && sample._interval >= _rtt.min_rtt() &&
+                                    (!sample._app_limited || rate > btl_bw())) {
+            auto &slot = _bw[_round % _bw.size()];
+            if (slot.first != _round) {
+                slot = {_round, rate};
+            } else {
+                slot.second = std::max (slot.second, rate);
+            }
+        }
+
+        switch (_state) {
+        case State::STARTUP:
+            if (new_round)
+                check_full_pipe (sample);
+            if (_full_bw_rounds >= 3) {
+                _state = State::DRAIN;
+                _pacing_gain = 1. / high_gain;
+                _cwnd_gain = high_gain;
+            }
+            break;
+        case State::DRAIN:
+            if (sample._in_flight <= bdp())
+                enter_probe_bw (now);
+            break;
+        case State::PROBE_BW:
+            advance_cycle (sample, now);
+            break;
+        case State::PROBE_RTT:
+            if (_probe_rtt_done.count() == 0 &&
+                                            sample._in_flight <= min_cwnd()) {
+                _probe_rtt_done = now +
+                            std::chrono::milliseconds (
+                                    static_cast<int64_t> (probe_rtt_msec));
+            } else if (_probe_rtt_done.count() != 0 && now > _probe_rtt_done) {
+                _rtt.reset_min_rtt (now);
+                if (_full_bw_rounds >= 3) {
+                    enter_probe_bw (now);
+                } else {
+                    _state = State::STARTUP;
+                    _pacing_gain = high_gain;
+                    _cwnd_gain = high_gain;
+                }
+            }
+            break;
+        }
+
+        if (_state != State::PROBE_RTT &&
+                                _rtt.min_rtt_expired (now,
+                                std::chrono::seconds (
+                                static_cast<int64_t> (min_rtt_window_sec)))) {
+            _state = State::PROBE_RTT;
+            _pacing_gain = 1.;
+            _cwnd_gain = 1.;
+            _probe_rtt_done = std::chrono::microseconds (0);
+        }
+    }
+
+    void on_loss (const uint64_t lost_bytes, const uint64_t in_flight,
+                                const std::chrono::microseconds now) override
+    {
+        // BBRv1 does not react to loss directly, the bandwidth samples
+        // will simply be lower.
+        FENRIR_UNUSED (lost_bytes);
+        FENRIR_UNUSED (in_flight);
+        FENRIR_UNUSED (now);
+    }
+
+private:
+    enum class State : uint8_t {
+        STARTUP   = 0x00,
+        DRAIN     = 0x01,
+        PROBE_BW  = 0x02,
+        PROBE_RTT = 0x03
+    };
+    static constexpr double high_gain = 2.885;  // 2/ln(2)
+    static constexpr uint32_t bw_window_rounds = 10;
+    static constexpr uint32_t min_rtt_window_sec = 10;
+    static constexpr uint32_t probe_rtt_msec = 200;
+
+    State _state;
+    // windowed max bandwidth: one slot per round, <round, bytes/sec>
+    std::array<std::pair<uint64_t, uint64_t>, bw_window_rounds> _bw;
+    uint64_t _round, _next_round_delivered;
+    uint64_t _full_bw;
+    uint8_t _full_bw_rounds;
+    uint8_t _cycle_idx;
+    std::chrono::microseconds _cycle_stamp, _probe_rtt_done;
+    double _pacing_gain, _cwnd_gain;
+
+    uint64_t min_cwnd() const
+        { return 4 * static_cast<uint64_t> (_mtu); }
+
+    uint64_t btl_bw() const
+    {
+        uint64_t ret = 0;
+        for (const auto &slot : _bw) {
+            if (slot.first + bw_window_rounds > _round)
+                ret = std::max (ret, slot.second);
+        }
+        return ret;
+    }
+
+    uint64_t bdp() const
+    {
+        if (!_rtt.has_sample())
+            return 0;
+        return btl_bw() * static_cast<uint64_t> (_rtt.min_rtt().count()) /
+                                                                        1000000;
+    }
+
+    void check_full_pipe (const Rate_Sample &sample)
+    {
+        if (sample._app_limited)
+            return;
+        const uint64_t bw = btl_bw();
+        // still growing by at least 25%?
+        if (bw >= _full_bw + _full_bw / 4) {
+            _full_bw = bw;
+            _full_bw_rounds = 0;
+            return;
+        }
+        ++_full_bw_rounds;
+    }
+
+    void enter_probe_bw (const std::chrono::microseconds now)
+    {
+        _state = State::PROBE_BW;
+        _cwnd_gain = 2.;
+        // do not start on the 0.75 phase
+        _cycle_idx = static_cast<uint8_t> (2 + (_round % 6));
+        _pacing_gain = cycle_gain (_cycle_idx);
+        _cycle_stamp = now;
+    }
+
+    void advance_cycle (const Rate_Sample &sample,
+                                            const std::chrono::microseconds now)
+    {
+        bool next = now - _cycle_stamp > _rtt.min_rtt();
+        // stay in the probing phase until we actually filled the pipe more,
+        // leave the draining phase as soon as the queue is gone
+        if (_pacing_gain > 1. && sample._in_flight <
+                    static_cast<uint64_t> (_pacing_gain *
+                                            static_cast<double> (bdp()))) {
+            next = false;
+        } else if (_pacing_gain < 1. && sample._in_flight <= bdp()) {
+            next = true;
+        }
+        if (!next)
+            return;
+        _cycle_idx = static_cast<uint8_t> ((_cycle_idx + 1) % 8);
+        _pacing_gain = cycle_gain (_cycle_idx);
+        _cycle_stamp = now;
+    }
+
+    static double cycle_gain (const uint8_t idx)
+    {
+        switch (idx) {
+        case 0:
+            return 1.25;
+        case 1:
+            return 0.75;
+        default:
+            return 1.;
+        }
+    }
+};
+
+} // namespace Rate
+} // namespace Impl
+} // namespace Fenrir__v1
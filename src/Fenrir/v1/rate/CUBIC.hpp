@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2016-2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/rate/Congestion.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Rate {
+
+// CUBIC, as in RFC 8312.
+// loss-based: the window grows as a cubic function of the time since
+// the last congestion event, and is multiplied by "beta" on loss.
+// Everything is kept in bytes, the cubic function works on packets (mtu)
+class FENRIR_LOCAL CUBIC final : public Congestion
+{
+public:
+    CUBIC (const uint32_t mtu, const uint32_t init_window)
+        : Congestion (mtu, init_window),
+          _cwnd (_init_window), _ssthresh (std::numeric_limits<uint64_t>::max()),
+          _w_max (0), _w_last_max (0), _k (0.),
+          _epoch_start (0), _recovery_start (0), _w_est (0) {}
+    CUBIC() = delete;
+    CUBIC (const CUBIC&) = default;
+    CUBIC& operator= (const CUBIC&) = default;
+    CUBIC (CUBIC &&) = default;
+    CUBIC& operator= (CUBIC &&) = default;
+    ~CUBIC() {}
+
+    Algorithm algorithm() const override
+        { return Algorithm::CUBIC; }
+
+    uint64_t cwnd() const override
+        { return _cwnd; }
+
+    uint64_t pacing_rate() const override
+    {
+        if (!_rtt.has_sample())
+            return 0;
+        // pace a bit faster than cwnd/rtt so that the window can
+        // actually be filled. faster still in slow start.
+        const uint64_t gain = _cwnd < _ssthresh ? 200 : 120;
+        const uint64_t srtt = static_cast<uint64_t> (_rtt.srtt().count());
+        return (_cwnd * 1000000 / srtt) * gain / 100;
+    }
+
+protected:
+    void on_ack (const Rate_Sample &sample,
+                                const std::chrono::microseconds now) override
+    {
+        if (_recovery_start.count() != 0 &&
+                                    now - _recovery_start < _rtt.srtt()) {
+            return; // still recovering, do not grow.
+        }
+        if (_cwnd < _ssthresh) {
+            // slow start
+            _cwnd += sample._acked;
+            return;
+        }
+        if (_epoch_start.count() == 0) {
+            _epoch_start = now;
+            if (_cwnd < _w_max) {
+                _k = std::cbrt (static_cast<double> (_w_max - _cwnd) /
+                                                        (_mtu * cubic_c));
+            } else {
+                _k = 0.;
+                _w_max = _cwnd;
+            }
+            _w_est = _cwnd;
+        }
+        const double t = static_cast<double> ((now - _epoch_start +
+                                            _rtt.min_rtt()).count()) / 1000000;
+        const double delta = t - _k;
+        const double w_cubic = cubic_c * delta * delta * delta * _mtu +
+                                                    static_cast<double> (_w_max);
+
+        // TCP-friendly region: estimate what Reno would have done
+        _w_est += static_cast<uint64_t> (reno_alpha * _mtu *
+                    static_cast<double> (sample._acked) /
+                                                static_cast<double> (_cwnd));
+
+        uint64_t target;
+        if (w_cubic <= 0.) {
+            target = _cwnd;
+        } else if (w_cubic > static_cast<double> (2 * _cwnd)) {
+            target = 2 * _cwnd; // max growth: double per rtt
+        } else {
+            target = static_cast<uint64_t> (w_cubic);
+        }
+        target = std::max (target, _w_est);
+        if (target > _cwnd) {
+            // spread the growth over one window of acks
+            _cwnd += std::max<uint64_t> (1,
+                                (target - _cwnd) * sample._acked / _cwnd);
+        }
+    }
+
+    void on_loss (const uint64_t lost_bytes, const uint64_t in_flight,
+                                const std::chrono::microseconds now) override
+    {
+        FENRIR_UNUSED (lost_bytes);
+        FENRIR_UNUSED (in_flight);
+        // only one reduction per rtt
+        if (_recovery_start.count() != 0 &&
+                                    now - _recovery_start < _rtt.srtt()) {
+            return;
+        }
+        _recovery_start = now;
+        _epoch_start = std::chrono::microseconds (0);
+        // fast convergence: release bandwidth to new flows
+        if (_cwnd < _w_last_max) {
+            _w_last_max = _cwnd;
+            _w_max = static_cast<uint64_t> (static_cast<double> (_cwnd) *
+                                                        (1. + beta) / 2.);
+        } else {
+            _w_last_max = _cwnd;
+            _w_max = _cwnd;
+        }
+        _cwnd = std::max (static_cast<uint64_t> (
+                                    static_cast<double> (_cwnd) * beta),
+                                                    static_cast<uint64_t> (
+                                                                2 * _mtu));
+        _ssthresh = _cwnd;
+    }
+
+private:
+    static constexpr double cubic_c = 0.4;
+    static constexpr double beta = 0.7;
+    // 3 * (1 - beta) / (1 + beta)
+    static constexpr double reno_alpha = 3. * (1. - beta) / (1. + beta);
+
+    uint64_t _cwnd, _ssthresh;
+    uint64_t _w_max, _w_last_max;
+    double _k;
+    std::chrono::microseconds _epoch_start, _recovery_start;
+    uint64_t _w_est;
+};
+
+} // namespace Rate
+} // namespace Impl
+} // namespace Fenrir__v1
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2016-2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include <type_safe/optional.hpp>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Rate {
+
+// Calendar queue: a ring of time buckets, each "granularity" wide.
+// Insertion and extraction are O(1) (amortized over the elapsed time).
+// Entries past the end of the ring are put in the last bucket and
+// re-inserted when that bucket is reached.
+// Entries are never removed: keep a generation in your data and ignore
+// the stale ones when they come out.
+// NOTE: not thread safe, the caller must handle locking.
+class FENRIR_LOCAL Calendar_Queue
+{
+public:
+    struct entry {
+        uint32_t _slot;
+        uint32_t _generation;
+        std::chrono::microseconds _when;
+    };
+
+    Calendar_Queue (const std::chrono::microseconds granularity,
+                                                        const uint32_t buckets)
+        : _buckets (buckets), _granularity (granularity), _cursor (0),
+                                                                    _size (0)
+    {
+        assert (granularity.count() > 0 && buckets > 1 &&
+                                        "Fenrir: Calendar_Queue: bad params");
+    }
+    Calendar_Queue() = delete;
+    Calendar_Queue (const Calendar_Queue&) = delete;
+    Calendar_Queue& operator= (const Calendar_Queue&) = delete;
+    Calendar_Queue (Calendar_Queue &&) = default;
+    Calendar_Queue& operator= (Calendar_Queue &&) = default;
+    ~Calendar_Queue() = default;
+
+    size_t size() const
+        { return _size; }
+
+    void push (const entry e)
+    {
+        uint64_t idx = std::max (bucket_of (e._when), _cursor);
+        const uint64_t last = _cursor + _buckets.size() - 1;
+        if (idx > last)
+            idx = last;
+        _buckets[static_cast<size_t> (idx % _buckets.size())].push_back (e);
+        ++_size;
+    }
+
+    // append to "out" all the entries that are due at "now"
+    void pop_due (const std::chrono::microseconds now, std::vector<entry> &out)
+    {
+        const uint64_t target = bucket_of (now);
+        while (_size > 0) {
+            auto &bucket = _buckets[static_cast<size_t> (
+                                                _cursor % _buckets.size())];
+            if (bucket.size() > 0) {
+                _tmp.swap (bucket);
+                _size -= _tmp.size();
+                for (const auto &e : _tmp) {
+                    if (e._when <= now) {
+                        out.push_back (e);
+                    } else {
+                        push (e);   // overflow, or later in this bucket
+                    }
+                }
+                _tmp.clear();
+            }
+            if (_cursor >= target)
+                return;
+            ++_cursor;
+        }
+        // nothing left: no need to walk the empty buckets.
+        _cursor = std::max (_cursor, target);
+    }
+
+    // earliest time something will be due. nullopt if empty.
+    type_safe::optional<std::chrono::microseconds> next_due() const
+    {
+        if (_size == 0)
+            return type_safe::nullopt;
+        for (uint64_t idx = _cursor; idx < _cursor + _buckets.size(); ++idx) {
+            const auto &bucket = _buckets[static_cast<size_t> (
+                                                    idx % _buckets.size())];
+            if (bucket.size() == 0)
+                continue;
+            auto min = std::min_element (bucket.begin(), bucket.end(),
+                                    [] (const entry &a, const entry &b)
+                                                { return a._when < b._when; });
+            return type_safe::make_optional (min->_when);
+        }
+        return type_safe::nullopt;
+    }
+private:
+    std::vector<std::vector<entry>> _buckets;
+    std::vector<entry> _tmp;
+    const std::chrono::microseconds _granularity;
+    uint64_t _cursor;   // absolute bucket index (time / granularity)
+    size_t _size;
+
+    uint64_t bucket_of (const std::chrono::microseconds t) const
+    {
+        if (t.count() <= 0)
+            return 0;
+        return static_cast<uint64_t> (t.count() / _granularity.count());
+    }
+};
+
+} // namespace Rate
+} // namespace Impl
+} // namespace Fenrir__v1
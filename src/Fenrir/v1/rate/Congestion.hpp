@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2016-2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/rate/Token_Bucket.hpp"
+#include <type_safe/optional.hpp>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <memory>
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Rate {
+
+// Congestion control framework.
+// Each path (link from -> link to) keeps:
+//  * a Delivery_Tracker: remembers the packets in flight and generates
+//      one Rate_Sample (rtt + delivery rate) for each acknowledged packet.
+//  * a Congestion controller: learns cwnd and pacing rate from the samples
+//  * a Token_Bucket: spaces the packets at the pacing rate, so that
+//      we do not burst a whole cwnd at once.
+// see draft-cheng-iccrg-delivery-rate-estimation for the sampling.
+
+
+// generated for each acknowledged packet
+struct FENRIR_LOCAL Rate_Sample
+{
+    std::chrono::microseconds _rtt;
+    std::chrono::microseconds _interval;
+    uint64_t _delivered;        // bytes delivered during "_interval"
+    uint64_t _prior_delivered;  // total delivered when the pkt was sent
+    uint64_t _total_delivered;  // total delivered, including this packet
+    uint64_t _acked;            // bytes of this packet
+    uint64_t _in_flight;        // bytes still in flight after this ack
+    bool _app_limited;
+
+    // bytes per second
+    uint64_t delivery_rate() const
+    {
+        if (_interval.count() <= 0)
+            return 0;
+        return (_delivered * 1000000) /
+                                    static_cast<uint64_t> (_interval.count());
+    }
+};
+
+
+// RFC 6298 smoothed rtt, plus a windowed minimum
+class FENRIR_LOCAL RTT_Estimator
+{
+public:
+    RTT_Estimator()
+        : _srtt (0), _rttvar (0),
+          _min_rtt (std::chrono::microseconds::max()),
+          _min_rtt_stamp (0), _latest (0) {}
+    RTT_Estimator (const RTT_Estimator&) = default;
+    RTT_Estimator& operator= (const RTT_Estimator&) = default;
+    RTT_Estimator (RTT_Estimator &&) = default;
+    RTT_Estimator& operator= (RTT_Estimator &&) = default;
+    ~RTT_Estimator() = default;
+
+    void update (const std::chrono::microseconds sample,
+                                            const std::chrono::microseconds now)
+    {
+        if (sample.count() <= 0)
+            return;
+        _latest = sample;
+        if (sample <= _min_rtt) {
+            _min_rtt = sample;
+            _min_rtt_stamp = now;
+        }
+        if (_srtt.count() == 0) {
+            _srtt = sample;
+            _rttvar = sample / 2;
+            return;
+        }
+        const auto diff = _srtt > sample ? _srtt - sample : sample - _srtt;
+        _rttvar = (3 * _rttvar + diff) / 4;
+        _srtt = (7 * _srtt + sample) / 8;
+    }
+    // the min rtt has not been refreshed in "window"
+    bool min_rtt_expired (const std::chrono::microseconds now,
+                                    const std::chrono::microseconds window) const
+        { return has_sample() && now - _min_rtt_stamp > window; }
+    // used when probing the min rtt again
+    void reset_min_rtt (const std::chrono::microseconds now)
+    {
+        _min_rtt = _latest;
+        _min_rtt_stamp = now;
+    }
+
+    bool has_sample() const
+        { return _srtt.count() != 0; }
+    std::chrono::microseconds srtt() const
+        { return _srtt; }
+    std::chrono::microseconds rttvar() const
+        { return _rttvar; }
+    std::chrono::microseconds latest() const
+        { return _latest; }
+    std::chrono::microseconds min_rtt() const
+        { return _min_rtt; }
+    std::chrono::microseconds rto() const
+    {
+        if (!has_sample())
+            return std::chrono::seconds (1);
+        return std::max (_srtt + 4 * _rttvar,
+                                    std::chrono::microseconds (200000));
+    }
+private:
+    std::chrono::microseconds _srtt, _rttvar;
+    std::chrono::microseconds _min_rtt, _min_rtt_stamp;
+    std::chrono::microseconds _latest;
+};
+
+
+// track the packets in flight on a path, generate the rate samples.
+// Sequence numbers are local to the path and strictly increasing.
+class FENRIR_LOCAL Delivery_Tracker
+{
+public:
+    Delivery_Tracker()
+        : _next_seq (0), _delivered (0), _in_flight (0), _lost (0),
+          _delivered_time (0), _first_sent_time (0), _app_limited_until (0) {}
+    Delivery_Tracker (const Delivery_Tracker&) = delete;
+    Delivery_Tracker& operator= (const Delivery_Tracker&) = delete;
+    Delivery_Tracker (Delivery_Tracker &&) = default;
+    Delivery_Tracker& operator= (Delivery_Tracker &&) = default;
+    ~Delivery_Tracker() = default;
+
+    uint64_t on_send (const uint32_t bytes, const std::chrono::microseconds now,
+                                                        const bool app_limited)
+    {
+        if (_in_flight == 0) {
+            // restart the sampling interval after an idle period
+            _first_sent_time = now;
+            _delivered_time = now;
+        }
+        if (app_limited)
+            _app_limited_until = _delivered + _in_flight + bytes;
+        _sent.push_back (sent {_next_seq, bytes, now, _delivered,
+                                        _delivered_time, _first_sent_time,
+                                        _app_limited_until > _delivered, false});
+        _in_flight += bytes;
+        return _next_seq++;
+    }
+
+    type_safe::optional<Rate_Sample> on_ack (const uint64_t seq,
+                                            const std::chrono::microseconds now)
+    {
+        auto pkt = find (seq);
+        if (pkt == nullptr || pkt->_done)
+            return type_safe::nullopt;
+        pkt->_done = true;
+        _in_flight -= pkt->_bytes;
+        _delivered += pkt->_bytes;
+        _delivered_time = now;
+        if (_app_limited_until != 0 && _delivered > _app_limited_until)
+            _app_limited_until = 0;
+
+        // the interval is the longest between the send and ack phases,
+        // so that ack compression does not overestimate the rate.
+        const auto send_elapsed = pkt->_sent_time - pkt->_first_sent_time;
+        const auto ack_elapsed = now - pkt->_delivered_time;
+        _first_sent_time = pkt->_sent_time;
+
+        Rate_Sample ret;
+        ret._rtt = now - pkt->_sent_time;
+        ret._interval = std::max (send_elapsed, ack_elapsed);
+        ret._delivered = _delivered - pkt->_prior_delivered;
+        ret._prior_delivered = pkt->_prior_delivered;
+        ret._total_delivered = _delivered;
+        ret._acked = pkt->_bytes;
+        ret._in_flight = _in_flight;
+        ret._app_limited = pkt->_app_limited;
+        cleanup();
+        return type_safe::make_optional (ret);
+    }
+
+    // returns the lost bytes (0 if already acked/lost)
+    uint32_t on_loss (const uint64_t seq)
+    {
+        auto pkt = find (seq);
+        if (pkt == nullptr || pkt->_done)
+            return 0;
+        pkt->_done = true;
+        _in_flight -= pkt->_bytes;
+        _lost += pkt->_bytes;
+        const uint32_t ret = pkt->_bytes;
+        cleanup();
+        return ret;
+    }
+
+    uint64_t in_flight() const
+        { return _in_flight; }
+    uint64_t delivered() const
+        { return _delivered; }
+    uint64_t lost() const
+        { return _lost; }
+    // oldest packet still in flight
+    type_safe::optional<uint64_t> oldest() const
+    {
+        if (_sent.size() == 0)
+            return type_safe::nullopt;
+        return type_safe::make_optional (_sent.front()._seq);
+    }
+    // send time of a packet still in flight
+    type_safe::optional<std::chrono::microseconds> sent_time (
+                                                        const uint64_t seq)
+    {
+        auto pkt = find (seq);
+        if (pkt == nullptr)
+            return type_safe::nullopt;
+        return type_safe::make_optional (pkt->_sent_time);
+    }
+private:
+    struct sent {
+        uint64_t _seq;
+        uint32_t _bytes;
+        std::chrono::microseconds _sent_time;
+        uint64_t _prior_delivered;
+        std::chrono::microseconds _delivered_time;
+        std::chrono::microseconds _first_sent_time;
+        bool _app_limited;
+        bool _done;
+    };
+    // ordered by seq, only the head is ever removed.
+    std::deque<sent> _sent;
+    uint64_t _next_seq;
+    uint64_t _delivered, _in_flight, _lost;
+    std::chrono::microseconds _delivered_time, _first_sent_time;
+    uint64_t _app_limited_until;
+
+    sent *find (const uint64_t seq)
+    {
+        if (_sent.size() == 0 || seq < _sent.front()._seq)
+            return nullptr;
+        // sequences are contiguous, no need to search
+        const uint64_t idx = seq - _sent.front()._seq;
+        if (idx >= _sent.size())
+            return nullptr;
+        return &_sent[static_cast<size_t> (idx)];
+    }
+    void cleanup()
+    {
+        while (_sent.size() > 0 && _sent.front()._done)
+            _sent.pop_front();
+    }
+};
+
+
+// Congestion controller interface.
+// Everything is in bytes and bytes per second.
+// NOTE: not thread safe, the caller (the Rate plugin) must handle locking.
+class FENRIR_LOCAL Congestion
+{
+public:
+    enum class FENRIR_LOCAL Algorithm : uint8_t {
+        CUBIC = 0x01,
+        BBR   = 0x02
+    };
+
+    Congestion (const uint32_t mtu, const uint32_t init_window)
+        : _mtu (mtu > min_mtu ? mtu : min_mtu),
+          _init_window (init_window > 2 * _mtu ? init_window : 2 * _mtu) {}
+    Congestion() = delete;
+    Congestion (const Congestion&) = default;
+    Congestion& operator= (const Congestion&) = default;
+    Congestion (Congestion &&) = default;
+    Congestion& operator= (Congestion &&) = default;
+    virtual ~Congestion() {}
+
+    virtual Algorithm algorithm() const = 0;
+
+    void ack (const Rate_Sample &sample, const std::chrono::microseconds now)
+    {
+        _rtt.update (sample._rtt, now);
+        on_ack (sample, now);
+    }
+    void loss (const uint64_t lost_bytes, const uint64_t in_flight,
+                                            const std::chrono::microseconds now)
+        { on_loss (lost_bytes, in_flight, now); }
+    // rtt sample for packets we already gave up on
+    void rtt_sample (const std::chrono::microseconds rtt,
+                                            const std::chrono::microseconds now)
+        { _rtt.update (rtt, now); }
+    void set_mtu (const uint32_t mtu)
+        { _mtu = mtu > min_mtu ? mtu : min_mtu; }
+
+    // max bytes in flight
+    virtual uint64_t cwnd() const = 0;
+    // bytes per second. 0 == unknown, do not pace
+    virtual uint64_t pacing_rate() const = 0;
+
+    const RTT_Estimator& rtt() const
+        { return _rtt; }
+protected:
+    static constexpr uint32_t min_mtu = 1280;  // ipv6 minimum
+    RTT_Estimator _rtt;
+    uint32_t _mtu;
+    uint32_t _init_window;
+
+    virtual void on_ack (const Rate_Sample &sample,
+                                        const std::chrono::microseconds now) = 0;
+    virtual void on_loss (const uint64_t lost_bytes, const uint64_t in_flight,
+                                        const std::chrono::microseconds now) = 0;
+};
+
+} // namespace Rate
+} // namespace Impl
+} // namespace Fenrir__v1
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2016-2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include <type_safe/optional.hpp>
+#include <algorithm>
+#include <chrono>
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Rate {
+
+// Datagram Packetization Layer Path MTU Discovery (RFC 8899)
+// for one destination. All sizes are UDP payloads.
+//
+// We start from a size that works everywhere, then search up to the mtu
+// of our interface with padded probe packets, acknowledged by their
+// timestamp echo. The first probe is the interface mtu, so that clean
+// paths are found in one rtt, then we try the common sizes (jumbo frames
+// and ethernet, minus the ipv6/udp headers), then we binary search.
+// A size is too big only after "max_probes" losses, not to confuse
+// random loss with the mtu.
+// When the search is complete we try again after "raise_sec":
+// the path might have changed. If the packets of the current size
+// are blackholed, we go back to the base and search again.
+// NOTE: not thread safe, the Rate plugin must handle locking.
+class FENRIR_LOCAL PMTU_Discovery
+{
+public:
+    // works everywhere: 1280 bytes ipv6 minimum, minus headers
+    static constexpr uint16_t base_mtu = 1200;
+
+    PMTU_Discovery (const uint16_t base)
+        : _state (State::SEARCHING),
+          _mtu (std::max (base, static_cast<uint16_t> (base_mtu))),
+          _base (_mtu), _too_big (no_limit), _failed (0), _next_probe (0) {}
+    PMTU_Discovery() = delete;
+    PMTU_Discovery (const PMTU_Discovery&) = default;
+    PMTU_Discovery& operator= (const PMTU_Discovery&) = default;
+    PMTU_Discovery (PMTU_Discovery &&) = default;
+    PMTU_Discovery& operator= (PMTU_Discovery &&) = default;
+    ~PMTU_Discovery() = default;
+
+    // largest confirmed size
+    uint16_t mtu() const
+        { return _mtu; }
+
+    // size of the probe to send now, if any.
+    // "max": the mtu of the interface we send from
+    type_safe::optional<uint16_t> want_probe (const uint16_t max,
+                                            const std::chrono::microseconds now)
+    {
+        if (now < _next_probe)
+            return type_safe::nullopt;
+        if (_state == State::COMPLETE) {
+            // raise timer: forget what was too big and try again
+            _state = State::SEARCHING;
+            _too_big = no_limit;
+            _failed = 0;
+        }
+        const uint32_t high = std::min<uint32_t> (_too_big, max + 1u);
+        if (high <= static_cast<uint32_t> (_mtu) + granularity) {
+            complete (now);
+            return type_safe::nullopt;
+        }
+        if (_too_big == no_limit)
+            return type_safe::make_optional (max);
+        for (const uint16_t common : {8952, 1452}) {
+            if (common > _mtu + granularity && common < high)
+                return type_safe::make_optional (common);
+        }
+        return type_safe::make_optional (static_cast<uint16_t> (
+                                                        (_mtu + high) / 2));
+    }
+
+    void probe_acked (const uint16_t size)
+    {
+        if (size > _mtu)
+            _mtu = size;
+        _failed = 0;
+    }
+
+    // "retry": time before the next probe
+    void probe_lost (const uint16_t size, const std::chrono::microseconds now,
+                                        const std::chrono::microseconds retry)
+    {
+        _next_probe = now + retry;
+        if (size <= _mtu)
+            return;
+        if (++_failed < max_probes)
+            return;
+        _failed = 0;
+        _too_big = std::min<uint32_t> (_too_big, size);
+    }
+
+    // the packets of the current size are lost, while the smaller ones
+    // were working before.
+    void black_hole (const std::chrono::microseconds now)
+    {
+        if (_mtu == _base)
+            return;
+        _state = State::SEARCHING;
+        _too_big = no_limit;
+        _failed = 0;
+        _mtu = _base;
+        _next_probe = now;
+    }
+private:
+    enum class State : uint8_t {
+        SEARCHING = 0x00,
+        COMPLETE  = 0x01
+    };
+    static constexpr uint32_t no_limit = 0x10000;
+    static constexpr uint32_t granularity = 16;
+    static constexpr uint8_t max_probes = 3;
+    static constexpr uint32_t raise_sec = 600;
+
+    State _state;
+    uint16_t _mtu, _base;
+    uint32_t _too_big;  // smallest size that failed
+    uint8_t _failed;    // failures of the current probe size
+    std::chrono::microseconds _next_probe;
+
+    void complete (const std::chrono::microseconds now)
+    {
+        _state = State::COMPLETE;
+        _next_probe = now + std::chrono::seconds (
+                                            static_cast<int64_t> (raise_sec));
+    }
+};
+
+} // namespace Rate
+} // namespace Impl
+} // namespace Fenrir__v1
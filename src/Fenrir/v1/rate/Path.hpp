@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2016-2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/net/Link_defs.hpp"
+#include "Fenrir/v1/rate/BBR.hpp"
+#include "Fenrir/v1/rate/Congestion.hpp"
+#include "Fenrir/v1/rate/CUBIC.hpp"
+#include "Fenrir/v1/rate/PMTU.hpp"
+#include "Fenrir/v1/rate/Token_Bucket.hpp"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Rate {
+
+FENRIR_INLINE std::unique_ptr<Congestion> mk_congestion (
+                                            const Congestion::Algorithm alg,
+                                            const Link_Params params)
+{
+    switch (alg) {
+    case Congestion::Algorithm::CUBIC:
+        return std::make_unique<CUBIC> (params.mtu(), params.init_window());
+    case Congestion::Algorithm::BBR:
+        return std::make_unique<BBR> (params.mtu(), params.init_window());
+    }
+    assert (false && "Fenrir: mk_congestion: nonexaustive switch?");
+    return nullptr;
+}
+
+// Congestion state of one destination link:
+// tracking of the packets in flight, congestion controller and pacer.
+//
+// Feedback comes from timestamp probes (see Control::Timestamp):
+// some packets carry a probe, and the peer echoes it back together with
+// the number of packets it received on that link.
+// An echo acknowledges all the packets up to the probe, and the difference
+// between what we sent and what the peer received since the last echo
+// tells us how many of them have been lost.
+// If nothing is echoed for a whole rto, the oldest packets are lost.
+// Until the first echo we do not know the rtt, nor if the peer echoes
+// at all: packets that expire then are only forgotten, not lost, so the
+// window stays at its initial size and the link keeps going.
+//
+// The path mtu is discovered with the same echoes (see PMTU_Discovery),
+// but the mtu probes are not tracked as data: their loss is not congestion.
+// NOTE: not thread safe, the Rate plugin must handle locking.
+class FENRIR_LOCAL Path
+{
+public:
+    Path (const Congestion::Algorithm alg, const Link_Params params)
+        : _cc (mk_congestion (alg, params)), _pmtu (params.mtu()),
+          _mtu_probe ({std::chrono::microseconds (0), 0}), _last_probe (0),
+          _echo_seq (0), _echo_received (0), _mtu_probes_received (0),
+          _echo_ts (0), _loss (0.), _mtu (_pmtu.mtu()), _timeouts (0),
+          _feedback (false) {}
+    Path() = delete;
+    Path (const Path&) = delete;
+    Path& operator= (const Path&) = delete;
+    Path (Path &&) = default;
+    Path& operator= (Path &&) = default;
+    ~Path() = default;
+
+    // how long we have to wait before sending "bytes". 0 => send now.
+    // when we are limited by the congestion window we can only wait for
+    // acks, so we return when we expect the next echo as a retry hint.
+    std::chrono::microseconds wait_time (const uint32_t bytes,
+                                            const std::chrono::microseconds now)
+    {
+        expire (now);
+        if (_tracker.in_flight() + bytes > _cc->cwnd()) {
+            const auto &rtt = _cc->rtt();
+            if (!rtt.has_sample() || _probes.size() == 0)
+                return std::chrono::milliseconds (1);
+            const auto expected = _probes.front()._sent + rtt.srtt();
+            const std::chrono::microseconds min (100);
+            if (expected <= now + min)
+                return min;
+            return expected - now;
+        }
+        update_pacer();
+        return _pacer.wait_time (bytes, now);
+    }
+
+    // should the next packet of "bytes" carry a timestamp probe?
+    bool want_probe (const uint32_t bytes,
+                                    const std::chrono::microseconds now) const
+    {
+        if (_probes.size() == 0)
+            return true;
+        // the last packet before the cwnd blocks us must carry a probe,
+        // or nothing would acknowledge it before the rto.
+        if (_tracker.in_flight() + 2 * bytes > _cc->cwnd())
+            return true;
+        return now - _last_probe >= probe_interval();
+    }
+
+    // register a sent packet. returns the sequence to use for ack/lost
+    // "now" must be the timestamp of the probe, if any.
+    uint64_t sent (const uint32_t bytes, const std::chrono::microseconds now,
+                                const bool app_limited, const bool probe)
+    {
+        update_pacer();
+        _pacer.force_consume (bytes, now);
+        const uint64_t seq = _tracker.on_send (bytes, now, app_limited);
+        if (probe) {
+            _probes.push_back ({now, seq});
+            _last_probe = now;
+        }
+        return seq;
+    }
+
+    // size of the mtu probe to send now, if any.
+    // "max": the mtu of the interface we send from
+    type_safe::optional<uint16_t> want_mtu_probe (const uint16_t max,
+                                            const std::chrono::microseconds now)
+    {
+        // one at a time, and we need the rto to detect the loss
+        if (_mtu_probe._size != 0 || !_cc->rtt().has_sample())
+            return type_safe::nullopt;
+        return _pmtu.want_probe (max, now);
+    }
+
+    // the mtu probe carries a timestamp probe, too, sent at "now"
+    void mtu_probe_sent (const uint16_t size,
+                                            const std::chrono::microseconds now)
+    {
+        update_pacer();
+        _pacer.force_consume (size, now);
+        _mtu_probe = {now, size};
+    }
+
+    // the peer echoed our probe, after holding it for "delay".
+    // "received" is the peer counter of the packets received on the link.
+    void echo (const std::chrono::microseconds timestamp,
+                                        const std::chrono::microseconds delay,
+                                        const uint32_t received,
+                                        const std::chrono::microseconds now)
+    {
+        if (timestamp <= _echo_ts)
+            return; // duplicate
+        _echo_ts = timestamp;
+        _feedback = true;
+        if (_mtu_probe._size != 0) {
+            if (timestamp == _mtu_probe._sent) {
+                _pmtu.probe_acked (_mtu_probe._size);
+                set_mtu (_pmtu.mtu());
+                _mtu_probe._size = 0;
+                ++_mtu_probes_received;
+                if (now - timestamp > delay)
+                    _cc->rtt_sample (now - timestamp - delay, now);
+                return;
+            }
+            if (timestamp > _mtu_probe._sent)
+                mtu_probe_lost (now);
+        }
+        // probes are echoed in order: the older ones or their echo
+        // have been lost, the counters will tell.
+        while (_probes.size() > 0 && _probes.front()._sent < timestamp)
+            _probes.pop_front();
+        if (_probes.size() == 0 || _probes.front()._sent != timestamp) {
+            // the probe expired: the rtt grew past the rto.
+            // we still need the sample, or we will keep expiring.
+            if (now - timestamp > delay)
+                _cc->rtt_sample (now - timestamp - delay, now);
+            return;
+        }
+        const uint64_t probe_seq = _probes.front()._seq;
+        _probes.pop_front();
+        _timeouts = 0;
+
+        // counters are cumulative, so lost echoes do not matter.
+        // reordering can make us think some packets are lost, but
+        // the next echo will then have more, not less, received packets.
+        const uint64_t sent = probe_seq + 1 - _echo_seq;
+        // the peer counted the mtu probes, too.
+        uint32_t delta_received = received - _echo_received;
+        delta_received -= std::min (delta_received, _mtu_probes_received);
+        _mtu_probes_received = 0;
+        uint64_t to_lose = sent > delta_received ? sent - delta_received : 0;
+        update_loss (static_cast<double> (to_lose) /
+                                                static_cast<double> (sent));
+        const uint64_t first = _echo_seq;
+        _echo_seq = probe_seq + 1;
+        _echo_received = received;
+
+        // cumulative ack. we do not know which packets are lost, so we
+        // blame the oldest ones. The packets we already declared lost
+        // after the rto are in the count, too.
+        // Only the probe gives a valid rtt sample:
+        // the others have been waiting for the probe.
+        for (uint64_t seq = first; seq <= probe_seq; ++seq) {
+            if (to_lose > 0 && seq != probe_seq) {
+                --to_lose;
+                lost (seq, now);
+                continue;
+            }
+            auto sample = _tracker.on_ack (seq, now);
+            if (!sample.has_value())
+                continue;
+            if (seq == probe_seq && sample.value()._rtt > delay) {
+                sample.value()._rtt -= delay;
+            } else {
+                sample.value()._rtt = std::chrono::microseconds (0);
+            }
+            _cc->ack (sample.value(), now);
+        }
+    }
+
+    void lost (const uint64_t seq, const std::chrono::microseconds now)
+    {
+        const uint32_t bytes = _tracker.on_loss (seq);
+        if (bytes == 0)
+            return;
+        _cc->loss (bytes, _tracker.in_flight(), now);
+    }
+
+    void set_mtu (const uint16_t mtu)
+    {
+        _mtu = mtu;
+        _cc->set_mtu (mtu);
+    }
+
+    // largest confirmed packet size
+    uint16_t mtu() const
+        { return _pmtu.mtu(); }
+    const Congestion& congestion() const
+        { return *_cc; }
+    uint64_t in_flight() const
+        { return _tracker.in_flight(); }
+    // fraction of lost packets, moving average
+    double loss() const
+        { return _loss; }
+
+    // estimated time for a packet sent now to reach the peer and be
+    // acknowledged. 0 if we do not know yet.
+    // used by the multipath scheduler: the latest rtt is used if worse than
+    // the average so that we react fast when a link degrades, and losses
+    // make the link look slower, as we will have to retransmit.
+    // An idle link had time to drain its queues, so we are optimistic,
+    // and after a while we use the min rtt so that the link is tried again:
+    // otherwise a link that looked bad once would never recover.
+    std::chrono::microseconds delivery_time (
+                                    const std::chrono::microseconds now) const
+    {
+        const auto &rtt = _cc->rtt();
+        if (!rtt.has_sample())
+            return std::chrono::microseconds (0);
+        auto base = std::max (rtt.srtt(), rtt.latest());
+        if (_tracker.in_flight() == 0) {
+            const std::chrono::microseconds refresh = std::max (4 * rtt.srtt(),
+                    std::chrono::microseconds (
+                        std::chrono::seconds (static_cast<int64_t> (
+                                                        reprobe_sec))));
+            if (now - _last_probe > refresh) {
+                base = rtt.min_rtt();
+            } else {
+                base = std::min (rtt.srtt(), rtt.latest());
+            }
+        }
+        const double loss = std::min (_loss, 0.5);
+        return std::chrono::microseconds (static_cast<int64_t> (
+                                static_cast<double> (base.count()) /
+                                                                (1. - loss)));
+    }
+private:
+    struct probe {
+        std::chrono::microseconds _sent;
+        uint64_t _seq;
+    };
+    static constexpr uint32_t reprobe_sec = 1;
+    static constexpr uint8_t black_hole_timeouts = 2;
+    Delivery_Tracker _tracker;
+    std::unique_ptr<Congestion> _cc;
+    PMTU_Discovery _pmtu;
+    struct {
+        std::chrono::microseconds _sent;
+        uint16_t _size;     // 0 == no probe in flight
+    } _mtu_probe;
+    Token_Bucket _pacer;
+    std::deque<probe> _probes;  // waiting for the echo, ordered
+    std::chrono::microseconds _last_probe;
+    uint64_t _echo_seq;         // first packet not covered by an echo
+    uint32_t _echo_received;    // peer counter in the last echo
+    uint32_t _mtu_probes_received;
+    std::chrono::microseconds _echo_ts; // last echoed timestamp
+    double _loss;
+    uint16_t _mtu;
+    uint8_t _timeouts;  // rto expirations without echoes in between
+    bool _feedback;     // at least one echo: the peer acks our packets
+
+    // a few probes per rtt, but not more than one per millisecond
+    std::chrono::microseconds probe_interval() const
+    {
+        const auto &rtt = _cc->rtt();
+        if (!rtt.has_sample())
+            return std::chrono::milliseconds (1);
+        const std::chrono::microseconds min = std::chrono::milliseconds (1);
+        return std::max (rtt.srtt() / 4, min);
+    }
+
+    void update_loss (const double lost)
+        { _loss = (7. * _loss + lost) / 8.; }
+
+    void mtu_probe_lost (const std::chrono::microseconds now)
+    {
+        const auto &rtt = _cc->rtt();
+        const auto retry = rtt.has_sample() ? rtt.srtt() :
+                                    std::chrono::microseconds (
+                                        std::chrono::seconds (1));
+        _pmtu.probe_lost (_mtu_probe._size, now, retry);
+        _mtu_probe._size = 0;
+    }
+
+    // no echo for a whole rto: the oldest packets are lost.
+    // if it keeps happening, maybe our packets are too big now.
+    void expire (const std::chrono::microseconds now)
+    {
+        const auto rto = _cc->rtt().rto();
+        if (_mtu_probe._size != 0 && now - _mtu_probe._sent >= rto)
+            mtu_probe_lost (now);
+        bool expired = false;
+        while (true) {
+            const auto oldest = _tracker.oldest();
+            if (!oldest.has_value())
+                break;
+            const auto sent_time = _tracker.sent_time (oldest.value());
+            if (!sent_time.has_value() || now - sent_time.value() < rto)
+                break;
+            if (_probes.size() > 0 && _probes.front()._seq == oldest.value()) {
+                if (_feedback)
+                    update_loss (1.);
+                _probes.pop_front();
+            }
+            if (!_feedback) {
+                // no echoes yet: just stop tracking it
+                _tracker.on_loss (oldest.value());
+                continue;
+            }
+            lost (oldest.value(), now);
+            expired = true;
+        }
+        if (!expired || ++_timeouts < black_hole_timeouts)
+            return;
+        _timeouts = 0;
+        _pmtu.black_hole (now);
+        set_mtu (_pmtu.mtu());
+    }
+
+    void update_pacer()
+    {
+        const uint64_t rate = _cc->pacing_rate();
+        if (rate == _pacer.rate())
+            return;
+        // let through ~1ms of data at once, but at least two packets:
+        // below that the timer precision costs more than the bursts.
+        const uint64_t burst = std::max (static_cast<uint64_t> (2 * _mtu),
+                                                                rate / 1000);
+        _pacer.set_rate (rate, burst);
+    }
+};
+
+} // namespace Rate
+} // namespace Impl
+} // namespace Fenrir__v1
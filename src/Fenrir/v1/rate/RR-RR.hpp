@@ -24,13 +24,19 @@
 #include "Fenrir/v1/plugin/Dynamic.hpp"
 #include "Fenrir/v1/event/Loop.hpp"
 #include "Fenrir/v1/Handler.hpp"
+#include "Fenrir/v1/rate/Calendar.hpp"
+#include "Fenrir/v1/rate/Path.hpp"
+#include "Fenrir/v1/rate/PMTU.hpp"
 #include "Fenrir/v1/rate/Rate.hpp"
+#include "Fenrir/v1/rate/Token_Bucket.hpp"
 #include <algorithm>
 #include <chrono>
-#include <map>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace Fenrir__v1 {
 namespace Impl {
@@ -41,9 +47,21 @@ namespace Rate {
 
 // RR_RR: Round-Robin --- Round-Robin
 // this simple implementation of rate check selects one connection in
-// round-robin, and then selects a link in that connection as
-// round-robin.
+// round-robin, and then selects the socket we send from in round-robin.
 // Does NOT check link or connection priorities.
+// each destination link has its own congestion control (CUBIC or BBR),
+// and packets are paced on each link.
+// The destination link is the one that will deliver the packet first
+// (earliest completion first, like ECF/BLEST): if the fast link is only
+// briefly blocked by its cwnd or pacing, we wait for it instead of sending
+// on a slower link, which would only deliver out of order.
+//
+// Only the connections that can send right now are in the round-robin
+// ring. Connections blocked by pacing, congestion or user limits are moved
+// to a calendar queue, keyed by the time they can send again, and
+// connections with nothing to send are parked until "wakeup".
+// This way selecting the next connection is O(1) amortized, no matter
+// how many connections are idle or throttled.
 
 
 class FENRIR_LOCAL RR_RR final: public Rate
@@ -52,8 +70,15 @@ public:
     RR_RR (const std::shared_ptr<Lib> from, Event::Loop *const loop,
                                                         Loader *const loader,
                                                         Random *const rnd,
-                                                        Handler *handler)
-        : Rate (from, loop, loader, rnd, handler), _last_conn (0) {}
+                                                        Handler *handler,
+                            const Congestion::Algorithm alg =
+                                                Congestion::Algorithm::CUBIC)
+        : Rate (from, loop, loader, rnd, handler), _algo (alg),
+          _ring_head (no_slot),
+          _calendar (std::chrono::microseconds (
+                            static_cast<int64_t> (calendar_granularity_usec)),
+                                                            calendar_buckets),
+          _next_wakeup (std::chrono::microseconds::max()) {}
 
     RR_RR() = delete;
     RR_RR (const RR_RR&) = delete;
@@ -64,8 +89,13 @@ public:
     void parse_event (std::shared_ptr<Event::Plugin_Timer> ev) override
         { FENRIR_UNUSED (ev); }
 
+    // start from the mtu that works everywhere, each Path will discover
+    // the real one.
     Link_Params def_link_params() override
-        { return Link_Params {{1500, 4500}}; }
+    {
+        return Link_Params {{static_cast<uint16_t> (
+                                        PMTU_Discovery::base_mtu), 4500}};
+    }
 
     type_safe::optional<send_info> send (
                             std::unique_ptr<Event::Send::Data> data) override;
@@ -73,6 +103,28 @@ public:
     void enqueue (const Link_ID from, const Link_ID to,
                 std::unique_ptr<Packet> pkt,
                     const type_safe::optional<Conn0_Type> handshake) override;
+
+    void timestamp_echo (const Conn_ID conn, const Link_ID to,
+                                const std::chrono::microseconds timestamp,
+                                const std::chrono::microseconds delay,
+                                const uint32_t received) override;
+
+    Impl::Error add_socket (const Link_ID sock) override;
+    Impl::Error del_socket (const Link_ID sock) override;
+    Impl::Error add_connection (const Conn_ID conn) override;
+    Impl::Error del_connection (const Conn_ID conn) override;
+    Impl::Error add_link (const Conn_ID conn, const Link_ID link,
+                                                const Direction dir) override;
+    Impl::Error del_link (const Conn_ID conn, const Link_ID link,
+                                                const Direction dir) override;
+    void wakeup (const Conn_ID conn) override;
+
+    Impl::Error set_socket_rate (const Link_ID sock,
+                                            const uint64_t bytes_sec) override;
+    Impl::Error set_connection_rate (const Conn_ID conn,
+                                            const uint64_t bytes_sec) override;
+    Impl::Error set_link_rate (const Conn_ID conn, const Link_ID to,
+                                            const uint64_t bytes_sec) override;
 private:
     enum class Send_Type : uint8_t { DATA = 0x01, HANDSHAKE = 0x00 };
     class FENRIR_LOCAL data_base : public Event::Send::Data
@@ -95,33 +147,86 @@ private:
         std::unique_ptr<Packet> _pkt;
     };
 
-    struct speed
+    // IDLE:    nothing to send, waiting for "wakeup"
+    // ACTIVE:  in the round-robin ring
+    // WAITING: in the calendar queue
+    // FREE:    the slot is unused
+    enum class Sched : uint8_t {
+        IDLE    = 0x00,
+        ACTIVE  = 0x01,
+        WAITING = 0x02,
+        FREE    = 0x03
+    };
+    static constexpr uint32_t no_slot = std::numeric_limits<uint32_t>::max();
+    // 250us * 4096: ~1 sec before the calendar has to wrap around
+    static constexpr uint32_t calendar_granularity_usec = 250;
+    static constexpr uint32_t calendar_buckets = 4096;
+
+    struct dest
+    {
+        dest (const Link_ID link, Path &&path)
+            : _link (link), _path (std::move(path)), _conn_mtu (0) {}
+        Link_ID _link;
+        Path _path;
+        Token_Bucket _max;          // max user-set rate. 0 == unlimited
+        uint16_t _conn_mtu;         // path mtu, as known by the Connection
+    };
+
+    struct sock_info
     {
-        uint64_t _max_bps;          // max user-set bitrate
-        uint64_t _max_congestion;   // max connection-discovered bitrate
-        uint64_t _last_amount;
-        std::chrono::microseconds _last_time;
+        sock_info (const Link_ID id, const uint16_t mtu)
+            : _id (id), _mtu (mtu) {}
+        Link_ID _id;
+        Token_Bucket _max;          // max user-set rate. 0 == unlimited
+        uint16_t _mtu;              // interface mtu, upper bound for probes
     };
 
     struct info
     {
+        info (const Conn_ID id, const uint32_t generation)
+            : _conn_id (id), _prev (no_slot), _next (no_slot),
+              _generation (generation), _sched (Sched::IDLE) {}
         Conn_ID _conn_id;
-        speed   _conn_speed;
-        Link_ID _last_link_to;
+        Token_Bucket _conn_max;     // max user-set rate. 0 == unlimited
         Link_ID _last_link_from;
-        std::vector<std::pair<Link_ID, speed>> _links_to;
-        std::vector<std::pair<Link_ID, speed>> _links_from;
+        std::vector<dest> _links_to;        // ordered
+        std::vector<Link_ID> _links_from;   // ordered
+        uint32_t _prev, _next;      // ring, only when ACTIVE
+        uint32_t _generation;       // invalidates stale calendar entries
+        Sched _sched;
     };
 
-    Conn_ID _last_conn;
-    // TODO: better if it is map? this will cause lots of moves when
-    // the first connections die out :( deque, better?
+    const Congestion::Algorithm _algo;
+    // slots never move: removed connections leave a free slot behind,
+    // that will be reused by the next connection.
     std::vector<info> _conninfo;
+    std::vector<uint32_t> _free_slots;
+    std::vector<sock_info> _sockets;    // ordered
+    std::unordered_map<uint32_t, uint32_t> _conn_slot;  // Conn_ID -> slot
+    uint32_t _ring_head;
+    Calendar_Queue _calendar;
+    std::vector<Calendar_Queue::entry> _due;
+    std::chrono::microseconds _next_wakeup;
     std::mutex _mtx;
 
     type_safe::optional<send_info> send_data();
     type_safe::optional<send_info> send_handshake (
                                     const std::unique_ptr<data_handshake> data);
+    void schedule_data (const std::chrono::microseconds when);
+    void wake_due (const std::chrono::microseconds now);
+    std::chrono::microseconds pick_links (info &inf,
+                                        const std::shared_ptr<Connection> conn,
+                                        const std::chrono::microseconds now,
+                                        Link_ID &from, Link_ID &to,
+                                        bool &probe, uint16_t &mtu_probe);
+    info *get_info (const Conn_ID conn);
+    sock_info *get_sock (const Link_ID sock);
+    static Token_Bucket mk_limit (const uint64_t bytes_sec);
+    dest *get_dest (info &inf, const Link_ID to);
+    Path *get_path (info &inf, const Link_ID to);
+    void ring_insert (const uint32_t slot);
+    void ring_remove (const uint32_t slot);
+    void park (const uint32_t slot);
 };
 
 FENRIR_INLINE type_safe::optional<Rate::send_info> RR_RR::send (
@@ -138,125 +243,549 @@ FENRIR_INLINE type_safe::optional<Rate::send_info> RR_RR::send_handshake (
                                     const std::unique_ptr<data_handshake> data)
 {
     const auto sock_from = get_socket (data->_from);
-    return type_safe::make_optional (
-                    send_info {sock_from, data->_to, std::move(data->_pkt)});
+    return type_safe::make_optional (send_info {sock_from, data->_to,
+                                                    std::move(data->_pkt)});
 }
 
 FENRIR_INLINE type_safe::optional<Rate::send_info> RR_RR::send_data()
 {
     std::unique_lock<std::mutex> lock (_mtx);
-
-    // select the connections via round-robin:
-    // keep the selected ID in "last_conn"
-
-    auto conn_it = std::upper_bound (_conninfo.begin(), _conninfo.end(),
-                    _last_conn,
-                        // operator<, => true on exit
-                        [] (const Conn_ID id, const auto &el)
-                            { return static_cast<bool> (id < el._conn_id); });
-    if (conn_it == _conninfo.end())
-        conn_it = _conninfo.begin(); // go back to beginning;
-    if (conn_it == _conninfo.end()) {
-        // no such connection id? don't sent anything anywhere.
-        return type_safe::nullopt;
+    // this is the scheduled event, if any
+    _next_wakeup = std::chrono::microseconds::max();
+
+    const auto now = usec_now();
+    wake_due (now);
+
+    while (true) {
+        // take the connection in the head of the ring.
+        // if it can not send now, move it to the calendar (or park it if it
+        // has no links) and try the next one. Each connection is touched
+        // at most once before it is removed from the ring, so this is
+        // O(1) amortized.
+        std::shared_ptr<Connection> conn;
+        Link_ID from, to;
+        bool probe = false;
+        uint16_t mtu_probe = 0;
+        uint32_t slot = no_slot;
+        while (_ring_head != no_slot) {
+            slot = _ring_head;
+            auto &inf = _conninfo[slot];
+            conn = _handler->get_connection (inf._conn_id);
+            if (conn == nullptr) {
+                park (slot);
+                continue;
+            }
+            const auto wait = pick_links (inf, conn, now, from, to, probe,
+                                                                    mtu_probe);
+            if (wait.count() == 0) {
+                _ring_head = inf._next;
+                break;
+            }
+            conn = nullptr;
+            if (wait == std::chrono::microseconds::max()) {
+                park (slot);
+                continue;
+            }
+            ring_remove (slot);
+            inf._sched = Sched::WAITING;
+            _calendar.push ({slot, inf._generation, now + wait});
+        }
+        if (conn == nullptr) {
+            const auto next = _calendar.next_due();
+            if (next.has_value())
+                schedule_data (next.value());
+            return type_safe::nullopt;
+        }
+        const uint32_t generation = _conninfo[slot]._generation;
+        // tell the connection about the new path mtu
+        auto chosen = get_dest (_conninfo[slot], to);
+        const uint16_t path_mtu = chosen->_path.mtu();
+        const bool new_mtu = chosen->_conn_mtu != path_mtu;
+        chosen->_conn_mtu = path_mtu;
+        // parallel crypto: let another thread build and encrypt the next
+        // packet, even for the same connection, while we work on this one.
+        // The budget is charged after the encryption, so each worker can
+        // overshoot the limits by one packet.
+        if (_handler->proxy_parallel_crypto() && _ring_head != no_slot)
+            schedule_data (now);
+        lock.unlock();
+        if (new_mtu)
+            conn->set_mtu (to, path_mtu);
+
+        // now get a packet with the data for one stream:
+        uint32_t data_mtu;
+        uint32_t overhead;
+        std::tie (data_mtu, overhead) = get_mtu (conn, from, to);
+        if (mtu_probe != 0)
+            data_mtu = mtu_probe;
+        if (data_mtu <= overhead) {
+            // the link was just removed
+            lock.lock();
+            continue;
+        }
+        auto pkt = std::make_unique<Packet> (
+                                        std::vector<uint8_t> (data_mtu, 0));
+        if (pkt == nullptr)
+            return type_safe::nullopt;
+        data_mtu -= overhead;
+
+        // add streams 'til full, or just the padded probe
+        type_safe::optional<std::chrono::microseconds> timestamp;
+        if (probe)
+            timestamp = now;
+        auto err = set_packet (conn, Packet_NN {pkt.get()}, to,
+                                    data_mtu, timestamp, mtu_probe != 0);
+        // encrypt before charging the budget: a packet we can not send
+        // must not use the limits nor the congestion window.
+        if (err == Impl::Error::NONE)
+            err = secure_packet (conn, Packet_NN {pkt.get()});
+
+        // the connection could have been removed while we were not locked.
+        lock.lock();
+        auto &inf = _conninfo[slot];
+        if (inf._generation != generation)
+            continue;
+        if (err != Impl::Error::NONE) {
+            // nothing to send (EMPTY), out of nonces or broken connection:
+            // do not retry until "wakeup"
+            if (inf._sched == Sched::ACTIVE)
+                park (slot);
+            continue;
+        }
+        // the links or the socket could have been removed, too.
+        auto to_it = std::lower_bound (inf._links_to.begin(),
+                                    inf._links_to.end(), to,
+                                    [] (const dest &lnk, const Link_ID id)
+                                                { return lnk._link < id; });
+        const auto sock = get_sock (from);
+        if (to_it == inf._links_to.end() || to_it->_link != to ||
+                                                            sock == nullptr) {
+            continue;
+        }
+        // account the packet on the whole hierarchy
+        const uint32_t bytes = static_cast<uint32_t> (pkt->raw.size());
+        sock->_max.force_consume (bytes, now);
+        inf._conn_max.force_consume (bytes, now);
+        to_it->_max.force_consume (bytes, now);
+        if (mtu_probe != 0) {
+            to_it->_path.mtu_probe_sent (mtu_probe, now);
+        } else {
+            to_it->_path.sent (bytes, now, false, probe);
+        }
+        // keep going as long as someone can send
+        if (_ring_head != no_slot)
+            schedule_data (now);
+        lock.unlock();
+        // send
+        return type_safe::make_optional (send_info {get_socket (from), to,
+                                                            std::move(pkt)});
     }
-    auto next_conn_id = conn_it->_conn_id;
-    auto conn = _handler->get_connection (next_conn_id);
+}
 
-    // make sure we are not over the connection bandwidth
-    auto time = std::chrono::high_resolution_clock::now().time_since_epoch();
-    auto usec = std::chrono::duration_cast<std::chrono::microseconds> (time);
+// NOTE: call with _mtx locked
+FENRIR_INLINE void RR_RR::schedule_data (const std::chrono::microseconds when)
+{
+    // an earlier event is already scheduled, it will reschedule itself
+    if (when >= _next_wakeup)
+        return;
+    _next_wakeup = when;
+    auto ev = Event::Send::mk_shared (_loop,
+                                std::make_unique<data_base> (Send_Type::DATA));
+    const auto now = usec_now();
+    if (when <= now) {
+        _loop->add_work (std::move(ev));
+    } else {
+        _loop->start (std::move(ev), when - now, Event::Repeat::NO);
+    }
+}
 
-    const uint64_t bps =  conn_it->_conn_speed._max_congestion /
-        static_cast<uint64_t>((usec - conn_it->_conn_speed._last_time).count());
-    if (bps > conn_it->_conn_speed._max_congestion) {
-        _last_conn = next_conn_id;
-        return send_data();
+// NOTE: call with _mtx locked
+FENRIR_INLINE void RR_RR::wake_due (const std::chrono::microseconds now)
+{
+    _due.clear();
+    _calendar.pop_due (now, _due);
+    for (const auto &e : _due) {
+        auto &inf = _conninfo[e._slot];
+        if (inf._generation != e._generation || inf._sched != Sched::WAITING)
+            continue;   // stale
+        ring_insert (e._slot);
     }
+}
 
-    // get a Link FROM which we send
-    // also, check that we do not go over the bandwidth limit.
-    // in that case, next link, or next connection after a full round.
-    auto next_from_it = std::upper_bound (conn_it->_links_from.begin(),
-                        conn_it->_links_from.end(), conn_it->_last_link_from,
-                [] (const Link_ID id, const auto &lnk) {
-                    return static_cast<bool> (id < std::get<Link_ID> (lnk));
-                });
-    if (next_from_it == conn_it->_links_from.end()) {
-        next_from_it = conn_it->_links_from.begin();
-        if (next_from_it == conn_it->_links_from.end()) {
-            _last_conn = next_conn_id;
-            return send_data();
+// select the link FROM which we send in round robin, and the link TO
+// which we send with the earliest estimated delivery (wait + rtt).
+// skip the links that are over their congestion window, pacing or
+// user limits (socket, connection and link).
+// returns how long we have to wait before sending: 0 => send now,
+// max() => no usable link.
+// NOTE: call with _mtx locked
+FENRIR_INLINE std::chrono::microseconds RR_RR::pick_links (info &inf,
+                                        const std::shared_ptr<Connection> conn,
+                                        const std::chrono::microseconds now,
+                                        Link_ID &from, Link_ID &to,
+                                        bool &probe, uint16_t &mtu_probe)
+{
+    auto min_wait = std::chrono::microseconds::max();
+    if (inf._links_from.size() == 0 || inf._links_to.size() == 0)
+        return min_wait;
+
+    auto next_from_it = std::upper_bound (inf._links_from.begin(),
+                                inf._links_from.end(), inf._last_link_from);
+    for (size_t from_count = 0; from_count < inf._links_from.size();
+                                                ++from_count, ++next_from_it) {
+        if (next_from_it == inf._links_from.end())
+            next_from_it = inf._links_from.begin();
+        const auto sock = get_sock (*next_from_it);
+        if (sock == nullptr)
+            continue;   // not one of our sockets (anymore)
+
+        auto best = inf._links_to.end();
+        auto best_wait = std::chrono::microseconds::max();
+        auto best_cost = std::chrono::microseconds::max();
+        uint32_t best_mtu = 0;
+        for (auto to_it = inf._links_to.begin(); to_it != inf._links_to.end();
+                                                                    ++to_it) {
+            const uint32_t mtu = std::get<0> (get_mtu (conn, *next_from_it,
+                                                                to_it->_link));
+            if (mtu == 0)
+                continue;
+            const auto wait = std::max (
+                        std::max (sock->_max.wait_time (mtu, now),
+                                        inf._conn_max.wait_time (mtu, now)),
+                        std::max (to_it->_max.wait_time (mtu, now),
+                                        to_it->_path.wait_time (mtu, now)));
+            const auto cost = wait + to_it->_path.delivery_time (now);
+            // on ties prefer the link we can use now
+            if (cost < best_cost || (cost == best_cost && wait < best_wait)) {
+                best = to_it;
+                best_wait = wait;
+                best_cost = cost;
+                best_mtu = mtu;
+            }
         }
-    }
-    const Link_ID next_link_from_id = std::get<Link_ID> (*next_from_it);
-    const auto next_link_from = get_socket (next_link_from_id);
-
-    // get a Link TO which we send
-    uint32_t link_count = static_cast<uint32_t> (conn_it->_links_to.size());
-    auto next_to_it = std::upper_bound (conn_it->_links_to.begin(),
-                            conn_it->_links_to.end(), conn_it->_last_link_to,
-                [] (const Link_ID id, const auto &lnk) {
-                    return static_cast<bool> (id < std::get<Link_ID> (lnk));
-                });
-    if (next_to_it == conn_it->_links_to.end()) {
-        next_to_it = conn_it->_links_to.begin();
-        if (next_to_it == conn_it->_links_to.end()) {
-            _last_conn = next_conn_id;
-            return send_data();
+        if (best == inf._links_to.end())
+            continue;
+        if (best_wait.count() == 0) {
+            from = *next_from_it;
+            to = best->_link;
+            probe = best->_path.want_probe (best_mtu, now);
+            // mtu probes only carry a padded timestamp probe
+            mtu_probe = 0;
+            const auto probe_size = best->_path.want_mtu_probe (sock->_mtu,
+                                                                        now);
+            if (probe_size.has_value()) {
+                mtu_probe = probe_size.value();
+                probe = true;
+            }
+            inf._last_link_from = from;
+            return best_wait;
         }
+        min_wait = std::min (min_wait, best_wait);
     }
-    Link_ID next_link_to;
-    while (link_count > 0) {
-        next_link_to = std::get<Link_ID> (*next_to_it);
-
-        const uint64_t link_bps =  conn_it->_conn_speed._max_congestion /
-                        static_cast<uint64_t> (
-                            (usec - conn_it->_conn_speed._last_time).count());
-        if (link_bps <= std::get<speed> (*next_to_it)._max_congestion)
-            break;
-        ++next_to_it;
-        if (next_to_it == conn_it->_links_to.end())
-            next_to_it = conn_it->_links_to.begin();
-        --link_count;
+    return min_wait;
+}
+
+// NOTE: call with _mtx locked
+FENRIR_INLINE RR_RR::info *RR_RR::get_info (const Conn_ID conn)
+{
+    auto it = _conn_slot.find (static_cast<uint32_t> (conn));
+    if (it == _conn_slot.end())
+        return nullptr;
+    return &_conninfo[it->second];
+}
+
+// NOTE: call with _mtx locked
+FENRIR_INLINE RR_RR::dest *RR_RR::get_dest (info &inf, const Link_ID to)
+{
+    auto to_it = std::lower_bound (inf._links_to.begin(), inf._links_to.end(),
+                                    to, [] (const dest &lnk, const Link_ID id)
+                                                { return lnk._link < id; });
+    if (to_it == inf._links_to.end() || to_it->_link != to)
+        return nullptr;
+    return &*to_it;
+}
+
+// NOTE: call with _mtx locked
+FENRIR_INLINE Path *RR_RR::get_path (info &inf, const Link_ID to)
+{
+    auto dst = get_dest (inf, to);
+    if (dst == nullptr)
+        return nullptr;
+    return &dst->_path;
+}
+
+// NOTE: call with _mtx locked
+FENRIR_INLINE RR_RR::sock_info *RR_RR::get_sock (const Link_ID sock)
+{
+    auto it = std::lower_bound (_sockets.begin(), _sockets.end(), sock,
+                                    [] (const sock_info &el, const Link_ID id)
+                                                    { return el._id < id; });
+    if (it == _sockets.end() || it->_id != sock)
+        return nullptr;
+    return &*it;
+}
+
+FENRIR_INLINE Token_Bucket RR_RR::mk_limit (const uint64_t bytes_sec)
+{
+    if (bytes_sec == 0)
+        return Token_Bucket();
+    // ~10ms of burst, but always let a jumbo frame through.
+    return Token_Bucket (bytes_sec, std::max (bytes_sec / 100,
+                                                static_cast<uint64_t> (9000)));
+}
+
+// insert just before the head: last in the round-robin order
+FENRIR_INLINE void RR_RR::ring_insert (const uint32_t slot)
+{
+    auto &inf = _conninfo[slot];
+    inf._sched = Sched::ACTIVE;
+    if (_ring_head == no_slot) {
+        inf._prev = inf._next = slot;
+        _ring_head = slot;
+        return;
     }
-    if (link_count == 0) {
-        // all links over congestion.
-        _last_conn = next_conn_id;
-        return send_data();
+    auto &head = _conninfo[_ring_head];
+    inf._next = _ring_head;
+    inf._prev = head._prev;
+    _conninfo[head._prev]._next = slot;
+    head._prev = slot;
+}
+
+FENRIR_INLINE void RR_RR::ring_remove (const uint32_t slot)
+{
+    auto &inf = _conninfo[slot];
+    if (inf._next == slot) {
+        _ring_head = no_slot;
+    } else {
+        _conninfo[inf._prev]._next = inf._next;
+        _conninfo[inf._next]._prev = inf._prev;
+        if (_ring_head == slot)
+            _ring_head = inf._next;
     }
-    lock.unlock();
-
-    // now get a packet with the data for one stream:
-    uint32_t data_mtu;
-    uint32_t overhead;
-    std::tie (data_mtu, overhead) = get_mtu (conn, next_link_from_id,
-                                                                next_link_to);
-    auto pkt = std::make_unique<Packet> (std::vector<uint8_t> (data_mtu, 0));
-    if (pkt == nullptr)
-        return type_safe::nullopt;
-
-    data_mtu -= overhead;
-
-    // add streams 'til full
-    if (set_packet (conn, Packet_NN {pkt.get()}, next_link_to, data_mtu) !=
-                                                            Impl::Error::NONE) {
-        return type_safe::nullopt;
+    inf._prev = inf._next = no_slot;
+}
+
+FENRIR_INLINE void RR_RR::park (const uint32_t slot)
+{
+    auto &inf = _conninfo[slot];
+    if (inf._sched == Sched::ACTIVE)
+        ring_remove (slot);
+    inf._sched = Sched::IDLE;
+}
+
+FENRIR_INLINE Impl::Error RR_RR::add_connection (const Conn_ID conn)
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    const uint32_t key = static_cast<uint32_t> (conn);
+    if (_conn_slot.find (key) != _conn_slot.end())
+        return Impl::Error::ALREADY_PRESENT;
+    uint32_t slot;
+    if (_free_slots.size() > 0) {
+        slot = _free_slots.back();
+        _free_slots.pop_back();
+        _conninfo[slot] = info (conn, _conninfo[slot]._generation + 1);
+    } else {
+        if (_conninfo.size() >= no_slot)
+            return Impl::Error::FULL;
+        slot = static_cast<uint32_t> (_conninfo.size());
+        _conninfo.emplace_back (conn, 0);
     }
+    _conn_slot.emplace (key, slot);
+    // new connections usually have something to say
+    ring_insert (slot);
+    schedule_data (usec_now());
+    return Impl::Error::NONE;
+}
+
+FENRIR_INLINE Impl::Error RR_RR::del_connection (const Conn_ID conn)
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    auto it = _conn_slot.find (static_cast<uint32_t> (conn));
+    if (it == _conn_slot.end())
+        return Impl::Error::WRONG_INPUT;
+    const uint32_t slot = it->second;
+    _conn_slot.erase (it);
+    park (slot);
+    auto &inf = _conninfo[slot];
+    inf._sched = Sched::FREE;
+    ++inf._generation;
+    inf._links_to.clear();
+    inf._links_from.clear();
+    _free_slots.push_back (slot);
+    return Impl::Error::NONE;
+}
+
+FENRIR_INLINE void RR_RR::wakeup (const Conn_ID conn)
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    auto it = _conn_slot.find (static_cast<uint32_t> (conn));
+    if (it == _conn_slot.end())
+        return;
+    // WAITING connections will be woken up by the calendar
+    if (_conninfo[it->second]._sched != Sched::IDLE)
+        return;
+    ring_insert (it->second);
+    schedule_data (usec_now());
+}
+
+FENRIR_INLINE Impl::Error RR_RR::add_socket (const Link_ID sock)
+{
+    const auto socket = get_socket (sock);
+    if (socket == nullptr)
+        return Impl::Error::WRONG_INPUT;
+    const uint16_t mtu = socket->mtu();
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    auto it = std::lower_bound (_sockets.begin(), _sockets.end(), sock,
+                                    [] (const sock_info &el, const Link_ID id)
+                                                    { return el._id < id; });
+    if (it != _sockets.end() && it->_id == sock)
+        return Impl::Error::ALREADY_PRESENT;
+    _sockets.emplace (it, sock, mtu);
+    return Impl::Error::NONE;
+}
+
+FENRIR_INLINE Impl::Error RR_RR::del_socket (const Link_ID sock)
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    auto it = std::lower_bound (_sockets.begin(), _sockets.end(), sock,
+                                    [] (const sock_info &el, const Link_ID id)
+                                                    { return el._id < id; });
+    if (it == _sockets.end() || it->_id != sock)
+        return Impl::Error::WRONG_INPUT;
+    // connections will just skip it from now on.
+    _sockets.erase (it);
+    return Impl::Error::NONE;
+}
+
+FENRIR_INLINE Impl::Error RR_RR::add_link (const Conn_ID conn,
+                                const Link_ID link, const Direction dir)
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    auto inf = get_info (conn);
+    if (inf == nullptr)
+        return Impl::Error::WRONG_INPUT;
+    switch (dir) {
+    case Direction::OUTGOING: {
+        auto it = std::lower_bound (inf->_links_from.begin(),
+                                                inf->_links_from.end(), link);
+        if (it != inf->_links_from.end() && *it == link)
+            return Impl::Error::ALREADY_PRESENT;
+        inf->_links_from.insert (it, link);
+        break;
+        }
+    case Direction::INCOMING: {
+        auto it = std::lower_bound (inf->_links_to.begin(),
+                                    inf->_links_to.end(), link,
+                                    [] (const dest &lnk, const Link_ID id)
+                                                { return lnk._link < id; });
+        if (it != inf->_links_to.end() && it->_link == link)
+            return Impl::Error::ALREADY_PRESENT;
+        inf->_links_to.emplace (it, link, Path (_algo, def_link_params()));
+        break;
+        }
+    }
+    // a new link might let a parked connection send
+    if (inf->_sched == Sched::IDLE) {
+        ring_insert (static_cast<uint32_t> (inf - _conninfo.data()));
+        schedule_data (usec_now());
+    }
+    return Impl::Error::NONE;
+}
 
+FENRIR_INLINE Impl::Error RR_RR::del_link (const Conn_ID conn,
+                                const Link_ID link, const Direction dir)
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    auto inf = get_info (conn);
+    if (inf == nullptr)
+        return Impl::Error::WRONG_INPUT;
+    switch (dir) {
+    case Direction::OUTGOING: {
+        auto it = std::lower_bound (inf->_links_from.begin(),
+                                                inf->_links_from.end(), link);
+        if (it == inf->_links_from.end() || *it != link)
+            return Impl::Error::WRONG_INPUT;
+        inf->_links_from.erase (it);
+        break;
+        }
+    case Direction::INCOMING: {
+        auto it = std::lower_bound (inf->_links_to.begin(),
+                                    inf->_links_to.end(), link,
+                                    [] (const dest &lnk, const Link_ID id)
+                                                { return lnk._link < id; });
+        if (it == inf->_links_to.end() || it->_link != link)
+            return Impl::Error::WRONG_INPUT;
+        inf->_links_to.erase (it);
+        break;
+        }
+    }
+    // if this was the last link the connection will be parked
+    // the next time it is selected.
+    return Impl::Error::NONE;
+}
 
-    conn_it->_last_link_from = next_link_from_id;
-    conn_it->_last_link_to   = next_link_to;
-    conn_it->_conn_speed._last_time = usec;
-    conn_it->_conn_speed._last_amount = pkt->raw.size() - overhead;
-    next_from_it->second._last_time = usec;
-    next_from_it->second._last_amount = pkt->raw.size() - overhead;
-    next_to_it->second._last_time = usec;
-    next_to_it->second._last_amount = pkt->raw.size() - overhead;
+FENRIR_INLINE Impl::Error RR_RR::set_socket_rate (const Link_ID sock,
+                                                    const uint64_t bytes_sec)
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    auto info = get_sock (sock);
+    if (info == nullptr)
+        return Impl::Error::WRONG_INPUT;
+    info->_max = mk_limit (bytes_sec);
+    return Impl::Error::NONE;
+}
 
-    // send
-    return type_safe::make_optional (
-                    send_info {next_link_from, next_link_to, std::move(pkt)});
+FENRIR_INLINE Impl::Error RR_RR::set_connection_rate (const Conn_ID conn,
+                                                    const uint64_t bytes_sec)
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    auto inf = get_info (conn);
+    if (inf == nullptr)
+        return Impl::Error::WRONG_INPUT;
+    inf->_conn_max = mk_limit (bytes_sec);
+    return Impl::Error::NONE;
+}
+
+FENRIR_INLINE Impl::Error RR_RR::set_link_rate (const Conn_ID conn,
+                                    const Link_ID to, const uint64_t bytes_sec)
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    auto inf = get_info (conn);
+    if (inf == nullptr)
+        return Impl::Error::WRONG_INPUT;
+    auto it = std::lower_bound (inf->_links_to.begin(), inf->_links_to.end(),
+                                    to, [] (const dest &lnk, const Link_ID id)
+                                                { return lnk._link < id; });
+    if (it == inf->_links_to.end() || it->_link != to)
+        return Impl::Error::WRONG_INPUT;
+    it->_max = mk_limit (bytes_sec);
+    return Impl::Error::NONE;
+}
+
+FENRIR_INLINE void RR_RR::timestamp_echo (const Conn_ID conn,
+                                    const Link_ID to,
+                                    const std::chrono::microseconds timestamp,
+                                    const std::chrono::microseconds delay,
+                                    const uint32_t received)
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    auto inf = get_info (conn);
+    if (inf == nullptr)
+        return;
+    auto path = get_path (*inf, to);
+    if (path != nullptr)
+        path->echo (timestamp, delay, received, usec_now());
 }
 
 FENRIR_INLINE void RR_RR::enqueue (const Link_ID from, const Link_ID to,
@@ -23,9 +23,11 @@
 #include "Fenrir/v1/common.hpp"
 #include "Fenrir/v1/data/Conn0_Type.hpp"
 #include "Fenrir/v1/event/Events_all.hpp"
+#include "Fenrir/v1/net/Direction.hpp"
 #include "Fenrir/v1/plugin/Dynamic.hpp"
 #include <type_safe/strong_typedef.hpp>
 #include <type_safe/optional.hpp>
+#include <chrono>
 #include <map>
 #include <memory>
 #include <utility>
@@ -89,16 +91,46 @@ public:
                         std::unique_ptr<Packet> pkt,
                           const type_safe::optional<Conn0_Type> handshake) = 0;
 
+    // congestion feedback, from the receive path: the peer echoed
+    // the timestamp probe we sent to "to" at "timestamp" (see set_packet),
+    // after holding it for "delay".
+    // "received" counts the packets the peer received on "to".
+    // The echoes are the only acks we have: until the first one arrives
+    // the packets that expire are forgotten, not lost.
+    virtual void timestamp_echo (const Conn_ID conn, const Link_ID to,
+                                const std::chrono::microseconds timestamp,
+                                const std::chrono::microseconds delay,
+                                const uint32_t received) = 0;
+
+    // topology tracking. The plugin should only look at the registered
+    // sockets, connections and links.
+    // sockets are our links, shared by all connections.
+    // connection links follow the Connection naming:
+    //   Direction::OUTGOING: our link, that we send from
+    //   Direction::INCOMING: the peer link, that we send to
+    // "wakeup" tells the plugin that the connection has new data to send
+    // after it reported nothing to send (EMPTY).
+    virtual Impl::Error add_socket (const Link_ID sock) = 0;
+    virtual Impl::Error del_socket (const Link_ID sock) = 0;
+    virtual Impl::Error add_connection (const Conn_ID conn) = 0;
+    virtual Impl::Error del_connection (const Conn_ID conn) = 0;
+    virtual Impl::Error add_link (const Conn_ID conn, const Link_ID link,
+                                                    const Direction dir) = 0;
+    virtual Impl::Error del_link (const Conn_ID conn, const Link_ID link,
+                                                    const Direction dir) = 0;
+    virtual void wakeup (const Conn_ID conn) = 0;
+
+    // user limits, in bytes per second. 0 == unlimited.
+    // limits are hierarchical: a link never gets more than its connection,
+    // and a connection never gets more than the socket it sends from.
+    virtual Impl::Error set_socket_rate (const Link_ID sock,
+                                                const uint64_t bytes_sec) = 0;
+    virtual Impl::Error set_connection_rate (const Conn_ID conn,
+                                                const uint64_t bytes_sec) = 0;
+    virtual Impl::Error set_link_rate (const Conn_ID conn, const Link_ID to,
+                                                const uint64_t bytes_sec) = 0;
+
     // FIXME: add the following functions (can change name):
-    //   * add socket
-    //   * set max socket speed
-    //   * del socket
-    //   * add connection
-    //   * set max conn speed
-    //   * del connection
-    //   * add link
-    //   * set max link speed
-    //   * del link
     //   * rate + (??)
     //   * rate - (??)
 protected:
@@ -108,8 +140,17 @@ protected:
                                         const std::shared_ptr<Connection> conn,
                                         const Link_ID link_from,
                                         const Link_ID link_to);
+    // "timestamp": add a timestamp probe to the packet, the peer will echo it
+    // "mtu_probe": only the timestamp probe, padded to fill the packet
     Impl::Error set_packet (std::shared_ptr<Connection> const conn,
-                        Packet_NN pkt, const Link_ID dest, const uint32_t mtu);
+                        Packet_NN pkt, const Link_ID dest, const uint32_t mtu,
+                const type_safe::optional<std::chrono::microseconds> timestamp,
+                                                        const bool mtu_probe);
+    // encrypt, hmac and ecc of a packet filled by set_packet.
+    // does not need any lock: call it after releasing yours, and before
+    // charging the packet on the limits: on errors nothing is sent.
+    Impl::Error secure_packet (std::shared_ptr<Connection> const conn,
+                                                                Packet_NN pkt);
     std::shared_ptr<Socket> get_socket (const Link_ID id);
 };
 
@@ -36,15 +36,21 @@ std::pair<uint32_t, uint32_t> Rate::get_mtu (
     { return {conn->mtu (link_from, link_to), conn->total_overhead()}; }
 
 Impl::Error Rate::set_packet (std::shared_ptr<Connection> const conn,
-                        Packet_NN pkt, const Link_ID dest, const uint32_t mtu)
+                        Packet_NN pkt, const Link_ID dest, const uint32_t mtu,
+                const type_safe::optional<std::chrono::microseconds> timestamp,
+                                                        const bool mtu_probe)
 {
-    auto err = conn->add_data (pkt, mtu);
+    auto err = conn->add_data (pkt, mtu, dest, timestamp, mtu_probe);
     if (err != Impl::Error::NONE)
         return err;
     conn->update_destination (dest);
-    return conn->add_security (pkt);
+    return Impl::Error::NONE;
 }
 
+Impl::Error Rate::secure_packet (std::shared_ptr<Connection> const conn,
+                                                                Packet_NN pkt)
+    { return conn->add_security (pkt); }
+
 std::shared_ptr<Socket> Rate::get_socket (const Link_ID id)
     { return _handler->get_socket (id); }
 
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2016-2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Rate {
+
+// current time, as used by all the rate-limiting code
+FENRIR_INLINE std::chrono::microseconds usec_now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds> (
+                    std::chrono::steady_clock::now().time_since_epoch());
+}
+
+// Simple token bucket, in bytes.
+// tokens are kept multiplied by 1.000.000 so that we can refill
+// them with microsecond precision without floating point.
+// rate == 0 means "unlimited"
+// NOTE: not thread safe, the caller must handle locking.
+class FENRIR_LOCAL Token_Bucket
+{
+public:
+    Token_Bucket()
+        : _rate (0), _burst (0), _tokens (0),
+                                        _last (std::chrono::microseconds (0)) {}
+    Token_Bucket (const uint64_t bytes_per_sec, const uint64_t burst)
+        : _rate (bytes_per_sec), _burst (burst), _tokens (burst * usec_sec),
+                                        _last (std::chrono::microseconds (0)) {}
+    Token_Bucket (const Token_Bucket&) = default;
+    Token_Bucket& operator= (const Token_Bucket&) = default;
+    Token_Bucket (Token_Bucket &&) = default;
+    Token_Bucket& operator= (Token_Bucket &&) = default;
+    ~Token_Bucket() = default;
+
+    uint64_t rate() const
+        { return _rate; }
+    uint64_t burst() const
+        { return _burst; }
+    bool unlimited() const
+        { return _rate == 0; }
+
+    void set_rate (const uint64_t bytes_per_sec, const uint64_t burst)
+    {
+        _rate = bytes_per_sec;
+        _burst = burst;
+        _tokens = std::min (_tokens, _burst * usec_sec);
+    }
+
+    // time we have to wait before "bytes" can be sent. 0 => now.
+    std::chrono::microseconds wait_time (const uint64_t bytes,
+                                            const std::chrono::microseconds now)
+    {
+        if (unlimited())
+            return std::chrono::microseconds (0);
+        refill (now);
+        // always let through at least one packet when the bucket is full,
+        // even if the packet is bigger than the burst size.
+        const uint64_t needed = std::min (bytes, _burst) * usec_sec;
+        if (_tokens >= needed)
+            return std::chrono::microseconds (0);
+        // round up, or we will wake up just before having enough tokens
+        return std::chrono::microseconds (static_cast<int64_t> (
+                                        (needed - _tokens + _rate - 1) / _rate));
+    }
+
+    // consume the tokens if they are available
+    bool consume (const uint64_t bytes, const std::chrono::microseconds now)
+    {
+        if (wait_time (bytes, now).count() != 0)
+            return false;
+        force_consume (bytes, now);
+        return true;
+    }
+
+    // consume even if we do not have enough tokens.
+    // used by the parent buckets once the child has decided to send.
+    void force_consume (const uint64_t bytes,
+                                            const std::chrono::microseconds now)
+    {
+        if (unlimited())
+            return;
+        refill (now);
+        const uint64_t used = bytes * usec_sec;
+        if (used >= _tokens) {
+            _tokens = 0;
+        } else {
+            _tokens -= used;
+        }
+    }
+
+private:
+    static constexpr uint64_t usec_sec = 1000000;
+    uint64_t _rate;     // bytes per second
+    uint64_t _burst;    // bytes
+    uint64_t _tokens;   // bytes * usec_sec
+    std::chrono::microseconds _last;
+
+    void refill (const std::chrono::microseconds now)
+    {
+        if (now <= _last)
+            return;
+        const uint64_t max = _burst * usec_sec;
+        const uint64_t elapsed = static_cast<uint64_t> ((now - _last).count());
+        _last = now;
+        // avoid overflows on long idle periods
+        if (elapsed >= (max - std::min (max, _tokens)) / _rate + 1) {
+            _tokens = max;
+            return;
+        }
+        _tokens = std::min (max, _tokens + elapsed * _rate);
+    }
+};
+
+} // namespace Rate
+} // namespace Impl
+} // namespace Fenrir__v1
@@ -34,6 +34,7 @@ namespace Recover {
 // per-packet correction.
 // This should be used to recover from
 // transmission errors
+// Must be safe for concurrent use with Handler::set_parallel_crypto (true)
 class FENRIR_LOCAL ECC : public Dynamic
 {
 public:
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/data/AS_list.hpp"
+#include "Fenrir/v1/resolve/Resolver.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Resolve {
+
+// Results of the resolvers, by fqdn, so that connecting again to the same
+// domain does not need any DNS round trip.
+//  * entries live for the TTL of the record (clamped)
+//  * failures are cached too, for a short time
+//  * when an entry is close to its expiration the first "get" says so,
+//    and the caller refreshes it in the background while still
+//    using the cached result.
+// The keys are shared, so we do not parse and init them again.
+// The cache is split in shards, each with its lock, so that the threads
+// that connect to different domains do not wait for each other.
+class FENRIR_LOCAL Cache
+{
+public:
+    enum class State : uint8_t {
+        MISS = 0x00,
+        HIT = 0x01,
+        REFRESH = 0x02  // hit, but please resolve it again
+    };
+
+    static constexpr size_t shards = 16;
+    static constexpr size_t max_shard_entries = 256;
+    static constexpr int64_t min_ttl_sec = 10;
+    static constexpr int64_t max_ttl_sec = 86400;
+    static constexpr int64_t negative_ttl_sec = 15;
+
+    Cache() = default;
+    Cache (const Cache&) = delete;
+    Cache& operator= (const Cache&) = delete;
+    Cache (Cache &&) = delete;
+    Cache& operator= (Cache &&) = delete;
+    ~Cache() = default;
+
+    // on hit, "out" gets a copy of the cached result.
+    State get (const std::vector<uint8_t> &fqdn, AS_list &out)
+    {
+        const auto name = Resolver::normalize (fqdn);
+        const auto now = std::chrono::steady_clock::now();
+        shard &sh = _shards[shard_idx (name)];
+        std::unique_lock<std::mutex> lock (sh._mtx);
+        FENRIR_UNUSED (lock);
+        auto it = sh._entries.find (name);
+        if (it == sh._entries.end())
+            return State::MISS;
+        if (it->second._expire <= now) {
+            sh._entries.erase (it);
+            return State::MISS;
+        }
+        out = it->second._as.clone();
+        // failures are not refreshed: they are short lived anyway
+        if (it->second._refreshing || it->second._as._err != Error::NONE ||
+                                                    it->second._refresh > now) {
+            return State::HIT;
+        }
+        it->second._refreshing = true;
+        return State::REFRESH;
+    }
+
+    // only successes and resolution failures are cached.
+    void put (const std::vector<uint8_t> &fqdn, const AS_list &as)
+    {
+        std::chrono::seconds ttl;
+        switch (as._err) {
+        case Error::NONE:
+            ttl = std::chrono::seconds (std::max (
+                                static_cast<int64_t> (min_ttl_sec), std::min (
+                                static_cast<int64_t> (max_ttl_sec), as._ttl)));
+            break;
+        case Error::RESOLVE_NOT_FOUND:
+        case Error::RESOLVE_NOT_FENRIR:
+            ttl = std::chrono::seconds (negative_ttl_sec);
+            break;
+        default:
+            return;
+        }
+        auto name = Resolver::normalize (fqdn);
+        const auto now = std::chrono::steady_clock::now();
+        shard &sh = _shards[shard_idx (name)];
+        std::unique_lock<std::mutex> lock (sh._mtx);
+        FENRIR_UNUSED (lock);
+        auto it = sh._entries.find (name);
+        if (it == sh._entries.end()) {
+            if (sh._entries.size() >= max_shard_entries)
+                evict (sh, now);
+            it = sh._entries.emplace (std::move(name), entry()).first;
+        }
+        it->second._as = as.clone();
+        it->second._expire = now + ttl;
+        // refresh when only 1/8 of the ttl is left
+        it->second._refresh = now + ttl - ttl / 8;
+        it->second._refreshing = false;
+    }
+
+    // a refresh has failed: let the next "get" try again
+    void refresh_failed (const std::vector<uint8_t> &fqdn)
+    {
+        const auto name = Resolver::normalize (fqdn);
+        shard &sh = _shards[shard_idx (name)];
+        std::unique_lock<std::mutex> lock (sh._mtx);
+        FENRIR_UNUSED (lock);
+        auto it = sh._entries.find (name);
+        if (it != sh._entries.end())
+            it->second._refreshing = false;
+    }
+private:
+    struct entry {
+        AS_list _as;
+        std::chrono::steady_clock::time_point _expire;
+        std::chrono::steady_clock::time_point _refresh;
+        bool _refreshing;
+
+        entry()
+            : _refreshing (false) {}
+    };
+    struct shard {
+        std::mutex _mtx;
+        std::map<std::vector<uint8_t>, entry> _entries;
+    };
+    std::array<shard, shards> _shards;
+
+    static size_t shard_idx (const std::vector<uint8_t> &name)
+    {
+        // FNV-1a. the user chooses the domains, not the attacker.
+        uint32_t hash = 2166136261u;
+        for (const uint8_t c : name) {
+            hash ^= c;
+            hash *= 16777619u;
+        }
+        return hash % shards;
+    }
+    // drop the expired entries. if none, drop the one closest to expiration
+    static void evict (shard &sh,
+                            const std::chrono::steady_clock::time_point now)
+    {
+        for (auto it = sh._entries.begin(); it != sh._entries.end();) {
+            if (it->second._expire <= now) {
+                it = sh._entries.erase (it);
+            } else {
+                ++it;
+            }
+        }
+        if (sh._entries.size() < max_shard_entries)
+            return;
+        auto oldest = std::min_element (sh._entries.begin(),
+                                                        sh._entries.end(),
+                                    [] (const auto &a, const auto &b)
+                                    { return a.second._expire <
+                                                        b.second._expire; });
+        sh._entries.erase (oldest);
+    }
+};
+
+} // namespace Resolve
+} // namespace Impl
+} // namespace Fenrir__v1
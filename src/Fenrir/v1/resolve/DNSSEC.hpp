@@ -23,6 +23,7 @@
 #include "Fenrir/v1/common.hpp"
 #include "Fenrir/v1/data/AS_list.hpp"
 #include "Fenrir/v1/event/Events_all.hpp"
+#include "Fenrir/v1/resolve/Disk_Cache.hpp"
 #include "Fenrir/v1/resolve/Resolver.hpp"
 #include <atomic>
 #include <chrono>
@@ -38,33 +39,10 @@ namespace Impl {
 namespace Resolve {
     class DNSSEC;
     static constexpr Resolver::ID dnssec_plugin_id { 1 };
-    static constexpr std::chrono::milliseconds poll_rate {500};
 } // namespace Resolve
 
 class Lib;
 class Loader;
-
-namespace Event {
-
-class Loop;
-
-// unbound needs
-class FENRIR_LOCAL DNSSEC final : public Plugin_Timer
-{
-public:
-    size_t _counter;
-    std::mutex _mtx;
-
-    DNSSEC() = delete;
-    DNSSEC (Loop *const loop, std::weak_ptr<Dynamic> resolver)
-        : Plugin_Timer (loop, std::move(resolver)), _counter (0)
-        {}
-    static std::shared_ptr<DNSSEC> mk_shared (Loop *const loop,
-                                                std::weak_ptr<Dynamic> resolver);
-};
-
-} // namespace Event
-
 class Random;
 
 namespace Resolve {
@@ -85,6 +63,7 @@ public:
     ID id() const override
         { return dnssec_plugin_id; }
     void parse_event (std::shared_ptr<Event::Plugin_Timer> ev) override;
+    void parse_io (std::shared_ptr<Event::Plugin_IO> ev) override;
 
     bool initialize() override;
     void stop() override;
@@ -105,13 +84,15 @@ private:
         std::unique_ptr<ub_fenrir, void(*)(ub_fenrir*)> ctx;
         std::mutex tracker_mtx;
         std::map<int32_t, std::unique_ptr<request_data>> tracker;
-        std::shared_ptr<Event::DNSSEC> _dnssec_polling;
+        // readable when libunbound has answers for us
+        std::shared_ptr<Event::Plugin_IO> _answers;
+        // validated records of the previous runs
+        Disk_Cache _disk;
 
         dnssec_data (Event::Loop *const _loop, Loader *const _loader,
-                        Random *const _rnd, std::weak_ptr<Dynamic> resolver)
+                                                        Random *const _rnd)
             :loop (_loop), loader (_loader), rnd (_rnd),
-                        ctx (nullptr, &unbound_cleanup), _dnssec_polling (
-                                    Event::DNSSEC::mk_shared (loop, resolver))
+                        ctx (nullptr, &unbound_cleanup), _answers (nullptr)
             {}
     };
 
@@ -132,8 +113,6 @@ private:
     // custom deleter to run ub_ctx_delete once we have finished.
     static void callback (void* mydata, int err, struct ub_result* result);
     static void unbound_cleanup (ub_fenrir *p);
-    static AS_list parse_dnssec_binary (const std::vector<uint8_t> &raw,
-                                        std::shared_ptr<dnssec_data> &_common);
 };
 
 
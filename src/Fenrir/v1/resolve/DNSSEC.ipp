@@ -21,10 +21,10 @@
 #pragma once
 
 #include "Fenrir/v1/resolve/DNSSEC.hpp"
+#include "Fenrir/v1/resolve/Disk_Cache.ipp"
+#include "Fenrir/v1/resolve/Resolver.ipp"
 #include "Fenrir/v1/event/Loop.hpp"
 #include "Fenrir/v1/plugin/Loader.ipp"
-#include "Fenrir/v1/util/endian.hpp"
-#include "Fenrir/v1/util/Z85.hpp"
 #include <algorithm>
 #include <arpa/nameser.h>
 #include <atomic>
@@ -32,6 +32,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <stdlib.h>
 #include <string>
 #include <tuple>
 #include <unbound.h>
@@ -40,36 +41,6 @@
 namespace Fenrir__v1 {
 namespace Impl {
 
-namespace Event {
-
-FENRIR_INLINE std::shared_ptr<DNSSEC> DNSSEC::mk_shared (Loop *const loop,
-                                                std::weak_ptr<Dynamic> resolver)
-{
-    auto e = std::make_shared<DNSSEC> (loop, std::move(resolver));
-    e->_ourselves = e;
-    return e;
-}
-
-static void dnssec_ev_add (std::shared_ptr<DNSSEC> ev, Loop *const loop)
-{
-    std::unique_lock<std::mutex> lock (ev->_mtx);
-    FENRIR_UNUSED (lock);
-    if (ev->_counter == 0)
-        loop->start (ev, Impl::Resolve::poll_rate, Event::Repeat::YES);
-    ++ev->_counter;
-}
-
-static void dnssec_ev_del (std::shared_ptr<DNSSEC> ev, Loop *const loop)
-{
-    std::unique_lock<std::mutex> lock (ev->_mtx);
-    FENRIR_UNUSED (lock);
-    --ev->_counter;
-    if (ev->_counter == 0)
-        loop->deactivate (ev);
-}
-
-} // namespace Event
-
 class Random;
 
 namespace Resolve {
@@ -78,7 +49,7 @@ FENRIR_INLINE bool DNSSEC::initialize()
 {
     int32_t retval;
 
-    common = std::make_shared<DNSSEC::dnssec_data>(_loop, _loader, _rnd, _self);
+    common = std::make_shared<DNSSEC::dnssec_data>(_loop, _loader, _rnd);
     // custom deleter to run ub_ctx_delete once we have finished.
     common->ctx = std::unique_ptr<ub_fenrir, void(*)(ub_fenrir*)> (
                                     static_cast<ub_fenrir *> (ub_ctx_create()),
@@ -104,6 +75,23 @@ FENRIR_INLINE bool DNSSEC::initialize()
                     common->ctx.get()), FENRIR_DIR_CONF "/Fenrir/dnssec.key");
     if (retval != 0)
         return false;
+
+    // libunbound can not save its validated DNSKEY/DS, so we save
+    // the validated Fenrir records: after a restart the known domains
+    // do not wait for the validation of the whole chain.
+    // Not being able to save them is not an error.
+    const char *env = getenv ("FENRIR_DNSSEC_CACHE");
+    common->_disk.open (env != nullptr ? env :
+                                            FENRIR_DIR_CACHE "/dnssec.cache");
+
+    // no polling: wake up as soon as the answers arrive
+    const int32_t fd = ub_fd (static_cast<struct ub_ctx *> (
+                                                        common->ctx.get()));
+    if (fd < 0)
+        return false;
+    common->_answers = Event::Plugin_IO::mk_shared (_loop, _self, fd,
+                                                            Impl::IO::READ);
+    _loop->start (common->_answers);
     return true;
 }
 
@@ -127,19 +115,25 @@ FENRIR_INLINE void DNSSEC::stop()
     }
     // trigger all stopped events
     ub_process (static_cast<struct ub_ctx *> (common->ctx.get()));
-    dnssec_ev_del (common->_dnssec_polling, _loop);
-    _loop->del (common->_dnssec_polling);
+    if (common->_answers != nullptr)
+        _loop->del (common->_answers);
 }
 
 FENRIR_INLINE void DNSSEC::parse_event (std::shared_ptr<Event::Plugin_Timer> ev)
+{
+    // no timers
+    FENRIR_UNUSED (ev);
+}
+
+FENRIR_INLINE void DNSSEC::parse_io (std::shared_ptr<Event::Plugin_IO> ev)
 {
     // libunbound uses a thread to parse everything, and you can provide
     // a callback to get the results back.
-    // ..but when is the callback called? it turns out you have to poll
-    // for that. -.-'
-    FENRIR_UNUSED (ev);
-    // process and call the callback
+    // The callbacks are called by ub_process, which we run when
+    // the unbound fd becomes readable.
     ub_process (static_cast<struct ub_ctx *> (common->ctx.get()));
+    // the loop stops plugin fds when they trigger
+    _loop->start (std::move(ev));
 }
 
 
@@ -151,6 +145,21 @@ FENRIR_INLINE Impl::Error DNSSEC::resolv_async (
 
     if (common == nullptr)
         return Impl::Error::INITIALIZATION;
+    // a refresh must ask the network, the saved record is about to expire
+    if (!request->_refresh) {
+        std::vector<uint8_t> txt;
+        int64_t ttl;
+        if (common->_disk.get (request->_fqdn, txt, ttl)) {
+            AS_list saved = parse_txt (txt, _loader);
+            if (saved._err == Impl::Error::NONE) {
+                saved._ttl = ttl;
+                request->_last_resolver = dnssec_plugin_id;
+                request->_as = std::move(saved);
+                _loop->add_work (std::move(request));
+                return Impl::Error::NONE;
+            }
+        }
+    }
     int32_t id = 0;
     auto data = std::make_unique<request_data> (common, request, id);
     auto data_raw = data.get();
@@ -169,12 +178,11 @@ FENRIR_INLINE Impl::Error DNSSEC::resolv_async (
                                                         T_TXT, C_IN, data_raw,
                                                         &DNSSEC::callback,
                                                         &data_raw->id);
-    dnssec_ev_add (common->_dnssec_polling, _loop);
     common->tracker.emplace (id, std::move(data));
     common->tracker_mtx.unlock();
 
     if (retval != 0)
-        return Impl::Error::RESOLVE_NOT_FOUND;
+        return Impl::Error::CAN_NOT_CONNECT;
     return Impl::Error::NONE;
 }
 
@@ -183,17 +191,20 @@ FENRIR_INLINE void DNSSEC::callback (void* mydata, int err,
 {
     std::unique_ptr<request_data> data {static_cast<request_data *> (mydata)};
     assert (data != nullptr && "Fenrir::DNSSEC data nullptr");
-    dnssec_ev_del (data->common->_dnssec_polling, data->common->loop);
     data->returned_ev->_last_resolver = dnssec_plugin_id;
 
     if (err != 0 || result->nxdomain || !result->havedata ||// have something
                         result->bogus || !result->secure) { // and be secure
         // new event, resolution failed.
-        if (result->bogus || !result->secure) {
+        // "err": unbound could not ask, and there is no "result"
+        if (err != 0) {
+            data->returned_ev->_as._err = Impl::Error::CAN_NOT_CONNECT;
+        } else if (result->bogus || !result->secure) {
             data->returned_ev->_as._err = Impl::Error::RESOLVE_NOT_FENRIR;
         } else {
             data->returned_ev->_as._err = Impl::Error::RESOLVE_NOT_FOUND;
         }
+        ub_resolve_free (result);
         data->common->loop->add_work (std::move(data->returned_ev));
         std::unique_lock<std::mutex> lock (data->common->tracker_mtx);
         FENRIR_UNUSED (lock);
@@ -216,12 +227,17 @@ FENRIR_INLINE void DNSSEC::callback (void* mydata, int err,
         raw[i].push_back ('\0');
     }
 
+    // secure, but no record we can use
+    data->returned_ev->_as._err = Impl::Error::RESOLVE_NOT_FENRIR;
     for (uint32_t i = 0; i < raw.size(); ++i) {
-        AS_list tmp = parse_dnssec_binary (raw[i], data->common);
+        AS_list tmp = parse_txt (raw[i], data->common->loader);
         // only keep the first result without errors
         if (tmp._err == Impl::Error::NONE) {
             // todo: insert other info (?)
+            tmp._ttl = result->ttl;
             data->returned_ev->_as = std::move(tmp);
+            data->common->_disk.put (data->returned_ev->_fqdn, raw[i],
+                                                                result->ttl);
             break;
         }
     }
@@ -242,173 +258,6 @@ FENRIR_INLINE void DNSSEC::unbound_cleanup (ub_fenrir *p)
     ub_ctx_delete (static_cast<struct ub_ctx *> (p));
 }
 
-FENRIR_INLINE AS_list DNSSEC::parse_dnssec_binary (
-                                        const std::vector<uint8_t> &raw,
-                                        std::shared_ptr<dnssec_data> &_common)
-{
-    // format of parsed data:
-    // TXT record:
-    // v=Fenrir1 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrst
-    // uvwxyz!#$%&()*+-;<=>?@^_`{|}~
-    // ecc..
-    // raw, base85-decoded:
-    // 1 byte: number of ip structs. each struct:
-    //		* bit 0-1: (most significant) ip type: 00 == ipv4, 01 = ipv6
-    //		* bit 2-4: (middle) priority (fallback)
-    //		* bit 5-7: (less significant) server preference probability
-    //		* 2 bytes: udp port
-    //		* X bytes: ip address (length delendent on type)
-    // 2 bytes: length of supported authentication algorithms
-    // Y * 2 bytes: list of authentication algorithms
-    // 1 byte: number of public keys. for each:
-    //		* 2 bytes: public key serial
-    //		* 2 byte: public key type
-    //		* W bytes: public key (dependent on type)
-    //
-    // This function does not return errorrs. it adds data to the result
-    // only if everything is ok.
-    AS_list result;
-    result._err = Impl::Error::WRONG_INPUT;
-
-    if (raw.size() < 28)
-        return result;
-    auto tmp = raw.begin();
-    // now skip: "(whitespace)v=Fenrir1(whitespace)"
-    while (tmp != raw.end() && (*tmp == ' ' || *tmp == '\t'))
-        ++tmp;
-    if ((raw.end() - tmp) < 28)
-        return result;
-
-    constexpr std::array<uint8_t, 10> fenrir = { "v=Fenrir1" };
-    if (!std::equal (tmp, tmp + 9, fenrir.begin()))
-        return result;
-    tmp += 9;
-
-    while (tmp != raw.end() && (*tmp == ' ' || *tmp == '\t'))
-        ++tmp;
-    if ((raw.end() - tmp) < 18)
-        return result;
-
-    // now tmp points to something we can decode. trim it.
-    const uint8_t *end = raw.data() + raw.size() - 1;
-    while (*end == '\0' || *end == '\n' || *end == '\r' ||
-                                                *end == ' ' || *end == '\t') {
-        --end;
-    }
-    ++end;
-
-    gsl::span<const uint8_t> encoded {&*tmp, end};
-    std::vector<uint8_t> decoded (z85_decoded_size (encoded), 0);
-    gsl::span<uint8_t> dec_span {decoded};
-
-    if (!Impl::z85_decode (encoded, dec_span))
-        return result;
-
-    // we can now parse the decoded data. format above.
-    // server ips
-    tmp = decoded.begin();
-    uint8_t auth_servers = *tmp;
-    ++tmp;
-    for (uint8_t i = 0; i < auth_servers; ++i) {
-        if (decoded.end() - tmp <= 3) {
-            result._servers.clear();
-            return result;
-        }
-        uint8_t flags = *(tmp++);
-        uint16_t port = l_to_h<uint16_t> (*reinterpret_cast<const uint16_t *> (
-                                                                        &*tmp));
-        tmp += sizeof(port);
-        bool ipv4;
-        switch (flags >> 6) {
-        case 0:
-            ipv4 = true;
-            break;
-        case 1: // ipv6
-            ipv4 = false;
-            break;
-        default:
-            result._servers.clear();
-            return result;
-        }
-        if (decoded.end() - tmp <= (ipv4 ? 4 : 16)) {
-            result._servers.clear();
-            return result;
-        }
-        result._servers.emplace_back (IP (&*tmp, !ipv4), port,
-                                            (flags >> 3) & 0x07, flags  & 0x07);
-        tmp += (ipv4 ? 4 : 16);
-    }
-    // server auths
-    if (decoded.end() - tmp <= 3) {
-        result._servers.clear();
-        return result;
-    }
-    const uint16_t auth_len = l_to_h<uint16_t> (
-                            *reinterpret_cast<const uint16_t *> (tmp.base()));
-    tmp += sizeof(auth_len);
-    if (static_cast<size_t>(decoded.end() - tmp) <= sizeof(uint16_t) +
-                                                auth_len * sizeof(uint16_t)) {
-        result._servers.clear();
-        return result;
-    }
-    result._auth_protocols.reserve (auth_len);
-    for (uint16_t idx = 0; idx < auth_len; ++idx) {
-        const auto auth_alg = l_to_h<Crypto::Auth::ID> (
-                            *reinterpret_cast<const Crypto::Auth::ID*>(&*tmp));
-        tmp += sizeof(auth_alg);
-        result._auth_protocols.push_back (auth_alg);
-    }
-    // public keys
-    if (decoded.end() - tmp <= 6) {
-        result._servers.clear();
-        return result;
-    }
-    const uint16_t keys = l_to_h<uint16_t> (
-                            *reinterpret_cast<const uint16_t *> (tmp.base()));
-    tmp += sizeof(keys);
-    result._key.reserve (keys);
-    for (uint8_t idx = 0; idx < keys; ++idx) {
-        if (decoded.end() - tmp <= 5) {
-            result._servers.clear();
-            result._auth_protocols.clear();
-            result._key.clear();
-            return result;
-        }
-        const auto key_id = l_to_h<Crypto::Key::Serial> (
-                    *reinterpret_cast<const Crypto::Key::Serial *> (&*tmp));
-        tmp += sizeof(key_id);
-        const auto key_type = l_to_h<Crypto::Key::ID> (
-                            *reinterpret_cast<const Crypto::Key::ID*> (&*tmp));
-        tmp += sizeof(key_type);
-        auto key = _common->loader->get_shared<Crypto::Key> (key_type);
-        if (key == nullptr)
-            continue; // unsupported key.
-        const auto pubkey_len = key->get_publen();
-        if (decoded.end() - tmp < pubkey_len) {
-            result._servers.clear();
-            result._auth_protocols.clear();
-            result._key.clear();
-            return result;
-        }
-        const gsl::span<const uint8_t> key_span (tmp.base(),
-                                                    tmp.base() + pubkey_len);
-        if (!key->init (key_span)) {
-            result._servers.clear();
-            result._auth_protocols.clear();
-            result._key.clear();
-            return result;
-        }
-        result._key.emplace_back (key_id, std::move(key));
-    }
-    if (result._key.size() == 0) {
-        result._servers.clear();
-        result._auth_protocols.clear();
-        return result;
-    }
-    result._err = Impl::Error::NONE;
-    return result;
-}
-
 
 } // namespace Resolve
 } // namespace Impl
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include <mutex>
+#include <sodium.h>
+#include <string>
+#include <vector>
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Resolve {
+
+// The DNSSEC-validated Fenrir records, saved on disk with their expiration,
+// so that a restarted process can connect without waiting for the
+// validation of the whole chain from the root.
+//
+// The file is mmap-ed and shared by all the processes that use it:
+//  * fixed size: a header and a hash table of fixed size slots
+//  * open addressing, a few slots probed per name
+//  * expiration is in wall clock seconds, it must survive reboots
+//  * each slot has a checksum: a slot written by two processes at the same
+//    time, or half written when one crashed, is just a miss.
+// The file holds records we trust without validating them again, so we
+// refuse to use it if it is not ours, or if others can write it.
+//
+// Path: $FENRIR_DNSSEC_CACHE, or FENRIR_DIR_CACHE/dnssec.cache
+class FENRIR_LOCAL Disk_Cache
+{
+public:
+    static constexpr uint32_t slots = 256;
+    static constexpr uint32_t slot_bytes = 2048;
+    static constexpr uint32_t max_probe = 8;
+    static constexpr size_t max_name = 255;
+    static constexpr int64_t max_ttl_sec = 86400;
+
+    Disk_Cache()
+        : _fd (-1), _map (nullptr) {}
+    Disk_Cache (const Disk_Cache&) = delete;
+    Disk_Cache& operator= (const Disk_Cache&) = delete;
+    Disk_Cache (Disk_Cache &&) = delete;
+    Disk_Cache& operator= (Disk_Cache &&) = delete;
+    ~Disk_Cache()
+        { close(); }
+
+    // false: no persistence, everything else still works.
+    bool open (const std::string &path);
+    void close();
+
+    // "txt": the record, "ttl": the seconds it is still valid for
+    bool get (const std::vector<uint8_t> &fqdn, std::vector<uint8_t> &txt,
+                                                                int64_t &ttl);
+    void put (const std::vector<uint8_t> &fqdn, const std::vector<uint8_t> &txt,
+                                                            const int64_t ttl);
+private:
+    // header: magic, slots, slot_bytes.
+    // slot: checksum (16), expiration (8), name length (2), txt length (2),
+    //      name, txt. 0 expiration: empty slot.
+    static constexpr size_t header_bytes = 16;
+    static constexpr size_t checksum_bytes = crypto_generichash_BYTES_MIN;
+    static constexpr size_t slot_head = checksum_bytes + 8 + 2 + 2;
+    static constexpr size_t max_txt = slot_bytes - slot_head - max_name;
+    static constexpr size_t file_bytes = header_bytes +
+                                    static_cast<size_t> (slots) * slot_bytes;
+
+    std::mutex _mtx;
+    int _fd;
+    uint8_t *_map;
+
+    struct slot_data {
+        int64_t _expire;
+        std::vector<uint8_t> _name;
+        std::vector<uint8_t> _txt;
+    };
+
+    uint8_t *slot (const uint32_t idx) const
+        { return _map + header_bytes + static_cast<size_t> (idx) * slot_bytes; }
+    static uint32_t hash (const std::vector<uint8_t> &name);
+    static void checksum (const uint8_t *const data, uint8_t *const out);
+    // false: empty or corrupted
+    static bool read_slot (const uint8_t *const raw, slot_data &out);
+    static void write_slot (uint8_t *const raw, const slot_data &in);
+    static int64_t now_sec();
+};
+
+} // namespace Resolve
+} // namespace Impl
+} // namespace Fenrir__v1
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/resolve/Disk_Cache.hpp"
+#include "Fenrir/v1/resolve/Resolver.hpp"
+#include "Fenrir/v1/util/endian.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fcntl.h>
+#include <limits>
+#include <sodium.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Resolve {
+
+namespace {
+constexpr std::array<uint8_t, 8> disk_cache_magic {{
+                                        'F','e','n','r','i','r','D','1' }};
+} // empty namespace
+
+FENRIR_INLINE bool Disk_Cache::open (const std::string &path)
+{
+    close();
+    const int fd = ::open (path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC |
+                                            O_NOFOLLOW, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat (fd, &info) != 0 || !S_ISREG (info.st_mode) ||
+                                            info.st_uid != geteuid() ||
+                                (info.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        ::close (fd);
+        return false;
+    }
+    // new file, or a different layout: start from an empty table
+    bool reset = static_cast<size_t> (info.st_size) != file_bytes;
+    if (reset && ftruncate (fd, static_cast<off_t> (file_bytes)) != 0) {
+        ::close (fd);
+        return false;
+    }
+    void *map = mmap (nullptr, file_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                                                        fd, 0);
+    if (map == MAP_FAILED) {
+        ::close (fd);
+        return false;
+    }
+    uint8_t *const raw = static_cast<uint8_t*> (map);
+    uint32_t raw_slots, raw_slot_bytes;
+    memcpy (&raw_slots, raw + disk_cache_magic.size(), sizeof(raw_slots));
+    memcpy (&raw_slot_bytes, raw + disk_cache_magic.size() + sizeof(uint32_t),
+                                                        sizeof(raw_slot_bytes));
+    if (reset || !std::equal (disk_cache_magic.begin(),
+                                            disk_cache_magic.end(), raw) ||
+                                        l_to_h<uint32_t> (raw_slots) != slots ||
+                            l_to_h<uint32_t> (raw_slot_bytes) != slot_bytes) {
+        memset (raw, 0, file_bytes);
+        std::copy (disk_cache_magic.begin(), disk_cache_magic.end(), raw);
+        raw_slots = h_to_l<uint32_t> (slots);
+        raw_slot_bytes = h_to_l<uint32_t> (slot_bytes);
+        memcpy (raw + disk_cache_magic.size(), &raw_slots, sizeof(raw_slots));
+        memcpy (raw + disk_cache_magic.size() + sizeof(uint32_t),
+                                    &raw_slot_bytes, sizeof(raw_slot_bytes));
+    }
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    _fd = fd;
+    _map = raw;
+    return true;
+}
+
+FENRIR_INLINE void Disk_Cache::close()
+{
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    if (_map != nullptr) {
+        munmap (_map, file_bytes);
+        _map = nullptr;
+    }
+    if (_fd >= 0) {
+        ::close (_fd);
+        _fd = -1;
+    }
+}
+
+FENRIR_INLINE bool Disk_Cache::get (const std::vector<uint8_t> &fqdn,
+                                    std::vector<uint8_t> &txt, int64_t &ttl)
+{
+    const auto name = Resolver::normalize (fqdn);
+    if (name.size() == 0 || name.size() > max_name)
+        return false;
+    const int64_t now = now_sec();
+    const uint32_t start = hash (name);
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    if (_map == nullptr)
+        return false;
+    slot_data data;
+    for (uint32_t probe = 0; probe < max_probe; ++probe) {
+        if (!read_slot (slot ((start + probe) % slots), data) ||
+                                                        data._name != name) {
+            continue;
+        }
+        if (data._expire <= now)
+            return false;
+        txt = std::move (data._txt);
+        ttl = data._expire - now;
+        return true;
+    }
+    return false;
+}
+
+FENRIR_INLINE void Disk_Cache::put (const std::vector<uint8_t> &fqdn,
+                                            const std::vector<uint8_t> &txt,
+                                                            const int64_t ttl)
+{
+    slot_data data;
+    data._name = Resolver::normalize (fqdn);
+    if (ttl <= 0 || txt.size() > max_txt || data._name.size() == 0 ||
+                                                data._name.size() > max_name) {
+        return;
+    }
+    data._expire = now_sec() + std::min (ttl,
+                                        static_cast<int64_t> (max_ttl_sec));
+    data._txt = txt;
+    const uint32_t start = hash (data._name);
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    if (_map == nullptr)
+        return;
+    // the same name, else a free slot, else the one that expires first
+    uint32_t selected = start % slots;
+    int64_t selected_expire = std::numeric_limits<int64_t>::max();
+    slot_data old;
+    for (uint32_t probe = 0; probe < max_probe; ++probe) {
+        const uint32_t idx = (start + probe) % slots;
+        if (!read_slot (slot (idx), old) || old._name == data._name) {
+            selected = idx;
+            break;
+        }
+        if (old._expire < selected_expire) {
+            selected = idx;
+            selected_expire = old._expire;
+        }
+    }
+    write_slot (slot (selected), data);
+}
+
+FENRIR_INLINE uint32_t Disk_Cache::hash (const std::vector<uint8_t> &name)
+{
+    // FNV-1a. the user chooses the domains, not the attacker.
+    uint32_t ret = 2166136261u;
+    for (const uint8_t c : name) {
+        ret ^= c;
+        ret *= 16777619u;
+    }
+    return ret % slots;
+}
+
+FENRIR_INLINE void Disk_Cache::checksum (const uint8_t *const data,
+                                                            uint8_t *const out)
+{
+    crypto_generichash (out, checksum_bytes, data + checksum_bytes,
+                                    slot_bytes - checksum_bytes, nullptr, 0);
+}
+
+FENRIR_INLINE bool Disk_Cache::read_slot (const uint8_t *const raw,
+                                                            slot_data &out)
+{
+    // other processes can write the slot while we read it: copy it first
+    std::array<uint8_t, slot_bytes> buf;
+    std::copy (raw, raw + slot_bytes, buf.begin());
+    std::array<uint8_t, checksum_bytes> sum;
+    checksum (buf.data(), sum.data());
+    if (sodium_memcmp (sum.data(), buf.data(), checksum_bytes) != 0)
+        return false;
+    int64_t expire;
+    uint16_t name_len, txt_len;
+    const uint8_t *p = buf.data() + checksum_bytes;
+    memcpy (&expire, p, sizeof(expire));
+    memcpy (&name_len, p + 8, sizeof(name_len));
+    memcpy (&txt_len, p + 10, sizeof(txt_len));
+    out._expire = l_to_h<int64_t> (expire);
+    name_len = l_to_h<uint16_t> (name_len);
+    txt_len = l_to_h<uint16_t> (txt_len);
+    if (out._expire == 0 || name_len > max_name || txt_len > max_txt)
+        return false;
+    p = buf.data() + slot_head;
+    out._name.assign (p, p + name_len);
+    out._txt.assign (p + name_len, p + name_len + txt_len);
+    return true;
+}
+
+FENRIR_INLINE void Disk_Cache::write_slot (uint8_t *const raw,
+                                                        const slot_data &in)
+{
+    // build it, then copy it with the checksum in one go:
+    // a reader only sees a torn slot for the time of a memcpy
+    std::array<uint8_t, slot_bytes> buf;
+    buf.fill (0);
+    const int64_t expire = h_to_l<int64_t> (in._expire);
+    const uint16_t name_len = h_to_l<uint16_t> (
+                                    static_cast<uint16_t> (in._name.size()));
+    const uint16_t txt_len = h_to_l<uint16_t> (
+                                    static_cast<uint16_t> (in._txt.size()));
+    uint8_t *p = buf.data() + checksum_bytes;
+    memcpy (p, &expire, sizeof(expire));
+    memcpy (p + 8, &name_len, sizeof(name_len));
+    memcpy (p + 10, &txt_len, sizeof(txt_len));
+    p = buf.data() + slot_head;
+    std::copy (in._name.begin(), in._name.end(), p);
+    std::copy (in._txt.begin(), in._txt.end(), p + in._name.size());
+    checksum (buf.data(), buf.data());
+    memcpy (raw, buf.data(), slot_bytes);
+}
+
+FENRIR_INLINE int64_t Disk_Cache::now_sec()
+{
+    return std::chrono::duration_cast<std::chrono::seconds> (
+                std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace Resolve
+} // namespace Impl
+} // namespace Fenrir__v1
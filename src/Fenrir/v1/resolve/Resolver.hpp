@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include <mutex>
 #include <vector>
 #include "Fenrir/v1/common.hpp"
 #include "Fenrir/v1/data/AS_list.hpp"
@@ -38,6 +39,29 @@ class Resolve;
 
 namespace Resolve {
 
+// all the resolvers are asked for the same fqdn, staggered.
+// the first good answer wins. A failure counts only when all the
+// resolvers have failed.
+class FENRIR_LOCAL Race
+{
+public:
+    std::mutex _mtx;
+    uint16_t _pending;  // resolvers that did not answer yet
+    bool _done;
+    Impl::Error _err;   // most useful failure so far
+
+    Race (const uint16_t resolvers)
+        : _pending (resolvers), _done (false),
+                                        _err (Impl::Error::CAN_NOT_CONNECT)
+        {}
+    Race() = delete;
+    Race (const Race&) = delete;
+    Race& operator= (const Race&) = delete;
+    Race (Race &&) = delete;
+    Race& operator= (Race &&) = delete;
+    ~Race() = default;
+};
+
 class FENRIR_LOCAL Resolver : public Dynamic
 {
 public:
@@ -59,11 +83,38 @@ public:
     virtual ~Resolver() {}
 
     virtual ID id() const = 0;
+    // local resolvers need no network: they are asked first
+    virtual bool is_local() const
+        { return false; }
 
     virtual bool initialize() = 0;
     virtual void stop() = 0;
     virtual Impl::Error resolv_async (
                                 std::shared_ptr<Event::Resolve> request) = 0;
+
+    // domains are case insensitive, and "example.com." == "example.com"
+    static std::vector<uint8_t> normalize (const std::vector<uint8_t> &fqdn)
+    {
+        std::vector<uint8_t> ret;
+        ret.reserve (fqdn.size());
+        for (const uint8_t c : fqdn) {
+            if (c == '\0')
+                break;
+            if (c >= 'A' && c <= 'Z') {
+                ret.push_back (static_cast<uint8_t> (c - 'A' + 'a'));
+            } else {
+                ret.push_back (c);
+            }
+        }
+        if (ret.size() > 0 && ret.back() == '.')
+            ret.pop_back();
+        return ret;
+    }
+protected:
+    // the content of a Fenrir TXT record ("v=Fenrir1 <z85 data>"),
+    // as produced by Fenrir_AS_Serializer
+    static AS_list parse_txt (const std::vector<uint8_t> &raw,
+                                                        Loader *const loader);
 };
 
 } // namespace Resolve
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/resolve/Resolver.hpp"
+#include "Fenrir/v1/plugin/Loader.ipp"
+#include "Fenrir/v1/util/endian.hpp"
+#include "Fenrir/v1/util/Z85.hpp"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Resolve {
+
+FENRIR_INLINE AS_list Resolver::parse_txt (const std::vector<uint8_t> &raw,
+                                                        Loader *const loader)
+{
+    // format of parsed data:
+    // TXT record:
+    // v=Fenrir1 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrst
+    // uvwxyz!#$%&()*+-;<=>?@^_`{|}~
+    // ecc..
+    // raw, base85-decoded:
+    // 1 byte: number of ip structs. each struct:
+    //		* bit 0-1: (most significant) ip type: 00 == ipv4, 01 = ipv6
+    //		* bit 2-4: (middle) priority (fallback)
+    //		* bit 5-7: (less significant) server preference probability
+    //		* 2 bytes: udp port
+    //		* X bytes: ip address (length delendent on type)
+    // 2 bytes: length of supported authentication algorithms
+    // Y * 2 bytes: list of authentication algorithms
+    // 1 byte: number of public keys. for each:
+    //		* 2 bytes: public key serial
+    //		* 2 byte: public key type
+    //		* W bytes: public key (dependent on type)
+    //
+    // This function does not return errorrs. it adds data to the result
+    // only if everything is ok.
+    AS_list result;
+    result._err = Impl::Error::WRONG_INPUT;
+
+    if (raw.size() < 28)
+        return result;
+    auto tmp = raw.begin();
+    // now skip: "(whitespace)v=Fenrir1(whitespace)"
+    while (tmp != raw.end() && (*tmp == ' ' || *tmp == '\t'))
+        ++tmp;
+    if ((raw.end() - tmp) < 28)
+        return result;
+
+    constexpr std::array<uint8_t, 10> fenrir = { "v=Fenrir1" };
+    if (!std::equal (tmp, tmp + 9, fenrir.begin()))
+        return result;
+    tmp += 9;
+
+    while (tmp != raw.end() && (*tmp == ' ' || *tmp == '\t'))
+        ++tmp;
+    if ((raw.end() - tmp) < 18)
+        return result;
+
+    // now tmp points to something we can decode. trim it.
+    const uint8_t *end = raw.data() + raw.size() - 1;
+    while (*end == '\0' || *end == '\n' || *end == '\r' ||
+                                                *end == ' ' || *end == '\t') {
+        --end;
+    }
+    ++end;
+
+    gsl::span<const uint8_t> encoded {&*tmp, end};
+    std::vector<uint8_t> decoded (z85_decoded_size (encoded), 0);
+    gsl::span<uint8_t> dec_span {decoded};
+
+    if (!Impl::z85_decode (encoded, dec_span))
+        return result;
+
+    // we can now parse the decoded data. format above.
+    // server ips
+    tmp = decoded.begin();
+    uint8_t auth_servers = *tmp;
+    ++tmp;
+    for (uint8_t i = 0; i < auth_servers; ++i) {
+        if (decoded.end() - tmp <= 3) {
+            result._servers.clear();
+            return result;
+        }
+        uint8_t flags = *(tmp++);
+        uint16_t port = l_to_h<uint16_t> (*reinterpret_cast<const uint16_t *> (
+                                                                        &*tmp));
+        tmp += sizeof(port);
+        bool ipv4;
+        switch (flags >> 6) {
+        case 0:
+            ipv4 = true;
+            break;
+        case 1: // ipv6
+            ipv4 = false;
+            break;
+        default:
+            result._servers.clear();
+            return result;
+        }
+        if (decoded.end() - tmp <= (ipv4 ? 4 : 16)) {
+            result._servers.clear();
+            return result;
+        }
+        result._servers.emplace_back (IP (&*tmp, !ipv4), port,
+                                            (flags >> 3) & 0x07, flags  & 0x07);
+        tmp += (ipv4 ? 4 : 16);
+    }
+    // server auths
+    if (decoded.end() - tmp <= 3) {
+        result._servers.clear();
+        return result;
+    }
+    const uint16_t auth_len = l_to_h<uint16_t> (
+                            *reinterpret_cast<const uint16_t *> (tmp.base()));
+    tmp += sizeof(auth_len);
+    if (static_cast<size_t>(decoded.end() - tmp) <= sizeof(uint16_t) +
+                                                auth_len * sizeof(uint16_t)) {
+        result._servers.clear();
+        return result;
+    }
+    result._auth_protocols.reserve (auth_len);
+    for (uint16_t idx = 0; idx < auth_len; ++idx) {
+        const auto auth_alg = l_to_h<Crypto::Auth::ID> (
+                            *reinterpret_cast<const Crypto::Auth::ID*>(&*tmp));
+        tmp += sizeof(auth_alg);
+        result._auth_protocols.push_back (auth_alg);
+    }
+    // public keys
+    if (decoded.end() - tmp <= 6) {
+        result._servers.clear();
+        return result;
+    }
+    const uint16_t keys = l_to_h<uint16_t> (
+                            *reinterpret_cast<const uint16_t *> (tmp.base()));
+    tmp += sizeof(keys);
+    result._key.reserve (keys);
+    for (uint8_t idx = 0; idx < keys; ++idx) {
+        if (decoded.end() - tmp <= 5) {
+            result._servers.clear();
+            result._auth_protocols.clear();
+            result._key.clear();
+            return result;
+        }
+        const auto key_id = l_to_h<Crypto::Key::Serial> (
+                    *reinterpret_cast<const Crypto::Key::Serial *> (&*tmp));
+        tmp += sizeof(key_id);
+        const auto key_type = l_to_h<Crypto::Key::ID> (
+                            *reinterpret_cast<const Crypto::Key::ID*> (&*tmp));
+        tmp += sizeof(key_type);
+        auto key = loader->get_shared<Crypto::Key> (key_type);
+        if (key == nullptr)
+            continue; // unsupported key.
+        const auto pubkey_len = key->get_publen();
+        if (decoded.end() - tmp < pubkey_len) {
+            result._servers.clear();
+            result._auth_protocols.clear();
+            result._key.clear();
+            return result;
+        }
+        const gsl::span<const uint8_t> key_span (tmp.base(),
+                                                    tmp.base() + pubkey_len);
+        if (!key->init (key_span)) {
+            result._servers.clear();
+            result._auth_protocols.clear();
+            result._key.clear();
+            return result;
+        }
+        result._key.emplace_back (key_id, std::move(key));
+    }
+    if (result._key.size() == 0) {
+        result._servers.clear();
+        result._auth_protocols.clear();
+        return result;
+    }
+    result._err = Impl::Error::NONE;
+    return result;
+}
+
+
+} // namespace Resolve
+} // namespace Impl
+} // namespace Fenrir__v1
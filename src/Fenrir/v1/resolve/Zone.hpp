@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/common.hpp"
+#include "Fenrir/v1/data/AS_list.hpp"
+#include "Fenrir/v1/event/Events_all.hpp"
+#include "Fenrir/v1/resolve/Resolver.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Fenrir__v1 {
+namespace Impl {
+
+class Lib;
+class Loader;
+class Random;
+
+namespace Resolve {
+
+static constexpr Resolver::ID zone_plugin_id { 2 };
+
+// Fenrir records from local files, no network involved:
+// services in the same datacenter, tests, offline deployments.
+//
+// The zone is a file, or a directory of files. One record per line:
+//   example.com v=Fenrir1 <z85 data>
+// The data is the output of Fenrir_AS_Serializer, the "v=Fenrir1" is
+// optional. Zone file syntax is accepted too:
+//   _fenrir.example.com. 300 IN TXT "v=Fenrir1 <z85 data>"
+// Empty lines and lines starting with '#' or ';' are ignored.
+//
+// Path: $FENRIR_ZONES, or FENRIR_DIR_CONF/Fenrir/zones
+// On linux the zone is reloaded as soon as it changes (inotify).
+class FENRIR_LOCAL Zone final : public Resolver
+{
+public:
+    Zone (Event::Loop *const loop, Loader *const loader, Random *const rnd)
+        : Resolver (std::shared_ptr<Lib> (nullptr), loop, loader, rnd),
+            _records (nullptr), _notify_fd (-1), _notify (nullptr)
+        {}
+    Zone() = delete;
+    Zone (const Zone&) = delete;
+    Zone& operator= (const Zone&) = delete;
+    Zone (Zone &&) = delete;
+    Zone& operator= (Zone &&) = delete;
+    ~Zone();
+    ID id() const override
+        { return zone_plugin_id; }
+    bool is_local() const override
+        { return true; }
+    void parse_event (std::shared_ptr<Event::Plugin_Timer> ev) override;
+    void parse_io (std::shared_ptr<Event::Plugin_IO> ev) override;
+
+    bool initialize() override;
+    void stop() override;
+    Impl::Error resolv_async (std::shared_ptr<Event::Resolve> request) override;
+
+private:
+    using records = std::unordered_map<std::string, AS_list>;
+
+    std::string _path;
+    // replaced as a whole on reload: lookups just copy the pointer
+    std::mutex _mtx;
+    std::shared_ptr<const records> _records;
+    int _notify_fd;
+    std::shared_ptr<Event::Plugin_IO> _notify;
+
+    bool load();
+    void load_file (const std::string &file, records &out);
+    bool parse_line (const std::string &line, std::string &name,
+                                                        AS_list &record) const;
+};
+
+} // namespace Resolve
+} // namespace Impl
+} // namespace Fenrir__v1
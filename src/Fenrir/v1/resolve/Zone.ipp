@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Fenrir/v1/resolve/Zone.hpp"
+#include "Fenrir/v1/resolve/Resolver.ipp"
+#include "Fenrir/v1/event/Loop.hpp"
+#include <algorithm>
+#include <array>
+#include <dirent.h>
+#include <fstream>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+namespace Fenrir__v1 {
+namespace Impl {
+namespace Resolve {
+
+FENRIR_INLINE Zone::~Zone()
+    { stop(); }
+
+FENRIR_INLINE bool Zone::initialize()
+{
+    const char *env = getenv ("FENRIR_ZONES");
+    _path = env != nullptr ? env : FENRIR_DIR_CONF "/Fenrir/zones";
+    if (!load())
+        return false;   // no zone, no resolver.
+#if defined(__linux__)
+    // watch the directory, not the file: editors and deploy tools
+    // replace the files instead of writing them.
+    std::string dir = _path;
+    struct stat info;
+    if (stat (_path.c_str(), &info) == 0 && !S_ISDIR (info.st_mode)) {
+        const auto slash = _path.rfind ('/');
+        dir = slash == std::string::npos ? "." : _path.substr (0, slash + 1);
+    }
+    _notify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (_notify_fd < 0)
+        return true;    // just no reloads
+    if (inotify_add_watch (_notify_fd, dir.c_str(), IN_CLOSE_WRITE |
+                                IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+        close (_notify_fd);
+        _notify_fd = -1;
+        return true;
+    }
+    _notify = Event::Plugin_IO::mk_shared (_loop, _self, _notify_fd,
+                                                            Impl::IO::READ);
+    _loop->start (_notify);
+#endif
+    return true;
+}
+
+FENRIR_INLINE void Zone::stop()
+{
+    if (_notify != nullptr) {
+        _loop->del (_notify);
+        _notify = nullptr;
+    }
+    if (_notify_fd >= 0) {
+        close (_notify_fd);
+        _notify_fd = -1;
+    }
+}
+
+FENRIR_INLINE void Zone::parse_event (std::shared_ptr<Event::Plugin_Timer> ev)
+{
+    // no timers
+    FENRIR_UNUSED (ev);
+}
+
+FENRIR_INLINE void Zone::parse_io (std::shared_ptr<Event::Plugin_IO> ev)
+{
+    if (_notify_fd < 0)
+        return; // stopped
+    // we reload everything anyway: just drain the events.
+    std::array<uint8_t, 4096> drain;
+    while (read (_notify_fd, drain.data(), drain.size()) > 0)
+        continue;
+    // if the zone disappeared we keep the old records
+    load();
+    // the loop stops plugin fds when they trigger
+    _loop->start (std::move(ev));
+}
+
+FENRIR_INLINE Impl::Error Zone::resolv_async (
+                                        std::shared_ptr<Event::Resolve> request)
+{
+    std::shared_ptr<const records> current;
+    {
+        std::unique_lock<std::mutex> lock (_mtx);
+        FENRIR_UNUSED (lock);
+        current = _records;
+    }
+    if (current == nullptr)
+        return Impl::Error::INITIALIZATION;
+    const auto name = Resolver::normalize (request->_fqdn);
+    auto it = current->find (std::string (name.begin(), name.end()));
+    request->_last_resolver = zone_plugin_id;
+    if (it == current->end()) {
+        request->_as._err = Impl::Error::RESOLVE_NOT_FOUND;
+    } else {
+        request->_as = it->second.clone();
+    }
+    _loop->add_work (std::move(request));
+    return Impl::Error::NONE;
+}
+
+// parse everything, then swap: lookups never see half a zone.
+FENRIR_INLINE bool Zone::load()
+{
+    struct stat info;
+    if (stat (_path.c_str(), &info) != 0)
+        return false;
+    auto fresh = std::make_shared<records>();
+    if (S_ISDIR (info.st_mode)) {
+        DIR *dir = opendir (_path.c_str());
+        if (dir == nullptr)
+            return false;
+        struct dirent *entry;
+        while ((entry = readdir (dir)) != nullptr) {
+            const std::string file (entry->d_name);
+            // hidden and temporary files, editor backups
+            if (file.size() == 0 || file[0] == '.' || file.back() == '~')
+                continue;
+            load_file (_path + "/" + file, *fresh);
+        }
+        closedir (dir);
+    } else {
+        load_file (_path, *fresh);
+    }
+    std::unique_lock<std::mutex> lock (_mtx);
+    FENRIR_UNUSED (lock);
+    _records = std::move(fresh);
+    return true;
+}
+
+FENRIR_INLINE void Zone::load_file (const std::string &file, records &out)
+{
+    std::ifstream in (file);
+    std::string line, name;
+    while (std::getline (in, line)) {
+        AS_list record;
+        if (!parse_line (line, name, record))
+            continue;
+        // like the TXT records: the first good one wins
+        out.emplace (std::move(name), std::move(record));
+    }
+}
+
+FENRIR_INLINE bool Zone::parse_line (const std::string &line,
+                                    std::string &name, AS_list &record) const
+{
+    const char *blank = " \t\r";
+    // name [ttl] [IN] [TXT] data
+    auto pos = line.find_first_not_of (blank);
+    if (pos == std::string::npos || line[pos] == '#' || line[pos] == ';')
+        return false;
+    auto end = line.find_first_of (blank, pos);
+    if (end == std::string::npos)
+        return false;
+    auto fqdn = Resolver::normalize (std::vector<uint8_t> (line.begin() +
+                                    static_cast<ssize_t> (pos), line.begin() +
+                                    static_cast<ssize_t> (end)));
+    // the DNS record is on "_fenrir.<domain>"
+    constexpr std::array<char, 8> prefix {{ '_','f','e','n','r','i','r','.'}};
+    if (fqdn.size() > prefix.size() &&
+                    std::equal (prefix.begin(), prefix.end(), fqdn.begin())) {
+        fqdn.erase (fqdn.begin(), fqdn.begin() +
+                                        static_cast<ssize_t> (prefix.size()));
+    }
+    int64_t ttl = 0;
+    pos = line.find_first_not_of (blank, end);
+    while (pos != std::string::npos) {
+        end = line.find_first_of (blank, pos);
+        const std::string token = line.substr (pos, end == std::string::npos ?
+                                                    std::string::npos :
+                                                    end - pos);
+        if (std::all_of (token.begin(), token.end(),
+                                [] (const char c) { return c >= '0' &&
+                                                            c <= '9'; })) {
+            ttl = strtoll (token.c_str(), nullptr, 10);
+        } else if (token != "IN" && token != "TXT") {
+            break;
+        }
+        pos = line.find_first_not_of (blank, end);
+    }
+    if (pos == std::string::npos)
+        return false;
+    std::string data = line.substr (pos);
+    while (data.size() > 0 && (data.back() == ' ' || data.back() == '\t' ||
+                                                        data.back() == '\r')) {
+        data.pop_back();
+    }
+    if (data.size() >= 2 && data.front() == '"' && data.back() == '"')
+        data = data.substr (1, data.size() - 2);
+    std::vector<uint8_t> txt;
+    if (data.compare (0, 9, "v=Fenrir1") != 0) {
+        // raw Fenrir_AS_Serializer output
+        const std::string version ("v=Fenrir1 ");
+        txt.assign (version.begin(), version.end());
+    }
+    txt.insert (txt.end(), data.begin(), data.end());
+
+    record = parse_txt (txt, _loader);
+    if (record._err != Impl::Error::NONE)
+        return false;
+    record._fqdn = fqdn;
+    record._ttl = ttl;
+    name.assign (fqdn.begin(), fqdn.end());
+    return true;
+}
+
+} // namespace Resolve
+} // namespace Impl
+} // namespace Fenrir__v1
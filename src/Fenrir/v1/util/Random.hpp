@@ -21,16 +21,33 @@
 #pragma once
 
 #include "Fenrir/v1/common.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <gsl/span>
 #include <limits>
 #include <mutex>
 #include <sodium.h>
+#include <string.h>
 #include <thread>
+#include <type_traits>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 namespace Fenrir__v1 {
 namespace Impl {
 
+// We need a lot of small random values (padding, stream ids, links...).
+// randombytes_buf for each one is a full ChaCha20 call, or a syscall.
+// Instead each thread keeps a 4KB block of ChaCha20 keystream:
+//  * the first bytes of each block are the key of the next one, and are
+//    erased: what we returned can not be recomputed later.
+//  * the key is reseeded from libsodium every "reseed_blocks" blocks,
+//    and in the child after a fork, so the two processes do not share the
+//    stream.
+// Large requests (keys) go straight to libsodium.
 class FENRIR_LOCAL Random
 {
 public:
@@ -38,6 +55,11 @@ public:
     {
         while (sodium_init() < 0)
             std::this_thread::sleep_for (std::chrono::milliseconds {1});
+#ifndef _WIN32
+        static std::once_flag fork_registered;
+        std::call_once (fork_registered, []
+                        { pthread_atfork (nullptr, nullptr, &forked); });
+#endif
     }
     Random (const Random&) = default;
     Random& operator= (const Random&) = default;
@@ -49,45 +71,121 @@ public:
     T uniform()
     {
         T ret;
-        randombytes_buf (&ret, sizeof(T));
+        fill (&ret, sizeof(T));
         return ret;
     }
 
+    // in [from, to)
     template<typename T>
     T uniform (const T from, const T to)
     {
-        static_assert (sizeof(T) <= sizeof(uint64_t),
-                            "Fenrir Random: can't be used with types > 64bit");
-        const T window = to - from;
+        static_assert (std::is_integral<T>::value &&
+                                            sizeof(T) <= sizeof(uint64_t),
+                    "Fenrir Random: only integers, and not bigger than 64bit");
+        using U = typename std::make_unsigned<T>::type;
+        const uint64_t window = static_cast<U> (static_cast<U> (to) -
+                                                    static_cast<U> (from));
         if (window == 0)
             return from;
-        T ret;
-        randombytes_buf (&ret, sizeof(T));
-        ret %= window;
-        return ret;
+        return static_cast<T> (static_cast<U> (from) +
+                                            static_cast<U> (below (window)));
     }
 
     template<typename T>
     void uniform (gsl::span<T> out)
     {
-        randombytes_buf (out.data(), sizeof(T) *
-                                            static_cast<size_t> (out.size()));
+        fill (out.data(), sizeof(T) * static_cast<size_t> (out.size()));
     }
 
     template<typename T>
     void uniform (gsl::span<T> out, const T from, const T to)
     {
-        static_assert (sizeof(T) <= sizeof(uint64_t),
-                            "Fenrir Random: can't be used with types > 64bit");
-        const T window = to - from;
-        if (window == 0) {
-            for (size_t idx = 0; idx < out.size(); ++idx)
-                out[idx] = from;
+        for (ssize_t idx = 0; idx < out.size(); ++idx)
+            out[idx] = uniform<T> (from, to);
+    }
+private:
+    static constexpr size_t block_bytes = 4096;
+    static constexpr size_t direct_bytes = 256;
+    static constexpr uint32_t reseed_blocks = 256;
+
+    struct pool {
+        std::array<uint8_t, block_bytes> _block;
+        std::array<uint8_t, crypto_stream_chacha20_KEYBYTES> _key;
+        size_t _next;
+        uint32_t _blocks;
+        uint64_t _generation;
+    };
+
+    static pool& thread_pool()
+    {
+        // _next == block_bytes: empty, refill (and seed) at first use
+        thread_local pool tpool {{{0}}, {{0}}, block_bytes, reseed_blocks, 0};
+        return tpool;
+    }
+    static std::atomic<uint64_t>& fork_generation()
+    {
+        static std::atomic<uint64_t> generation (0);
+        return generation;
+    }
+    static void forked()
+        { fork_generation().fetch_add (1, std::memory_order_relaxed); }
+
+    static void refill (pool &tpool, const uint64_t generation)
+    {
+        if (tpool._blocks >= reseed_blocks ||
+                                        tpool._generation != generation) {
+            randombytes_buf (tpool._key.data(), tpool._key.size());
+            tpool._blocks = 0;
+            tpool._generation = generation;
+        }
+        // the key changes every block: the nonce can be fixed
+        const std::array<uint8_t, crypto_stream_chacha20_NONCEBYTES> nonce
+                                                                        {{0}};
+        crypto_stream_chacha20 (tpool._block.data(), tpool._block.size(),
+                                            nonce.data(), tpool._key.data());
+        memcpy (tpool._key.data(), tpool._block.data(), tpool._key.size());
+        memset (tpool._block.data(), 0, tpool._key.size());
+        tpool._next = tpool._key.size();
+        ++tpool._blocks;
+    }
+
+    static void fill (void *const out, const size_t bytes)
+    {
+        if (bytes >= direct_bytes) {
+            randombytes_buf (out, bytes);
             return;
         }
-        randombytes_buf (out.data(), sizeof(T) * out.size());
-        for (size_t idx = 0; idx < out.size(); ++idx)
-            out[idx] %= window;
+        pool &tpool = thread_pool();
+        const uint64_t generation = fork_generation().load (
+                                                    std::memory_order_relaxed);
+        if (tpool._generation != generation)
+            tpool._next = block_bytes;  // drop what the parent had
+        uint8_t *dest = static_cast<uint8_t*> (out);
+        size_t missing = bytes;
+        while (missing > 0) {
+            if (tpool._next == block_bytes)
+                refill (tpool, generation);
+            const size_t take = std::min (missing, block_bytes - tpool._next);
+            memcpy (dest, tpool._block.data() + tpool._next, take);
+            // do not keep what we returned
+            memset (tpool._block.data() + tpool._next, 0, take);
+            tpool._next += take;
+            dest += take;
+            missing -= take;
+        }
+    }
+
+    // unbiased, in [0, window)
+    static uint64_t below (const uint64_t window)
+    {
+        // the first "threshold" values would make the low results
+        // more likely: reject them.
+        const uint64_t threshold = (0 - window) % window;
+        uint64_t ret;
+        do {
+            fill (&ret, sizeof(ret));
+        } while (ret < threshold);
+        return ret % window;
     }
 };
 
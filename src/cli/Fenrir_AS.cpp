@@ -36,6 +36,7 @@
 #include <gsl/span>
 #include <fstream>
 #include <iostream>
+#include <sodium.h>
 #include <stdlib.h>
 #include <string>
 #include <string.h>
@@ -67,12 +68,18 @@ static option::ArgStatus Unknown(const option::Option& option, bool msg)
 
 };
 
-enum  optionIndex {UNKNOWN, HELP, CONFIG};
+enum  optionIndex {UNKNOWN, HELP, CONFIG, COOKIE_SECRET};
+// the secret never goes on the command line: everyone can read it there.
+#define COOKIE_SECRET_ENV "FENRIR_COOKIE_SECRET"
 const option::Descriptor usage[] =
 {
  {UNKNOWN,  0, "", "", Arg::Unknown, "USAGE: -c [FILENAME]\n"},
  {HELP,     0, "h", "help", Arg::None, "-h --help\tThis help."},
  {CONFIG,   0, "c", "config", Arg::None, "-c --config [FILE]"},
+ {COOKIE_SECRET, 0, "s", "cookie-secret-file", Arg::String,
+                "-s --cookie-secret-file [FILE]\tShare the handshakes with "
+                        "the servers that use the same secret (Z85, first "
+                        "line). Default: the " COOKIE_SECRET_ENV " variable."},
  {0,0,0,0,0,0}
 };
 
@@ -152,6 +159,33 @@ int main (int argc, char **argv)
         std::cerr << "could not load key\n";
         return 1;
     }
+    std::string z85;
+    if (options[COOKIE_SECRET].count() == 1) {
+        std::ifstream secret_file (options[COOKIE_SECRET].arg);
+        if (!secret_file || !std::getline (secret_file, z85)) {
+            std::cerr << "Err: can't read the cookie secret file\n";
+            return 1;
+        }
+    } else if (getenv (COOKIE_SECRET_ENV) != nullptr) {
+        z85 = getenv (COOKIE_SECRET_ENV);
+    }
+    if (z85.size() > 0) {
+        const gsl::span<const uint8_t> z85_secret (
+                            reinterpret_cast<const uint8_t*> (z85.data()),
+                                            static_cast<ssize_t> (z85.size()));
+        std::vector<uint8_t> secret (
+                        Fenrir__v1::Impl::z85_decoded_size (z85_secret), 0);
+        const bool ok = secret.size() != 0 &&
+                    Fenrir__v1::Impl::z85_decode (z85_secret, secret) &&
+                    FH.set_cookie_secret (secret,
+                    Fenrir__v1::Impl::Cookie_Keys::default_rotation_sec);
+        sodium_memzero (&z85[0], z85.size());
+        sodium_memzero (secret.data(), secret.size());
+        if (!ok) {
+            std::cerr << "Err: bad cookie secret\n";
+            return 1;
+        }
+    }
     Fenrir__v1::Impl::IP ip;
     ip.ipv6 = false;
     ip.ip.v4 = in_addr{0};
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// The timing loop of the benchmarks: run "step" in batches until
+// "min_secs" have passed, on one thread.
+
+#include <chrono>
+#include <cstdint>
+
+namespace Bench {
+
+// seconds per call of "step", or a negative number if a call failed.
+// "step" returns false on errors.
+template<typename Step>
+double secs_per_call (Step &&step, const double min_secs = 0.5,
+                                                const uint32_t batch = 100)
+{
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    uint64_t calls = 0;
+    double secs = 0.;
+    while (secs < min_secs) {
+        for (uint32_t idx = 0; idx < batch; ++idx) {
+            if (!step())
+                return -1.;
+        }
+        calls += batch;
+        secs = std::chrono::duration<double> (clock::now() - start).count();
+    }
+    return secs / static_cast<double> (calls);
+}
+
+} // namespace Bench
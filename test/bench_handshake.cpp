@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// CPU cost of the server side of the 3-RTT handshake, per message.
+// Only the crypto work of Handshake::answer_c_init and answer_c_cookie,
+// with the native plugins, the server Cookie_Keys and the message sizes of
+// a typical handshake:
+//  * C_INIT, signed cookie: two Ed25519 signatures
+//  * C_INIT, MAC cookie: one hash and one AEAD seal
+//  * C_COOKIE: open or verify the cookie, two ephemeral keys, the key
+//    exchange, the sealed server data and the S_KEYS signature.
+// A C_INIT flood only pays the first step, so the MAC cookie is what
+// keeps a server answering.
+
+#include "Fenrir/v1/crypto/Sodium.hpp"
+#include "Fenrir/v1/net/Cookie_Keys.hpp"
+#include "bench.hpp"
+#include <array>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+namespace {
+
+using Fenrir__v1::Impl::Error;
+using Fenrir__v1::Impl::Role;
+using Fenrir__v1::Impl::Cookie_Keys;
+namespace Crypto = Fenrir__v1::Impl::Crypto;
+
+constexpr size_t c_init_bytes = 160;    // C_INIT + S_COOKIE header
+constexpr size_t s_cookie_bytes = 48;   // signed part of the S_COOKIE
+constexpr size_t mac_cookie_bytes = 71; // mac_cookie_format::bytes
+constexpr size_t srv_key_bytes = 84;    // srv_key_format::bytes
+constexpr size_t s_keys_bytes = 200;    // signed part of the S_KEYS
+constexpr double min_secs = 0.5;
+
+// microseconds per call, or a negative number on errors
+double bench (const std::function<bool()> &step)
+{
+    const double secs = Bench::secs_per_call (step, min_secs);
+    return secs < 0. ? secs : secs * 1000000.;
+}
+
+} // namespace
+
+int main (void)
+{
+    if (sodium_init() < 0)
+        return 1;
+    Crypto::Ed25519 priv;
+    if (!priv.init())
+        return 1;
+    Cookie_Keys cookie_key;
+    // the client ephemeral key, as received in the C_COOKIE
+    Crypto::Ed25519 client;
+    std::vector<uint8_t> client_pub (client.get_publen(), 0);
+    if (!client.init() || !client.get_pubkey (client_pub))
+        return 1;
+
+    std::vector<uint8_t> cs_tosign (c_init_bytes, 0x42);
+    std::vector<uint8_t> s_tosign (s_cookie_bytes, 0x43);
+    std::vector<uint8_t> s_keys (s_keys_bytes, 0x44);
+    std::vector<uint8_t> sign1 (priv.signature_length(), 0);
+    std::vector<uint8_t> sign2 (priv.signature_length(), 0);
+    std::vector<uint8_t> mac (mac_cookie_bytes + cookie_key.bytes_overhead());
+    std::vector<uint8_t> srv (srv_key_bytes + cookie_key.bytes_overhead());
+    std::array<uint8_t, crypto_generichash_BYTES> cs_hash;
+
+    const auto c_init_signed = [&] () {
+            return priv.sign (cs_tosign, sign1) && priv.sign (s_tosign, sign2);
+        };
+    const auto c_init_mac = [&] () {
+            crypto_generichash (cs_hash.data(), cs_hash.size(),
+                            cs_tosign.data(), cs_tosign.size(), nullptr, 0);
+            return cookie_key.encrypt (mac) == Error::NONE;
+        };
+    // the cookie we will get back in the C_COOKIE
+    if (!c_init_signed() || !c_init_mac())
+        return 1;
+    const std::vector<uint8_t> sealed_mac = mac;
+    const auto c_cookie_common = [&] () {
+            Crypto::Ed25519 client_ephemeral, server_ephemeral;
+            if (!client_ephemeral.init (client_pub) || !server_ephemeral.init())
+                return false;
+            std::array<uint8_t, 64> session;
+            if (!server_ephemeral.exchange_key (&client_ephemeral,
+                                gsl::span<const uint8_t> (),
+                                gsl::span<const uint8_t> (),
+                                gsl::span<uint8_t, 64> (session.data(), 64),
+                                                            Role::Server)) {
+                return false;
+            }
+            return cookie_key.encrypt (srv) == Error::NONE &&
+                                                    priv.sign (s_keys, sign1);
+        };
+    const auto c_cookie_mac = [&] () {
+            mac = sealed_mac;
+            gsl::span<uint8_t> out;
+            if (cookie_key.decrypt (mac, out) != Error::NONE)
+                return false;
+            crypto_generichash (cs_hash.data(), cs_hash.size(),
+                            cs_tosign.data(), cs_tosign.size(), nullptr, 0);
+            return c_cookie_common();
+        };
+    const auto c_cookie_signed = [&] () {
+            return priv.verify (s_tosign, sign2) && c_cookie_common();
+        };
+
+    const struct {
+        const char *_name;
+        std::function<bool()> _step;
+    } steps[] = {
+        {"C_INIT, signed cookie", c_init_signed},
+        {"C_INIT, MAC cookie", c_init_mac},
+        {"C_COOKIE, signed cookie", c_cookie_signed},
+        {"C_COOKIE, MAC cookie", c_cookie_mac},
+    };
+    printf ("%-26s %12s %14s\n", "server message", "usec", "per sec/core");
+    for (const auto &step : steps) {
+        const double usec = bench (step._step);
+        if (usec < 0.) {
+            printf ("FAIL: %s\n", step._name);
+            return 1;
+        }
+        printf ("%-26s %12.2f %14.0f\n", step._name, usec, 1000000. / usec);
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Reconnect latency: full handshake against the resumption with a ticket.
+// Only the crypto of both ends is measured, the round trips are added
+// for a few typical RTTs, up to the first data byte on the server:
+//  * full: C_INIT, C_COOKIE and C_AUTH (3 RTT), then the data (0.5 RTT)
+//  * resume with early data: the data is in the C_RESUME (0.5 RTT)
+//  * resume, no early data (shared cookie secret): the data waits for
+//    the S_RESUME (1.5 RTT)
+// The crypto follows Handshake::answer_c_cookie, answer_c_auth,
+// answer_c_resume and resume_keys, with the native plugins.
+
+#include "Fenrir/v1/crypto/Sodium.hpp"
+#include "Fenrir/v1/net/Cookie_Keys.hpp"
+#include "bench.hpp"
+#include <array>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+namespace {
+
+using Fenrir__v1::Impl::Error;
+using Fenrir__v1::Impl::Role;
+using Fenrir__v1::Impl::Cookie_Keys;
+namespace Crypto = Fenrir__v1::Impl::Crypto;
+
+constexpr size_t mac_cookie_bytes = 71; // mac_cookie_format::bytes
+constexpr size_t srv_key_bytes = 84;    // srv_key_format::bytes
+constexpr size_t s_keys_bytes = 200;    // signed part of the S_KEYS
+constexpr size_t auth_bytes = 128;      // C_AUTH / S_RESULT, cleartext
+constexpr size_t ticket_bytes = 96;     // ticket_format::bytes
+constexpr size_t early_bytes = 512;     // max_early_data
+constexpr double min_secs = 0.5;
+constexpr std::array<char, 8> context {{ "FENRIR_" }};
+
+// microseconds per call, or a negative number on errors
+double bench (const std::function<bool()> &step)
+{
+    const double secs = Bench::secs_per_call (step, min_secs);
+    return secs < 0. ? secs : secs * 1000000.;
+}
+
+// the 8 keys of the connection, as in resume_keys and the S_KEYS
+bool derive (const std::array<uint8_t, 64> &secret,
+                                        Crypto::ChaCha20_Poly1305_IETF &enc)
+{
+    Crypto::blake2b kdf;
+    std::array<uint8_t, 64> key (secret);
+    bool ok = kdf.init (key);
+    for (uint64_t idx = 1; ok && idx <= 8; ++idx)
+        ok = kdf.get (idx, context, key) && (idx != 1 || enc.set_key (key));
+    sodium_memzero (key.data(), key.size());
+    return ok;
+}
+
+} // namespace
+
+int main (void)
+{
+    if (sodium_init() < 0)
+        return 1;
+    Crypto::Ed25519 srv_priv;
+    if (!srv_priv.init())
+        return 1;
+    std::vector<uint8_t> srv_pub (srv_priv.get_publen(), 0);
+    if (!srv_priv.get_pubkey (srv_pub))
+        return 1;
+    Cookie_Keys cookie;
+    std::array<uint8_t, 64> secret;
+    randombytes_buf (secret.data(), secret.size());
+    Crypto::ChaCha20_Poly1305_IETF conn_key;
+    if (!derive (secret, conn_key))
+        return 1;
+
+    std::vector<uint8_t> mac (mac_cookie_bytes + cookie.bytes_overhead());
+    std::vector<uint8_t> srv (srv_key_bytes + cookie.bytes_overhead());
+    std::vector<uint8_t> s_keys (s_keys_bytes, 0x44);
+    std::vector<uint8_t> sign (srv_priv.signature_length(), 0);
+    std::vector<uint8_t> auth (auth_bytes + conn_key.bytes_overhead());
+    std::vector<uint8_t> ticket (ticket_bytes + cookie.bytes_overhead());
+    std::vector<uint8_t> resume (early_bytes + auth_bytes +
+                                                conn_key.bytes_overhead());
+    if (cookie.encrypt (mac) != Error::NONE ||
+                                    !srv_priv.sign (s_keys, sign) ||
+                                    cookie.encrypt (ticket) != Error::NONE) {
+        return 1;
+    }
+    const std::vector<uint8_t> sealed_mac = mac;
+    const std::vector<uint8_t> sealed_ticket = ticket;
+
+    // client and server, C_INIT to S_RESULT
+    const auto full = [&] () {
+            gsl::span<uint8_t> out;
+            std::vector<uint8_t> tmp = sealed_mac;
+            if (cookie.encrypt (mac) != Error::NONE ||
+                                    cookie.decrypt (tmp, out) != Error::NONE) {
+                return false;
+            }
+            Crypto::Ed25519 client_eph, client_view, srv_eph, srv_view;
+            std::vector<uint8_t> pub (client_eph.get_publen(), 0);
+            if (!client_eph.init() || !client_eph.get_pubkey (pub) ||
+                                !srv_view.init (pub) || !srv_eph.init() ||
+                                !srv_eph.get_pubkey (pub) ||
+                                !client_view.init (pub)) {
+                return false;
+            }
+            std::array<uint8_t, 64> srv_session, client_session;
+            if (!srv_eph.exchange_key (&srv_view, gsl::span<const uint8_t>(),
+                            gsl::span<const uint8_t>(),
+                            gsl::span<uint8_t, 64> (srv_session.data(), 64),
+                                                        Role::Server) ||
+                    !client_eph.exchange_key (&client_view,
+                            gsl::span<const uint8_t>(),
+                            gsl::span<const uint8_t>(),
+                            gsl::span<uint8_t, 64> (client_session.data(), 64),
+                                                        Role::Client)) {
+                return false;
+            }
+            Crypto::ChaCha20_Poly1305_IETF srv_enc, client_enc;
+            return cookie.encrypt (srv) == Error::NONE &&
+                    srv_priv.sign (s_keys, sign) &&
+                    srv_priv.verify (s_keys, sign) &&
+                    derive (client_session, client_enc) &&
+                    client_enc.encrypt (auth) == Error::NONE &&
+                    derive (srv_session, srv_enc) &&
+                    srv_enc.decrypt (auth, out) == Error::NONE &&
+                    cookie.encrypt (ticket) == Error::NONE &&
+                    srv_enc.encrypt (auth) == Error::NONE &&
+                    client_enc.decrypt (auth, out) == Error::NONE;
+        };
+    // client and server, C_RESUME to S_RESUME
+    const auto resumed = [&] () {
+            std::array<uint8_t, 16> nonce;
+            randombytes_buf (nonce.data(), nonce.size());
+            std::array<uint8_t, 64> key;
+            crypto_generichash (key.data(), key.size(), nonce.data(),
+                                nonce.size(), secret.data(), secret.size());
+            Crypto::ChaCha20_Poly1305_IETF client_enc, srv_enc;
+            if (!derive (key, client_enc) ||
+                                client_enc.encrypt (resume) != Error::NONE) {
+                return false;
+            }
+            gsl::span<uint8_t> out;
+            ticket = sealed_ticket;
+            if (cookie.decrypt (ticket, out) != Error::NONE)
+                return false;
+            crypto_generichash (key.data(), key.size(), nonce.data(),
+                                nonce.size(), secret.data(), secret.size());
+            return derive (key, srv_enc) &&
+                    srv_enc.decrypt (resume, out) == Error::NONE &&
+                    cookie.encrypt (ticket) == Error::NONE &&
+                    srv_enc.encrypt (auth) == Error::NONE &&
+                    client_enc.decrypt (auth, out) == Error::NONE;
+        };
+
+    const double full_usec = bench (full);
+    const double resume_usec = bench (resumed);
+    if (full_usec < 0. || resume_usec < 0.) {
+        printf ("FAIL\n");
+        return 1;
+    }
+    printf ("crypto, both ends: full %.2f usec, resume %.2f usec\n\n",
+                                                    full_usec, resume_usec);
+    printf ("time to the first data byte on the server, msec\n");
+    printf ("%8s %12s %14s %14s\n", "RTT", "full", "resume+early",
+                                                                "resume");
+    for (const double rtt : {1., 20., 100.}) {
+        printf ("%8.0f %12.2f %14.2f %14.2f\n", rtt,
+                                    3.5 * rtt + full_usec / 1000.,
+                                    0.5 * rtt + resume_usec / 1000.,
+                                    1.5 * rtt + resume_usec / 1000.);
+    }
+    return 0;
+}
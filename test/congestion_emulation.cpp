@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Congestion control over an emulated path:
+// a bottleneck with a drop-tail queue, a fixed propagation delay and
+// random losses. The receiver echoes the timestamp probes like a real peer
+// (see Connection::parse_control), and the echoes are the only feedback
+// the sender gets.
+// Prints the goodput of CUBIC and BBR, fails if a link stalls.
+
+#include "Fenrir/v1/rate/Path.hpp"
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <random>
+
+namespace {
+
+using usec = std::chrono::microseconds;
+using Fenrir__v1::Impl::Link_Params;
+using Fenrir__v1::Impl::Rate::Congestion;
+using Fenrir__v1::Impl::Rate::Path;
+using Fenrir__v1::Impl::Rate::PMTU_Discovery;
+
+struct scenario {
+    const char *_name;
+    uint64_t _bytes_sec;    // bottleneck
+    usec _rtt;              // propagation only
+    uint64_t _queue;        // bottleneck buffer, bytes
+    double _loss;           // random, on top of the queue drops
+    bool _echo;             // does the peer echo the probes?
+};
+
+struct result {
+    double _goodput;        // bytes per second, whole run
+    double _tail_goodput;   // bytes per second, second half
+    double _queue_delay;    // average, microseconds
+};
+
+constexpr uint64_t nic_bytes_sec = 125000000;   // 1Gbit, sender interface
+
+result run (const Congestion::Algorithm alg, const scenario &sc,
+                                                        const usec duration)
+{
+    struct pkt {
+        usec _arrival;
+        usec _sent;
+        uint32_t _bytes;
+        bool _probe;
+        bool _lost;
+    };
+    struct echo {
+        usec _arrival;
+        usec _timestamp;
+        uint32_t _received;
+    };
+    Path path (alg, Link_Params {{static_cast<uint16_t> (
+                                        PMTU_Discovery::base_mtu), 4500}});
+    std::mt19937_64 rnd (42);
+    std::uniform_real_distribution<double> coin (0., 1.);
+    std::deque<pkt> wire;
+    std::deque<echo> echoes;
+    const usec one_way = sc._rtt / 2;
+    usec now (0), nic_free (0), bottleneck_free (0);
+    uint32_t received = 0;
+    uint64_t delivered = 0, tail_delivered = 0, queued_pkts = 0;
+    double queue_delay = 0;
+
+    while (now < duration) {
+        while (wire.size() > 0 && wire.front()._arrival <= now) {
+            const pkt &in = wire.front();
+            if (!in._lost) {
+                ++received;
+                delivered += in._bytes;
+                if (now >= duration / 2)
+                    tail_delivered += in._bytes;
+                if (in._probe && sc._echo)
+                    echoes.push_back ({in._arrival + one_way, in._sent,
+                                                                    received});
+            }
+            wire.pop_front();
+        }
+        while (echoes.size() > 0 && echoes.front()._arrival <= now) {
+            path.echo (echoes.front()._timestamp, usec (0),
+                                            echoes.front()._received, now);
+            echoes.pop_front();
+        }
+
+        const uint32_t bytes = path.mtu();
+        const usec wait = path.wait_time (bytes, now);
+        if (wait.count() == 0 && nic_free <= now) {
+            const bool probe = path.want_probe (bytes, now);
+            path.sent (bytes, now, false, probe);
+            nic_free = now + usec (static_cast<int64_t> (
+                                        bytes * 1000000 / nic_bytes_sec));
+            const usec start = std::max (now, bottleneck_free);
+            const uint64_t backlog = static_cast<uint64_t> (
+                    (start - now).count()) * sc._bytes_sec / 1000000;
+            if (backlog + bytes > sc._queue)
+                continue;   // tail drop
+            queue_delay += static_cast<double> ((start - now).count());
+            ++queued_pkts;
+            bottleneck_free = start + usec (static_cast<int64_t> (
+                                            bytes * 1000000 / sc._bytes_sec));
+            wire.push_back ({bottleneck_free + one_way, now, bytes, probe,
+                                                    coin (rnd) < sc._loss});
+            continue;
+        }
+
+        usec next = duration;
+        if (wire.size() > 0)
+            next = std::min (next, wire.front()._arrival);
+        if (echoes.size() > 0)
+            next = std::min (next, echoes.front()._arrival);
+        if (wait.count() > 0)
+            next = std::min (next, now + wait);
+        else
+            next = std::min (next, nic_free);
+        now = std::max (next, now + usec (1));
+    }
+    const double secs = static_cast<double> (duration.count()) / 1000000.;
+    return {static_cast<double> (delivered) / secs,
+            static_cast<double> (tail_delivered) / (secs / 2),
+            queued_pkts == 0 ? 0. :
+                            queue_delay / static_cast<double> (queued_pkts)};
+}
+
+} // namespace
+
+int main (void)
+{
+    const std::chrono::seconds duration (30);
+    const scenario scenarios[] = {
+        {"10Mbit 50ms",         1250000, usec (50000), 62500, 0.,   true},
+        {"10Mbit 50ms 1% loss", 1250000, usec (50000), 62500, 0.01, true},
+        {"100Mbit 20ms",       12500000, usec (20000), 250000, 0.,  true},
+        {"10Mbit 50ms no echo", 1250000, usec (50000), 62500, 0.,   false},
+    };
+    const struct {
+        const char *_name;
+        Congestion::Algorithm _alg;
+    } algs[] = {
+        {"CUBIC", Congestion::Algorithm::CUBIC},
+        {"BBR",   Congestion::Algorithm::BBR},
+    };
+
+    int ret = 0;
+    for (const auto &sc : scenarios) {
+        for (const auto &alg : algs) {
+            const result res = run (alg._alg, sc, duration);
+            const double util = res._goodput /
+                                        static_cast<double> (sc._bytes_sec);
+            printf ("%-22s %-6s %8.2f Mbit/s (%5.1f%%)  queue %6.2f ms\n",
+                                sc._name, alg._name,
+                                res._goodput * 8 / 1000000., util * 100.,
+                                res._queue_delay / 1000.);
+            // nothing may stall: not even a peer that never echoes.
+            if (res._tail_goodput <= 0.) {
+                printf ("  FAIL: stalled\n");
+                ret = 1;
+            }
+            // without random losses we want most of the bottleneck
+            if (sc._echo && sc._loss == 0. && util < 0.5) {
+                printf ("  FAIL: link underused\n");
+                ret = 1;
+            }
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Nonce uniqueness across the nonce lanes:
+// more threads than lanes reserve batches of nonces from the same
+// Nonce_Lanes, as encrypt_batch does for a burst. Every nonce must be
+// unique, and must read back as the lane nonce it was written from.
+// Then the same through ChaCha20_Poly1305_IETF::encrypt_batch: every
+// packet must decrypt, with a sequence no other packet has.
+
+#include "Fenrir/v1/crypto/Sodium.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Fenrir__v1::Impl::Error;
+constexpr size_t nonce_bytes = crypto_aead_chacha20poly1305_IETF_NPUBBYTES;
+using Lanes = Fenrir__v1::Impl::Crypto::Nonce_Lanes<nonce_bytes>;
+using Nonce = std::array<uint8_t, nonce_bytes>;
+
+constexpr uint32_t threads = 40;        // more than the lanes: lanes shared
+constexpr uint32_t per_thread = 50000;
+constexpr uint32_t per_burst_thread = 5000;
+
+bool worker (Lanes &lanes, std::vector<Nonce> &out)
+{
+    out.reserve (per_thread);
+    uint32_t batch = 1;
+    while (out.size() < per_thread) {
+        uint64_t first;
+        if (lanes.reserve (batch, first) != Error::NONE)
+            return false;
+        for (uint64_t idx = 0; idx < batch; ++idx) {
+            Nonce nonce;
+            lanes.write (gsl::span<uint8_t, nonce_bytes> (nonce.data(),
+                                                nonce_bytes), first + idx);
+            if (Lanes::read (gsl::span<const uint8_t> (nonce.data(),
+                                nonce_bytes)) != first + idx) {
+                return false;
+            }
+            out.push_back (nonce);
+        }
+        // batches of 1..16, the packets of a burst
+        batch = batch % 16 + 1;
+    }
+    return true;
+}
+
+// bursts of 1..16 packets through encrypt_batch, "out" gets the sequences
+bool burst_worker (Fenrir__v1::Impl::Crypto::ChaCha20_Poly1305_IETF &enc,
+                                                    std::vector<uint64_t> &out)
+{
+    constexpr size_t payload = 32;
+    std::vector<std::vector<uint8_t>> pkts (16, std::vector<uint8_t> (
+                                        payload + enc.bytes_overhead(), 0));
+    std::vector<gsl::span<uint8_t>> spans;
+    for (auto &pkt : pkts)
+        spans.emplace_back (pkt);
+    std::vector<Error> errs (pkts.size());
+    uint32_t burst = 1;
+    while (out.size() < per_burst_thread) {
+        enc.encrypt_batch (gsl::span<gsl::span<uint8_t>> (spans.data(),
+                                                                    burst),
+                            gsl::span<Error> (errs.data(), burst));
+        for (uint32_t idx = 0; idx < burst; ++idx) {
+            const auto seq = enc.sequence (spans[idx]);
+            gsl::span<uint8_t> clear;
+            if (errs[idx] != Error::NONE || !seq.has_value() ||
+                        enc.decrypt (spans[idx], clear) != Error::NONE) {
+                return false;
+            }
+            out.push_back (seq.value());
+        }
+        burst = burst % 16 + 1;
+    }
+    return true;
+}
+
+} // namespace
+
+int main (void)
+{
+    if (sodium_init() < 0)
+        return 1;
+    Lanes lanes;
+    std::vector<std::vector<Nonce>> results (threads);
+    std::vector<uint8_t> ok (threads, 0);
+    std::vector<std::thread> pool;
+    for (uint32_t idx = 0; idx < threads; ++idx) {
+        pool.emplace_back ([&lanes, &results, &ok, idx] () {
+                ok[idx] = worker (lanes, results[idx]) ? 1 : 0;
+            });
+    }
+    for (auto &thr : pool)
+        thr.join();
+
+    std::vector<Nonce> all;
+    for (uint32_t idx = 0; idx < threads; ++idx) {
+        if (ok[idx] == 0) {
+            printf ("FAIL: thread %u: reserve or read back failed\n", idx);
+            return 1;
+        }
+        all.insert (all.end(), results[idx].begin(), results[idx].end());
+    }
+    std::sort (all.begin(), all.end());
+    const auto dup = std::adjacent_find (all.begin(), all.end());
+    if (dup != all.end()) {
+        printf ("FAIL: nonce reused\n");
+        return 1;
+    }
+    printf ("%zu nonces from %u threads, all unique\n", all.size(), threads);
+
+    Fenrir__v1::Impl::Crypto::ChaCha20_Poly1305_IETF enc;
+    std::array<uint8_t, 64> key;
+    randombytes_buf (key.data(), key.size());
+    if (!enc.set_key (key))
+        return 1;
+    std::vector<std::vector<uint64_t>> seqs (threads);
+    pool.clear();
+    for (uint32_t idx = 0; idx < threads; ++idx) {
+        pool.emplace_back ([&enc, &seqs, &ok, idx] () {
+                ok[idx] = burst_worker (enc, seqs[idx]) ? 1 : 0;
+            });
+    }
+    for (auto &thr : pool)
+        thr.join();
+    std::vector<uint64_t> all_seqs;
+    for (uint32_t idx = 0; idx < threads; ++idx) {
+        if (ok[idx] == 0) {
+            printf ("FAIL: thread %u: encrypt_batch or decrypt failed\n", idx);
+            return 1;
+        }
+        all_seqs.insert (all_seqs.end(), seqs[idx].begin(), seqs[idx].end());
+    }
+    std::sort (all_seqs.begin(), all_seqs.end());
+    if (std::adjacent_find (all_seqs.begin(), all_seqs.end()) !=
+                                                            all_seqs.end()) {
+        printf ("FAIL: encrypt_batch reused a nonce\n");
+        return 1;
+    }
+    printf ("%zu packets sealed in bursts, all unique\n", all_seqs.size());
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2017, Luca Fulchir<luca@fulchir.it>, All rights reserved.
+ *
+ * This file is part of libFenrir.
+ *
+ * libFenrir is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * libFenrir is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and a copy of the GNU Lesser General Public License
+ * along with libFenrir.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Replay_Window: a lane accepts its packets reordered up to the window
+// size, and rejects the duplicates and the packets older than the window.
+// The other lanes are not affected.
+
+#include "Fenrir/v1/net/Replay_Window.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace {
+
+using Fenrir__v1::Impl::Replay_Window;
+
+uint64_t seq (const uint64_t lane, const uint64_t counter)
+    { return (lane << Replay_Window::counter_bits) | counter; }
+
+// like the receiver: check before the crypto, commit after
+bool accept (Replay_Window &win, const uint64_t sequence)
+    { return win.check (sequence) && win.commit (sequence); }
+
+bool fail (const char *what, const uint64_t counter)
+{
+    printf ("FAIL: %s: %llu\n", what,
+                                static_cast<unsigned long long> (counter));
+    return false;
+}
+
+// every packet in "window" gets shuffled in a window as large as ours,
+// then the whole batch again: all the first, none the second time.
+bool reorder (const uint32_t rounds)
+{
+    Replay_Window win;
+    std::mt19937_64 rng (42);
+    constexpr uint64_t window = Replay_Window::window;
+    uint64_t next = 0;
+    for (uint32_t round = 0; round < rounds; ++round) {
+        std::vector<uint64_t> batch (window);
+        for (auto &counter : batch)
+            counter = next++;
+        std::shuffle (batch.begin(), batch.end(), rng);
+        for (const auto counter : batch) {
+            if (!accept (win, seq (3, counter)))
+                return fail ("reordered packet rejected", counter);
+        }
+        for (const auto counter : batch) {
+            if (win.check (seq (3, counter)) || win.commit (seq (3, counter)))
+                return fail ("duplicate accepted", counter);
+        }
+    }
+    return true;
+}
+
+bool edges()
+{
+    Replay_Window win;
+    constexpr uint64_t window = Replay_Window::window;
+    // the newest first, then the oldest in the window: max reordering
+    const uint64_t top = 5 * window + 17;
+    if (!accept (win, seq (0, top)))
+        return fail ("first packet rejected", top);
+    if (!accept (win, seq (0, top - window + 1)))
+        return fail ("oldest in window rejected", top - window + 1);
+    if (accept (win, seq (0, top - window)))
+        return fail ("too old accepted", top - window);
+    if (accept (win, seq (0, top)) || accept (win, seq (0, top - window + 1)))
+        return fail ("duplicate accepted", top);
+    // lanes are independent
+    if (!accept (win, seq (1, 0)) || !accept (win, seq (15, top - window)))
+        return fail ("other lane rejected", 0);
+    // a jump further than the whole ring clears it
+    const uint64_t far = top + 100 * window;
+    if (!accept (win, seq (0, far)) || !accept (win, seq (0, far - 1)) ||
+                                    !accept (win, seq (0, far - window + 1))) {
+        return fail ("packet after a jump rejected", far);
+    }
+    if (accept (win, seq (0, far)) || accept (win, seq (0, top)))
+        return fail ("duplicate or old after a jump accepted", far);
+    // check does not move the window, only commit does
+    if (!win.check (seq (0, far + window)) ||
+                                    !win.check (seq (0, far - window + 2))) {
+        return fail ("check rejected a new packet", far + window);
+    }
+    return true;
+}
+
+// random jumps forward and back, against the obvious implementation:
+// everything received, and the highest counter.
+bool model (const uint32_t packets)
+{
+    Replay_Window win;
+    std::mt19937_64 rng (7);
+    constexpr uint64_t window = Replay_Window::window;
+    std::set<uint64_t> seen;
+    uint64_t top = 0;
+    for (uint32_t idx = 0; idx < packets; ++idx) {
+        const int64_t delta = std::uniform_int_distribution<int64_t> (
+                        -static_cast<int64_t> (window) - 64, 3 * 64) (rng);
+        uint64_t counter = top + static_cast<uint64_t> (delta);
+        if (delta < 0 && top < static_cast<uint64_t> (-delta))
+            counter = 0;
+        const bool expected = seen.count (counter) == 0 &&
+                                            (counter + window > top);
+        if (accept (win, seq (7, counter)) != expected)
+            return fail ("different from the model", counter);
+        if (expected) {
+            seen.insert (counter);
+            top = std::max (top, counter);
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main (void)
+{
+    static_assert (Replay_Window::window >= 1024, "replay window too small");
+    if (!edges() || !reorder (64) || !model (200000))
+        return 1;
+    printf ("window of %llu packets per lane: reordering ok, "
+                "duplicates and old packets rejected\n",
+                static_cast<unsigned long long> (Replay_Window::window));
+    return 0;
+}